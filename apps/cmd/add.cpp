@@ -20,6 +20,7 @@ namespace cmd
     .custom_help("add *.JPG")
     .add_options()
     ("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
+    ("j,jobs", "Number of threads used to hash and parse files (0 = one per CPU core)", cxxopts::value<int>()->default_value("1"))
     ("p,paths", "Paths or shell-style glob patterns to add to index (e.g. *.JPG, **/*.tif)", cxxopts::value<std::vector<std::string>>());
         // clang-format on
         opts.parse_positional({"paths"});
@@ -42,15 +43,29 @@ namespace cmd
 
         const auto ddbPath = opts["working-dir"].as<std::string>();
         const auto paths = opts["paths"].as<std::vector<std::string>>();
+        const auto jobs = opts["jobs"].as<int>();
+
+        const auto printEntry = [](const ddb::Entry &e, bool updated)
+        {
+            std::cout << (updated ? "U\t" : "A\t") << e.path
+                      << std::endl;
+            return true;
+        };
 
         const auto db = ddb::open(std::string(ddbPath), true);
-        addToIndex(db.get(), ddb::expandGlobPatterns(paths),
-                   [](const ddb::Entry &e, bool updated)
-                   {
-                       std::cout << (updated ? "U\t" : "A\t") << e.path
-                                 << std::endl;
-                       return true;
-                   });
+
+        if (jobs == 1)
+        {
+            addToIndex(db.get(), ddb::expandGlobPatterns(paths), printEntry);
+        }
+        else
+        {
+            ddb::AddOptions addOpts;
+            addOpts.jobs = jobs;
+
+            ddb::AddResult result;
+            addToIndexEx(db.get(), ddb::expandGlobPatterns(paths), addOpts, result, printEntry);
+        }
     }
 
 } // namespace cmd
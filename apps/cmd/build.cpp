@@ -22,7 +22,9 @@ namespace cmd
         ("o,output", "Output folder", cxxopts::value<std::string>()->default_value((fs::path(DDB_FOLDER) / DDB_BUILD_PATH).string()))
         ("p,path", "File to process", cxxopts::value<std::string>())
     	("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
-    	("f,force", "Force rebuild", cxxopts::value<bool>()->default_value("false"));
+    	("f,force", "Force rebuild", cxxopts::value<bool>()->default_value("false"))
+    	("j,jobs", "Number of builds to run concurrently (0 = as many as CPU and memory allow)", cxxopts::value<int>()->default_value("1"))
+    	("order", "Build order when building all files: index, small (smallest first), large (largest first)", cxxopts::value<std::string>()->default_value("index"));
 
         // clang-format on
         opts.parse_positional({"path"});
@@ -42,6 +44,8 @@ namespace cmd
             const auto output = opts["output"].as<std::string>();
             const auto ddbPath = opts["working-dir"].as<std::string>();
             const auto force = opts["force"].as<bool>();
+            const auto jobs = opts["jobs"].as<int>();
+            const auto order = opts["order"].as<std::string>();
 
             if (output.length() == 0)
                 printHelp();
@@ -50,7 +54,34 @@ namespace cmd
 
             if (!opts.count("path"))
             {
-                buildAll(db.get(), output, force);
+                ddb::BuildOptions buildOpts;
+                buildOpts.force = force;
+                buildOpts.jobs = jobs;
+
+                if (order == "small")
+                    buildOpts.order = ddb::BuildOrder::SmallestFirst;
+                else if (order == "large")
+                    buildOpts.order = ddb::BuildOrder::LargestFirst;
+                else if (order != "index")
+                    throw ddb::InvalidArgsException("Invalid build order: " + order);
+
+                ddb::BuildProgressCallback progress = nullptr;
+                if (jobs != 1)
+                {
+                    progress = [](const ddb::BuildProgress &p)
+                    {
+                        if (!p.started)
+                        {
+                            std::cout << "[" << p.completed << "/" << p.total << "] " << p.path;
+                            if (p.eta >= 0)
+                                std::cout << " (ETA " << static_cast<long long>(p.eta) << "s)";
+                            std::cout << std::endl;
+                        }
+                        return true;
+                    };
+                }
+
+                buildAllEx(db.get(), output, buildOpts, progress);
             }
             else
             {
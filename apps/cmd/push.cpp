@@ -26,7 +26,9 @@ namespace cmd
             .custom_help("push [remote]")
             .add_options()
                 ("r,remote", "The remote Registry", cxxopts::value<std::string>()->default_value(""))
-                ("k,insecure", "Disable SSL certificate verification", cxxopts::value<bool>());
+                ("k,insecure", "Disable SSL certificate verification", cxxopts::value<bool>())
+                ("j,jobs", "Number of files to upload concurrently", cxxopts::value<int>()->default_value("4"))
+                ("limit-rate", "Maximum upload speed in KB/s (0 = unlimited)", cxxopts::value<long long>()->default_value("0"));
 
         // clang-format on
         opts.parse_positional({"remote"});
@@ -44,7 +46,11 @@ namespace cmd
             const auto remote = opts["remote"].as<std::string>();
             auto sslVerify = opts["insecure"].count() == 0;
 
-            ddb::push(remote, sslVerify);
+            ddb::PushOptions pushOpts;
+            pushOpts.jobs = opts["jobs"].as<int>();
+            pushOpts.maxBytesPerSecond = opts["limit-rate"].as<long long>() * 1024;
+
+            ddb::push(remote, sslVerify, pushOpts);
         }
         catch (ddb::IndexException &e)
         {
@@ -24,6 +24,7 @@ namespace cmd
             .custom_help("search '*file*'")
             .add_options()
             ("q,query", "Search query", cxxopts::value<std::string>())
+			("b,bbox", "Only entries whose footprint intersects this bounding box (minX,minY,maxX,maxY in EPSG:4326)", cxxopts::value<std::string>())
 			("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
 			("f,format", "Output format (text|json)", cxxopts::value<std::string>()->default_value("text"));
 		// clang-format on
@@ -44,10 +45,11 @@ namespace cmd
 			const auto ddbPath = opts["working-dir"].as<std::string>();
 			const auto query = opts.count("query") > 0 ? opts["query"].as<std::string>() : "%";
 			const auto format = opts["format"].as<std::string>();
+			const auto bbox = opts.count("bbox") > 0 ? ddb::parseBbox(opts["bbox"].as<std::string>()) : std::vector<double>();
 
 			const auto db = ddb::open(std::string(ddbPath), true);
 
-			searchIndex(db.get(), query, std::cout, format);
+			searchIndex(db.get(), query, std::cout, format, bbox);
 		}
 		catch (ddb::InvalidArgsException &e)
 		{
@@ -25,7 +25,8 @@ namespace cmd
     ("x", "Generate a single tile with the specified coordinate (XYZ, unless --tms is used). Must be used with -y", cxxopts::value<std::string>()->default_value("auto"))
     ("y", "Generate a single tile with the specified coordinate (XYZ, unless --tms is used). Must be used with -x", cxxopts::value<std::string>()->default_value("auto"))
     ("s,size", "Tile size", cxxopts::value<int>()->default_value("256"))
-    ("tms", "Generate TMS tiles instead of XYZ", cxxopts::value<bool>());
+    ("tms", "Generate TMS tiles instead of XYZ", cxxopts::value<bool>())
+    ("color", "Point cloud coloring (auto|rgb|elevation|intensity|classification)", cxxopts::value<std::string>()->default_value("auto"));
         // clang-format on
         opts.parse_positional({"input", "output"});
     }
@@ -56,8 +57,9 @@ namespace cmd
         auto x = opts["x"].as<std::string>();
         auto y = opts["y"].as<std::string>();
         auto tileSize = opts["size"].as<int>();
+        auto color = opts["color"].as<std::string>();
 
-        ddb::TilerHelper::runTiler(input, output, tileSize, tms, std::cout, format, z, x, y);
+        ddb::TilerHelper::runTiler(input, output, tileSize, tms, std::cout, format, z, x, y, color);
     }
 
 }
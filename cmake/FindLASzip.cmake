@@ -0,0 +1,23 @@
+# Find LASzip
+# ~~~~~~~~~~~
+# CMake module to search for the LASzip library (DLL API)
+#
+# If it's found it sets LASZIP_FOUND to TRUE
+# and adds the following target
+#
+#   LASzip::LASzip
+
+find_path(LASZIP_INCLUDE_DIR laszip/laszip_api.h)
+find_library(LASZIP_LIBRARY NAMES laszip laszip3)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LASzip DEFAULT_MSG LASZIP_LIBRARY LASZIP_INCLUDE_DIR)
+
+if(LASZIP_FOUND AND NOT TARGET LASzip::LASzip)
+    add_library(LASzip::LASzip UNKNOWN IMPORTED)
+    set_target_properties(LASzip::LASzip PROPERTIES
+        IMPORTED_LOCATION "${LASZIP_LIBRARY}"
+        INTERFACE_INCLUDE_DIRECTORIES "${LASZIP_INCLUDE_DIR}")
+endif()
+
+mark_as_advanced(LASZIP_INCLUDE_DIR LASZIP_LIBRARY)
@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef BANDMATH_H
+#define BANDMATH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ddb_export.h"
+
+namespace ddb {
+
+struct BandFilter;
+
+// Band-math expression compiled to register bytecode.
+//
+// Grammar (usual precedence, '^' is right associative and binds tighter than unary minus):
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := ('-' | '+') unary | power
+//   power   := primary ('^' unary)?
+//   primary := number | band | func '(' expr (',' expr)* ')' | '(' expr ')'
+//   band    := R | G | B | N | Re | T
+//   func    := abs | sqrt | log | exp | min | max
+//
+// Programs are evaluated block by block over a small register file that stays in L1,
+// so every instruction is a tight loop over a few hundred pixels instead of a per-pixel
+// tree walk. A pixel is nodata if any band it references is nodata, if any division has
+// a denominator with |d| < 1e-10 (as the built-in formulas) or if the result is not finite.
+class DDB_DLL BandMathProgram {
+public:
+    enum class OpCode : uint8_t {
+        Copy, Add, Sub, Mul, Div, Pow, Min, Max, Neg, Abs, Sqrt, Log, Exp
+    };
+
+    enum class OperandKind : uint8_t { Register, Band, Constant };
+
+    struct Operand {
+        OperandKind kind = OperandKind::Constant;
+        int index = 0;      // Register number or band symbol index (see bandSymbols)
+        float value = 0.0f; // Constant value
+    };
+
+    struct Instruction {
+        OpCode op;
+        int dst;
+        Operand a;
+        Operand b; // Unused by unary instructions
+    };
+
+    // Band symbols in index order: R, G, B, N, Re, T
+    static const std::vector<std::string>& bandSymbols();
+
+    // Compile an expression. Throws InvalidArgsException on syntax errors.
+    static BandMathProgram compile(const std::string &expr);
+
+    // Evaluate over pixelCount pixels. Band symbols are resolved through the filter;
+    // if a referenced band is not available the output is filled with nodata.
+    void evaluate(const BandFilter &filter,
+                  const std::vector<float*> &bandData,
+                  float *outData,
+                  size_t pixelCount,
+                  float nodata) const;
+
+    // Bands referenced by the expression, in the requiredBands format of
+    // VegetationFormula (e.g. "RGN", "NRe")
+    std::string requiredBands() const;
+
+    const std::string& expression() const { return expr_; }
+    const std::vector<Instruction>& instructions() const { return code_; }
+    int registerCount() const { return registerCount_; }
+
+private:
+    std::string expr_;
+    std::vector<Instruction> code_;
+    int registerCount_ = 0;
+    bool usesBand_[6] = {false, false, false, false, false, false};
+};
+
+} // namespace ddb
+
+#endif // BANDMATH_H
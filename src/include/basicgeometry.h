@@ -42,10 +42,19 @@ namespace ddb
         DDB_DLL virtual std::string toWkt() const = 0;
         DDB_DLL virtual json toGeoJSON() const = 0;
 
+        // SpatiaLite geometry BLOB, the internal format of geometry columns
+        // (empty for an empty geometry, to be bound as NULL)
+        DDB_DLL virtual std::string toSpatialiteBlob(int srid = 4326) const = 0;
+
+        // Replaces the points with those of a SpatiaLite geometry BLOB. Returns
+        // false and leaves the geometry empty if data is not a geometry of this type
+        DDB_DLL virtual bool fromSpatialiteBlob(const void *data, int size) = 0;
+
         std::vector<Point> points;
 
     protected:
         void initGeoJsonBase(json &j) const;
+        std::string spatialiteBlob(int srid, int classType, const std::string &body) const;
     };
     inline std::ostream &operator<<(std::ostream &os, const BasicGeometry &g)
     {
@@ -62,12 +71,16 @@ namespace ddb
     {
         DDB_DLL virtual std::string toWkt() const override;
         DDB_DLL virtual json toGeoJSON() const override;
+        DDB_DLL virtual std::string toSpatialiteBlob(int srid = 4326) const override;
+        DDB_DLL virtual bool fromSpatialiteBlob(const void *data, int size) override;
     };
 
     struct BasicPolygonGeometry : BasicGeometry
     {
         DDB_DLL virtual std::string toWkt() const override;
         DDB_DLL virtual json toGeoJSON() const override;
+        DDB_DLL virtual std::string toSpatialiteBlob(int srid = 4326) const override;
+        DDB_DLL virtual bool fromSpatialiteBlob(const void *data, int size) override;
     };
 
     enum BasicGeometryType
@@ -8,6 +8,7 @@
 #include "dbops.h"
 
 #include <ctime>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -16,10 +17,49 @@ namespace ddb
 
     DDB_DLL bool isBuildable(Database *db, const std::string &path, std::string &subfolder);
 
+    enum class BuildOrder
+    {
+        Index,         // Database order
+        SmallestFirst, // Quick results first
+        LargestFirst   // Shortest total time when running in parallel
+    };
+
+    // Options for buildAllEx / buildPendingEx / DDBBuildEx.
+    struct DDB_DLL BuildOptions
+    {
+        bool force = false;
+        int jobs = 1;                     // Concurrent builds; 1 = serial, <= 0 = as many as the budget allows
+        BuildOrder order = BuildOrder::Index;
+        std::vector<std::string> priority; // Entry paths built before all others, in this order
+        long long memoryBudgetMb = 0;     // 0 = DDB_BUILD_MEMORY_MB, or half of the physical memory
+    };
+
+    struct DDB_DLL BuildProgress
+    {
+        size_t total = 0;
+        size_t completed = 0; // Including failed
+        size_t failed = 0;
+        size_t running = 0;
+        double elapsed = 0;   // Seconds
+        double eta = -1;      // Seconds, -1 until the first build completes
+        std::string path;     // Entry that was just started or completed
+        bool started = false; // Whether path was started (true) or completed (false)
+    };
+
+    // Return false to cancel: no new builds are started, running ones complete
+    typedef std::function<bool(const BuildProgress &p)> BuildProgressCallback;
+
     DDB_DLL void buildAll(Database *db, const std::string &outputPath, bool force = false);
     DDB_DLL void build(Database *db, const std::string &path, const std::string &outputPath, bool force = false);
 
     DDB_DLL void buildPending(Database *db, const std::string &outputPath, bool force = false);
+
+    // Same as buildAll / buildPending, running independent builds concurrently.
+    // Build errors are logged and counted in the progress. Returns false if canceled.
+    DDB_DLL bool buildAllEx(Database *db, const std::string &outputPath, const BuildOptions &options,
+                            BuildProgressCallback callback = nullptr);
+    DDB_DLL bool buildPendingEx(Database *db, const std::string &outputPath, const BuildOptions &options,
+                                BuildProgressCallback callback = nullptr);
     DDB_DLL bool isBuildPending(Database *db);
 
     /**
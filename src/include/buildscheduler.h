@@ -0,0 +1,74 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef BUILDSCHEDULER_H
+#define BUILDSCHEDULER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "build.h"
+#include "ddb_export.h"
+#include "entry.h"
+#include "fs.h"
+
+namespace ddb
+{
+
+    // One build to run. Jobs sharing the same target (the hash of the output
+    // folder, e.g. a sidecar and its main file) never run at the same time.
+    struct BuildJob
+    {
+        Entry entry;
+        std::string target;
+
+        // ".pending" marker consumed when the job starts (buildPending only)
+        fs::path pendingFile;
+    };
+
+    // Resources a build is expected to hold while it runs
+    struct BuildResources
+    {
+        int resourceClass = 0;   // Builds of the same class share classLimit
+        int classLimit = 0;      // Max concurrent builds of this class, 0 = no limit
+        int cpu = 1;             // Hardware threads
+        long long memoryMb = 0;
+        long long diskBytes = 0; // Scratch + output space
+    };
+
+    // Per-type estimates: COG warps and Untwine use all cores, Obj2Tiles and
+    // build-lod are external processes that run one at a time, vectors are cheap
+    DDB_DLL BuildResources estimateBuildResources(const Entry &e);
+
+    // Runs build jobs concurrently within a CPU/memory/disk budget.
+    // The progress callback is always invoked on the thread calling run().
+    class BuildScheduler
+    {
+        BuildOptions options;
+        fs::path outputPath;
+        std::vector<BuildJob> jobs;
+        int cpuBudget;
+        long long memoryBudgetMb;
+
+    public:
+        typedef std::function<void(const BuildJob &job)> Runner;
+
+        DDB_DLL BuildScheduler(const BuildOptions &options, const fs::path &outputPath);
+
+        DDB_DLL void add(BuildJob job);
+        size_t size() const { return jobs.size(); }
+
+        // Whether run() will execute jobs on worker threads (jobs != 1)
+        bool isParallel() const { return options.jobs != 1; }
+
+        DDB_DLL void setBudget(int cpu, long long memoryMb);
+
+        // Runs all jobs; a runner that throws marks the job as failed. Returns
+        // false if the callback canceled the run (running builds are completed).
+        DDB_DLL bool run(const Runner &runner, const BuildProgressCallback &callback = nullptr);
+    };
+
+} // namespace ddb
+
+#endif // BUILDSCHEDULER_H
@@ -4,28 +4,57 @@
 #ifndef COORDSTRANSFORMER_H
 #define COORDSTRANSFORMER_H
 
+#include <memory>
+#include <string>
+
 #include "gdal_inc.h"
 #include "ddb_export.h"
 
 namespace ddb
 {
 
+    struct CachedTransformation;
+
+    // Transforms coordinates between two spatial reference systems (in
+    // traditional GIS order, i.e. lon/lat). Transformations are kept in a
+    // process-wide cache keyed by (source, target) SRS: constructing a
+    // transformer for a pair that was used before does not parse the SRS
+    // definitions nor rebuild the PROJ pipeline. A transformer instance
+    // must not be shared between threads, but any number of instances for
+    // the same pair can be used concurrently.
     class CoordsTransformer
     {
-        OGRSpatialReferenceH hSrc = OSRNewSpatialReference(nullptr);
-        OGRSpatialReferenceH hTgt = OSRNewSpatialReference(nullptr);
-        OGRCoordinateTransformationH hTransform;
+        std::shared_ptr<CachedTransformation> cached;
+        OGRCoordinateTransformationH hTransform = nullptr;
+
+        void init(const std::string &srsFrom, const std::string &srsTo);
 
     public:
         DDB_DLL CoordsTransformer(int epsgFrom, int epsgTo);
         DDB_DLL CoordsTransformer(const std::string &wktFrom, int epsgTo);
         DDB_DLL CoordsTransformer(int epsgFrom, const std::string &wktTo);
+
+        // Any definition accepted by OSRSetFromUserInput ("EPSG:4326", WKT, PROJ strings)
+        DDB_DLL CoordsTransformer(const std::string &srsFrom, const std::string &srsTo);
         DDB_DLL ~CoordsTransformer();
 
+        CoordsTransformer(const CoordsTransformer &) = delete;
+        CoordsTransformer &operator=(const CoordsTransformer &) = delete;
+
         DDB_DLL void transform(double *x, double *y);
         DDB_DLL void transform(double *x, double *y, double *z);
+
+        // Transforms count points in place (z can be null). Throws if any point fails.
+        DDB_DLL void transform(size_t count, double *x, double *y, double *z = nullptr);
+
+        // Transforms count points in place, setting success[i] for each point
+        // instead of throwing. Returns the number of points transformed.
+        DDB_DLL size_t transform(size_t count, double *x, double *y, double *z, int *success);
     };
 
+    // Releases the idle transformations held by the cache
+    DDB_DLL void clearCoordsTransformerCache();
+
 }
 
 #endif // COORDSTRANSFORMER_H
@@ -0,0 +1,105 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef COPCSOURCE_H
+#define COPCSOURCE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ddb_export.h"
+#include "fingerprintcache.h"
+#include "pointcloud.h"
+
+namespace ddb
+{
+
+    // Points in contiguous arrays (native SRS)
+    struct CopcPoints
+    {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+        std::vector<uint16_t> red;
+        std::vector<uint16_t> green;
+        std::vector<uint16_t> blue;
+        std::vector<uint16_t> intensity;
+        std::vector<uint8_t> classification;
+
+        size_t size() const { return x.size(); }
+        DDB_DLL void reserve(size_t count);
+    };
+
+    // One octree node of the COPC hierarchy
+    struct CopcNode
+    {
+        int32_t d, x, y, z;
+        uint64_t offset;
+        int32_t pointCount;
+        uint64_t firstPoint; // Index of the first point of the node's LAZ chunk
+    };
+
+    struct CopcCacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t chunks = 0;
+        size_t bytes = 0;
+    };
+
+    struct LaszipReader;
+
+    // Shared, thread-safe access to a local COPC file. The header and the whole
+    // hierarchy are parsed once and kept in memory; decoded nodes go to a
+    // process-wide LRU cache (DDB_COPC_CACHE_MB, 256 MB by default), so
+    // neighbouring tiles reuse the chunks they have in common.
+    class CopcSource
+    {
+        std::string path;
+        FileIdentity identity;
+        unsigned long long id;
+
+        double center[3];
+        double halfSize;
+        double spacing;
+        std::vector<CopcNode> nodes;
+
+        std::mutex mutex;
+        std::vector<std::unique_ptr<LaszipReader>> readers; // Idle
+        std::map<int, std::pair<PointCloudInfo, int>> infos; // By polyBoundsSrs
+
+        CopcSource(const std::string &path, const FileIdentity &identity);
+
+        std::shared_ptr<const CopcPoints> readNode(const CopcNode &node);
+        std::unique_ptr<LaszipReader> acquireReader();
+        void releaseReader(std::unique_ptr<LaszipReader> reader);
+
+    public:
+        DDB_DLL ~CopcSource();
+
+        // Returns the source for copcPath, reloading it if the file changed on disk
+        DDB_DLL static std::shared_ptr<CopcSource> open(const std::string &copcPath);
+
+        // Cached getCopcInfo()
+        DDB_DLL bool getInfo(PointCloudInfo &info, int polyBoundsSrs = 4326, int *span = nullptr);
+
+        // Appends the points within [minX, maxX] x [minY, maxY] (native SRS) of the nodes
+        // overlapping it, down to the depth whose spacing matches resolution (0 = all
+        // depths), the same selection as PDAL's CopcReader bounds/resolution options
+        DDB_DLL void read(double minX, double minY, double maxX, double maxY,
+                          double resolution, CopcPoints &out);
+
+        const std::vector<CopcNode> &getNodes() const { return nodes; }
+        double getSpacing() const { return spacing; }
+    };
+
+    DDB_DLL CopcCacheStats getCopcCacheStats();
+    DDB_DLL void clearCopcCache();
+
+} // namespace ddb
+
+#endif // COPCSOURCE_H
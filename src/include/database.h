@@ -38,11 +38,24 @@ namespace ddb
     DDB_DLL std::string getReadme() const;
     DDB_DLL json getExtent() const;
 
+    // SQL condition matching entries whose footprint (polygon_geom, or point_geom
+    // when there is no polygon) intersects a bbox in EPSG:4326, looked up in the
+    // R*Tree spatial indexes. The bbox is read from the numbered parameters
+    // ?firstParam..?firstParam+3 (see bindBbox); alias qualifies the entries columns.
+    DDB_DLL std::string bboxFilter(int firstParam, const std::string &alias = "");
+
     DDB_DLL MetaManager *getMetaManager();
   };
 
   DDB_DLL json wktBboxCoordinates(const std::string &wktBbox);
 
+  // Binds bbox (minx, miny, maxx, maxy) for bboxFilter(firstParam) and returns
+  // the index of the next parameter
+  DDB_DLL int bindBbox(Statement *q, int firstParam, const std::vector<double> &bbox);
+
+  // Parses "minx,miny,maxx,maxy"
+  DDB_DLL std::vector<double> parseBbox(const std::string &bbox);
+
 }
 
 #endif // DATABASE_H
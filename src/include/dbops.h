@@ -4,6 +4,8 @@
 #ifndef DBOPS_H
 #define DBOPS_H
 
+#include <unordered_map>
+
 #include "database.h"
 #include "statement.h"
 #include "entry.h"
@@ -11,6 +13,7 @@
 #include "fs.h"
 #include "ddb_export.h"
 #include "registryutils.h"
+#include "pushpipeline.h"
 
 namespace ddb
 {
@@ -23,6 +26,8 @@ namespace ddb
     struct DDB_DLL AddOptions {
         bool stopOnError = true;      // default == today's addToIndex() semantics
         int maxConflictRetries = 2;   // bounded re-plan passes on TOCTOU conflict
+        int jobs = 1;                 // COMPUTE worker threads; 1 = serial, <= 0 = one per hardware thread
+        int commitBatchSize = 256;    // with jobs != 1 and stopOnError == false, commit every N computed items
     };
 
     // One item-scoped failure (a corrupt/unreadable file), as opposed to a database-scoped
@@ -59,16 +64,30 @@ namespace ddb
      * if no patterns matched anything at all.
      */
     DDB_DLL std::vector<std::string> expandGlobPatterns(const std::vector<std::string> &patterns);
-    DDB_DLL std::vector<Entry> getMatchingEntries(Database *db, const fs::path &path, int maxRecursionDepth = 0, bool isFolder = false);
+    // bbox (minx, miny, maxx, maxy in EPSG:4326, empty for none) restricts the
+    // results to entries whose footprint intersects it
+    DDB_DLL std::vector<Entry> getMatchingEntries(Database *db, const fs::path &path, int maxRecursionDepth = 0, bool isFolder = false,
+                                                  const std::vector<double> &bbox = {});
     DDB_DLL void checkDeleteBuild(Database *db, const std::string &hash);
     DDB_DLL void checkDeleteMeta(Database *db, const std::string &path);
     DDB_DLL int deleteFromIndex(Database *db, const std::string &query, bool isFolder = false, RemoveCallback callback = nullptr);
 
     DDB_DLL void doUpdate(Statement *updateQ, const Entry &e);
 
-    DDB_DLL void listIndex(Database *db, const std::vector<std::string> &paths, std::ostream &out, const std::string &format, bool recursive = false, int maxRecursionDepth = 0);
-    DDB_DLL void searchIndex(Database *db, const std::string &query, std::ostream &out, const std::string &format);
-    DDB_DLL void addToIndex(Database *db, const std::vector<std::string> &paths, AddCallback callback = nullptr);
+    // Escapes a path or query for LIKE ... ESCAPE '/', turning * into %
+    DDB_DLL std::string sanitize_query_param(const std::string &str);
+
+    // Streams the entries in path order, as they are read. With a limit (> 0), at most
+    // limit entries after the "after" path are written and the path of the last one
+    // is returned if more are left (empty otherwise), to continue from.
+    DDB_DLL std::string listIndex(Database *db, const std::vector<std::string> &paths, std::ostream &out, const std::string &format, bool recursive = false, int maxRecursionDepth = 0,
+                                  const std::string &after = "", int limit = 0);
+    DDB_DLL void searchIndex(Database *db, const std::string &query, std::ostream &out, const std::string &format,
+                             const std::vector<double> &bbox = {});
+    // knownHashes maps index paths to content hashes the caller has already verified
+    // (e.g. files downloaded during a pull); those files are not read again to hash them
+    DDB_DLL void addToIndex(Database *db, const std::vector<std::string> &paths, AddCallback callback = nullptr,
+                            const std::unordered_map<std::string, std::string> &knownHashes = {});
 
     /**
      * Batch add with per-item error isolation.
@@ -117,7 +136,7 @@ namespace ddb
 
     DDB_DLL void clone(const ddb::TagComponents &tag, const std::string &folder, bool sslVerify = true);
 
-    DDB_DLL void push(const std::string &registry, bool sslVerify = true);
+    DDB_DLL void push(const std::string &registry, bool sslVerify = true, const PushOptions &options = PushOptions());
     DDB_DLL void pull(const std::string &registry, MergeStrategy mergeStrategy, bool sslVerify = true);
 
 }
@@ -0,0 +1,38 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef DBPOOL_H
+#define DBPOOL_H
+
+#include <memory>
+#include <string>
+
+#include "database.h"
+#include "ddb_export.h"
+
+namespace ddb
+{
+
+    struct DatabasePoolStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t idle = 0; // Open connections currently waiting in the pool
+    };
+
+    // Opt-in pool of open database connections, keyed by canonical path.
+    // openPooled leases a connection to the calling thread until the last copy of
+    // the returned pointer is released, so concurrent callers never share one.
+    // Leased connections are revalidated (same database file, same schema version)
+    // before reuse. With pooling disabled (the default) openPooled is open().
+    DDB_DLL void setDatabasePoolEnabled(bool enabled);
+    DDB_DLL bool isDatabasePoolEnabled();
+    DDB_DLL std::shared_ptr<Database> openPooled(const std::string &directory, bool traverseUp);
+
+    // Closes the idle connections; leased ones are closed when released
+    DDB_DLL void closePooledDatabases();
+    DDB_DLL DatabasePoolStats getDatabasePoolStats();
+
+} // namespace ddb
+
+#endif // DBPOOL_H
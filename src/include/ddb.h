@@ -82,6 +82,18 @@ extern "C"
      * @param verbose whether the program should output log messages to stdout */
     DDB_DLL void DDBRegisterProcess(bool verbose = false);
 
+    /** Enable or disable the pool of open database connections used by the
+     * read-only functions (get, list, search, meta, stac...). Disabled by default;
+     * long-lived hosts should enable it to avoid reopening the database on every call.
+     * Disabling it closes the idle connections.
+     * @param enabled whether to pool connections */
+    DDB_DLL void DDBSetDatabasePooling(bool enabled);
+
+    /** Close all pooled database connections and cached tilers. Connections in use
+     * are closed as soon as the calling function returns.
+     * Useful before moving or deleting a database. */
+    DDB_DLL void DDBCloseAll();
+
     /** Get library version */
     DDB_DLL const char *DDBGetVersion();
 
@@ -160,6 +172,21 @@ extern "C"
      * @return DDBERR_NONE on success, an error otherwise */
     DDB_DLL DDBErr DDBList(const char *ddbPath, const char **paths, int numPaths, char **output, const char *format, bool recursive = false, int maxRecursionDepth = 0);
 
+    /** List files inside index, one page at a time (in path order)
+     * @param ddbPath path to a DroneDB database (parent of ".ddb")
+     * @param paths array of paths to parse
+     * @param numPaths number of paths
+     * @param format output format. One of: ["text", "json"]
+     * @param recursive whether to recursively scan folders
+     * @param maxRecursionDepth limit the depth of recursion
+     * @param token continuation token of the previous page, empty (or NULL) for the first page
+     * @param pageSize maximum number of entries in the page
+     * @param output pointer to C-string where to store result
+     * @param nextToken pointer to C-string where to store the continuation token of the next page (empty on the last page)
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBListPage(const char *ddbPath, const char **paths, int numPaths, const char *format, bool recursive, int maxRecursionDepth,
+                               const char *token, int pageSize, char **output, char **nextToken);
+
     /** Search files inside index
      * @param ddbPath path to a DroneDB database (parent of ".ddb")
      * @param query search string
@@ -168,6 +195,15 @@ extern "C"
      * @return DDBERR_NONE on success, an error otherwise */
     DDB_DLL DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const char *format);
 
+    /** Search files inside index whose footprint intersects a bounding box
+     * @param ddbPath path to a DroneDB database (parent of ".ddb")
+     * @param query search string
+     * @param bbox bounding box "minX,minY,maxX,maxY" in EPSG:4326
+     * @param output pointer to C-string where to store result
+     * @param format output format. One of: ["text", "json"]
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBSearchBbox(const char *ddbPath, const char *query, const char *bbox, char **output, const char *format);
+
     /** Append password to database
      * @param ddbPath path to a DroneDB database (parent of ".ddb")
      * @param password password to append
@@ -229,6 +265,8 @@ extern "C"
      * @param tx X coordinates
      * @param ty Y coordinates
      * @param outputTilePath output pointer to C-String where to store output tile path.
+     *        The tile is copied out of the user cache into a spool file, prefer
+     *        DDBMemoryCachedTile when the caller does not need a path.
      * @param tileSize tile size in pixels
      * @param tms Generate TMS-style tiles instead of XYZ
      * @param forceRecreate ignore cache and always recreate the tile
@@ -252,6 +290,27 @@ extern "C"
     /** Generate a tile in memory with explicit output format ("png" or "jpeg"). */
     DDB_DLL DDBErr DDBMemoryTileFmt(const char *inputPath, int tz, int tx, int ty, uint8_t **outBuffer, int *outBufferSize, int tileSize = 256, bool tms = false, bool forceRecreate = false, const char *inputPathHash = "", const char *outputFormat = "png");
 
+    /** Same as DDBTile, with the coloring of COPC point cloud tiles
+     * @param pointCloudColor one of "auto", "rgb", "elevation", "intensity", "classification" (NULL for "auto").
+     *                        Ignored for other inputs.
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBPointCloudTile(const char *inputPath, int tz, int tx, int ty, char **outputTilePath, int tileSize = 256, bool tms = false, bool forceRecreate = false, const char *pointCloudColor = "auto");
+
+    /** Same as DDBMemoryTile, with the coloring of COPC point cloud tiles
+     * @param pointCloudColor one of "auto", "rgb", "elevation", "intensity", "classification" (NULL for "auto").
+     *                        Ignored for other inputs.
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBMemoryPointCloudTile(const char *inputPath, int tz, int tx, int ty, uint8_t **outBuffer, int *outBufferSize, int tileSize = 256, bool tms = false, bool forceRecreate = false, const char *inputPathHash = "", const char *pointCloudColor = "auto");
+
+    /** Same as DDBTile/DDBPointCloudTile, but returns the tile from the user cache in memory
+     * instead of writing it to a spool file
+     * @param outBuffer pointer to output buffer. The caller is responsible for destroying the buffer with DDBVSIFree.
+     * @param outBufferSize output buffer size.
+     * @param inputPathHash Optional hash of the resource to tile (if available)
+     * @param pointCloudColor coloring of COPC point cloud tiles (NULL for "auto"). Ignored for other inputs.
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBMemoryCachedTile(const char *inputPath, int tz, int tx, int ty, uint8_t **outBuffer, int *outBufferSize, int tileSize = 256, bool tms = false, bool forceRecreate = false, const char *inputPathHash = "", const char *pointCloudColor = "auto");
+
     /** Generate delta between two ddbs
      * @param ddbSourceStamp JSON stamp of the source DroneDB database
      * @param ddbTargetStamp JSON stamp of the target DroneDB database
@@ -296,6 +355,14 @@ extern "C"
      * @return DDBERR_NONE on success, an error otherwise */
     DDB_DLL DDBErr DDBGetStamp(const char *ddbPath, char **output);
 
+    /** Get the current database's stamp in binary form (see encodeStamp), for registries
+     * answering stamp requests that accept application/x-ddb-stamp
+     * @param ddbPath path to the source DroneDB database (parent of ".ddb")
+     * @param outBuffer pointer to output buffer. The caller is responsible for destroying the buffer with DDBVSIFree.
+     * @param outBufferSize pointer to output buffer size
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBGetBinaryStamp(const char *ddbPath, uint8_t **outBuffer, int *outBufferSize);
+
     /** Rescan all files in the index to update metadata
      * @param ddbPath path to a DroneDB database (parent of ".ddb")
      * @param output pointer to C-string where to store output (JSON array of results)
@@ -321,6 +388,30 @@ extern "C"
      * @return DDBERR_NONE on success, an error otherwise */
     DDB_DLL DDBErr DDBBuild(const char *ddbPath, const char *source = nullptr, const char *dest = nullptr, bool force = false, bool pendingOnly = false);
 
+    /** Build progress callback.
+     * @param completed number of builds completed (including failed ones)
+     * @param failed number of failed builds
+     * @param total number of builds
+     * @param eta estimated seconds left, or -1 if unknown
+     * @param path entry that was just started or completed
+     * @param userData opaque pointer passed through from the caller
+     * @return 0 to continue, non-zero to stop starting new builds */
+    typedef int (*DDBBuildProgressCallback)(int completed, int failed, int total, double eta, const char *path, void *userData);
+
+    /** Build all (or pending) entries, running independent builds concurrently
+     * within the CPU, memory (DDB_BUILD_MEMORY_MB) and disk budget of the host
+     * @param ddbPath path to the source DroneDB database (parent of ".ddb")
+     * @param dest dest filesystem path (optional, if not specified: default path)
+     * @param force rebuild if already existing
+     * @param pendingOnly build only pending files
+     * @param jobs max concurrent builds; 1 = serial, <= 0 = as many as the budget allows
+     * @param order 0 = database order, 1 = smallest first, 2 = largest first
+     * @param progress optional progress callback (may be NULL)
+     * @param progressUserData opaque pointer forwarded to the progress callback
+     * @return DDBERR_NONE on success, DDBERR_CANCELED if canceled, an error otherwise */
+    DDB_DLL DDBErr DDBBuildEx(const char *ddbPath, const char *dest, bool force, bool pendingOnly,
+                              int jobs, int order, DDBBuildProgressCallback progress, void *progressUserData);
+
     /** Cleanup a dataset:
      *   1. Remove from the database all (non-directory) entries whose underlying
      *      file no longer exists on the filesystem.
@@ -450,6 +541,20 @@ extern "C"
      *  @param offset number of items to skip (paging)
      *  @param output pointer to C-string where to store result (JSON) */
     DDB_DLL DDBErr DDBStacItemCollection(const char *ddbPath, const char *stacCollectionRoot, const char *id, const char *stacCatalogRoot, const char *bbox, const char *datetime, int limit, int offset, char **output);
+
+    /** Generate a STAC API ItemCollection with keyset paging
+     *  @param ddbPath path to the source DroneDB database (parent of ".ddb")
+     *  @param stacCollectionRoot Absolute URL of the STAC collection
+     *  @param id STAC collection ID to use instead of folder name (must be unique for entire catalog)
+     *  @param stacCatalogRoot Absolute URL of the STAC catalog
+     *  @param bbox optional bounding box filter "minX,minY,maxX,maxY" (EPSG:4326), can be empty
+     *  @param datetime optional RFC 3339 datetime or interval "start/end" (".." for open ends), can be empty
+     *  @param limit maximum number of items to return (<= 0 defaults to 10)
+     *  @param offset number of items to skip (must be 0 when token is set)
+     *  @param token optional paging token from the "next" link of the previous page, can be empty
+     *  @param approximateCount if true, numberMatched is only computed for small results (omitted otherwise)
+     *  @param output pointer to C-string where to store result (JSON) */
+    DDB_DLL DDBErr DDBStacItemCollectionEx(const char *ddbPath, const char *stacCollectionRoot, const char *id, const char *stacCatalogRoot, const char *bbox, const char *datetime, int limit, int offset, const char *token, bool approximateCount, char **output);
     /** Get raster info including bands, detected sensor, presets
      * @param path Path to raster file
      * @param output Pointer to receive JSON string (caller must free with DDBFree)
@@ -464,6 +569,11 @@ extern "C"
      * @return DDBERR_NONE on success, an error otherwise */
     DDB_DLL DDBErr DDBGetRasterMetadata(const char *path, const char *formula, const char *bandFilter, char **output);
 
+    /** Register custom formulas, replacing any with the same id
+     * @param formulasJson JSON object: {"formulas": [{"id", "name", "expr", "help", "min", "max"}]}
+     * @return DDBERR_NONE on success, an error otherwise */
+    DDB_DLL DDBErr DDBRegisterFormulas(const char *formulasJson);
+
     /** Generate memory thumbnail with band mapping, formula, and stretch
      * @param filePath Path to raster file
      * @param size Thumbnail size in pixels
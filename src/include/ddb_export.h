@@ -13,7 +13,12 @@
 // Database schema version for migration management
 // Increment this value when making schema changes
 // Version 0 = legacy database without versioning
-// Version 1 = first versioned schema (current)
-#define DDB_SCHEMA_VERSION 1
+// Version 1 = first versioned schema
+// Version 2 = fingerprint_cache table
+// Version 3 = R*Tree spatial indexes on entry geometries
+// Version 4 = entries.capture_time column
+// Version 5 = merkle_nodes/merkle_dirty tables
+// Version 6 = entries.capture_time is a generated column (current)
+#define DDB_SCHEMA_VERSION 6
 
 #endif // DDB_EXPORT_H
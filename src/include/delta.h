@@ -100,6 +100,12 @@ namespace ddb
 
     DDB_DLL std::vector<SimpleEntry> parseStampEntries(const json &stamp);
 
+    // Compact binary form of a stamp (front-coded paths, raw SHA-256 digests).
+    // Registries can serve it instead of JSON for this content type.
+    constexpr const char *BinaryStampContentType = "application/x-ddb-stamp";
+    DDB_DLL std::string encodeStamp(const json &stamp);
+    DDB_DLL json decodeStamp(const std::string &data);
+
 } // namespace ddb
 
 #endif // DELTA_H
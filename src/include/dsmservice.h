@@ -7,8 +7,12 @@
 
 #include <string>
 #include <vector>
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include "gdal_inc.h"
 #include "userprofile.h"
 #include "geo.h"
@@ -16,39 +20,130 @@
 
 using namespace ddb;
 
+struct DSMCacheEntry;
+
+// Recency lists of the DSM blocks kept in memory and of the open datasets,
+// shared by all entries of the service. Blocks are dropped, least recently
+// used first, to stay within a byte budget (DDB_DSM_CACHE_MB, 256 MB by
+// default); datasets are closed past MaxOpenDatasets.
+class DSMBlockCache
+{
+public:
+    static constexpr size_t MaxOpenDatasets = 16;
+
+    struct Block
+    {
+        DSMCacheEntry *entry;
+        unsigned int key;
+        size_t bytes;
+    };
+    typedef std::list<Block>::iterator BlockRef;
+    typedef std::list<DSMCacheEntry *>::iterator DatasetRef;
+
+    explicit DSMBlockCache(size_t maxBytes);
+
+    // Registers a block just read, evicting other blocks over the budget
+    BlockRef add(DSMCacheEntry *entry, unsigned int key, size_t blockBytes);
+    void touch(BlockRef block);
+    void release(BlockRef block);
+
+    // Registers a dataset just opened, closing the least recently used ones over the limit
+    DatasetRef addDataset(DSMCacheEntry *entry);
+    void touchDataset(DatasetRef dataset);
+    void releaseDataset(DatasetRef dataset);
+
+    size_t size() const { return bytes; }
+
+private:
+    std::list<Block> blocks;            // most recently used first
+    std::list<DSMCacheEntry *> datasets; // most recently used first
+    size_t bytes = 0;
+    size_t maxBytes;
+};
+
+// A DSM raster known to the service. Only the header is read when the
+// entry is indexed; elevation values are read on demand in blocks of
+// BlockSize x BlockSize pixels, held in the service's DSMBlockCache.
 struct DSMCacheEntry
 {
+    static constexpr unsigned int BlockSize = 256;
+
+    fs::path path;
     unsigned int width, height;
     int hasNodata;
     float nodata;
 
     double geoTransform[6];
-    std::vector<float> data;
     BoundingBox<Point2D> bbox;
 
-    DDB_DLL DSMCacheEntry() : width(0), height(0), hasNodata(0), nodata(0)
-    {
-        memset(geoTransform, 0, sizeof(double) * 6);
-    }
+    // Reads the header of path, throws GDALException if it's not a usable DSM
+    DDB_DLL DSMCacheEntry(const fs::path &path, DSMBlockCache &blockCache);
+    DDB_DLL ~DSMCacheEntry();
 
-    DDB_DLL void loadData(GDALDatasetH hDataset);
+    DSMCacheEntry(const DSMCacheEntry &) = delete;
+    DSMCacheEntry &operator=(const DSMCacheEntry &) = delete;
+
+    // Bilinear interpolation of the four pixels around the point (nearest
+    // pixel next to nodata values). Returns nodata outside of the raster.
     DDB_DLL float getElevation(double latitude, double longitude);
+
+private:
+    friend class DSMBlockCache;
+
+    DSMBlockCache &blockCache;
+
+    GDALDatasetH hDataset = nullptr; // opened on the first read
+    DSMBlockCache::DatasetRef datasetRef;
+    std::unordered_map<unsigned int, std::pair<std::vector<float>, DSMBlockCache::BlockRef>> blocks;
+
+    float getPixel(unsigned int x, unsigned int y);
+    void closeDataset();
 };
 
 class DSMService
 {
-    std::unordered_map<std::string, DSMCacheEntry> cache; // filename --> cache entry
+    DSMBlockCache blockCache; // outlives the entries
+    std::unordered_map<std::string, std::unique_ptr<DSMCacheEntry>> cache; // path --> cache entry
+    std::unordered_set<std::string> unusable;                              // paths that could not be read
+
+    // 1x1 degree cells --> entries overlapping them
+    std::unordered_map<long long, std::vector<DSMCacheEntry *>> grid;
+
+    fs::path demDir;
+    bool demDirScanned = false;
+
+    std::recursive_mutex mutex;
+
     DSMService();
     ~DSMService();
     static DSMService *instance;
 
     static void cleanup();
 
+    DSMCacheEntry *findEntry(double latitude, double longitude);
+
+    // Elevation from the first entry containing the point that has a value there
+    bool sampleEntries(double latitude, double longitude, float &elevation);
+
+    // Called with guard locked; it's released while downloading
+    float lookupAltitude(double latitude, double longitude, std::unique_lock<std::recursive_mutex> &guard);
+    bool scanDirectory(const fs::path &dir, bool recursive, bool removeUnusable, double latitude, double longitude);
+
 public:
     DDB_DLL static DSMService *get();
 
     DDB_DLL float getAltitude(double latitude, double longitude);
 
+    // Altitudes of count points, 0 where no elevation is available
+    DDB_DLL void getAltitudes(size_t count, const double *latitudes, const double *longitudes, float *altitudes);
+
+    // Reads elevations only from the DEMs found in dir and its subfolders, never
+    // from the network. DEMs can be in any format GDAL can read, but must be
+    // single band, north-up and in geographic coordinates (EPSG:4326); other
+    // files are skipped with a warning. An empty path restores the default
+    // online service. Defaults to the DDB_DSM_DIR environment variable.
+    DDB_DLL void setDEMDirectory(const fs::path &dir);
+
     DDB_DLL bool loadDiskCache(double latitude, double longitude);
     DDB_DLL std::string loadFromNetwork(double latitude, double longitude);
     DDB_DLL bool addGeoTIFFToCache(const fs::path &filePath, double latitude, double longitude);
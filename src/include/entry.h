@@ -144,6 +144,13 @@ namespace ddb
             }
         }
 
+        // Geometry columns read as SpatiaLite BLOBs (NULL columns have no data)
+        void parseGeometryBlobs(const void *pointBlob, int pointSize, const void *polygonBlob, int polygonSize)
+        {
+            point_geom.fromSpatialiteBlob(pointBlob, pointSize);
+            polygon_geom.fromSpatialiteBlob(polygonBlob, polygonSize);
+        }
+
         void parseMeta(const std::string &metaJson)
         {
             meta.clear();
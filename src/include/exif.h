@@ -7,6 +7,9 @@
 #include <exiv2/exiv2.hpp>
 #include <memory>
 #include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <cmath>
 #include "utils.h"
 #include "sensor_data.h"
@@ -145,9 +148,25 @@ namespace ddb
         Exiv2::Image *image;
         Exiv2::ExifData exifData;
         Exiv2::XmpData xmpData;
+        ImageSize pixelSize;
+
+        // key --> first datum with that key, built on the first lookup
+        std::unordered_map<std::string, Exiv2::ExifData::const_iterator> exifIndex;
+        std::unordered_map<std::string, Exiv2::XmpData::const_iterator> xmpIndex;
+        bool indexed = false;
+
+        void buildIndex();
 
     public:
-        ExifParser(Exiv2::Image *image) : image(image), exifData(image->exifData()), xmpData(image->xmpData()) {};
+        ExifParser(Exiv2::Image *image) : image(image), exifData(image->exifData()), xmpData(image->xmpData()), pixelSize(0, 0) {};
+
+        // Metadata decoded without an Exiv2::Image (see exifreader.h)
+        ExifParser(Exiv2::ExifData exifData, Exiv2::XmpData xmpData, const ImageSize &pixelSize)
+            : image(nullptr), exifData(std::move(exifData)), xmpData(std::move(xmpData)), pixelSize(pixelSize) {};
+
+        // The indexes point into this instance's data
+        ExifParser(const ExifParser &) = delete;
+        ExifParser &operator=(const ExifParser &) = delete;
 
         Exiv2::ExifData::const_iterator findExifKey(const std::string &key);
         Exiv2::ExifData::const_iterator findExifKey(const std::initializer_list<std::string> &keys);
@@ -198,6 +217,13 @@ namespace ddb
      */
     struct FingerprintContext
     {
+        // Bytes captured while hashing dataPath (the whole file when completeData),
+        // so that fingerprinting does not read the file again. exivImage may point
+        // into it, hence it is declared first.
+        std::vector<uint8_t> fileData;
+        std::string dataPath;
+        bool completeData = false;
+
         std::unique_ptr<Exiv2::Image> exivImage;
         std::unique_ptr<ExifParser> parser;
         GeoLocation geo;
@@ -0,0 +1,53 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef EXIFREADER_H
+#define EXIFREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "exif.h"
+#include "ddb_export.h"
+
+namespace ddb
+{
+
+    // Location of the metadata in a JPEG held in memory (pointers into it)
+    struct JpegSegments
+    {
+        const uint8_t *exif = nullptr; // TIFF header of the APP1 Exif segment
+        size_t exifSize = 0;
+        const char *xmp = nullptr; // XMP packet of the APP1 XMP segment
+        size_t xmpSize = 0;
+        int width = 0; // from the frame header
+        int height = 0;
+    };
+
+    // Walks the JPEG markers up to the start of the image data. Returns false if
+    // the data is not a JPEG, ends before the frame header, or has metadata that
+    // only Exiv2 handles (several Exif/XMP segments, extended XMP). Does not allocate.
+    DDB_DLL bool scanJpegSegments(const uint8_t *data, size_t size, JpegSegments &segments);
+
+    // Decodes the IFD0, Exif and GPS IFDs of a TIFF structure (maker notes,
+    // thumbnails and interoperability IFDs are skipped). Returns false on
+    // anything malformed.
+    DDB_DLL bool decodeExifIfds(const uint8_t *data, size_t size, Exiv2::ExifData &exifData);
+
+    // Decodes an XMP packet made only of simple properties (rdf:Description
+    // attributes or text elements). Returns false, leaving xmpData empty, if it has
+    // arrays, structures, qualifiers or anything else the XMP toolkit is needed for.
+    DDB_DLL bool decodeSimpleXmp(const char *packet, size_t size, Exiv2::XmpData &xmpData);
+
+    // Reads the metadata of a JPEG without opening it with Exiv2: the segments
+    // are located natively and the common cases decoded natively, falling back
+    // to Exiv2's decoders per segment. Returns nullptr if the whole file
+    // should go through Exiv2 (see scanJpegSegments).
+    // Can be disabled by setting the DDB_NATIVE_EXIF environment variable to 0.
+    DDB_DLL std::unique_ptr<ExifParser> readJpegMetadata(const uint8_t *data, size_t size);
+
+}
+
+#endif // EXIFREADER_H
@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef FINGERPRINTCACHE_H
+#define FINGERPRINTCACHE_H
+
+#include "database.h"
+#include "entry.h"
+#include "fs.h"
+#include "ddb_export.h"
+
+namespace ddb
+{
+
+    // Filesystem identity of a regular file. Two stats returning the same identity
+    // are assumed to refer to the same, unmodified content.
+    struct FileIdentity
+    {
+        long long device = 0;
+        long long inode = 0;
+        long long size = 0;
+        long long mtimeNs = 0;
+
+        bool operator==(const FileIdentity &o) const
+        {
+            return device == o.device && inode == o.inode && size == o.size && mtimeNs == o.mtimeNs;
+        }
+        bool operator!=(const FileIdentity &o) const { return !(*this == o); }
+    };
+
+    /** Read the identity of a regular file
+     * @return false if the file cannot be stat'ed or is not a regular file */
+    DDB_DLL bool getFileIdentity(const fs::path &p, FileIdentity &id);
+
+    struct CachedFingerprint
+    {
+        std::string hash;
+
+        // True if type/properties/geometries were recorded by this DroneDB version
+        // and can be reused instead of re-parsing the file
+        bool hasEntry = false;
+        EntryType type = EntryType::Undefined;
+        json properties;
+        BasicPointGeometry point_geom;
+        BasicPolygonGeometry polygon_geom;
+
+        /** Fill an entry from the cache as parseEntry would, without reading the file.
+         * Only meaningful if hasEntry is true. */
+        DDB_DLL void toEntry(const fs::path &path, const fs::path &rootDirectory, const FileIdentity &id, Entry &e) const;
+    };
+
+    // Per-database cache of content fingerprints keyed by (device, inode) and validated
+    // by (size, mtime_ns). Lets add/rescan skip re-reading files whose content cannot
+    // have changed (touch-only re-adds, renames within the same filesystem, rescans).
+    class FingerprintCache
+    {
+        Database *db;
+
+    public:
+        FingerprintCache(Database *db) : db(db) {}
+
+        DDB_DLL bool lookup(const FileIdentity &id, CachedFingerprint &out);
+
+        // Record a fully parsed entry
+        DDB_DLL void store(const FileIdentity &id, const Entry &e);
+
+        // Record only the content hash (metadata was not parsed)
+        DDB_DLL void storeHash(const FileIdentity &id, const std::string &hash);
+
+        // Delete the fingerprints whose hash no longer matches any entry, so the table
+        // doesn't grow with every file ever indexed. Called after entries are removed
+        // (a file renamed on disk is then only reused if added before removing the
+        // old path). Returns the number of rows deleted.
+        DDB_DLL int prune();
+
+        // Files modified in the last couple of seconds are not cached: a write landing in the
+        // same timestamp tick as our stat would otherwise go unnoticed
+        DDB_DLL static bool isCacheable(const FileIdentity &id);
+    };
+
+} // namespace ddb
+
+#endif // FINGERPRINTCACHE_H
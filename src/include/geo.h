@@ -105,10 +105,15 @@ namespace ddb
 
     DDB_DLL UTMZone getUTMZone(double latitude, double longitude);
     DDB_DLL std::string getProjForUTM(const UTMZone &zone);
+    DDB_DLL double centralMeridian(const UTMZone &zone);
+
+    // UTM conversions are computed in closed form (see utm.h), without PROJ
     DDB_DLL Projected2D toUTM(double latitude, double longitude, const UTMZone &zone);
+    DDB_DLL void toUTM(size_t count, const double *latitudes, const double *longitudes, double *x, double *y, const UTMZone &zone);
 
     DDB_DLL Geographic2D fromUTM(const Projected2D &p, const UTMZone &zone);
     DDB_DLL Geographic2D fromUTM(double x, double y, const UTMZone &zone);
+    DDB_DLL void fromUTM(size_t count, const double *x, const double *y, double *latitudes, double *longitudes, const UTMZone &zone);
 
 }
 
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <memory>
 #include <stdexcept>
+#include <vector>
 #include "ddb_export.h"
 #include <openssl/evp.h>
 
@@ -164,10 +165,37 @@ static const uint64_t crc64_table[256] = {
     uint64_t(0x536fa08fdfd90e51), uint64_t(0x29b7d047efec8728),
 };
 
+// Incremental SHA-256, for content that is not available all at once
+class SHA256Digest{
+    EvpMdCtxPtr ctx;
+public:
+    DDB_DLL SHA256Digest();
+    DDB_DLL void update(const void *data, size_t size);
+
+    // Hex digest of everything passed to update(); ends the digest
+    DDB_DLL std::string hex();
+};
+
 class Hash{
 public:
+    /** SHA-256 of a file's content. Files larger than a few read blocks are
+     * read on a background thread so that I/O of block N+1 overlaps the digest of block N. */
     DDB_DLL static std::string fileSHA256(const std::string &path);
+
+    /** SHA-256 of a file's content, also returning its first maxHeadBytes bytes
+     * (the whole file if smaller) from the same read. */
+    DDB_DLL static std::string fileSHA256(const std::string &path, std::vector<uint8_t> &head, size_t maxHeadBytes);
+
+    /** SHA-256 of many files, hashed concurrently.
+     * @param paths files to hash
+     * @param maxThreads maximum number of files hashed at once (<= 0 = one per hardware thread)
+     * @param ioBudgetBytes upper bound on read buffer memory across all threads; caps concurrency
+     * @return hashes, in the same order as paths. Throws (first failure in input order) if a file cannot be read */
+    DDB_DLL static std::vector<std::string> filesSHA256(const std::vector<std::string> &paths,
+                                                        int maxThreads = 0,
+                                                        size_t ioBudgetBytes = 64 * 1024 * 1024);
     DDB_DLL static std::string strSHA256(const std::string &str);
+    DDB_DLL static std::string strSHA256(const char *data, size_t size);
 
     DDB_DLL static std::string strCRC64(const std::string &str);
     DDB_DLL static std::string strCRC64(const char *str, uint64_t size);
@@ -0,0 +1,98 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "database.h"
+#include "delta.h"
+#include "ddb_export.h"
+
+namespace ddb
+{
+
+    enum class MerkleTree
+    {
+        Entries = 0, // Nodes are directories ("" = root)
+        Meta = 1     // Nodes are buckets of meta ids sharing their first two characters
+    };
+
+    enum class MerkleNodeType
+    {
+        File,
+        Directory,
+        ImpliedDirectory, // Parent of indexed entries that has no entry of its own
+        MetaBucket,
+        Meta
+    };
+
+    struct MerkleChild
+    {
+        std::string path; // Entry path, bucket or meta id
+        std::string hash; // Content hash of files, subtree hash of the others (empty for meta ids and empty directories)
+        MerkleNodeType type;
+
+        bool isDirectory() const { return type == MerkleNodeType::Directory || type == MerkleNodeType::ImpliedDirectory; }
+    };
+
+    // Hierarchical view of a stamp: each node hash covers its whole subtree,
+    // so two sides only need to compare the children of nodes that differ
+    class MerkleSource
+    {
+    public:
+        virtual ~MerkleSource() = default;
+
+        // Covers all entries and meta; equal roots mean equal stamps
+        virtual std::string rootHash() = 0;
+
+        // Hash of a node, empty if it has no children
+        virtual std::string nodeHash(MerkleTree tree, const std::string &path) = 0;
+
+        // Children of a node, sorted by path
+        virtual std::vector<MerkleChild> children(MerkleTree tree, const std::string &path) = 0;
+    };
+
+    // Merkle tree of an index, kept in the merkle_nodes table. Triggers on entries
+    // and entries_meta mark the parents of changed rows in merkle_dirty; the
+    // affected nodes (and their ancestors) are rehashed on the next read.
+    // Registry push/pull still exchange full stamps (Database::getStamp): pull
+    // diffs the remote stamp against the last synced one, which has no local
+    // index. The tree is used when both sides are local databases.
+    class MerkleIndex : public MerkleSource
+    {
+        Database *db;
+
+        // Rehashed nodes that could not be written back because the database is
+        // read-only or busy ("" for nodes that were dropped). Reads see them
+        // on top of merkle_nodes.
+        std::map<std::pair<MerkleTree, std::string>, std::string> overlay;
+
+        size_t rehashDirty(bool persist);
+        bool storedHash(MerkleTree tree, const std::string &path, std::string &hash);
+        void applyOverlay(MerkleTree tree, int depth, const std::string &lo, const std::string &hi,
+                          MerkleNodeType type, std::vector<MerkleChild> &nodes) const;
+
+    public:
+        MerkleIndex(Database *db) : db(db) {}
+
+        // Rehashes the nodes changed since the last refresh. The result is stored
+        // if the database can be written, kept in memory otherwise.
+        DDB_DLL void refresh();
+
+        DDB_DLL std::string rootHash() override;
+        DDB_DLL std::string nodeHash(MerkleTree tree, const std::string &path) override;
+        DDB_DLL std::vector<MerkleChild> children(MerkleTree tree, const std::string &path) override;
+    };
+
+    // Same result as getDelta on the two full stamps, visiting only the
+    // branches whose hashes differ
+    DDB_DLL Delta getMerkleDelta(MerkleSource &source, MerkleSource &destination);
+
+} // namespace ddb
+
+#endif // MERKLE_H
@@ -6,6 +6,8 @@
 
 #include <string>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <zip.h>
 
@@ -20,6 +22,31 @@ namespace ddb::zip
 
     DDB_DLL void _extractAll(zip_t *pZip, const std::string &outdir, std::ostream *progressOut = nullptr);
 
+    // Extracts a ZIP archive while it is being received, without seeking or
+    // buffering it: entries (stored or deflated, with or without data descriptors,
+    // ZIP64) are decoded from their local headers and written straight to outdir.
+    // Entries listed in expectedHashes are checked against their SHA-256 as they
+    // are written; a mismatching file is removed and a ZipException is thrown.
+    class ZipStreamExtractor
+    {
+        struct State;
+        std::unique_ptr<State> s;
+
+    public:
+        DDB_DLL ZipStreamExtractor(const std::string &outdir,
+                                   const std::unordered_map<std::string, std::string> &expectedHashes = {});
+        DDB_DLL ~ZipStreamExtractor();
+
+        // Feeds the next bytes of the archive
+        DDB_DLL void write(const char *data, size_t size);
+
+        // Throws if the archive ended before its central directory
+        DDB_DLL void finish();
+
+        // Number of file and directory entries extracted so far
+        DDB_DLL size_t extracted() const;
+    };
+
 }
 
 #endif // MZIP_H
@@ -0,0 +1,41 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef PCRASTERIZER_H
+#define PCRASTERIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ddb_export.h"
+
+namespace ddb
+{
+
+    // Points of a tile in contiguous arrays. px/py are pixel coordinates
+    // of the point centers in a tile padded by the point radius on each side.
+    struct RasterPoints
+    {
+        std::vector<int> px;
+        std::vector<int> py;
+        std::vector<double> z;
+        std::vector<uint8_t> r;
+        std::vector<uint8_t> g;
+        std::vector<uint8_t> b;
+
+        size_t size() const { return px.size(); }
+        DDB_DLL void resize(size_t count);
+    };
+
+    // Splats each point as a circle of the given radius into a tileSize x tileSize
+    // planar RGB buffer and its alpha mask. A point is drawn only if it is
+    // higher than the points drawn before it at the same center pixel.
+    // Rows are split into bands rendered on up to threads threads, each with
+    // its own z-buffer; the output is identical to a single-threaded render.
+    DDB_DLL void rasterizePoints(const RasterPoints &points, int radius, int tileSize,
+                                 uint8_t *buffer, uint8_t *alpha, int threads = 1);
+
+} // namespace ddb
+
+#endif // PCRASTERIZER_H
@@ -11,13 +11,28 @@
 
 #include "ddb_export.h"
 #include "fs.h"
+#include "copcsource.h"
 #include "geo.h"
+#include "pcrasterizer.h"
 #include "tiler.h"
 #include "pointcloud.h"
 
 namespace ddb
 {
 
+    // How points are colored in rendered tiles
+    enum class PointCloudRenderMode
+    {
+        Auto,          // RGB if the cloud has colors, elevation otherwise
+        RGB,
+        Elevation,     // Terrain ramp over the Z range of the cloud
+        Intensity,     // Grayscale
+        Classification // ASPRS class colors
+    };
+
+    // Parses "auto", "rgb", "elevation", "intensity" or "classification"
+    DDB_DLL PointCloudRenderMode parsePointCloudRenderMode(const std::string &mode);
+
     // Tiler that renders web-map raster tiles from a built COPC (.copc.laz) file
     // using PDAL's CopcReader. Drop-in replacement for the previous EptTiler.
     class PointCloudTiler : public Tiler
@@ -25,11 +40,20 @@ namespace ddb
         int wSize;
         PointCloudInfo pcInfo;
         bool hasColors;
+        PointCloudRenderMode renderMode;
+
+        // Local files are read through the shared COPC source, remote ones with PDAL
+        std::shared_ptr<CopcSource> source;
+
+        void readPoints(double minX, double minY, double maxX, double maxY,
+                        double resolution, CopcPoints &points);
+        void colorizePoints(const CopcPoints &cloud, RasterPoints &points) const;
 
     public:
         DDB_DLL PointCloudTiler(const std::string &copcPath,
                                 const std::string &outputFolder, int tileSize = 256,
-                                bool tms = false);
+                                bool tms = false,
+                                PointCloudRenderMode renderMode = PointCloudRenderMode::Auto);
         DDB_DLL ~PointCloudTiler();
 
         DDB_DLL std::string tile(int tz, int tx, int ty, uint8_t **outBuffer = nullptr, int *outBufferSize = nullptr) override;
@@ -4,11 +4,13 @@
 #ifndef PUSHMANAGER_H
 #define PUSHMANAGER_H
 
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "ddb_export.h"
 #include "mio.h"
+#include "pushpipeline.h"
 #include <cpr/cpr.h>
 #include "registry.h"
 #include "shareclient.h"
@@ -22,6 +24,7 @@ namespace ddb
         std::vector<std::string> neededFiles;
         std::vector<std::string> neededMeta;
         std::string token;
+        size_t chunkSize = 0; // Largest upload chunk accepted by the registry, 0 if it only takes whole files
     };
 
     class PushManager
@@ -30,6 +33,10 @@ namespace ddb
         std::string organization;
         std::string dataset;
 
+        // Uploads run concurrently, token renewals must not
+        std::mutex tokenMutex;
+        std::string validAuthToken();
+
     public:
         DDB_DLL PushManager(ddb::Registry *registry,
                             const std::string &organization,
@@ -41,7 +48,17 @@ namespace ddb
         }
 
         DDB_DLL PushInitResponse init(const std::string &registryStampChecksum, const json &dbStamp);
-        DDB_DLL void upload(const std::string &fullPath, const std::string &file, const std::string &token);
+        // onSent is called with the bytes sent so far, as the upload progresses
+        DDB_DLL void upload(const std::string &fullPath, const std::string &file, const std::string &token,
+                            const std::function<void(uint64_t bytes)> &onSent = nullptr);
+
+        // Bytes of file received by the registry during this push
+        DDB_DLL uint64_t uploadStatus(const std::string &file, const std::string &token);
+
+        // Sends size bytes of file at offset; returns the bytes of file received so far
+        DDB_DLL uint64_t uploadChunk(const std::string &file, const std::string &token,
+                                     uint64_t offset, uint64_t fileSize, const std::string &checksum,
+                                     const char *data, size_t size);
         DDB_DLL void meta(const json &metaDump, const std::string &token);
         DDB_DLL void commit(const std::string &token);
 
@@ -49,5 +66,35 @@ namespace ddb
         DDB_DLL std::string getDataset() { return this->dataset; }
     };
 
+    // Uploads the files of a push initialized with PushManager::init
+    class PushManagerTransport : public PushTransport
+    {
+        PushManager &pushManager;
+        PushInitResponse pir;
+
+    public:
+        PushManagerTransport(PushManager &pushManager, const PushInitResponse &pir)
+            : pushManager(pushManager), pir(pir) {}
+
+        size_t maxChunkSize() override { return pir.chunkSize; }
+
+        uint64_t received(const std::string &path) override
+        {
+            return pushManager.uploadStatus(path, pir.token);
+        }
+
+        uint64_t sendChunk(const std::string &path, uint64_t offset, uint64_t fileSize,
+                           const std::string &checksum, const char *data, size_t size) override
+        {
+            return pushManager.uploadChunk(path, pir.token, offset, fileSize, checksum, data, size);
+        }
+
+        void sendFile(const std::string &path, const fs::path &fullPath,
+                      const std::function<void(uint64_t bytes)> &onSent) override
+        {
+            pushManager.upload(fullPath.generic_string(), path, pir.token, onSent);
+        }
+    };
+
 } // namespace ddb
 #endif // PUSHMANAGER_H
@@ -0,0 +1,84 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef PUSHPIPELINE_H
+#define PUSHPIPELINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ddb_export.h"
+#include "fs.h"
+
+namespace ddb
+{
+
+    // Options for Registry::push
+    struct DDB_DLL PushOptions
+    {
+        int jobs = 4;                     // Concurrent uploads
+        size_t chunkSize = 0;             // 0 = DDB_PUSH_CHUNK_MB (8 MB by default); capped by the registry
+        long long maxBytesPerSecond = 0;  // Shared by all uploads; 0 = unlimited
+        int retries = 5;                  // Consecutive failures of a transfer before giving up
+        int retryDelayMs = 1000;          // Doubled after each consecutive failure
+    };
+
+    // Where the pipeline sends files. Transient failures (dropped connections,
+    // 5xx responses, corrupted chunks) must throw NetException, so that the
+    // transfer is retried; anything else aborts the push.
+    class PushTransport
+    {
+    public:
+        virtual ~PushTransport() = default;
+
+        // Largest chunk accepted by the remote, 0 if it only takes whole files
+        virtual size_t maxChunkSize() = 0;
+
+        // Number of bytes of path the remote has acknowledged so far
+        virtual uint64_t received(const std::string &path) = 0;
+
+        // Sends size bytes of path starting at offset, with the SHA-256 of the chunk.
+        // Returns the number of bytes of path acknowledged after this chunk.
+        virtual uint64_t sendChunk(const std::string &path, uint64_t offset, uint64_t fileSize,
+                                   const std::string &checksum, const char *data, size_t size) = 0;
+
+        // Sends the whole file in one request, calling onSent with the number of bytes
+        // read as they go out. onSent may block, to throttle the transfer.
+        virtual void sendFile(const std::string &path, const fs::path &fullPath,
+                              const std::function<void(uint64_t bytes)> &onSent) = 0;
+    };
+
+    // Token bucket shared by concurrent transfers
+    class BandwidthLimiter
+    {
+        std::mutex mutex;
+        long long bytesPerSecond;
+        std::chrono::steady_clock::time_point next;
+
+    public:
+        // bytesPerSecond <= 0 = unlimited
+        DDB_DLL explicit BandwidthLimiter(long long bytesPerSecond);
+
+        // Blocks until bytes can be sent without exceeding the rate
+        DDB_DLL void acquire(uint64_t bytes);
+    };
+
+    // Called when a file starts uploading, from the uploading thread (serialized)
+    typedef std::function<void(const std::string &path)> PushFileCallback;
+
+    // Uploads basePath / path for each of paths through transport, options.jobs at
+    // a time. Files are sent in chunks when the transport supports them; after a
+    // failure the upload resumes from the last chunk acknowledged by the remote.
+    // Throws the first non-transient error, or the last error once a transfer
+    // has failed options.retries times in a row.
+    DDB_DLL void pushFiles(PushTransport &transport, const fs::path &basePath,
+                           const std::vector<std::string> &paths, const PushOptions &options,
+                           const PushFileCallback &callback = nullptr);
+
+} // namespace ddb
+
+#endif // PUSHPIPELINE_H
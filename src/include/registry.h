@@ -16,6 +16,7 @@
 #include "ddb_export.h"
 #include <cpr/cpr.h>
 #include "database.h"
+#include "pushpipeline.h"
 
 namespace ddb
 {
@@ -87,7 +88,7 @@ namespace ddb
                            std::ostream &out);
 
         DDB_DLL void pull(const std::string &path, const MergeStrategy mergeStrategy, std::ostream &out);
-        DDB_DLL void push(const std::string &path, std::ostream &out);
+        DDB_DLL void push(const std::string &path, std::ostream &out, const PushOptions &options = PushOptions());
 
         DDB_DLL void handleError(cpr::Response &res);
 
@@ -107,13 +108,16 @@ namespace ddb
                                    const std::string &dataset,
                                    const std::vector<std::string> &files,
                                    const std::string &folder,
-                                   std::ostream &out);
+                                   std::ostream &out,
+                                   const std::unordered_map<std::string, std::string> &expectedHashes = {});
         DDB_DLL json getMetaDump(const std::string &organization,
                                  const std::string &dataset,
                                  const std::vector<std::string> &ids);
     };
 
-    DDB_DLL std::vector<Conflict> applyDelta(const Delta &d, const fs::path &sourcePath, Database *destination, const MergeStrategy mergeStrategy, const json &sourceMetaDump, std::ostream &out = std::cout);
+    // verifiedHashes: content hashes of the source files already checked against the delta, by path
+    DDB_DLL std::vector<Conflict> applyDelta(const Delta &d, const fs::path &sourcePath, Database *destination, const MergeStrategy mergeStrategy, const json &sourceMetaDump, std::ostream &out = std::cout,
+                                             const std::unordered_map<std::string, std::string> &verifiedHashes = {});
     DDB_DLL void ensureParentFolderExists(const fs::path &folder);
     DDB_DLL std::unordered_map<std::string, bool> computeDeltaLocals(Delta d, Database *destination, const std::string &hlDestFolder);
 
@@ -12,6 +12,7 @@
 
 #include <string>
 #include <memory>
+#include <unordered_map>
 
 #include "statement.h"
 #include "fs.h"
@@ -23,6 +24,8 @@ class SqliteDatabase {
   protected:
     sqlite3 *db;
     std::string openFile;
+
+    std::unordered_map<std::string, std::unique_ptr<Statement>> statementCache;
   public:
     DDB_DLL SqliteDatabase();
     DDB_DLL SqliteDatabase &open(const std::string &file);
@@ -33,6 +36,7 @@ class SqliteDatabase {
     DDB_DLL bool tableExists(const std::string &table);
     DDB_DLL std::string getOpenFile() const;
     DDB_DLL int changes();
+    DDB_DLL bool isReadOnly() const;
     DDB_DLL void setJournalMode(const std::string &mode);
     DDB_DLL void setWritableSchema(bool enabled);
     DDB_DLL bool renameColumnIfExists(const std::string &table, const std::string &columnDefBefore, const std::string &columnDefAfter);
@@ -43,6 +47,12 @@ class SqliteDatabase {
 
     DDB_DLL std::unique_ptr<Statement> query(const std::string &query) const;
 
+    // Prepared statement owned by the connection and reused across calls, for hot
+    // queries. It is returned reset with no bindings; callers should reset() it once
+    // done so it does not hold a read transaction open. Not reentrant.
+    DDB_DLL Statement *cachedQuery(const std::string &query);
+    DDB_DLL void resetCachedQueries();
+
     DDB_DLL ~SqliteDatabase();
 };
 
@@ -20,7 +20,9 @@ namespace ddb
 
     // Generate a STAC API ItemCollection (GeoJSON FeatureCollection of STAC Items)
     // for all geometry-bearing entries of a dataset, with optional bbox / datetime
-    // filtering and limit/offset paging.
+    // filtering and paging. Pages can be requested by offset or, in constant time,
+    // with the token of the "next" link of the previous page. approximateCount
+    // bounds the cost of numberMatched, which is omitted for very large results.
     DDB_DLL json generateStacItemCollection(const std::string &ddbPath,
                                             const std::string &stacCollectionRoot = ".",
                                             const std::string &id = "",
@@ -29,7 +31,9 @@ namespace ddb
                                             const std::string &datetimeStart = "",
                                             const std::string &datetimeEnd = "",
                                             int limit = 10,
-                                            int offset = 0);
+                                            int offset = 0,
+                                            const std::string &token = "",
+                                            bool approximateCount = false);
 
 }
 
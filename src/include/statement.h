@@ -30,6 +30,8 @@ public:
   DDB_DLL Statement &bind(int paramNum, const std::string &value);
   DDB_DLL Statement &bind(int paramNum, int value);
   DDB_DLL Statement &bind(int paramNum, long long value);
+  DDB_DLL Statement &bind(int paramNum, double value);
+  DDB_DLL Statement &bind(int paramNum, const void *data, int size); // Blob
 
   DDB_DLL bool fetch();
 
@@ -38,6 +40,7 @@ public:
   DDB_DLL std::string getText(int columnId);
   DDB_DLL double getDouble(int columnId);
   DDB_DLL const void *getBlob(int columnId);
+  DDB_DLL int getBlobSize(int columnId);
 
   DDB_DLL int getColumnsCount() const;
   // TODO: more
@@ -44,12 +44,23 @@ DDB_DLL std::string detectStockpileJson(const std::string &rasterPath,
                                         float sensitivity);
 
 /**
- * Auto-detect ALL stockpile footprints by full-DEM scan.
+ * Tiling of the full-DEM scan. Results do not depend on these settings.
+ */
+struct StockpileScanOptions {
+    int tileSize = 0; // Tile side in pixels; 0 = 1024
+    int threads = 0;  // Tiles processed concurrently; 0 = hardware concurrency
+};
+
+/**
+ * Auto-detect ALL stockpile footprints by full-DEM scan, at the native
+ * resolution of the raster. Tiles are read with a halo and processed in
+ * parallel, so memory does not depend on the raster size.
  *
- * Pipeline: full raster -> low-pass base plane -> diff -> gaussian smoothing
- * -> adaptive global threshold -> two-pass connected components labeling
- * -> per-component contour tracing + Douglas-Peucker simplification
- * -> sort by estimated volume desc -> truncate to maxResults.
+ * Pipeline: tiled scan -> streaming median + coarse low-pass base plane
+ * -> diff -> gaussian smoothing -> adaptive global threshold -> per-tile
+ * connected components labeling, stitched across tiles with union-find
+ * -> sort by estimated volume desc -> contour tracing + Douglas-Peucker
+ * simplification of the top maxResults components.
  *
  * Output JSON schema:
  * {
@@ -80,6 +91,12 @@ DDB_DLL std::string detectAllStockpilesJson(const std::string &rasterPath,
                                             double minAreaM2,
                                             int maxResults);
 
+DDB_DLL std::string detectAllStockpilesJson(const std::string &rasterPath,
+                                            float sensitivity,
+                                            double minAreaM2,
+                                            int maxResults,
+                                            const StockpileScanOptions &options);
+
 } // namespace ddb
 
 #endif // STOCKPILE_H
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <memory>
 #include "ddb_export.h"
 #include "json.h"
 
@@ -79,6 +80,10 @@ DDB_DLL RawThermalData extractRawThermalData(const std::string &filePath);
 DDB_DLL double rawToTemperature(uint16_t raw, const ThermalCalibration &cal);
 DDB_DLL std::vector<float> rawToTemperatureMap(const RawThermalData &raw, const ThermalCalibration &cal);
 
+// rawToTemperature for every 16-bit raw value, computed once per calibration
+// and shared by the images that use it
+DDB_DLL std::shared_ptr<const std::vector<float>> temperatureLut(const ThermalCalibration &cal);
+
 // Check if a GeoTIFF contains direct temperature values (e.g., ODM output)
 DDB_DLL bool isDirectTemperatureRaster(const std::string &filePath);
 
@@ -87,6 +92,7 @@ DDB_DLL bool isDirectTemperatureRaster(const std::string &filePath);
 // can be reused by the neutral raster analysis surface without duplication.
 struct TemperatureData {
     std::vector<float> temperatures;
+    std::vector<uint16_t> rawValues; // Sensor counts, when temperatures were converted from them
     int width = 0;
     int height = 0;
     bool hasGeoTransform = false;
@@ -95,6 +101,20 @@ struct TemperatureData {
 };
 
 DDB_DLL TemperatureData readTemperatureData(const std::string &filePath);
+
+// readTemperatureData through a process-wide LRU cache keyed by path and file
+// identity (DDB_THERMAL_CACHE_MB, 256 MB by default), so that repeated queries
+// on the same image decode it once
+DDB_DLL std::shared_ptr<const TemperatureData> readTemperatureDataCached(const std::string &filePath);
+DDB_DLL void clearTemperatureDataCache();
+
+// Statistics of values (reordered in place), in O(n)
+DDB_DLL ThermalAreaStats computeAreaStats(std::vector<float> &values);
+
+// Statistics from a histogram of 16-bit raw values, each worth lut[raw];
+// non-finite values are skipped
+DDB_DLL ThermalAreaStats computeAreaStats(const std::vector<uint64_t> &histogram,
+                                          const std::vector<float> &lut);
 DDB_DLL void pixelToGeo(double px, double py, const double geoTransform[6],
                         const std::string &projection, double &geoX, double &geoY);
 
@@ -6,6 +6,8 @@
 
 #include "gdal_inc.h"
 
+#include <functional>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -14,10 +16,34 @@
 #include "geo.h"
 #include "gdaltiler.h"
 #include "thumbs.h"
+#include "tilestore.h"
 
 namespace ddb
 {
 
+    struct TilerPoolStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t idle = 0; // Open tilers currently waiting in the pool
+    };
+
+    struct TileStoreStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t open = 0; // Tile stores currently open
+
+        double hitRatio() const
+        {
+            return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+        }
+    };
+
+    // Creates the tile store of a dataset; name uniquely identifies the
+    // dataset version and tile size and is safe to use as a file name
+    typedef std::function<std::shared_ptr<TileStore>(const std::string &name)> TileStoreFactory;
+
     class TilerHelper
     {
         // Parses a string (either "N" or "min-max") and returns
@@ -28,6 +54,10 @@ namespace ddb
         static fs::path getCacheFolderName(const fs::path &tileablePath,
                                            time_t modifiedTime, int tileSize);
 
+        // Tile store of a dataset in the user cache, one per point cloud coloring
+        static std::string userCacheStoreName(const fs::path &tileablePath, time_t modifiedTime,
+                                              int tileSize, const std::string &pointCloudColor);
+
     public:
         DDB_DLL static void runTiler(const fs::path &input,
                                      const fs::path &output,
@@ -37,23 +67,39 @@ namespace ddb
                                      const std::string &format = "text",
                                      const std::string &zRange = "auto",
                                      const std::string &x = "auto",
-                                     const std::string &y = "auto");
+                                     const std::string &y = "auto",
+                                     const std::string &pointCloudColor = "auto");
 
-        // Get a single tile from user cache
+        // Get a single tile from user cache. Tiles are kept in one tile store per
+        // dataset (by default an MBTiles file in the user profile, holding at most
+        // DDB_TILE_CACHE_MB megabytes) and the returned file is a short-lived copy.
+        // pointCloudColor is the coloring of COPC tiles (see parsePointCloudRenderMode),
+        // each coloring has its own store
         DDB_DLL static fs::path getFromUserCache(const fs::path &tileablePath,
                                                  int tz, int tx, int ty,
                                                  int tileSize, bool tms,
                                                  bool forceRecreate,
-                                                 const std::string &tileablePathHash = "");
+                                                 const std::string &tileablePathHash = "",
+                                                 const std::string &pointCloudColor = "auto");
+
+        // Get a single tile from user cache into a buffer (free with VSIFree)
+        DDB_DLL static void getFromUserCache(const fs::path &tileablePath,
+                                             int tz, int tx, int ty,
+                                             int tileSize, bool tms,
+                                             bool forceRecreate,
+                                             uint8_t **outBuffer, int *outBufferSize,
+                                             const std::string &tileablePathHash = "",
+                                             const std::string &pointCloudColor = "auto");
 
-        // Get a single tile
+        // Get a single tile (pointCloudColor only applies to COPC point clouds)
         DDB_DLL static fs::path getTile(const fs::path &tileablePath,
                                         int tz, int tx, int ty,
                                         int tileSize, bool tms,
                                         bool forceRecreate,
                                         const fs::path &outputFolder,
                                         uint8_t **outBuffer = nullptr, int *outBufferSize = nullptr,
-                                        const std::string &tileablePathHash = "");
+                                        const std::string &tileablePathHash = "",
+                                        const std::string &pointCloudColor = "auto");
 
         // Get a single tile with explicit output format ("png" or "jpeg")
         DDB_DLL static fs::path getTile(const fs::path &tileablePath,
@@ -83,6 +129,19 @@ namespace ddb
                                           const std::string &tileablePathHash = "");
 
         DDB_DLL static void cleanupUserCache();
+
+        // Replaces the tile store used by getFromUserCache (nullptr restores the
+        // default MBTiles store). Closes all open stores and resets the stats.
+        DDB_DLL static void setUserCacheStoreFactory(TileStoreFactory factory);
+        DDB_DLL static TileStoreStats getUserCacheStats();
+
+        // getTile reuses open GDALTiler/PointCloudTiler instances across calls, keyed by
+        // (file identity, tile size, tms, output folder), so consecutive tiles of the same
+        // dataset skip opening it, building the warped VRT and toGeoTIFF.
+        // Tilers are leased to one caller at a time; concurrent requests for the same
+        // dataset each get their own instance.
+        DDB_DLL static void clearTilerPool();
+        DDB_DLL static TilerPoolStats getTilerPoolStats();
     };
 
 } // namespace ddb
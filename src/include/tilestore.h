@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ddb_export.h"
+#include "fs.h"
+#include "sqlite_database.h"
+
+namespace ddb
+{
+
+    // Storage backend for rendered tiles of one dataset.
+    // Coordinates are XYZ; implementations must be thread-safe.
+    class TileStore
+    {
+    public:
+        DDB_DLL virtual ~TileStore() {}
+
+        // Returns false on a miss
+        virtual bool get(int tz, int tx, int ty, std::vector<uint8_t> &data) = 0;
+        virtual void put(int tz, int tx, int ty, const uint8_t *data, size_t size) = 0;
+    };
+
+    // Single-file MBTiles (SQLite) tile store. Rows follow the MBTiles layout
+    // (tile_row is TMS) with extra size/last_access columns used to evict the least
+    // recently used tiles once the file holds more than maxBytes of tile data.
+    class MBTilesStore : public TileStore
+    {
+        SqliteDatabase db;
+        std::mutex mutex;
+        long long maxBytes;
+        long long totalBytes = 0;
+
+        void evict();
+
+    public:
+        DDB_DLL MBTilesStore(const fs::path &file, long long maxBytes);
+
+        DDB_DLL bool get(int tz, int tx, int ty, std::vector<uint8_t> &data) override;
+        DDB_DLL void put(int tz, int tx, int ty, const uint8_t *data, size_t size) override;
+
+        // Bytes of tile data currently stored
+        DDB_DLL long long getTotalBytes();
+    };
+
+} // namespace ddb
+
+#endif // TILESTORE_H
@@ -183,6 +183,10 @@ DDB_DLL bool isValidStringParam(const char* str);
 // Validate string parameter requiring non-empty
 DDB_DLL bool isValidNonEmptyStringParam(const char* str);
 
+// Integer value of an environment variable, or defaultValue if it is unset,
+// not a number or less than minValue
+DDB_DLL long long getEnvLong(const char* name, long long defaultValue, long long minValue = 0);
+
 // Parse a comma-separated list of entry type names into a vector of EntryType
 // Returns an empty vector if types is null or empty
 // Throws InvalidArgsException if an unknown type is found or if Directory type is specified
@@ -0,0 +1,155 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef UTM_H
+#define UTM_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace ddb
+{
+
+    // Transverse Mercator projection on the ellipsoid, using the 6th order
+    // Krüger series in the third flattening (Karney, "Transverse Mercator with
+    // an accuracy of a few nanometers", J. Geodesy 85, 2011). Within a UTM zone
+    // the error is a few nanometers, with no PROJ objects involved: the
+    // coefficients are computed once per ellipsoid and every conversion is a
+    // fixed sequence of arithmetic, so the batch loops can be vectorized.
+    class TransverseMercator
+    {
+        static constexpr int order = 6;
+
+        double e;   // eccentricity
+        double e2m; // 1 - e^2
+        double k0A; // scale factor times rectifying radius
+        double alp[order + 1];
+        double bet[order + 1];
+
+        static double eatanhe(double x, double e)
+        {
+            return e * std::atanh(e * x);
+        }
+
+        // tan(conformal latitude) of tan(latitude)
+        double taupf(double tau) const
+        {
+            const double tau1 = std::hypot(1.0, tau);
+            const double sig = std::sinh(eatanhe(tau / tau1, e));
+            return std::hypot(1.0, sig) * tau - sig * tau1;
+        }
+
+        // tan(latitude) of tan(conformal latitude), by Newton's method. The
+        // starting value is within 1e-3 and convergence is quadratic, so a
+        // fixed number of steps reaches full precision without branching.
+        double tauf(double taup) const
+        {
+            double tau = taup / e2m;
+            for (int i = 0; i < 4; i++)
+            {
+                const double taupa = taupf(tau);
+                tau += (taup - taupa) * (1 + e2m * tau * tau) /
+                       (e2m * std::hypot(1.0, tau) * std::hypot(1.0, taupa));
+            }
+            return tau;
+        }
+
+        static double normalizeLongitude(double lon)
+        {
+            return std::remainder(lon, 360.0);
+        }
+
+    public:
+        // a: equatorial radius (meters), f: flattening, k0: central scale factor
+        TransverseMercator(double a, double f, double k0)
+        {
+            const double n = f / (2 - f);
+            const double n2 = n * n, n3 = n2 * n, n4 = n3 * n, n5 = n4 * n, n6 = n5 * n;
+
+            e = std::sqrt(f * (2 - f));
+            e2m = 1 - e * e;
+            k0A = k0 * a / (1 + n) * (1 + n2 / 4 + n4 / 64 + n6 / 256);
+
+            alp[0] = bet[0] = 0;
+            alp[1] = n / 2 - 2 * n2 / 3 + 5 * n3 / 16 + 41 * n4 / 180 - 127 * n5 / 288 + 7891 * n6 / 37800;
+            alp[2] = 13 * n2 / 48 - 3 * n3 / 5 + 557 * n4 / 1440 + 281 * n5 / 630 - 1983433 * n6 / 1935360;
+            alp[3] = 61 * n3 / 240 - 103 * n4 / 140 + 15061 * n5 / 26880 + 167603 * n6 / 181440;
+            alp[4] = 49561 * n4 / 161280 - 179 * n5 / 168 + 6601661 * n6 / 7257600;
+            alp[5] = 34729 * n5 / 80640 - 3418889 * n6 / 1995840;
+            alp[6] = 212378941 * n6 / 319334400;
+
+            bet[1] = n / 2 - 2 * n2 / 3 + 37 * n3 / 96 - n4 / 360 - 81 * n5 / 512 + 96199 * n6 / 604800;
+            bet[2] = n2 / 48 + n3 / 15 - 437 * n4 / 1440 + 46 * n5 / 105 - 1118711 * n6 / 3870720;
+            bet[3] = 17 * n3 / 480 - 37 * n4 / 840 - 209 * n5 / 4480 + 5569 * n6 / 90720;
+            bet[4] = 4397 * n4 / 161280 - 11 * n5 / 504 - 830251 * n6 / 7257600;
+            bet[5] = 4583 * n5 / 161280 - 108847 * n6 / 3991680;
+            bet[6] = 20648693 * n6 / 638668800;
+        }
+
+        // WGS84 with the UTM scale factor
+        static const TransverseMercator &utm()
+        {
+            static const TransverseMercator tm(6378137.0, 1 / 298.257223563, 0.9996);
+            return tm;
+        }
+
+        // Projects (latitude, longitude) in degrees to (x, y) in meters, relative
+        // to the central meridian lon0 (no false easting/northing)
+        void forward(double lon0, double latitude, double longitude, double &x, double &y) const
+        {
+            const double phi = latitude * M_PI / 180.0;
+            const double lam = normalizeLongitude(longitude - lon0) * M_PI / 180.0;
+
+            const double taup = taupf(std::tan(phi));
+            const double xip = std::atan2(taup, std::cos(lam));
+            const double etap = std::asinh(std::sin(lam) / std::hypot(taup, std::cos(lam)));
+
+            double xi = xip, eta = etap;
+            for (int j = 1; j <= order; j++)
+            {
+                xi += alp[j] * std::sin(2 * j * xip) * std::cosh(2 * j * etap);
+                eta += alp[j] * std::cos(2 * j * xip) * std::sinh(2 * j * etap);
+            }
+
+            x = k0A * eta;
+            y = k0A * xi;
+        }
+
+        // Inverse of forward
+        void reverse(double lon0, double x, double y, double &latitude, double &longitude) const
+        {
+            const double xi = y / k0A;
+            const double eta = x / k0A;
+
+            double xip = xi, etap = eta;
+            for (int j = 1; j <= order; j++)
+            {
+                xip -= bet[j] * std::sin(2 * j * xi) * std::cosh(2 * j * eta);
+                etap -= bet[j] * std::cos(2 * j * xi) * std::sinh(2 * j * eta);
+            }
+
+            const double s = std::sinh(etap);
+            const double c = std::cos(xip);
+            const double taup = std::sin(xip) / std::hypot(s, c);
+
+            latitude = std::atan(tauf(taup)) * 180.0 / M_PI;
+            longitude = normalizeLongitude(lon0 + std::atan2(s, c) * 180.0 / M_PI);
+        }
+
+        // Batch versions of forward/reverse over count points
+        void forward(double lon0, size_t count, const double *latitudes, const double *longitudes, double *x, double *y) const
+        {
+            for (size_t i = 0; i < count; i++)
+                forward(lon0, latitudes[i], longitudes[i], x[i], y[i]);
+        }
+
+        void reverse(double lon0, size_t count, const double *x, const double *y, double *latitudes, double *longitudes) const
+        {
+            for (size_t i = 0; i < count; i++)
+                reverse(lon0, x[i], y[i], latitudes[i], longitudes[i]);
+        }
+    };
+
+} // namespace ddb
+
+#endif // UTM_H
@@ -10,11 +10,16 @@
 #include <functional>
 #include <cstdint>
 #include <tuple>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include "json.h"
 #include "ddb_export.h"
 
 namespace ddb {
 
+class BandMathProgram;
+
 struct VegetationFormula {
     std::string id;
     std::string name;
@@ -55,10 +60,25 @@ class DDB_DLL VegetationEngine {
 public:
     static VegetationEngine& instance();
 
-    const std::vector<VegetationFormula>& getAllFormulas() const { return formulas_; }
+    std::vector<VegetationFormula> getAllFormulas() const;
     std::vector<VegetationFormula> getFormulasForFilter(const BandFilter &filter) const;
 
-    const VegetationFormula* getFormula(const std::string &id) const;
+    // The returned formula stays valid if it is replaced or unregistered meanwhile
+    std::shared_ptr<const VegetationFormula> getFormula(const std::string &id) const;
+
+    // Register a custom formula evaluated from its expr (see bandmath.h). requiredBands
+    // is derived from the expression if empty; a formula with the same id is replaced.
+    // Throws InvalidArgsException if the expression does not compile or the id is built-in.
+    void registerFormula(const VegetationFormula &formula);
+
+    // Remove a custom formula. Returns false if there is none with this id.
+    // Throws InvalidArgsException if the id is built-in.
+    bool unregisterFormula(const std::string &id);
+
+    // Register custom formulas from JSON: {"formulas": [{"id", "name", "expr", "help", "min", "max"}]}
+    // Either all of them are registered or, if one is invalid, none.
+    // Formulas in formulas.json in the user profile are registered on startup.
+    void loadFormulas(const std::string &jsonStr);
 
     // Auto-detect band filter from sensor profile
     BandFilter autoDetectFilter(const std::string &rasterPath) const;
@@ -109,11 +129,28 @@ private:
     void initFormulas();
     void initColormaps();
 
+    // Validates a custom formula and fills its defaults; the program is compiled from its expr
+    VegetationFormula prepareFormula(const VegetationFormula &formula,
+                                     std::shared_ptr<const BandMathProgram> &program) const;
+    void addFormulas(const std::vector<std::pair<VegetationFormula, std::shared_ptr<const BandMathProgram>>> &formulas);
+
+    // Compiled program of a custom formula (compiled on the fly if it's no longer registered)
+    std::shared_ptr<const BandMathProgram> getProgram(const VegetationFormula &formula) const;
+
     static void interpolateColormap(ColormapEntry *entries,
                                     const std::vector<std::tuple<float, uint8_t, uint8_t, uint8_t>> &stops);
 
-    std::vector<VegetationFormula> formulas_;
+    void loadProfileFormulas();
+
+    // Built-in formulas first, then custom ones. Entries are immutable and
+    // replaced as a whole, so callers can hold them without the lock.
+    mutable std::shared_mutex formulasMutex_;
+    std::vector<std::shared_ptr<const VegetationFormula>> formulas_;
     std::vector<Colormap> colormaps_;
+
+    // Programs of the registered custom formulas, keyed by id
+    mutable std::mutex programsMutex_;
+    std::map<std::string, std::shared_ptr<const BandMathProgram>> programs_;
 };
 
 } // namespace ddb
@@ -0,0 +1,519 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "bandmath.h"
+#include "vegetation.h"
+#include "exceptions.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+namespace ddb {
+
+namespace {
+
+const float EPS = 1e-10f;
+
+// Pixels per block; with the register file this keeps the working set in L1
+const size_t BlockSize = 256;
+
+const int MaxRegisters = 32;
+
+const char BandFilterSymbols[] = {'R', 'G', 'B', 'N', 'e', 'T'};
+const int BandCount = 6;
+
+typedef BandMathProgram::OpCode OpCode;
+typedef BandMathProgram::Operand Operand;
+typedef BandMathProgram::OperandKind OperandKind;
+
+inline float applyUnary(OpCode op, float a) {
+    switch (op) {
+        case OpCode::Copy: return a;
+        case OpCode::Neg: return -a;
+        case OpCode::Abs: return std::abs(a);
+        case OpCode::Sqrt: return std::sqrt(a);
+        case OpCode::Log: return std::log(a);
+        case OpCode::Exp: return std::exp(a);
+        default: return a;
+    }
+}
+
+inline float applyBinary(OpCode op, float a, float b) {
+    switch (op) {
+        case OpCode::Add: return a + b;
+        case OpCode::Sub: return a - b;
+        case OpCode::Mul: return a * b;
+        case OpCode::Div: return a / b;
+        case OpCode::Pow: return std::pow(a, b);
+        case OpCode::Min: return b < a ? b : a;
+        case OpCode::Max: return a < b ? b : a;
+        default: return a;
+    }
+}
+
+bool isUnary(OpCode op) {
+    return op == OpCode::Copy || op == OpCode::Neg || op == OpCode::Abs ||
+           op == OpCode::Sqrt || op == OpCode::Log || op == OpCode::Exp;
+}
+
+// --- Parser ---
+
+struct Node {
+    enum Kind { Constant, Band, Unary, Binary } kind;
+    OpCode op = OpCode::Copy;
+    float value = 0.0f;
+    int band = 0;
+    int lhs = -1;
+    int rhs = -1;
+    int height = 0; // of the subtree, bounds the recursion of CodeGen::emit
+};
+
+// Bounds the recursion of the parser and of code generation, so a hostile
+// formula throws instead of overflowing the stack
+const int MaxNesting = 256;
+
+class Parser {
+public:
+    explicit Parser(const std::string &expr) : expr(expr) {}
+
+    int parse() {
+        const int root = parseExpr();
+        skipSpaces();
+        if (pos < expr.size()) fail("unexpected '" + std::string(1, expr[pos]) + "'");
+        return root;
+    }
+
+    std::vector<Node> nodes;
+
+private:
+    const std::string &expr;
+    size_t pos = 0;
+    int nesting = 0;
+
+    // Counts a level of recursion for as long as it's in scope
+    struct Nested {
+        Parser &parser;
+        explicit Nested(Parser &parser) : parser(parser) {
+            if (++parser.nesting > MaxNesting) parser.fail("expression too deeply nested");
+        }
+        ~Nested() { parser.nesting--; }
+    };
+
+    [[noreturn]] void fail(const std::string &msg) const {
+        throw InvalidArgsException("Invalid expression \"" + expr + "\" at position " +
+                                   std::to_string(pos + 1) + ": " + msg);
+    }
+
+    void skipSpaces() {
+        while (pos < expr.size() && std::isspace(static_cast<unsigned char>(expr[pos]))) pos++;
+    }
+
+    bool accept(char c) {
+        skipSpaces();
+        if (pos < expr.size() && expr[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) fail(std::string("expected '") + c + "'");
+    }
+
+    int addNode(Node n) {
+        if (n.lhs >= 0) n.height = std::max(n.height, nodes[n.lhs].height + 1);
+        if (n.rhs >= 0) n.height = std::max(n.height, nodes[n.rhs].height + 1);
+        if (n.height > MaxNesting) fail("expression too deeply nested");
+        nodes.push_back(n);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    int constant(float v) {
+        Node n;
+        n.kind = Node::Constant;
+        n.value = v;
+        return addNode(n);
+    }
+
+    // Constant operands are folded right away, so codegen never sees an
+    // instruction whose operands are all constants
+    int unary(OpCode op, int a) {
+        if (nodes[a].kind == Node::Constant) return constant(applyUnary(op, nodes[a].value));
+        Node n;
+        n.kind = Node::Unary;
+        n.op = op;
+        n.lhs = a;
+        return addNode(n);
+    }
+
+    int binary(OpCode op, int a, int b) {
+        if (op == OpCode::Div && nodes[b].kind == Node::Constant && std::abs(nodes[b].value) < EPS)
+            fail("division by zero");
+        if (nodes[a].kind == Node::Constant && nodes[b].kind == Node::Constant)
+            return constant(applyBinary(op, nodes[a].value, nodes[b].value));
+        Node n;
+        n.kind = Node::Binary;
+        n.op = op;
+        n.lhs = a;
+        n.rhs = b;
+        return addNode(n);
+    }
+
+    int parseExpr() {
+        int lhs = parseTerm();
+        for (;;) {
+            if (accept('+')) lhs = binary(OpCode::Add, lhs, parseTerm());
+            else if (accept('-')) lhs = binary(OpCode::Sub, lhs, parseTerm());
+            else return lhs;
+        }
+    }
+
+    int parseTerm() {
+        int lhs = parseUnary();
+        for (;;) {
+            if (accept('*')) lhs = binary(OpCode::Mul, lhs, parseUnary());
+            else if (accept('/')) lhs = binary(OpCode::Div, lhs, parseUnary());
+            else return lhs;
+        }
+    }
+
+    int parseUnary() {
+        const Nested nested(*this);
+        if (accept('-')) return unary(OpCode::Neg, parseUnary());
+        if (accept('+')) return parseUnary();
+        return parsePower();
+    }
+
+    int parsePower() {
+        const int base = parsePrimary();
+        if (accept('^')) return binary(OpCode::Pow, base, parseUnary());
+        return base;
+    }
+
+    int parsePrimary() {
+        skipSpaces();
+        if (pos >= expr.size()) fail("unexpected end of expression");
+
+        const char c = expr[pos];
+        if (accept('(')) {
+            const Nested nested(*this);
+            const int inner = parseExpr();
+            expect(')');
+            return inner;
+        }
+
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') return parseNumber();
+
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            const size_t start = pos;
+            while (pos < expr.size() && std::isalnum(static_cast<unsigned char>(expr[pos]))) pos++;
+            const std::string ident = expr.substr(start, pos - start);
+
+            const auto &symbols = BandMathProgram::bandSymbols();
+            const auto it = std::find(symbols.begin(), symbols.end(), ident);
+            if (it != symbols.end()) {
+                Node n;
+                n.kind = Node::Band;
+                n.band = static_cast<int>(it - symbols.begin());
+                return addNode(n);
+            }
+
+            return parseCall(ident, start);
+        }
+
+        fail("unexpected '" + std::string(1, c) + "'");
+    }
+
+    int parseCall(const std::string &name, size_t start) {
+        OpCode op;
+        int arity;
+        if (name == "abs") { op = OpCode::Abs; arity = 1; }
+        else if (name == "sqrt") { op = OpCode::Sqrt; arity = 1; }
+        else if (name == "log") { op = OpCode::Log; arity = 1; }
+        else if (name == "exp") { op = OpCode::Exp; arity = 1; }
+        else if (name == "min") { op = OpCode::Min; arity = 2; }
+        else if (name == "max") { op = OpCode::Max; arity = 2; }
+        else {
+            pos = start;
+            fail("unknown identifier '" + name + "'");
+        }
+
+        expect('(');
+        const int a = parseExpr();
+        if (arity == 1) {
+            expect(')');
+            return unary(op, a);
+        }
+        expect(',');
+        const int b = parseExpr();
+        expect(')');
+        return binary(op, a, b);
+    }
+
+    int parseNumber() {
+        const size_t start = pos;
+        while (pos < expr.size() && (std::isdigit(static_cast<unsigned char>(expr[pos])) || expr[pos] == '.')) pos++;
+
+        // Optional exponent, only if followed by digits so "2e" is not swallowed
+        if (pos < expr.size() && (expr[pos] == 'e' || expr[pos] == 'E')) {
+            size_t p = pos + 1;
+            if (p < expr.size() && (expr[p] == '+' || expr[p] == '-')) p++;
+            if (p < expr.size() && std::isdigit(static_cast<unsigned char>(expr[p]))) {
+                while (p < expr.size() && std::isdigit(static_cast<unsigned char>(expr[p]))) p++;
+                pos = p;
+            }
+        }
+
+        std::istringstream ss(expr.substr(start, pos - start));
+        ss.imbue(std::locale::classic());
+        double v;
+        if (!(ss >> v) || !ss.eof()) {
+            pos = start;
+            fail("invalid number");
+        }
+        return constant(static_cast<float>(v));
+    }
+};
+
+// --- Code generation ---
+
+class CodeGen {
+public:
+    CodeGen(const std::vector<Node> &nodes, std::vector<BandMathProgram::Instruction> &code)
+        : nodes(nodes), code(code) {}
+
+    Operand emit(int idx) {
+        const Node &n = nodes[idx];
+        Operand o;
+        switch (n.kind) {
+            case Node::Constant:
+                o.kind = OperandKind::Constant;
+                o.value = n.value;
+                return o;
+            case Node::Band:
+                o.kind = OperandKind::Band;
+                o.index = n.band;
+                return o;
+            case Node::Unary: {
+                const Operand a = emit(n.lhs);
+                release(a);
+                return push(n.op, a, Operand());
+            }
+            case Node::Binary:
+            default: {
+                const Operand a = emit(n.lhs);
+                const Operand b = emit(n.rhs);
+                release(a);
+                release(b);
+                return push(n.op, a, b);
+            }
+        }
+    }
+
+    // Make sure the result ends up in a register
+    void finish(const Operand &result) {
+        if (result.kind != OperandKind::Register) push(OpCode::Copy, result, Operand());
+    }
+
+    int registerCount() const { return static_cast<int>(used.size()); }
+
+private:
+    const std::vector<Node> &nodes;
+    std::vector<BandMathProgram::Instruction> &code;
+    std::vector<bool> used;
+
+    // Registers are freed as soon as they are consumed, so an instruction can
+    // write into one of its own sources (every op is element-wise)
+    int allocate() {
+        for (size_t i = 0; i < used.size(); i++) {
+            if (!used[i]) {
+                used[i] = true;
+                return static_cast<int>(i);
+            }
+        }
+        if (static_cast<int>(used.size()) >= MaxRegisters)
+            throw InvalidArgsException("Expression is too complex");
+        used.push_back(true);
+        return static_cast<int>(used.size()) - 1;
+    }
+
+    void release(const Operand &o) {
+        if (o.kind == OperandKind::Register) used[o.index] = false;
+    }
+
+    Operand push(OpCode op, const Operand &a, const Operand &b) {
+        BandMathProgram::Instruction ins;
+        ins.op = op;
+        ins.dst = allocate();
+        ins.a = a;
+        ins.b = b;
+        code.push_back(ins);
+
+        Operand o;
+        o.kind = OperandKind::Register;
+        o.index = ins.dst;
+        return o;
+    }
+};
+
+// --- Evaluation ---
+
+// An operand resolved for one block: either a pointer to n floats or a scalar
+struct Source {
+    const float *ptr;
+    float value;
+};
+
+template <typename F>
+inline void unaryLoop(F f, const Source &a, float *d, size_t n) {
+    if (a.ptr) {
+        for (size_t i = 0; i < n; i++) d[i] = f(a.ptr[i]);
+    } else {
+        std::fill(d, d + n, f(a.value));
+    }
+}
+
+template <typename F>
+inline void binaryLoop(F f, const Source &a, const Source &b, float *d, size_t n) {
+    if (a.ptr && b.ptr) {
+        for (size_t i = 0; i < n; i++) d[i] = f(a.ptr[i], b.ptr[i]);
+    } else if (a.ptr) {
+        const float bv = b.value;
+        for (size_t i = 0; i < n; i++) d[i] = f(a.ptr[i], bv);
+    } else {
+        const float av = a.value;
+        for (size_t i = 0; i < n; i++) d[i] = f(av, b.ptr[i]);
+    }
+}
+
+} // namespace
+
+const std::vector<std::string>& BandMathProgram::bandSymbols() {
+    static const std::vector<std::string> symbols = {"R", "G", "B", "N", "Re", "T"};
+    return symbols;
+}
+
+BandMathProgram BandMathProgram::compile(const std::string &expr) {
+    Parser parser(expr);
+    const int root = parser.parse();
+
+    if (parser.nodes[root].kind == Node::Constant && !std::isfinite(parser.nodes[root].value))
+        throw InvalidArgsException("Invalid expression \"" + expr + "\": result is not finite");
+
+    BandMathProgram program;
+    program.expr_ = expr;
+
+    CodeGen gen(parser.nodes, program.code_);
+    gen.finish(gen.emit(root));
+    program.registerCount_ = gen.registerCount();
+
+    for (const auto &n : parser.nodes) {
+        if (n.kind == Node::Band) program.usesBand_[n.band] = true;
+    }
+
+    LOGD << "Compiled \"" << expr << "\" to " << program.code_.size() << " instructions, "
+         << program.registerCount_ << " registers";
+
+    return program;
+}
+
+std::string BandMathProgram::requiredBands() const {
+    std::string bands;
+    for (int b = 0; b < BandCount; b++) {
+        if (usesBand_[b]) bands += bandSymbols()[b];
+    }
+    return bands;
+}
+
+void BandMathProgram::evaluate(const BandFilter &filter,
+                               const std::vector<float*> &bandData,
+                               float *outData,
+                               size_t pixelCount,
+                               float nodata) const {
+    const float *bands[BandCount] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+    for (int b = 0; b < BandCount; b++) {
+        if (!usesBand_[b]) continue;
+
+        const int idx = filter.get(BandFilterSymbols[b]);
+        if (idx < 0 || idx >= static_cast<int>(bandData.size()) || bandData[idx] == nullptr) {
+            LOGD << "Band " << bandSymbols()[b] << " is not available for \"" << expr_ << "\"";
+            std::fill(outData, outData + pixelCount, nodata);
+            return;
+        }
+        bands[b] = bandData[idx];
+    }
+
+    std::vector<float> registers(static_cast<size_t>(registerCount_) * BlockSize);
+    uint8_t invalid[BlockSize];
+    const float *result = registers.data() + static_cast<size_t>(code_.back().dst) * BlockSize;
+
+    for (size_t start = 0; start < pixelCount; start += BlockSize) {
+        const size_t n = std::min(BlockSize, pixelCount - start);
+
+        auto resolve = [&](const Operand &o) -> Source {
+            switch (o.kind) {
+                case OperandKind::Register: return {registers.data() + static_cast<size_t>(o.index) * BlockSize, 0.0f};
+                case OperandKind::Band: return {bands[o.index] + start, 0.0f};
+                default: return {nullptr, o.value};
+            }
+        };
+
+        std::memset(invalid, 0, n);
+
+        for (const auto &ins : code_) {
+            float *d = registers.data() + static_cast<size_t>(ins.dst) * BlockSize;
+            const Source a = resolve(ins.a);
+
+            switch (ins.op) {
+                case OpCode::Copy: unaryLoop([](float x) { return x; }, a, d, n); break;
+                case OpCode::Neg: unaryLoop([](float x) { return -x; }, a, d, n); break;
+                case OpCode::Abs: unaryLoop([](float x) { return std::abs(x); }, a, d, n); break;
+                case OpCode::Sqrt: unaryLoop([](float x) { return std::sqrt(x); }, a, d, n); break;
+                case OpCode::Log: unaryLoop([](float x) { return std::log(x); }, a, d, n); break;
+                case OpCode::Exp: unaryLoop([](float x) { return std::exp(x); }, a, d, n); break;
+                default: break;
+            }
+            if (isUnary(ins.op)) continue;
+
+            const Source b = resolve(ins.b);
+            switch (ins.op) {
+                case OpCode::Add: binaryLoop([](float x, float y) { return x + y; }, a, b, d, n); break;
+                case OpCode::Sub: binaryLoop([](float x, float y) { return x - y; }, a, b, d, n); break;
+                case OpCode::Mul: binaryLoop([](float x, float y) { return x * y; }, a, b, d, n); break;
+                case OpCode::Pow: binaryLoop([](float x, float y) { return std::pow(x, y); }, a, b, d, n); break;
+                case OpCode::Min: binaryLoop([](float x, float y) { return y < x ? y : x; }, a, b, d, n); break;
+                case OpCode::Max: binaryLoop([](float x, float y) { return x < y ? y : x; }, a, b, d, n); break;
+                case OpCode::Div:
+                    // Flag near-zero denominators before d (which may alias b) is written.
+                    // Constant denominators are rejected at compile time.
+                    if (b.ptr) {
+                        for (size_t i = 0; i < n; i++) invalid[i] |= static_cast<uint8_t>(std::abs(b.ptr[i]) < EPS);
+                    }
+                    binaryLoop([](float x, float y) { return x / y; }, a, b, d, n);
+                    break;
+                default: break;
+            }
+        }
+
+        for (int bi = 0; bi < BandCount; bi++) {
+            if (!bands[bi]) continue;
+            const float *p = bands[bi] + start;
+            for (size_t i = 0; i < n; i++) invalid[i] |= static_cast<uint8_t>(p[i] == nodata);
+        }
+
+        float *o = outData + start;
+        for (size_t i = 0; i < n; i++) {
+            const float x = result[i];
+            const float z = x - x; // NaN for NaN and +-inf
+            o[i] = (invalid[i] | (z != z)) ? nodata : x;
+        }
+    }
+}
+
+} // namespace ddb
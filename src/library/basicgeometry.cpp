@@ -3,12 +3,170 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include "basicgeometry.h"
+
+#include <algorithm>
+#include <cstring>
+
 #include "exceptions.h"
+#include "logger.h"
 #include "utils.h"
 
 namespace ddb
 {
 
+    namespace
+    {
+        // SpatiaLite BLOB layout: 0x00, byte order (0x01 = little endian), int32 SRID,
+        // MBR (min x, min y, max x, max y), 0x7C, int32 class type, geometry, 0xFE
+        const unsigned char BLOB_START = 0x00;
+        const unsigned char BLOB_LITTLE_ENDIAN = 0x01;
+        const unsigned char BLOB_MBR_END = 0x7C;
+        const unsigned char BLOB_END = 0xFE;
+
+        // Class types are the base type plus 1000 (Z), 2000 (M) or 3000 (ZM);
+        // compressed linestrings and polygons add another 1000000
+        const int CLASS_POINT = 1;
+        const int CLASS_POLYGON = 3;
+        const int CLASS_Z = 1000;
+        const int CLASS_COMPRESSED = 1000000;
+
+        class BlobReader
+        {
+            const unsigned char *data;
+            int size;
+            int offset = 0;
+            bool littleEndian = true;
+
+            bool take(int bytes, uint64_t &v)
+            {
+                if (!ok || offset + bytes > size)
+                {
+                    ok = false;
+                    return false;
+                }
+
+                v = 0;
+                for (int i = 0; i < bytes; i++)
+                {
+                    const uint64_t b = data[offset + (littleEndian ? i : bytes - 1 - i)];
+                    v |= b << (8 * i);
+                }
+                offset += bytes;
+                return true;
+            }
+
+        public:
+            bool ok = true;
+
+            // Geometry class, with and without the dimension and compression flags
+            int classType = 0;
+            int baseClass = 0;
+            bool hasZ = false;
+            bool hasM = false;
+            bool compressed = false;
+
+            BlobReader(const void *data, int size) : data(static_cast<const unsigned char *>(data)), size(size) {}
+
+            bool readHeader()
+            {
+                if (data == nullptr || size < 44 || data[0] != BLOB_START || data[38] != BLOB_MBR_END || data[size - 1] != BLOB_END)
+                    return false;
+
+                littleEndian = data[1] == BLOB_LITTLE_ENDIAN;
+                offset = 39; // SRID and MBR are not needed to read the points
+                classType = static_cast<int>(readInt32());
+
+                int t = classType;
+                compressed = t >= CLASS_COMPRESSED;
+                if (compressed)
+                    t -= CLASS_COMPRESSED;
+                const int dims = t / CLASS_Z;
+                baseClass = t % CLASS_Z;
+                hasZ = dims == 1 || dims == 3;
+                hasM = dims == 2 || dims == 3;
+
+                return ok && dims <= 3;
+            }
+
+            uint32_t readInt32()
+            {
+                uint64_t v = 0;
+                take(4, v);
+                return static_cast<uint32_t>(v);
+            }
+
+            double readDouble()
+            {
+                uint64_t v = 0;
+                take(8, v);
+                double d;
+                std::memcpy(&d, &v, sizeof(d));
+                return d;
+            }
+
+            float readFloat()
+            {
+                const uint32_t v = readInt32();
+                float f;
+                std::memcpy(&f, &v, sizeof(f));
+                return f;
+            }
+
+            Point readPoint()
+            {
+                Point p;
+                p.x = readDouble();
+                p.y = readDouble();
+                if (hasZ)
+                    p.z = readDouble();
+                if (hasM)
+                    readDouble();
+                return p;
+            }
+
+            // Compressed vertices (all but the first and last of a ring) are
+            // float offsets from the previous vertex; M stays a double
+            Point readCompressedPoint(const Point &previous)
+            {
+                Point p;
+                p.x = previous.x + readFloat();
+                p.y = previous.y + readFloat();
+                if (hasZ)
+                    p.z = previous.z + readFloat();
+                if (hasM)
+                    readDouble();
+                return p;
+            }
+
+            // The geometry must end exactly at the end marker
+            bool atEnd() const
+            {
+                return ok && offset == size - 1;
+            }
+        };
+
+        void appendInt32(std::string &s, uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+
+        void appendDouble(std::string &s, double d)
+        {
+            uint64_t v;
+            std::memcpy(&v, &d, sizeof(v));
+            for (int i = 0; i < 8; i++)
+                s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+
+        void appendPoint(std::string &s, const Point &p)
+        {
+            appendDouble(s, p.x);
+            appendDouble(s, p.y);
+            appendDouble(s, p.z);
+        }
+    }
+
     std::string BasicPointGeometry::toWkt() const
     {
         if (empty())
@@ -32,6 +190,40 @@ namespace ddb
         return j;
     }
 
+    std::string BasicPointGeometry::toSpatialiteBlob(int srid) const
+    {
+        if (empty())
+            return "";
+
+        std::string body;
+        appendPoint(body, points[0]);
+        return spatialiteBlob(srid, CLASS_POINT + CLASS_Z, body);
+    }
+
+    bool BasicPointGeometry::fromSpatialiteBlob(const void *data, int size)
+    {
+        clear();
+        if (size <= 0)
+            return false;
+
+        BlobReader r(data, size);
+        if (!r.readHeader() || r.baseClass != CLASS_POINT || r.compressed)
+        {
+            LOGD << "Not a SpatiaLite point (class " << r.classType << ")";
+            return false;
+        }
+
+        const Point p = r.readPoint();
+        if (!r.atEnd())
+        {
+            LOGD << "Invalid SpatiaLite point BLOB";
+            return false;
+        }
+
+        addPoint(p);
+        return true;
+    }
+
     std::string BasicPolygonGeometry::toWkt() const
     {
         if (empty())
@@ -74,6 +266,66 @@ namespace ddb
         return j;
     }
 
+    std::string BasicPolygonGeometry::toSpatialiteBlob(int srid) const
+    {
+        if (empty())
+            return "";
+
+        std::string body;
+        body.reserve(8 + points.size() * 24);
+        appendInt32(body, 1);
+        appendInt32(body, static_cast<uint32_t>(points.size()));
+        for (const auto &p : points)
+            appendPoint(body, p);
+        return spatialiteBlob(srid, CLASS_POLYGON + CLASS_Z, body);
+    }
+
+    bool BasicPolygonGeometry::fromSpatialiteBlob(const void *data, int size)
+    {
+        clear();
+        if (size <= 0)
+            return false;
+
+        BlobReader r(data, size);
+        if (!r.readHeader() || r.baseClass != CLASS_POLYGON)
+        {
+            LOGD << "Not a SpatiaLite polygon (class " << r.classType << ")";
+            return false;
+        }
+
+        // Only the exterior ring is kept, polygons with holes are not expected
+        if (r.readInt32() != 1)
+        {
+            LOGD << "Unsupported SpatiaLite polygon (ring count is not 1)";
+            return false;
+        }
+
+        const uint32_t count = r.readInt32();
+        if (!r.ok || count > static_cast<uint32_t>(size) / 8)
+        {
+            LOGD << "Invalid SpatiaLite polygon BLOB";
+            return false;
+        }
+
+        points.reserve(count);
+        for (uint32_t i = 0; i < count && r.ok; i++)
+        {
+            if (!r.compressed || i == 0 || i == count - 1)
+                points.push_back(r.readPoint());
+            else
+                points.push_back(r.readCompressedPoint(points.back()));
+        }
+
+        if (!r.atEnd())
+        {
+            LOGD << "Invalid SpatiaLite polygon BLOB";
+            clear();
+            return false;
+        }
+
+        return true;
+    }
+
     void BasicGeometry::addPoint(const Point &p)
     {
         points.push_back(p);
@@ -118,6 +370,34 @@ namespace ddb
         j["properties"] = json({});
     }
 
+    std::string BasicGeometry::spatialiteBlob(int srid, int classType, const std::string &body) const
+    {
+        double minX = points[0].x, minY = points[0].y;
+        double maxX = minX, maxY = minY;
+        for (const auto &p : points)
+        {
+            minX = std::min(minX, p.x);
+            minY = std::min(minY, p.y);
+            maxX = std::max(maxX, p.x);
+            maxY = std::max(maxY, p.y);
+        }
+
+        std::string blob;
+        blob.reserve(44 + body.size());
+        blob.push_back(static_cast<char>(BLOB_START));
+        blob.push_back(static_cast<char>(BLOB_LITTLE_ENDIAN));
+        appendInt32(blob, static_cast<uint32_t>(srid));
+        appendDouble(blob, minX);
+        appendDouble(blob, minY);
+        appendDouble(blob, maxX);
+        appendDouble(blob, maxY);
+        blob.push_back(static_cast<char>(BLOB_MBR_END));
+        appendInt32(blob, static_cast<uint32_t>(classType));
+        blob += body;
+        blob.push_back(static_cast<char>(BLOB_END));
+        return blob;
+    }
+
     BasicGeometryType getBasicGeometryTypeFromName(const std::string &name)
     {
         if (name == "auto")
@@ -17,6 +17,7 @@
 
 #include "3d.h"
 #include "buildlock.h"
+#include "buildscheduler.h"
 #include "cog.h"
 #include "dbops.h"
 #include "ddb.h"
@@ -377,13 +378,64 @@ void buildInternal(Database* db, const Entry& e, const std::string& outputPath,
     }
 }
 
+// Hash of the build folder an entry writes to: its own, or the one of its main
+// file for dependencies (sidecars)
+static std::string buildTarget(Database* db, const Entry& e) {
+    std::string subfolder;
+    std::string mainFile;
+    Entry mainEntry;
+
+    if (!isBuildableInternal(e, subfolder) && isBuildableDependency(e, mainFile, subfolder) &&
+        getEntry(db, mainFile, mainEntry))
+        return mainEntry.hash;
+
+    return e.hash;
+}
+
+static BuildScheduler::Runner buildRunner(Database* db,
+                                          const BuildScheduler& scheduler,
+                                          const std::string& outPath,
+                                          bool force) {
+    const bool parallel = scheduler.isParallel();
+    const std::string rootDirectory = db->rootDirectory().string();
+
+    return [=](const BuildJob& job) {
+        // Only remove the pending file when we're about to attempt the build
+        if (!job.pendingFile.empty()) {
+            io::assureIsRemoved(job.pendingFile);
+            LOGD << "Attempting build for " << job.entry.path
+                 << " (all dependencies now available)";
+        }
+
+        if (!parallel) {
+            buildInternal(db, job.entry, outPath, force);
+            return;
+        }
+
+        // Database connections are not shared between threads
+        const auto workerDb = open(rootDirectory, false);
+        buildInternal(workerDb.get(), job.entry, outPath, force);
+    };
+}
+
 void buildAll(Database* db, const std::string& outputPath, bool force) {
+    BuildOptions options;
+    options.force = force;
+    buildAllEx(db, outputPath, options);
+}
+
+bool buildAllEx(Database* db,
+                const std::string& outputPath,
+                const BuildOptions& options,
+                BuildProgressCallback callback) {
     std::string outPath = outputPath;
     if (outPath.empty())
         outPath = db->buildDirectory().string();
 
     LOGD << "In buildAll('" << outputPath << "')";
 
+    BuildScheduler scheduler(options, outPath);
+
     // List all buildable files in DB
     auto q = db->query(
         "SELECT path, hash, type, properties, mtime, size, depth FROM entries WHERE type = ? OR "
@@ -396,21 +448,20 @@ void buildAll(Database* db, const std::string& outputPath, bool force) {
     q->bind(6, Tiles3D);
 
     while (q->fetch()) {
-        Entry e(q->getText(0),
-                q->getText(1),
-                q->getInt(2),
-                q->getText(3),
-                q->getInt64(4),
-                q->getInt64(5),
-                q->getInt(6));
-
-        // Call build on each of them
-        try {
-            buildInternal(db, e, outPath, force);
-        } catch (const AppException& err) {
-            LOGD << "Cannot build " << e.path << ": " << err.what();
-        }
+        BuildJob job;
+        job.entry = Entry(q->getText(0),
+                          q->getText(1),
+                          q->getInt(2),
+                          q->getText(3),
+                          q->getInt64(4),
+                          q->getInt64(5),
+                          q->getInt(6));
+        job.target = buildTarget(db, job.entry);
+        scheduler.add(std::move(job));
     }
+    q.reset();
+
+    return scheduler.run(buildRunner(db, scheduler, outPath, options.force), callback);
 }
 
 void build(Database* db, const std::string& path, const std::string& outputPath, bool force) {
@@ -488,14 +539,26 @@ PendingFileData parsePendingFile(const fs::path& pendingFilePath) {
 }  // namespace
 
 void buildPending(Database* db, const std::string& outputPath, bool force) {
+    BuildOptions options;
+    options.force = force;
+    buildPendingEx(db, outputPath, options);
+}
+
+bool buildPendingEx(Database* db,
+                    const std::string& outputPath,
+                    const BuildOptions& options,
+                    BuildProgressCallback callback) {
     auto buildDir = db->buildDirectory();
     if (!fs::exists(buildDir))
-        return;
+        return true;
 
     std::string outPath = outputPath;
     if (outPath.empty())
         outPath = buildDir.string();
 
+    const bool force = options.force;
+    BuildScheduler scheduler(options, outPath);
+
     for (auto i = fs::recursive_directory_iterator(buildDir);
          i != fs::recursive_directory_iterator();
          ++i) {
@@ -548,30 +611,25 @@ void buildPending(Database* db, const std::string& outputPath, bool force) {
 
         while (q->fetch()) {
             found = true;
-            Entry e(q->getText(0),
-                    q->getText(1),
-                    q->getInt(2),
-                    q->getText(3),
-                    q->getInt64(4),
-                    q->getInt64(5),
-                    q->getInt(6));
-
-            // Only remove the pending file if we're going to attempt the build
-            io::assureIsRemoved(i->path());
 
-            // Call build
-            try {
-                LOGD << "Attempting build for " << e.path
-                     << " (all dependencies now available)";
-                buildInternal(db, e, outPath, force);
-            } catch (const AppException& err) {
-                LOGD << "Cannot build " << e.path << ": " << err.what();
-            }
+            BuildJob job;
+            job.entry = Entry(q->getText(0),
+                              q->getText(1),
+                              q->getInt(2),
+                              q->getText(3),
+                              q->getInt64(4),
+                              q->getInt64(5),
+                              q->getInt(6));
+            job.target = hash;
+            job.pendingFile = i->path();
+            scheduler.add(std::move(job));
         }
 
         if (!found)
             io::assureIsRemoved(i->path());
     }
+
+    return scheduler.run(buildRunner(db, scheduler, outPath, force), callback);
 }
 
 bool isBuildPending(Database* db) {
@@ -629,13 +687,7 @@ std::vector<PendingBuildInfo> getPendingBuildInfo(Database* db) {
 // low enough never to trip on a healthy host yet high enough to stop a build
 // from beginning on an essentially full disk.
 static void ensureSufficientDiskSpace(const fs::path& dir) {
-    long long minMb = 512;
-    if (const char* env = std::getenv("DDB_MIN_FREE_DISK_MB"); env && *env) {
-        char* endp = nullptr;
-        const long long v = std::strtoll(env, &endp, 10);
-        if (endp != env && v >= 0)
-            minMb = v;
-    }
+    const long long minMb = utils::getEnvLong("DDB_MIN_FREE_DISK_MB", 512);
     if (minMb == 0)
         return;  // explicitly disabled
 
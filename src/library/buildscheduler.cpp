@@ -0,0 +1,401 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "buildscheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "exceptions.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        int hardwareThreads()
+        {
+            return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        long long physicalMemoryMb()
+        {
+#ifdef _WIN32
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof(status);
+            if (GlobalMemoryStatusEx(&status))
+                return static_cast<long long>(status.ullTotalPhys / (1024ULL * 1024ULL));
+#else
+            const long pages = sysconf(_SC_PHYS_PAGES);
+            const long pageSize = sysconf(_SC_PAGE_SIZE);
+            if (pages > 0 && pageSize > 0)
+                return static_cast<long long>(pages) * pageSize / (1024LL * 1024LL);
+#endif
+            return 0;
+        }
+
+        // Free space on the filesystem holding path (which might not exist yet), -1 if unknown
+        long long availableDisk(const fs::path &path)
+        {
+            std::error_code ec;
+            fs::path dir = fs::absolute(path, ec);
+            while (!dir.empty() && !fs::exists(dir, ec) && dir != dir.parent_path())
+                dir = dir.parent_path();
+
+            const fs::space_info si = fs::space(dir, ec);
+            if (ec)
+                return -1;
+            return static_cast<long long>(si.available);
+        }
+
+        void orderJobs(std::vector<BuildJob> &jobs, const BuildOptions &options)
+        {
+            if (options.order == BuildOrder::SmallestFirst)
+                std::stable_sort(jobs.begin(), jobs.end(), [](const BuildJob &a, const BuildJob &b)
+                                 { return a.entry.size < b.entry.size; });
+            else if (options.order == BuildOrder::LargestFirst)
+                std::stable_sort(jobs.begin(), jobs.end(), [](const BuildJob &a, const BuildJob &b)
+                                 { return a.entry.size > b.entry.size; });
+
+            if (options.priority.empty())
+                return;
+
+            std::unordered_map<std::string, size_t> rank;
+            for (size_t i = 0; i < options.priority.size(); i++)
+                rank.emplace(options.priority[i], i);
+
+            std::stable_sort(jobs.begin(), jobs.end(), [&rank](const BuildJob &a, const BuildJob &b)
+                             {
+                const auto ra = rank.find(a.entry.path);
+                const auto rb = rank.find(b.entry.path);
+                const size_t ia = ra != rank.end() ? ra->second : std::numeric_limits<size_t>::max();
+                const size_t ib = rb != rank.end() ? rb->second : std::numeric_limits<size_t>::max();
+                return ia < ib; });
+        }
+    }
+
+    BuildResources estimateBuildResources(const Entry &e)
+    {
+        const int cores = hardwareThreads();
+        const long long size = static_cast<long long>(e.size);
+        const long long sizeMb = size / (1024 * 1024);
+
+        BuildResources r;
+        r.resourceClass = static_cast<int>(e.type);
+
+        switch (e.type)
+        {
+        case GeoRaster:
+            // gdalwarp runs with NUM_THREADS=ALL_CPUS and a DDB_WARP_MEMORY_MB buffer
+            r.classLimit = 2;
+            r.cpu = std::max(1, cores / 2);
+            r.memoryMb = utils::getEnvLong("DDB_WARP_MEMORY_MB", 512, 1) + 256;
+            r.diskBytes = size * 2;
+            break;
+        case PointCloud:
+            // Untwine is multi-threaded and its memory grows with the input
+            r.classLimit = 2;
+            r.cpu = std::max(1, cores / 2);
+            r.memoryMb = 1024 + std::min(sizeMb * 2, 8192LL);
+            r.diskBytes = size * 3;
+            break;
+        case Model:
+            // Nexus and Obj2Tiles load the whole mesh; Obj2Tiles is a separate process
+            r.classLimit = 1;
+            r.cpu = std::min(2, cores);
+            r.memoryMb = 512 + sizeMb * 4;
+            r.diskBytes = size * 3;
+            break;
+        case GaussianSplat:
+            // build-lod is a separate multi-threaded process
+            r.classLimit = 1;
+            r.cpu = std::max(1, cores / 2);
+            r.memoryMb = 1024 + sizeMb * 4;
+            r.diskBytes = size * 2;
+            break;
+        case Vector:
+            r.cpu = 1;
+            r.memoryMb = 256 + sizeMb * 4;
+            r.diskBytes = size * 2;
+            break;
+        case Tiles3D:
+            // Archive extraction, I/O bound
+            r.classLimit = 2;
+            r.cpu = 1;
+            r.memoryMb = 128;
+            r.diskBytes = size * 2;
+            break;
+        default:
+            r.cpu = 1;
+            r.memoryMb = 256;
+            r.diskBytes = size;
+            break;
+        }
+
+        return r;
+    }
+
+    BuildScheduler::BuildScheduler(const BuildOptions &options, const fs::path &outputPath) : options(options), outputPath(outputPath)
+    {
+        cpuBudget = hardwareThreads();
+
+        memoryBudgetMb = options.memoryBudgetMb;
+        if (memoryBudgetMb <= 0)
+        {
+            const long long physical = physicalMemoryMb();
+            memoryBudgetMb = utils::getEnvLong("DDB_BUILD_MEMORY_MB", physical > 0 ? physical / 2 : 4096, 1);
+        }
+    }
+
+    void BuildScheduler::add(BuildJob job)
+    {
+        jobs.push_back(std::move(job));
+    }
+
+    void BuildScheduler::setBudget(int cpu, long long memoryMb)
+    {
+        cpuBudget = std::max(1, cpu);
+        memoryBudgetMb = std::max(1LL, memoryMb);
+    }
+
+    bool BuildScheduler::run(const Runner &runner, const BuildProgressCallback &callback)
+    {
+        orderJobs(jobs, options);
+
+        const auto start = std::chrono::steady_clock::now();
+        BuildProgress progress;
+        progress.total = jobs.size();
+
+        // ETA is extrapolated from the bytes built so far
+        double totalWeight = 0;
+        double doneWeight = 0;
+        for (const auto &job : jobs)
+            totalWeight += static_cast<double>(std::max<std::uintmax_t>(job.entry.size, 1));
+
+        auto report = [&](const BuildJob &job, bool started) -> bool
+        {
+            progress.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            progress.eta = doneWeight > 0 ? progress.elapsed * (totalWeight - doneWeight) / doneWeight : -1;
+            progress.path = job.entry.path;
+            progress.started = started;
+            return !callback || callback(progress);
+        };
+
+        auto complete = [&](const BuildJob &job, const std::string &error)
+        {
+            progress.completed++;
+            if (!error.empty())
+            {
+                progress.failed++;
+                LOGD << "Cannot build " << job.entry.path << ": " << error;
+            }
+            doneWeight += static_cast<double>(std::max<std::uintmax_t>(job.entry.size, 1));
+        };
+
+        if (!isParallel())
+        {
+            for (const auto &job : jobs)
+            {
+                progress.running = 1;
+                if (!report(job, true))
+                    return false;
+
+                std::string error;
+                try
+                {
+                    runner(job);
+                }
+                catch (const AppException &e)
+                {
+                    error = e.what();
+                    if (error.empty())
+                        error = "Unknown error";
+                }
+
+                progress.running = 0;
+                complete(job, error);
+                if (!report(job, false))
+                    return false;
+            }
+
+            return true;
+        }
+
+        const size_t maxRunning = options.jobs > 0 ? static_cast<size_t>(options.jobs)
+                                                   : std::numeric_limits<size_t>::max();
+
+        std::vector<BuildResources> resources;
+        resources.reserve(jobs.size());
+        for (const auto &job : jobs)
+            resources.push_back(estimateBuildResources(job.entry));
+
+        struct Outcome
+        {
+            size_t index;
+            std::string error;
+            std::exception_ptr fatal;
+        };
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Outcome> finished;
+        std::vector<std::thread> workers(jobs.size());
+
+        // Always join the workers, including when the callback throws
+        struct WorkersGuard
+        {
+            std::vector<std::thread> &workers;
+            ~WorkersGuard()
+            {
+                for (auto &t : workers)
+                    if (t.joinable())
+                        t.join();
+            }
+        } guard{workers};
+
+        std::list<size_t> queue;
+        for (size_t i = 0; i < jobs.size(); i++)
+            queue.push_back(i);
+
+        std::unordered_map<int, int> classRunning;
+        std::unordered_set<std::string> activeTargets;
+        size_t running = 0;
+        int cpuUsed = 0;
+        long long memoryUsed = 0;
+        long long diskUsed = 0;
+        bool canceled = false;
+        std::exception_ptr fatal;
+
+        LOGD << "Scheduling " << jobs.size() << " builds (cpu budget " << cpuBudget << ", memory budget "
+             << memoryBudgetMb << " MB)";
+
+        while (true)
+        {
+            std::deque<Outcome> done;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.swap(finished);
+            }
+
+            for (auto &o : done)
+            {
+                workers[o.index].join();
+
+                const auto &r = resources[o.index];
+                running--;
+                classRunning[r.resourceClass]--;
+                cpuUsed -= r.cpu;
+                memoryUsed -= r.memoryMb;
+                diskUsed -= r.diskBytes;
+                activeTargets.erase(jobs[o.index].target);
+
+                // Errors other than build failures (out of memory...) abort the run
+                // like they do in a serial build, once the running builds are done
+                if (o.fatal && !fatal)
+                {
+                    fatal = o.fatal;
+                    canceled = true;
+                }
+
+                progress.running = running;
+                complete(jobs[o.index], o.error);
+                if (!report(jobs[o.index], false))
+                    canceled = true;
+            }
+
+            if (!canceled)
+            {
+                const long long disk = availableDisk(outputPath);
+
+                for (auto it = queue.begin(); it != queue.end() && running < maxRunning;)
+                {
+                    const size_t i = *it;
+                    const auto &r = resources[i];
+
+                    // A job larger than the whole budget still runs, alone
+                    const bool fits = running == 0 ||
+                                      ((r.classLimit == 0 || classRunning[r.resourceClass] < r.classLimit) &&
+                                       cpuUsed + r.cpu <= cpuBudget &&
+                                       memoryUsed + r.memoryMb <= memoryBudgetMb &&
+                                       (disk < 0 || diskUsed + r.diskBytes <= disk) &&
+                                       activeTargets.count(jobs[i].target) == 0);
+                    if (!fits)
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    it = queue.erase(it);
+                    running++;
+                    classRunning[r.resourceClass]++;
+                    cpuUsed += r.cpu;
+                    memoryUsed += r.memoryMb;
+                    diskUsed += r.diskBytes;
+                    activeTargets.insert(jobs[i].target);
+
+                    workers[i] = std::thread([&, i]()
+                                             {
+                        Outcome o{i, "", nullptr};
+                        try
+                        {
+                            runner(jobs[i]);
+                        }
+                        catch (const AppException &e)
+                        {
+                            o.error = e.what();
+                            if (o.error.empty())
+                                o.error = "Unknown error";
+                        }
+                        catch (...)
+                        {
+                            o.fatal = std::current_exception();
+                        }
+
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            finished.push_back(std::move(o));
+                        }
+                        cv.notify_one(); });
+
+                    progress.running = running;
+                    if (!report(jobs[i], true))
+                    {
+                        canceled = true;
+                        break;
+                    }
+                }
+            }
+
+            if (running == 0 && (queue.empty() || canceled))
+                break;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&finished]
+                    { return !finished.empty(); });
+        }
+
+        if (fatal)
+            std::rethrow_exception(fatal);
+
+        return queue.empty() || !canceled;
+    }
+
+} // namespace ddb
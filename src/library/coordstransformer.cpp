@@ -1,84 +1,232 @@
 /* This Source Code Form is subject to the terms of the Mozilla Public
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
-#include <sstream>
+#include <algorithm>
+#include <climits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "coordstransformer.h"
 #include "exceptions.h"
 
 namespace ddb
 {
-    using WktPtr = std::unique_ptr<char, void(*)(void*)>;
 
-    CoordsTransformer::CoordsTransformer(int epsgFrom, int epsgTo)
+    // Transformations for one (source, target) pair. OGR transformations are not
+    // thread safe, so each transformer leases its own clone of the prototype.
+    struct CachedTransformation
     {
-        if (OSRImportFromEPSG(hSrc, epsgFrom) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + std::to_string(epsgFrom) + ". Is PROJ available?");
-
-        if (OSRImportFromEPSG(hTgt, epsgTo) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + std::to_string(epsgTo) + ". Is PROJ available?");
+        std::mutex mutex;
+        OGRCoordinateTransformationH prototype = nullptr;
+        std::vector<OGRCoordinateTransformationH> idle;
+        bool evicted = false;
+
+        ~CachedTransformation()
+        {
+            for (auto h : idle)
+                OCTDestroyCoordinateTransformation(h);
+            if (prototype)
+                OCTDestroyCoordinateTransformation(prototype);
+        }
+    };
+
+    namespace
+    {
+        // Distinct (source, target) pairs kept in the cache
+        const size_t MaxCachedPairs = 64;
+
+        // Idle transformations kept per pair, enough for a full set of worker threads
+        const size_t MaxIdlePerPair = 32;
+
+        struct SrsHandle
+        {
+            OGRSpatialReferenceH h = OSRNewSpatialReference(nullptr);
+            ~SrsHandle()
+            {
+                if (h)
+                    OSRDestroySpatialReference(h);
+            }
+        };
+
+        void importSrs(SrsHandle &srs, const std::string &definition)
+        {
+            if (!srs.h || OSRSetFromUserInput(srs.h, definition.c_str()) != OGRERR_NONE)
+                throw GDALException("Cannot import spatial reference system " + definition + ". Is PROJ available?");
+            OSRSetAxisMappingStrategy(srs.h, OAMS_TRADITIONAL_GIS_ORDER);
+        }
+
+        // LRU cache of the pairs
+        class TransformationCache
+        {
+            typedef std::list<std::pair<std::string, std::shared_ptr<CachedTransformation>>> PairList;
+
+            std::mutex mutex;
+            PairList pairs; // Most recently used first
+            std::unordered_map<std::string, PairList::iterator> index;
+
+        public:
+            static TransformationCache &instance()
+            {
+                // Never destroyed: PROJ contexts might be gone during static destruction
+                static TransformationCache *cache = new TransformationCache();
+                return *cache;
+            }
+
+            std::shared_ptr<CachedTransformation> get(const std::string &key)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                auto it = index.find(key);
+                if (it != index.end())
+                {
+                    pairs.splice(pairs.begin(), pairs, it->second);
+                    return it->second->second;
+                }
+
+                if (pairs.size() >= MaxCachedPairs)
+                    evict(std::prev(pairs.end()));
+
+                auto entry = std::make_shared<CachedTransformation>();
+                pairs.emplace_front(key, entry);
+                index.emplace(key, pairs.begin());
+                return entry;
+            }
+
+            void clear()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (!pairs.empty())
+                    evict(pairs.begin());
+            }
+
+        private:
+            void evict(PairList::iterator it)
+            {
+                {
+                    // Leased transformations are destroyed when they are returned
+                    std::lock_guard<std::mutex> lock(it->second->mutex);
+                    it->second->evicted = true;
+                    for (auto h : it->second->idle)
+                        OCTDestroyCoordinateTransformation(h);
+                    it->second->idle.clear();
+                }
+                index.erase(it->first);
+                pairs.erase(it);
+            }
+        };
+    }
 
-        hTransform = OCTNewCoordinateTransformation(hSrc, hTgt);
-        if (!hTransform)
-            throw GDALException("Failed to create coordinate transformation");
+    CoordsTransformer::CoordsTransformer(int epsgFrom, int epsgTo)
+    {
+        init("EPSG:" + std::to_string(epsgFrom), "EPSG:" + std::to_string(epsgTo));
     }
 
     CoordsTransformer::CoordsTransformer(const std::string &wktFrom, int epsgTo)
     {
-
-        WktPtr wktOwner(strdup(wktFrom.c_str()), std::free);
-
-        char* wktPtr = wktOwner.get();
-        if (OSRImportFromWkt(hSrc, &wktPtr) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + wktFrom + ". Is PROJ available?");
-
-        if (OSRImportFromEPSG(hTgt, epsgTo) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + std::to_string(epsgTo) + ". Is PROJ available?");
-
-        hTransform = OCTNewCoordinateTransformation(hSrc, hTgt);
-        if (!hTransform)
-            throw GDALException("Failed to create coordinate transformation");
+        init(wktFrom, "EPSG:" + std::to_string(epsgTo));
     }
 
     CoordsTransformer::CoordsTransformer(int epsgFrom, const std::string &wktTo)
     {
-        if (OSRImportFromEPSG(hSrc, epsgFrom) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + std::to_string(epsgFrom) + ". Is PROJ available?");
-
-        WktPtr wktOwner(strdup(wktTo.c_str()), std::free);
+        init("EPSG:" + std::to_string(epsgFrom), wktTo);
+    }
 
-        char* wktPtr = wktOwner.get();
-        if (OSRImportFromWkt(hTgt, &wktPtr) != OGRERR_NONE)
-            throw GDALException("Cannot import spatial reference system " + wktTo + ". Is PROJ available?");
+    CoordsTransformer::CoordsTransformer(const std::string &srsFrom, const std::string &srsTo)
+    {
+        init(srsFrom, srsTo);
+    }
 
-        hTransform = OCTNewCoordinateTransformation(hSrc, hTgt);
-        if (!hTransform)
-            throw GDALException("Failed to create coordinate transformation");
+    void CoordsTransformer::init(const std::string &srsFrom, const std::string &srsTo)
+    {
+        // Definitions never contain a NUL, so the key is unambiguous
+        std::string key;
+        key.reserve(srsFrom.size() + srsTo.size() + 1);
+        key.append(srsFrom).push_back('\0');
+        key.append(srsTo);
+
+        auto entry = TransformationCache::instance().get(key);
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->idle.empty())
+        {
+            hTransform = entry->idle.back();
+            entry->idle.pop_back();
+        }
+        else
+        {
+            if (!entry->prototype)
+            {
+                SrsHandle src, tgt;
+                importSrs(src, srsFrom);
+                importSrs(tgt, srsTo);
+
+                entry->prototype = OCTNewCoordinateTransformation(src.h, tgt.h);
+                if (!entry->prototype)
+                    throw GDALException("Failed to create coordinate transformation");
+            }
+
+            OGRCoordinateTransformation *clone = OGRCoordinateTransformation::FromHandle(entry->prototype)->Clone();
+            if (!clone)
+                throw GDALException("Failed to create coordinate transformation");
+            hTransform = OGRCoordinateTransformation::ToHandle(clone);
+        }
+
+        cached = std::move(entry);
     }
 
     CoordsTransformer::~CoordsTransformer()
     {
-        if (hTransform)
+        if (!hTransform)
+            return;
+
+        std::lock_guard<std::mutex> lock(cached->mutex);
+        if (!cached->evicted && cached->idle.size() < MaxIdlePerPair)
+            cached->idle.push_back(hTransform);
+        else
             OCTDestroyCoordinateTransformation(hTransform);
-        if (hTgt)
-            OSRDestroySpatialReference(hTgt);
-        if (hSrc)
-            OSRDestroySpatialReference(hSrc);
     }
 
     void CoordsTransformer::transform(double *x, double *y)
     {
-        double none = 0.0;
-        if (!OCTTransform(hTransform, 1, x, y, &none))
-            throw GDALException("Transform failed");
-
+        transform(1, x, y, nullptr);
     }
 
     void CoordsTransformer::transform(double *x, double *y, double *z)
     {
-        if (!OCTTransform(hTransform, 1, x, y, z))
-            throw GDALException("Transform failed");
+        transform(1, x, y, z);
+    }
+
+    void CoordsTransformer::transform(size_t count, double *x, double *y, double *z)
+    {
+        // OCTTransform takes an int count
+        for (size_t offset = 0; offset < count; offset += INT_MAX)
+        {
+            const int n = static_cast<int>(std::min<size_t>(count - offset, INT_MAX));
+            if (!OCTTransform(hTransform, n, x + offset, y + offset, z ? z + offset : nullptr))
+                throw GDALException("Transform failed");
+        }
+    }
 
+    size_t CoordsTransformer::transform(size_t count, double *x, double *y, double *z, int *success)
+    {
+        for (size_t offset = 0; offset < count; offset += INT_MAX)
+        {
+            const int n = static_cast<int>(std::min<size_t>(count - offset, INT_MAX));
+            OCTTransformEx(hTransform, n, x + offset, y + offset, z ? z + offset : nullptr, success + offset);
+        }
+
+        size_t transformed = 0;
+        for (size_t i = 0; i < count; i++)
+            if (success[i])
+                transformed++;
+        return transformed;
+    }
+
+    void clearCoordsTransformerCache()
+    {
+        TransformationCache::instance().clear();
     }
 
 }
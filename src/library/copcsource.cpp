@@ -0,0 +1,470 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "copcsource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <set>
+#include <unordered_map>
+
+#include <laszip/laszip_api.h>
+
+#include "exceptions.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace ddb
+{
+
+    struct LaszipReader
+    {
+        laszip_POINTER h = nullptr;
+        laszip_header_struct *header = nullptr;
+        laszip_point_struct *point = nullptr;
+        bool opened = false;
+
+        ~LaszipReader()
+        {
+            if (h)
+            {
+                if (opened)
+                    laszip_close_reader(h);
+                laszip_destroy(h);
+            }
+        }
+
+        std::string error() const
+        {
+            laszip_CHAR *msg = nullptr;
+            if (h && laszip_get_error(h, &msg) == 0 && msg)
+                return msg;
+            return "unknown LASzip error";
+        }
+    };
+
+    namespace
+    {
+        // Size of the fixed parts of a COPC file (LAS 1.4 header, copc info VLR)
+        const size_t LasHeaderSize = 375;
+        const size_t VlrHeaderSize = 54;
+        const size_t CopcInfoSize = 160;
+        const size_t HierarchyEntrySize = 32;
+
+        // Sources kept open, across all files
+        const size_t MaxOpenSources = 16;
+
+        // Idle LASzip readers kept per source
+        const size_t MaxIdleReaders = 8;
+
+        // Decoded bytes per point in CopcPoints
+        const size_t PointBytes = sizeof(double) * 3 + sizeof(uint16_t) * 4 + sizeof(uint8_t);
+
+        template <typename T>
+        T readLE(const char *p)
+        {
+            T v;
+            std::memcpy(&v, p, sizeof(T));
+            return v;
+        }
+
+        void readAt(std::ifstream &f, uint64_t offset, char *buf, size_t size, const std::string &path)
+        {
+            f.seekg(static_cast<std::streamoff>(offset));
+            if (!f.read(buf, static_cast<std::streamsize>(size)))
+                throw PDALException("Cannot read COPC file " + path + " at offset " + std::to_string(offset));
+        }
+
+        // Byte budget of the decoded chunk cache. Configurable via the
+        // DDB_COPC_CACHE_MB environment variable; defaults to 256 MB.
+        size_t chunkCacheMaxBytes()
+        {
+            const long long maxMb = utils::getEnvLong("DDB_COPC_CACHE_MB", 256);
+            return static_cast<size_t>(maxMb) * 1024 * 1024;
+        }
+
+        class ChunkCache
+        {
+            struct Chunk
+            {
+                std::string key;
+                std::shared_ptr<const CopcPoints> points;
+                size_t bytes;
+            };
+            typedef std::list<Chunk> ChunkList;
+
+            std::mutex mutex;
+            ChunkList chunks; // Most recently used first
+            std::unordered_map<std::string, ChunkList::iterator> index;
+            size_t bytes = 0;
+            size_t maxBytes = chunkCacheMaxBytes();
+            size_t hits = 0;
+            size_t misses = 0;
+
+        public:
+            static ChunkCache &instance()
+            {
+                static ChunkCache *cache = new ChunkCache();
+                return *cache;
+            }
+
+            std::shared_ptr<const CopcPoints> get(const std::string &key)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = index.find(key);
+                if (it == index.end())
+                {
+                    misses++;
+                    return nullptr;
+                }
+
+                hits++;
+                chunks.splice(chunks.begin(), chunks, it->second);
+                return it->second->points;
+            }
+
+            void put(const std::string &key, std::shared_ptr<const CopcPoints> points)
+            {
+                const size_t size = points->size() * PointBytes;
+                ChunkList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+
+                if (size > maxBytes || index.count(key))
+                    return;
+
+                chunks.push_front(Chunk{key, std::move(points), size});
+                index[key] = chunks.begin();
+                bytes += size;
+
+                while (bytes > maxBytes)
+                {
+                    auto last = std::prev(chunks.end());
+                    bytes -= last->bytes;
+                    index.erase(last->key);
+                    evicted.splice(evicted.end(), chunks, last);
+                }
+            }
+
+            void clear()
+            {
+                ChunkList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+                evicted.swap(chunks);
+                index.clear();
+                bytes = 0;
+                hits = misses = 0;
+            }
+
+            CopcCacheStats getStats()
+            {
+                CopcCacheStats stats;
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.hits = hits;
+                stats.misses = misses;
+                stats.chunks = chunks.size();
+                stats.bytes = bytes;
+                return stats;
+            }
+        };
+
+        struct SourceRegistry
+        {
+            std::mutex mutex;
+            std::list<std::pair<std::string, std::shared_ptr<CopcSource>>> sources; // Most recently used first
+
+            static SourceRegistry &instance()
+            {
+                static SourceRegistry *registry = new SourceRegistry();
+                return *registry;
+            }
+        };
+
+        std::atomic<unsigned long long> nextSourceId{1};
+    }
+
+    void CopcPoints::reserve(size_t count)
+    {
+        x.reserve(count);
+        y.reserve(count);
+        z.reserve(count);
+        red.reserve(count);
+        green.reserve(count);
+        blue.reserve(count);
+        intensity.reserve(count);
+        classification.reserve(count);
+    }
+
+    CopcSource::CopcSource(const std::string &path, const FileIdentity &identity)
+        : path(path), identity(identity), id(nextSourceId++)
+    {
+        std::ifstream f(fs::path(path), std::ios::binary);
+        if (!f.is_open())
+            throw FSException("Cannot open " + path);
+
+        char head[LasHeaderSize + VlrHeaderSize + CopcInfoSize];
+        readAt(f, 0, head, sizeof(head), path);
+
+        // The copc info VLR must immediately follow the LAS 1.4 header
+        if (std::memcmp(head, "LASF", 4) != 0 || head[24] != 1 || head[25] != 4 ||
+            std::strncmp(head + LasHeaderSize + 2, "copc", 16) != 0 ||
+            readLE<uint16_t>(head + LasHeaderSize + 18) != 1)
+            throw PDALException(path + " is not a COPC file");
+
+        const uint64_t pointCount = readLE<uint64_t>(head + 247);
+
+        const char *info = head + LasHeaderSize + VlrHeaderSize;
+        center[0] = readLE<double>(info);
+        center[1] = readLE<double>(info + 8);
+        center[2] = readLE<double>(info + 16);
+        halfSize = readLE<double>(info + 24);
+        spacing = readLE<double>(info + 32);
+
+        // Load every hierarchy page
+        std::vector<std::pair<uint64_t, uint64_t>> pages{{readLE<uint64_t>(info + 40), readLE<uint64_t>(info + 48)}};
+        std::set<uint64_t> visited;
+        std::vector<char> page;
+        while (!pages.empty())
+        {
+            const auto p = pages.back();
+            pages.pop_back();
+            if (!visited.insert(p.first).second || p.second % HierarchyEntrySize != 0)
+                throw PDALException("Invalid COPC hierarchy in " + path);
+
+            page.resize(p.second);
+            readAt(f, p.first, page.data(), page.size(), path);
+
+            for (size_t i = 0; i < page.size(); i += HierarchyEntrySize)
+            {
+                const char *e = page.data() + i;
+                CopcNode node;
+                node.d = readLE<int32_t>(e);
+                node.x = readLE<int32_t>(e + 4);
+                node.y = readLE<int32_t>(e + 8);
+                node.z = readLE<int32_t>(e + 12);
+                node.offset = readLE<uint64_t>(e + 16);
+                const int32_t byteSize = readLE<int32_t>(e + 24);
+                node.pointCount = readLE<int32_t>(e + 28);
+                node.firstPoint = 0;
+
+                if (node.pointCount == -1)
+                    pages.emplace_back(node.offset, static_cast<uint64_t>(byteSize));
+                else if (node.pointCount > 0)
+                    nodes.push_back(node);
+            }
+        }
+
+        // Each node is one LAZ chunk and chunks are numbered in file order
+        std::sort(nodes.begin(), nodes.end(), [](const CopcNode &a, const CopcNode &b)
+                  { return a.offset < b.offset; });
+        uint64_t first = 0;
+        for (auto &node : nodes)
+        {
+            node.firstPoint = first;
+            first += static_cast<uint64_t>(node.pointCount);
+        }
+        if (first != pointCount)
+            throw PDALException("COPC hierarchy of " + path + " does not match its point count");
+
+        LOGD << "Loaded COPC hierarchy of " << path << " (" << nodes.size() << " nodes)";
+    }
+
+    CopcSource::~CopcSource()
+    {
+    }
+
+    std::shared_ptr<CopcSource> CopcSource::open(const std::string &copcPath)
+    {
+        const std::string key = fs::absolute(copcPath).string();
+
+        FileIdentity identity;
+        if (!getFileIdentity(key, identity))
+            throw FSException("Cannot open " + copcPath);
+
+        auto &registry = SourceRegistry::instance();
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (auto it = registry.sources.begin(); it != registry.sources.end(); ++it)
+            {
+                if (it->first != key)
+                    continue;
+
+                // Stale sources are dropped; their chunks age out of the cache
+                if (it->second->identity == identity)
+                {
+                    registry.sources.splice(registry.sources.begin(), registry.sources, it);
+                    return it->second;
+                }
+                registry.sources.erase(it);
+                break;
+            }
+        }
+
+        std::shared_ptr<CopcSource> source(new CopcSource(key, identity));
+
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.sources.remove_if([&key](const auto &s)
+                                   { return s.first == key; });
+        registry.sources.emplace_front(key, source);
+        if (registry.sources.size() > MaxOpenSources)
+            registry.sources.pop_back();
+
+        return source;
+    }
+
+    bool CopcSource::getInfo(PointCloudInfo &info, int polyBoundsSrs, int *span)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = infos.find(polyBoundsSrs);
+        if (it == infos.end())
+        {
+            std::pair<PointCloudInfo, int> entry;
+            if (!getCopcInfo(path, entry.first, polyBoundsSrs, &entry.second))
+                return false;
+            it = infos.emplace(polyBoundsSrs, std::move(entry)).first;
+        }
+
+        info = it->second.first;
+        if (span != nullptr)
+            *span = it->second.second;
+        return true;
+    }
+
+    std::unique_ptr<LaszipReader> CopcSource::acquireReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!readers.empty())
+            {
+                auto reader = std::move(readers.back());
+                readers.pop_back();
+                return reader;
+            }
+        }
+
+        auto reader = std::make_unique<LaszipReader>();
+        if (laszip_create(&reader->h) != 0)
+            throw PDALException("Cannot create LASzip reader");
+
+        laszip_BOOL compressed = 0;
+        if (laszip_open_reader(reader->h, path.c_str(), &compressed) != 0)
+            throw PDALException("Cannot open " + path + ": " + reader->error());
+        reader->opened = true;
+
+        if (laszip_get_header_pointer(reader->h, &reader->header) != 0 ||
+            laszip_get_point_pointer(reader->h, &reader->point) != 0)
+            throw PDALException("Cannot read " + path + ": " + reader->error());
+
+        return reader;
+    }
+
+    void CopcSource::releaseReader(std::unique_ptr<LaszipReader> reader)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readers.size() < MaxIdleReaders)
+            readers.push_back(std::move(reader));
+    }
+
+    std::shared_ptr<const CopcPoints> CopcSource::readNode(const CopcNode &node)
+    {
+        const std::string key = std::to_string(id) + "/" + std::to_string(node.d) + "-" +
+                                std::to_string(node.x) + "-" + std::to_string(node.y) + "-" + std::to_string(node.z);
+
+        auto &cache = ChunkCache::instance();
+        if (auto cached = cache.get(key))
+            return cached;
+
+        auto reader = acquireReader();
+        if (laszip_seek_point(reader->h, static_cast<laszip_I64>(node.firstPoint)) != 0)
+            throw PDALException("Cannot seek in " + path + ": " + reader->error());
+
+        const laszip_header_struct *h = reader->header;
+        const laszip_point_struct *p = reader->point;
+        const bool extended = h->point_data_format >= 6;
+
+        auto points = std::make_shared<CopcPoints>();
+        points->reserve(static_cast<size_t>(node.pointCount));
+        for (int32_t i = 0; i < node.pointCount; i++)
+        {
+            if (laszip_read_point(reader->h) != 0)
+                throw PDALException("Cannot read point from " + path + ": " + reader->error());
+
+            points->x.push_back(p->X * h->x_scale_factor + h->x_offset);
+            points->y.push_back(p->Y * h->y_scale_factor + h->y_offset);
+            points->z.push_back(p->Z * h->z_scale_factor + h->z_offset);
+            points->red.push_back(p->rgb[0]);
+            points->green.push_back(p->rgb[1]);
+            points->blue.push_back(p->rgb[2]);
+            points->intensity.push_back(p->intensity);
+            points->classification.push_back(extended ? p->extended_classification : p->classification);
+        }
+
+        releaseReader(std::move(reader));
+
+        cache.put(key, points);
+        return points;
+    }
+
+    void CopcSource::read(double minX, double minY, double maxX, double maxY,
+                          double resolution, CopcPoints &out)
+    {
+        // Same depth limit as PDAL's CopcReader
+        int depthEnd = INT_MAX;
+        if (resolution > 0)
+            depthEnd = std::max(1, static_cast<int>(std::ceil(std::log2(spacing / resolution))) + 1);
+
+        const double rootMinX = center[0] - halfSize;
+        const double rootMinY = center[1] - halfSize;
+
+        for (const auto &node : nodes)
+        {
+            if (node.d >= depthEnd)
+                continue;
+
+            const double side = 2.0 * halfSize / static_cast<double>(1ULL << std::min(node.d, 62));
+            const double nodeMinX = rootMinX + node.x * side;
+            const double nodeMinY = rootMinY + node.y * side;
+            if (nodeMinX > maxX || nodeMinX + side < minX || nodeMinY > maxY || nodeMinY + side < minY)
+                continue;
+
+            const auto points = readNode(node);
+            for (size_t i = 0; i < points->size(); i++)
+            {
+                const double x = points->x[i];
+                const double y = points->y[i];
+                if (x < minX || x > maxX || y < minY || y > maxY)
+                    continue;
+
+                out.x.push_back(x);
+                out.y.push_back(y);
+                out.z.push_back(points->z[i]);
+                out.red.push_back(points->red[i]);
+                out.green.push_back(points->green[i]);
+                out.blue.push_back(points->blue[i]);
+                out.intensity.push_back(points->intensity[i]);
+                out.classification.push_back(points->classification[i]);
+            }
+        }
+    }
+
+    CopcCacheStats getCopcCacheStats()
+    {
+        return ChunkCache::instance().getStats();
+    }
+
+    void clearCopcCache()
+    {
+        ChunkCache::instance().clear();
+
+        auto &registry = SourceRegistry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.sources.clear();
+    }
+
+} // namespace ddb
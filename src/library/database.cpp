@@ -5,6 +5,7 @@
 #include "database.h"
 #include "metamanager.h"
 
+#include <algorithm>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
@@ -15,6 +16,7 @@
 #include "hash.h"
 #include "logger.h"
 #include "mio.h"
+#include "transaction.h"
 
 namespace ddb
 {
@@ -65,6 +67,34 @@ namespace ddb
   ON entries (hash);
 )<<<";
 
+    const char *spatialIndexesDdl = R"<<<(
+  SELECT CreateSpatialIndex("entries", "point_geom")
+  WHERE NOT EXISTS (SELECT 1 FROM sqlite_master WHERE name = 'idx_entries_point_geom');
+  SELECT CreateSpatialIndex("entries", "polygon_geom")
+  WHERE NOT EXISTS (SELECT 1 FROM sqlite_master WHERE name = 'idx_entries_polygon_geom');
+)<<<";
+
+    // capture_time is the acquisition instant of an entry in seconds (EXIF capture
+    // time, mtime when unknown). It is a virtual generated column: SQLite computes it
+    // on read and when maintaining its index, so writes to entries are not doubled
+#define DDB_CAPTURE_TIME_EXPR(row)                                                                              \
+    "CASE WHEN json_extract(CASE WHEN json_valid(" row "properties) THEN " row "properties END, '$.captureTime') > 0 " \
+    "THEN json_extract(" row "properties, '$.captureTime') / 1000.0 ELSE " row "mtime END"
+
+    const char *captureTimeDdl =
+        "ALTER TABLE entries ADD COLUMN capture_time REAL GENERATED ALWAYS AS (" DDB_CAPTURE_TIME_EXPR("") ") VIRTUAL;\n"
+        "CREATE INDEX IF NOT EXISTS ix_entries_capture_time ON entries (capture_time);\n";
+
+    // Schema version 4/5 stored capture_time as a plain column kept in sync by triggers
+    const char *dropStoredCaptureTimeDdl = R"<<<(
+  DROP TRIGGER IF EXISTS tg_entries_capture_time_insert;
+  DROP TRIGGER IF EXISTS tg_entries_capture_time_update;
+  DROP INDEX IF EXISTS ix_entries_capture_time;
+  ALTER TABLE entries DROP COLUMN capture_time;
+)<<<";
+
+#undef DDB_CAPTURE_TIME_EXPR
+
     const char *passwordsTableDdl = R"<<<(
   CREATE TABLE IF NOT EXISTS passwords (
       salt TEXT,
@@ -98,11 +128,96 @@ BEGIN
 END;
 )<<<";
 
+    const char *fingerprintCacheTableDdl = R"<<<(
+  CREATE TABLE IF NOT EXISTS fingerprint_cache (
+      device INTEGER NOT NULL,
+      inode INTEGER NOT NULL,
+      size INTEGER NOT NULL,
+      mtime_ns INTEGER NOT NULL,
+      hash TEXT NOT NULL,
+      type INTEGER,
+      entry TEXT,
+      parser TEXT,
+      PRIMARY KEY (device, inode)
+  );
+)<<<";
+
+    // Parent directory of a path ("" at the top level): rtrim() with every
+    // character of the path but '/' strips its last component
+#define DDB_PARENT_PATH_EXPR(p) "rtrim(rtrim(" p ", replace(" p ", '/', '')), '/')"
+
+    // Merkle tree of the stamp (see merkle.h). Triggers mark the nodes above
+    // changed rows as dirty; hashes are recomputed by MerkleIndex::refresh
+    const char *merkleDdl =
+        "CREATE TABLE IF NOT EXISTS merkle_nodes (\n"
+        "    tree INTEGER NOT NULL,\n"
+        "    path TEXT NOT NULL,\n"
+        "    depth INTEGER NOT NULL,\n"
+        "    hash TEXT NOT NULL,\n"
+        "    PRIMARY KEY (tree, path)\n"
+        ");\n"
+        "CREATE INDEX IF NOT EXISTS ix_merkle_nodes_depth ON merkle_nodes (tree, depth, path);\n"
+        "CREATE TABLE IF NOT EXISTS merkle_dirty (\n"
+        "    tree INTEGER NOT NULL,\n"
+        "    path TEXT NOT NULL,\n"
+        "    PRIMARY KEY (tree, path)\n"
+        ");\n"
+        "CREATE INDEX IF NOT EXISTS ix_entries_depth_path ON entries (depth, path);\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_merkle_insert\n"
+        "AFTER INSERT ON entries\n"
+        "FOR EACH ROW\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (0, " DDB_PARENT_PATH_EXPR("NEW.path") ");\n"
+        "END;\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_merkle_update\n"
+        "AFTER UPDATE OF path, hash, type, depth ON entries\n"
+        "FOR EACH ROW\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (0, " DDB_PARENT_PATH_EXPR("OLD.path") ");\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (0, " DDB_PARENT_PATH_EXPR("NEW.path") ");\n"
+        "END;\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_merkle_delete\n"
+        "AFTER DELETE ON entries\n"
+        "FOR EACH ROW\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (0, " DDB_PARENT_PATH_EXPR("OLD.path") ");\n"
+        "END;\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_meta_merkle_insert\n"
+        "AFTER INSERT ON entries_meta\n"
+        "FOR EACH ROW\n"
+        "WHEN (NEW.id IS NOT NULL)\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (1, substr(NEW.id, 1, 2));\n"
+        "END;\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_meta_merkle_update\n"
+        "AFTER UPDATE OF id ON entries_meta\n"
+        "FOR EACH ROW\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) SELECT 1, substr(OLD.id, 1, 2) WHERE OLD.id IS NOT NULL;\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) SELECT 1, substr(NEW.id, 1, 2) WHERE NEW.id IS NOT NULL;\n"
+        "END;\n"
+        "CREATE TRIGGER IF NOT EXISTS tg_entries_meta_merkle_delete\n"
+        "AFTER DELETE ON entries_meta\n"
+        "FOR EACH ROW\n"
+        "WHEN (OLD.id IS NOT NULL)\n"
+        "BEGIN\n"
+        "   INSERT OR IGNORE INTO merkle_dirty (tree, path) VALUES (1, substr(OLD.id, 1, 2));\n"
+        "END;\n"
+        // Existing rows
+        "INSERT OR IGNORE INTO merkle_dirty (tree, path) SELECT DISTINCT 0, " DDB_PARENT_PATH_EXPR("path") " FROM entries;\n"
+        "INSERT OR IGNORE INTO merkle_dirty (tree, path) SELECT DISTINCT 1, substr(id, 1, 2) FROM entries_meta WHERE id IS NOT NULL;\n";
+
+#undef DDB_PARENT_PATH_EXPR
+
     Database &Database::createTables()
     {
         const std::string sql = std::string(entriesTableDdl) + '\n' +
+                                spatialIndexesDdl + '\n' +
+                                captureTimeDdl + '\n' +
                                 passwordsTableDdl + '\n' +
-                                entriesMetaTableDdl;
+                                entriesMetaTableDdl + '\n' +
+                                fingerprintCacheTableDdl + '\n' +
+                                merkleDdl;
 
         LOGD << "About to create tables...";
         this->exec(sql);
@@ -201,15 +316,84 @@ END;
                 LOGD << "Dropped attributes table";
             }
 
-            // Mark database as migrated to current version
-            this->setUserVersion(DDB_SCHEMA_VERSION);
-            LOGD << "Database migrated to schema version " << DDB_SCHEMA_VERSION;
+        }
+
+        // Migration 1 --> 2
+        // Added the fingerprint_cache table
+        if (dbVersion < 2)
+        {
+            LOGD << "Creating fingerprint cache table";
+            this->exec(fingerprintCacheTableDdl);
+        }
+
+        // Migration 2 --> 3
+        // Added R*Tree spatial indexes on entry geometries
+        // (populated from the existing rows and kept up to date by SpatiaLite triggers)
+        if (dbVersion < 3)
+        {
+            LOGD << "Creating spatial indexes";
+            this->exec(spatialIndexesDdl);
+        }
+
+        // Migration 3 --> 4
+        // Added the entries.capture_time column (with index)
+        if (dbVersion < 4)
+        {
+            Transaction tx(this, Transaction::Mode::Immediate);
+
+            // Another process might have migrated the database while we waited for the lock
+            // (pragma_table_info does not list generated columns, pragma_table_xinfo does)
+            const auto q = this->query("SELECT COUNT(*) FROM pragma_table_xinfo('entries') WHERE name = 'capture_time'");
+            if (q->fetch() && q->getInt(0) == 0)
+            {
+                LOGD << "Adding capture time column";
+                this->exec(captureTimeDdl);
+            }
+
+            tx.commit();
+        }
+
+        // Migration 4 --> 5
+        // Added the Merkle tree of the stamp (merkle_nodes, merkle_dirty and their triggers)
+        if (dbVersion < 5)
+        {
+            Transaction tx(this, Transaction::Mode::Immediate);
+            LOGD << "Creating Merkle tree tables";
+            this->exec(merkleDdl);
+            tx.commit();
+        }
+
+        // Migration 5 --> 6
+        // entries.capture_time became a virtual generated column (no more triggers)
+        if (dbVersion < 6)
+        {
+            Transaction tx(this, Transaction::Mode::Immediate);
+
+            // hidden = 0 is a plain column, 2 and 3 are generated ones. The statement is
+            // finalized before altering the table
+            bool storedColumn;
+            {
+                const auto q = this->query("SELECT COUNT(*) FROM pragma_table_xinfo('entries') WHERE name = 'capture_time' AND hidden = 0");
+                storedColumn = q->fetch() && q->getInt(0) > 0;
+            }
+
+            if (storedColumn)
+            {
+                LOGD << "Converting capture time to a generated column";
+                this->exec(dropStoredCaptureTimeDdl);
+                this->exec(captureTimeDdl);
+            }
+
+            tx.commit();
         }
 
         // Future migrations would be added here:
-        // if (dbVersion < 2) { runMigration_1_to_2(); }
-        // if (dbVersion < 3) { runMigration_2_to_3(); }
+        // if (dbVersion < 7) { runMigration_6_to_7(); }
         // etc.
+
+        // Mark database as migrated to current version
+        this->setUserVersion(DDB_SCHEMA_VERSION);
+        LOGD << "Database migrated to schema version " << DDB_SCHEMA_VERSION;
     }
 
     json Database::getProperties() const
@@ -501,6 +685,68 @@ END;
         }
     }
 
+    std::string Database::bboxFilter(int firstParam, const std::string &alias)
+    {
+        const std::string col = alias.empty() ? "" : alias + ".";
+        const std::string minx = "?" + std::to_string(firstParam);
+        const std::string miny = "?" + std::to_string(firstParam + 1);
+        const std::string maxx = "?" + std::to_string(firstParam + 2);
+        const std::string maxy = "?" + std::to_string(firstParam + 3);
+
+        const std::string exact = "MbrIntersects(BuildMbr(" + minx + ", " + miny + ", " + maxx + ", " + maxy + ", 4326), "
+                                  "CASE WHEN " + col + "polygon_geom IS NOT NULL THEN " + col + "polygon_geom ELSE " + col + "point_geom END)";
+
+        // Databases whose spatial index could not be created fall back to a full scan
+        if (!this->tableExists("idx_entries_polygon_geom") || !this->tableExists("idx_entries_point_geom"))
+            return exact;
+
+        const auto candidates = [&](const std::string &column)
+        {
+            return "SELECT pkid FROM idx_entries_" + column + " WHERE xmin <= " + maxx + " AND xmax >= " + minx +
+                   " AND ymin <= " + maxy + " AND ymax >= " + miny;
+        };
+
+        // The R*Tree stores float MBRs rounded outwards, so its candidates are a superset;
+        // the exact test keeps results identical to the unindexed query
+        return "(" + col + "rowid IN (" + candidates("polygon_geom") + " UNION " + candidates("point_geom") + ") AND " + exact + ")";
+    }
+
+    int bindBbox(Statement *q, int firstParam, const std::vector<double> &bbox)
+    {
+        if (bbox.size() != 4)
+            throw InvalidArgsException("bbox must contain exactly 4 values");
+
+        // Corners in any order, like BuildMbr
+        q->bind(firstParam, std::min(bbox[0], bbox[2]));
+        q->bind(firstParam + 1, std::min(bbox[1], bbox[3]));
+        q->bind(firstParam + 2, std::max(bbox[0], bbox[2]));
+        q->bind(firstParam + 3, std::max(bbox[1], bbox[3]));
+
+        return firstParam + 4;
+    }
+
+    std::vector<double> parseBbox(const std::string &bbox)
+    {
+        std::vector<double> values;
+        std::stringstream ss(bbox);
+        std::string token;
+        while (std::getline(ss, token, ','))
+        {
+            try
+            {
+                values.push_back(std::stod(token));
+            }
+            catch (...)
+            {
+                throw InvalidArgsException("Invalid bbox value: " + token);
+            }
+        }
+        if (values.size() != 4)
+            throw InvalidArgsException("bbox must contain exactly 4 comma-separated values");
+
+        return values;
+    }
+
     json wktBboxCoordinates(const std::string &wktBbox)
     {
         std::vector<double> values;
@@ -8,8 +8,15 @@
 #include "status.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <future>
+#include <map>
 #include <mutex>
 #include <system_error>
 #include <thread>
@@ -18,6 +25,7 @@
 #include "entry_types.h"
 #include "exceptions.h"
 #include "exif.h"
+#include "fingerprintcache.h"
 #include "hash.h"
 #include "logger.h"
 #include "mio.h"
@@ -40,9 +48,16 @@ static std::mutex g_dbOpenMutex;
 
 #define UPDATE_QUERY                                                              \
     "UPDATE entries SET hash=?, type=?, properties=?, mtime=?, size=?, depth=?, " \
-    "point_geom=GeomFromText(?, 4326), polygon_geom=GeomFromText(?, 4326) "       \
+    "point_geom=?, polygon_geom=? "                                               \
     "WHERE path=?"
 
+    // Geometries are bound as SpatiaLite BLOBs, empty ones as NULL
+    static void bindGeometry(Statement *q, int paramNum, const BasicGeometry &g)
+    {
+        const auto blob = g.toSpatialiteBlob();
+        q->bind(paramNum, blob.empty() ? nullptr : blob.data(), static_cast<int>(blob.size()));
+    }
+
     std::unique_ptr<Database> open(const std::string &directory,
                                    bool traverseUp = false)
     {
@@ -483,8 +498,8 @@ static std::mutex g_dbOpenMutex;
         updateQ->bind(4, static_cast<long long>(e.mtime));
         updateQ->bind(5, static_cast<long long>(e.size));
         updateQ->bind(6, e.depth);
-        updateQ->bind(7, e.point_geom.toWkt());
-        updateQ->bind(8, e.polygon_geom.toWkt());
+        bindGeometry(updateQ, 7, e.point_geom);
+        bindGeometry(updateQ, 8, e.polygon_geom);
 
         // Where
         updateQ->bind(9, e.path);
@@ -492,10 +507,349 @@ static std::mutex g_dbOpenMutex;
         updateQ->execute();
     }
 
-    void listIndex(Database *db, const std::vector<std::string> &paths, std::ostream &output, const std::string &format, bool recursive, int maxRecursionDepth)
+    namespace
     {
-        if (format != "json" && format != "text")
-            throw InvalidArgsException("Invalid format " + format);
+        // Entries with lo <= path < hi and depth <= maxDepth (any depth if negative)
+        struct ListRange
+        {
+            std::string lo;
+            std::string hi;
+            int maxDepth;
+
+            bool contains(const std::string &path, int depth) const
+            {
+                return path >= lo && path < hi && (maxDepth < 0 || depth <= maxDepth);
+            }
+        };
+
+        // JSON string literal (as dumped by nlohmann::json)
+        std::string jsonString(const std::string &s)
+        {
+            std::string res;
+            res.reserve(s.size() + 2);
+            res += '"';
+            for (const char c : s)
+            {
+                switch (c)
+                {
+                case '"':
+                    res += "\\\"";
+                    break;
+                case '\\':
+                    res += "\\\\";
+                    break;
+                case '\b':
+                    res += "\\b";
+                    break;
+                case '\f':
+                    res += "\\f";
+                    break;
+                case '\n':
+                    res += "\\n";
+                    break;
+                case '\r':
+                    res += "\\r";
+                    break;
+                case '\t':
+                    res += "\\t";
+                    break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                        res += buf;
+                    }
+                    else
+                        res += c;
+                }
+            }
+            res += '"';
+            return res;
+        }
+
+        // Reads entries_meta in path order alongside an entries cursor, so that
+        // the meta of all listed entries comes from a single query
+        class MetaCursor
+        {
+            std::unique_ptr<Statement> q;
+            bool hasRow;
+
+        public:
+            // hi empty means no upper bound
+            MetaCursor(Database *db, const std::string &lo, const std::string &hi)
+            {
+                q = db->query(std::string("SELECT path, key, id, data, mtime FROM entries_meta WHERE path >= ?") +
+                              (hi.empty() ? "" : " AND path < ?") + " ORDER BY path, key");
+                q->bind(1, lo);
+                if (!hi.empty())
+                    q->bind(2, hi);
+                hasRow = q->fetch();
+            }
+
+            // Meta of path in the format of the "meta" field of Entry::toJSON
+            // (empty if none); paths must be requested in ascending order
+            std::string take(const std::string &path)
+            {
+                while (hasRow && q->getText(0) < path)
+                    hasRow = q->fetch();
+
+                std::string meta;
+                std::string key;
+                std::vector<std::string> values;
+
+                const auto flush = [&]()
+                {
+                    if (values.empty())
+                        return;
+
+                    meta += meta.empty() ? "{" : ",";
+                    meta += jsonString(key) + ":";
+
+                    // Plural keys hold lists, singular keys their last value
+                    if (!key.empty() && key.back() == 's')
+                    {
+                        meta += "[";
+                        for (size_t i = 0; i < values.size(); i++)
+                            meta += (i > 0 ? "," : "") + values[i];
+                        meta += "]";
+                    }
+                    else
+                        meta += values.back();
+
+                    values.clear();
+                };
+
+                while (hasRow && q->getText(0) == path)
+                {
+                    const auto k = q->getText(1);
+                    if (k != key)
+                    {
+                        flush();
+                        key = k;
+                    }
+                    values.push_back("{\"data\":" + q->getText(3) + ",\"id\":" + jsonString(q->getText(2)) +
+                                     ",\"mtime\":" + std::to_string(q->getInt64(4)) + "}");
+                    hasRow = q->fetch();
+                }
+                flush();
+
+                if (!meta.empty())
+                    meta += "}";
+                return meta;
+            }
+        };
+
+        // Writes entries straight from query rows (path, hash, type, properties, mtime, size, depth,
+        // point_geom, polygon_geom), one at a time,
+        // without building an Entry or a json object for each of them. The JSON
+        // format matches Entry::toJSON.
+        class EntryStreamWriter
+        {
+            std::ostream &out;
+            bool json;
+            bool first = true;
+
+            void writeNumber(double v)
+            {
+                if (!std::isfinite(v))
+                {
+                    out << "null";
+                    return;
+                }
+
+                // Shortest representation that reads back the same value
+                char buf[32];
+                for (int precision = 15; precision <= 17; precision++)
+                {
+                    snprintf(buf, sizeof(buf), "%.*g", precision, v);
+                    if (strtod(buf, nullptr) == v)
+                        break;
+                }
+                out << buf;
+                if (strpbrk(buf, ".e") == nullptr)
+                    out << ".0";
+            }
+
+            void writePoint(const Point &p)
+            {
+                out << "[";
+                writeNumber(p.x);
+                out << ",";
+                writeNumber(p.y);
+                out << ",";
+                writeNumber(p.z);
+                out << "]";
+            }
+
+            // Same as BasicGeometry::toGeoJSON
+            void writeGeometry(const BasicGeometry &g, bool polygon)
+            {
+                out << "{\"crs\":{\"properties\":{\"name\":\"EPSG:4326\"},\"type\":\"name\"},\"geometry\":{\"coordinates\":";
+                if (polygon)
+                {
+                    out << "[[";
+                    for (size_t i = 0; i < g.points.size(); i++)
+                    {
+                        if (i > 0)
+                            out << ",";
+                        writePoint(g.points[i]);
+                    }
+                    out << "]]";
+                }
+                else
+                    writePoint(g.points[0]);
+                out << ",\"type\":\"" << (polygon ? "Polygon" : "Point") << "\"},\"properties\":{},\"type\":\"Feature\"}";
+            }
+
+        public:
+            EntryStreamWriter(std::ostream &out, const std::string &format) : out(out), json(format == "json")
+            {
+                if (format != "json" && format != "text")
+                    throw InvalidArgsException("Invalid format " + format);
+            }
+
+            bool needsMeta() const
+            {
+                return json;
+            }
+
+            void begin()
+            {
+                if (json)
+                    out << "[";
+            }
+
+            void end()
+            {
+                if (json)
+                    out << "]";
+            }
+
+            void write(Statement *q, const std::string &meta)
+            {
+                const auto path = q->getText(0);
+                if (!json)
+                {
+                    out << path << "\n";
+                    return;
+                }
+
+                if (!first)
+                    out << ",";
+                first = false;
+
+                // Keys in the (sorted) order of a dumped json object
+                out << "{\"depth\":" << q->getInt(6);
+                const auto hash = q->getText(1);
+                if (!hash.empty())
+                {
+                    out << ",\"hash\":";
+                    out << jsonString(hash);
+                }
+                if (!meta.empty())
+                    out << ",\"meta\":" << meta;
+                out << ",\"mtime\":" << q->getInt64(4) << ",\"path\":";
+                out << jsonString(path);
+
+                BasicPointGeometry point;
+                if (point.fromSpatialiteBlob(q->getBlob(7), q->getBlobSize(7)) && !point.empty())
+                {
+                    out << ",\"point_geom\":";
+                    writeGeometry(point, false);
+                }
+                BasicPolygonGeometry polygon;
+                if (polygon.fromSpatialiteBlob(q->getBlob(8), q->getBlobSize(8)) && !polygon.empty())
+                {
+                    out << ",\"polygon_geom\":";
+                    writeGeometry(polygon, true);
+                }
+
+                // Stored as dumped JSON, written as is
+                const auto properties = q->getText(3);
+                if (!properties.empty() && properties != "null" && properties != "{}" && properties != "[]")
+                    out << ",\"properties\":" << properties;
+
+                out << ",\"size\":" << q->getInt64(5) << ",\"type\":" << q->getInt(2) << "}";
+            }
+        };
+
+        // Streams the entries in the ranges in path order, each once, starting
+        // after the given path. Overlapping ranges are read with a single query.
+        // Stops after limit entries (0 = no limit) and returns the path of the last
+        // one written if more are left, an empty string otherwise.
+        std::string streamRanges(Database *db, std::vector<ListRange> ranges, EntryStreamWriter &writer,
+                                 const std::string &after, int limit)
+        {
+            std::sort(ranges.begin(), ranges.end(), [](const ListRange &l, const ListRange &r)
+                      { return l.lo < r.lo; });
+
+            // Just after "after" (no path is in between)
+            const std::string start = after.empty() ? "" : after + std::string(1, '\0');
+
+            auto q = db->cachedQuery("SELECT path, hash, type, properties, mtime, size, depth, point_geom, polygon_geom "
+                                     "FROM entries WHERE path >= ? AND path < ? ORDER BY path");
+            int written = 0;
+            std::string last;
+
+            writer.begin();
+            for (size_t i = 0; i < ranges.size();)
+            {
+                // Window of overlapping ranges
+                size_t j = i + 1;
+                std::string hi = ranges[i].hi;
+                while (j < ranges.size() && ranges[j].lo < hi)
+                    hi = std::max(hi, ranges[j++].hi);
+
+                const std::string lo = std::max(ranges[i].lo, start);
+                if (lo < hi)
+                {
+                    std::unique_ptr<MetaCursor> meta;
+                    if (writer.needsMeta())
+                        meta = std::make_unique<MetaCursor>(db, lo, hi);
+
+                    q->bind(1, lo);
+                    q->bind(2, hi);
+                    while (q->fetch())
+                    {
+                        const auto path = q->getText(0);
+                        const int depth = q->getInt(6);
+                        bool listed = false;
+                        for (size_t k = i; k < j && !listed; k++)
+                            listed = ranges[k].contains(path, depth);
+                        if (!listed)
+                            continue;
+
+                        if (limit > 0 && written == limit)
+                        {
+                            q->reset();
+                            writer.end();
+                            return last;
+                        }
+
+                        writer.write(q, meta ? meta->take(path) : "");
+                        last = path;
+                        written++;
+                    }
+                    q->reset();
+                }
+
+                i = j;
+            }
+            writer.end();
+
+            return "";
+        }
+
+    } // namespace
+
+    std::string listIndex(Database *db, const std::vector<std::string> &paths, std::ostream &output, const std::string &format,
+                          bool recursive, int maxRecursionDepth, const std::string &after, int limit)
+    {
+        EntryStreamWriter writer(output, format);
+
+        if (maxRecursionDepth < 0)
+            throw FSException("Max recursion depth cannot be negative");
 
         const fs::path directory = db->rootDirectory();
         std::vector<fs::path> pathList;
@@ -514,9 +868,11 @@ static std::mutex g_dbOpenMutex;
         else
             pathList = std::vector<fs::path>(paths.begin(), paths.end());
 
-        std::vector<Entry> baseEntries;
+        // Entries matching the requested paths (type and depth), without their contents
+        std::map<std::string, std::pair<int, int>> baseEntries;
         bool expandFolders = recursive;
 
+        auto q = db->cachedQuery("SELECT path, type, depth FROM entries WHERE path LIKE ? ESCAPE '/' AND depth <= ?");
         for (const fs::path &path : pathList)
         {
             io::Path relPath = io::Path(path).relativeTo(directory);
@@ -526,107 +882,68 @@ static std::mutex g_dbOpenMutex;
             // Let's expand only if we were asked to list a different folder
             expandFolders = expandFolders || pathStr.length() > 0;
 
-            const auto depth = static_cast<int>(count(pathStr.begin(), pathStr.end(), '/'));
-            std::vector<Entry> matches = getMatchingEntries(db, relPath.generic(), depth + 1);
-            baseEntries.insert(baseEntries.end(), matches.begin(), matches.end());
-        }
-
-        // Remove duplicates
-        sort(baseEntries.begin(), baseEntries.end(), [](const Entry &l, const Entry &r)
-             { return l.path < r.path; });
-        baseEntries.erase(unique(baseEntries.begin(), baseEntries.end(), [](const Entry &l, const Entry &r)
-                                 { return l.path == r.path; }),
-                          baseEntries.end());
+            auto pattern = sanitize_query_param(pathStr);
+            if (pattern.empty())
+                pattern = "%";
 
-        // Sort by type
-        sort(baseEntries.begin(), baseEntries.end(), [](const Entry &l, const Entry &r)
-             { return l.type < r.type; });
+            q->bind(1, pattern);
+            q->bind(2, static_cast<int>(count(pathStr.begin(), pathStr.end(), '/')));
+            while (q->fetch())
+                baseEntries[q->getText(0)] = std::make_pair(q->getInt(1), q->getInt(2));
+            q->reset();
+        }
 
         const bool isSingle = pathList.size() == baseEntries.size();
 
-        std::vector<Entry> outputEntries;
-
-        for (const Entry &entry : baseEntries)
+        std::vector<ListRange> ranges;
+        for (const auto &b : baseEntries)
         {
-            if (entry.type != Directory)
-                outputEntries.emplace_back(Entry(entry));
-            else
-            {
-                if (!isSingle || !expandFolders)
-                    outputEntries.emplace_back(Entry(entry));
-
-                if (expandFolders)
-                {
-                    const auto depth = recursive ? maxRecursionDepth : entry.depth + 2;
-                    std::vector<Entry> entries = getMatchingEntries(db, entry.path, depth, true);
-                    for (const Entry &e : entries)
-                        outputEntries.emplace_back(Entry(e));
-                }
-            }
-        }
+            const auto &path = b.first;
+            const bool isDirectory = b.second.first == Directory;
 
-        // Sort by path
-        std::sort(outputEntries.begin(), outputEntries.end(), [](const Entry &l, const Entry &r)
-                  { return l.path < r.path; });
+            if (!isDirectory || !isSingle || !expandFolders)
+                ranges.push_back({path, path + std::string(1, '\0'), -1});
 
-        if (format == "text")
-        {
-            for (auto &e : outputEntries)
+            // Folder contents: "path/..." sorts before "path0"
+            if (isDirectory && expandFolders)
             {
-                output << e.path << std::endl;
+                const int maxDepth = recursive ? maxRecursionDepth - 1 : b.second.second + 1;
+                ranges.push_back({path + "/", path + "0", maxDepth});
             }
         }
-        else if (format == "json")
-        {
-            output << "[";
-            bool first = true;
 
-            for (auto &e : outputEntries)
-            {
+        return streamRanges(db, ranges, writer, after, limit);
+    }
 
-                json j;
-                e.toJSON(j);
-                if (!first)
-                    output << ",";
-                output << j.dump();
+    void searchIndex(Database *db, const std::string &query, std::ostream &out, const std::string &format,
+                     const std::vector<double> &bbox)
+    {
+        EntryStreamWriter writer(out, format);
 
-                first = false;
-            }
+        auto pattern = sanitize_query_param(query);
+        if (pattern.empty())
+            pattern = "%";
 
-            output << "]";
-        }
-        else
-        {
-            throw InvalidArgsException("Unsupported format '" + format + "'");
-        }
-    }
+        std::string sql = "SELECT path, hash, type, properties, mtime, size, depth, point_geom, polygon_geom "
+                          "FROM entries e WHERE e.path LIKE ? ESCAPE '/'";
+        if (!bbox.empty())
+            sql += " AND " + db->bboxFilter(2, "e");
+        sql += " ORDER BY e.path";
 
-    void searchIndex(Database *db, const std::string &query, std::ostream &out, const std::string &format)
-    {
-        auto entries = getMatchingEntries(db, query, 0, false);
-        std::sort(entries.begin(), entries.end(), [](const Entry &l, const Entry &r)
-                  { return l.path < r.path; });
+        auto q = db->cachedQuery(sql);
+        q->bind(1, pattern);
+        if (!bbox.empty())
+            bindBbox(q, 2, bbox);
 
-        if (format == "text")
-        {
-            for (auto &e : entries)
-                out << e.path << std::endl;
-        }
-        else if (format == "json")
-        {
-            out << "[";
-            bool first = true;
-            for (auto &e : entries)
-            {
-                json j;
-                e.toJSON(j);
-                if (!first)
-                    out << ",";
-                out << j.dump();
-                first = false;
-            }
-            out << "]";
-        }
+        std::unique_ptr<MetaCursor> meta;
+        if (writer.needsMeta())
+            meta = std::make_unique<MetaCursor>(db, "", "");
+
+        writer.begin();
+        while (q->fetch())
+            writer.write(q, meta ? meta->take(q->getText(0)) : "");
+        writer.end();
+        q->reset();
     }
 
     namespace {
@@ -639,6 +956,11 @@ static std::mutex g_dbOpenMutex;
         bool existsInDb = false;
         long long dbMtime = 0;
         std::string dbHash;
+
+        // Fingerprint cache hit for the identity observed at PLAN time
+        bool hasCached = false;
+        FileIdentity identity;
+        CachedFingerprint cached;
     };
 
     // Result of the COMPUTE phase: a fully parsed entry, ready to be written. Computed with
@@ -648,15 +970,35 @@ static std::mutex g_dbOpenMutex;
         bool isUpdate = false;
         long long observedMtime = 0;
         long long observedSize = 0;
+
+        // Identity stat'ed before reading the file; recorded in the fingerprint cache on commit
+        bool hasIdentity = false;
+        FileIdentity identity;
+    };
+
+    // Everything COMPUTE hands over to COMMIT: entries to write, plus unchanged files whose
+    // content hash had to be recomputed (touched but identical) and is worth caching.
+    struct ComputedBatch {
+        std::vector<ComputedAddItem> items;
+        std::vector<std::pair<FileIdentity, std::string>> refreshedHashes;
+
+        bool empty() const { return items.empty() && refreshedHashes.empty(); }
+        void clear() {
+            items.clear();
+            refreshedHashes.clear();
+        }
     };
 
     // PLAN: short, read-only pass over the index. No write lock is ever taken here.
+    // Hashes in knownHashes are trusted like a hash-only fingerprint cache hit
     std::vector<PlannedAddItem> planAddCandidates(Database *db, const std::vector<fs::path> &pathList,
-                                                  const fs::path &directory) {
+                                                  const fs::path &directory,
+                                                  const std::unordered_map<std::string, std::string> &knownHashes = {}) {
         std::vector<PlannedAddItem> planned;
         planned.reserve(pathList.size());
 
         auto q = db->query("SELECT mtime,hash FROM entries WHERE path=?");
+        FingerprintCache cache(db);
 
         for (auto &p : pathList) {
             io::Path relPath = io::Path(p).relativeTo(directory);
@@ -681,76 +1023,148 @@ static std::mutex g_dbOpenMutex;
             }
             q->reset();
 
+            if (getFileIdentity(p, item.identity)) {
+                item.hasCached = cache.lookup(item.identity, item.cached);
+
+                const auto known = knownHashes.find(item.relPath);
+                if (!item.hasCached && known != knownHashes.end()) {
+                    item.hasCached = true;
+                    item.cached.hash = known->second;
+                }
+            }
+
             planned.push_back(std::move(item));
         }
 
         return planned;
     }
 
-    // COMPUTE: hashing, fingerprinting, EXIF/GDAL/PDAL metadata extraction. No transaction is
-    // held during this phase; this is the part that used to run for the whole duration of the
-    // write lock (C1/I1).
+    // Outcome of computing a single planned item.
+    enum class ComputeStatus { Computed, Unchanged, Failed };
+
+    struct ComputeOutcome {
+        ComputeStatus status = ComputeStatus::Failed;
+        ComputedAddItem item;
+        AddItemError error;
+        bool refreshedHash = false; // Unchanged, but item.entry.hash was recomputed
+    };
+
+    // COMPUTE for one item: hashing, fingerprinting, EXIF/GDAL/PDAL metadata extraction.
+    // Touches the filesystem only (never the database connection), so it is safe to run on
+    // worker threads.
     //
     // Item-scoped exceptions (FSException, GDALException, PDALException, JSONException,
-    // IndexException) are captured into `errors` when `stopOnError` is false; with
-    // `stopOnError` true they propagate and abort the whole call, matching addToIndex()'s
-    // original all-or-nothing semantics. Database-scoped exceptions (DBException,
+    // IndexException) are captured into the outcome when `stopOnError` is false; with
+    // `stopOnError` true they propagate. Database-scoped exceptions (DBException,
     // DBBusyException, bad_alloc, anything else) always propagate.
-    std::vector<ComputedAddItem> computeAddEntries(const std::vector<PlannedAddItem> &planned,
-                                                    const fs::path &directory, bool stopOnError,
-                                                    std::vector<AddItemError> &errors,
-                                                    std::vector<std::string> &unchanged) {
-        std::vector<ComputedAddItem> computed;
-        computed.reserve(planned.size());
-
-        for (auto &item : planned) {
-            Entry e;
-            bool add = false;
-            bool update = false;
-
-            if (item.existsInDb) {
-                const auto status = checkUpdate(e, item.absPath, item.dbMtime, item.dbHash);
-                update = status != FileStatus::NotModified;
-                if (!update) {
-                    unchanged.push_back(item.relPath);
-                    continue;
+    ComputeOutcome computeAddItem(const PlannedAddItem &item, const fs::path &directory, bool stopOnError) {
+        ComputeOutcome out;
+        Entry e;
+        bool add = false;
+
+        // The PLAN-time cache hit is only trusted if the file still has the same identity
+        FileIdentity identity;
+        const bool hasIdentity = getFileIdentity(item.absPath, identity);
+        const bool cacheHit = hasIdentity && item.hasCached && identity == item.identity;
+
+        if (item.existsInDb) {
+            if (cacheHit) {
+                e.mtime = io::Path(item.absPath).getModifiedTime();
+                if (e.mtime == item.dbMtime || item.cached.hash == item.dbHash) {
+                    out.status = ComputeStatus::Unchanged;
+                    return out;
                 }
             } else {
-                add = true;
+                const auto status = checkUpdate(e, item.absPath, item.dbMtime, item.dbHash);
+                if (status == FileStatus::NotModified) {
+                    out.status = ComputeStatus::Unchanged;
+                    if (hasIdentity && !e.hash.empty()) {
+                        out.refreshedHash = true;
+                        out.item.identity = identity;
+                        out.item.entry.hash = e.hash;
+                    }
+                    return out;
+                }
             }
+        } else {
+            add = true;
+        }
 
-            try {
-                // parseEntry() skips re-hashing if checkUpdate() already set e.hash.
+        try {
+            if (cacheHit && item.cached.hasEntry) {
+                item.cached.toEntry(item.absPath, directory, identity, e);
+            } else {
+                if (cacheHit)
+                    e.hash = item.cached.hash;
+
+                // parseEntry() skips re-hashing if checkUpdate() or the cache already set e.hash.
                 parseEntry(item.absPath, directory, e, true);
-            } catch (const FSException &ex) {
-                if (stopOnError) throw;
-                errors.push_back({item.relPath, "FS", ex.what()});
-                continue;
-            } catch (const GDALException &ex) {
-                if (stopOnError) throw;
-                errors.push_back({item.relPath, "GDAL", ex.what()});
-                continue;
-            } catch (const PDALException &ex) {
-                if (stopOnError) throw;
-                errors.push_back({item.relPath, "PDAL", ex.what()});
-                continue;
-            } catch (const JSONException &ex) {
-                if (stopOnError) throw;
-                errors.push_back({item.relPath, "JSON", ex.what()});
-                continue;
-            } catch (const IndexException &ex) {
-                if (stopOnError) throw;
-                errors.push_back({item.relPath, "INDEX", ex.what()});
-                continue;
             }
+        } catch (const FSException &ex) {
+            if (stopOnError) throw;
+            out.error = {item.relPath, "FS", ex.what()};
+            return out;
+        } catch (const GDALException &ex) {
+            if (stopOnError) throw;
+            out.error = {item.relPath, "GDAL", ex.what()};
+            return out;
+        } catch (const PDALException &ex) {
+            if (stopOnError) throw;
+            out.error = {item.relPath, "PDAL", ex.what()};
+            return out;
+        } catch (const JSONException &ex) {
+            if (stopOnError) throw;
+            out.error = {item.relPath, "JSON", ex.what()};
+            return out;
+        } catch (const IndexException &ex) {
+            if (stopOnError) throw;
+            out.error = {item.relPath, "INDEX", ex.what()};
+            return out;
+        }
+
+        out.status = ComputeStatus::Computed;
+        out.item.isUpdate = !add;
+        out.item.observedMtime = e.mtime;
+        out.item.observedSize = static_cast<long long>(e.size);
+        out.item.hasIdentity = hasIdentity;
+        out.item.identity = identity;
+        out.item.entry = std::move(e);
+        return out;
+    }
 
-            ComputedAddItem ci;
-            ci.isUpdate = !add;
-            ci.observedMtime = e.mtime;
-            ci.observedSize = static_cast<long long>(e.size);
-            ci.entry = std::move(e);
-            computed.push_back(std::move(ci));
+    // Routes an outcome into the unchanged/errors buckets, or into `computed` for COMMIT.
+    void collectOutcome(ComputeOutcome &&out, const PlannedAddItem &item,
+                        ComputedBatch &computed,
+                        std::vector<AddItemError> &errors,
+                        std::vector<std::string> &unchanged) {
+        switch (out.status) {
+            case ComputeStatus::Unchanged:
+                unchanged.push_back(item.relPath);
+                if (out.refreshedHash)
+                    computed.refreshedHashes.emplace_back(out.item.identity, std::move(out.item.entry.hash));
+                break;
+            case ComputeStatus::Failed:
+                errors.push_back(std::move(out.error));
+                break;
+            case ComputeStatus::Computed:
+                computed.items.push_back(std::move(out.item));
+                break;
         }
+    }
+
+    // COMPUTE: serial pass over all planned items. No transaction is held during this phase;
+    // this is the part that used to run for the whole duration of the write lock (C1/I1).
+    // With `stopOnError` true an item-scoped exception aborts the whole call, matching
+    // addToIndex()'s original all-or-nothing semantics.
+    ComputedBatch computeAddEntries(const std::vector<PlannedAddItem> &planned,
+                                    const fs::path &directory, bool stopOnError,
+                                    std::vector<AddItemError> &errors,
+                                    std::vector<std::string> &unchanged) {
+        ComputedBatch computed;
+        computed.items.reserve(planned.size());
+
+        for (auto &item : planned)
+            collectOutcome(computeAddItem(item, directory, stopOnError), item, computed, errors, unchanged);
 
         return computed;
     }
@@ -761,28 +1175,32 @@ static std::mutex g_dbOpenMutex;
     // Items whose (mtime,size) changed since COMPUTE are reported via `conflicts` (absolute
     // paths) instead of being written with stale metadata; the caller decides whether to
     // re-plan them (addToIndexEx) or let them self-heal on the next add/rescan (addToIndex).
-    void commitAddEntries(Database *db, const std::vector<ComputedAddItem> &computed,
+    // Returns false if the callback canceled the operation (the batch was rolled back).
+    bool commitAddEntries(Database *db, const ComputedBatch &computed,
                           const fs::path &directory, AddCallback callback,
                           std::vector<std::pair<Entry, bool>> *accepted,
                           std::vector<fs::path> *conflicts,
                           std::vector<std::string> *unchanged) {
         if (computed.empty())
-            return;
+            return true;
 
         auto insertQ = db->query(
             "INSERT INTO entries (path, hash, type, properties, mtime, size, depth, "
             "point_geom, polygon_geom) "
-            "VALUES (?, ?, ?, ?, ?, ?, ?, GeomFromText(?, 4326), GeomFromText(?, "
-            "4326))");
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
         const auto updateQ = db->query(UPDATE_QUERY);
+        FingerprintCache cache(db);
 
         Transaction tx(db, Transaction::Mode::Immediate);
 
+        for (auto &refreshed : computed.refreshedHashes)
+            cache.storeHash(refreshed.first, refreshed.second);
+
         // Buffered locally and only merged into `accepted` after a successful commit, so a
         // canceled/rolled-back batch never reports rolled-back writes as committed.
         std::vector<std::pair<Entry, bool>> tentative;
 
-        for (auto &ci : computed) {
+        for (auto &ci : computed.items) {
             const fs::path absPath = directory / io::Path(ci.entry.path).get();
 
             // Re-validate filesystem state (mtime/size) between COMPUTE and COMMIT.
@@ -845,13 +1263,16 @@ static std::mutex g_dbOpenMutex;
                 insertQ->bind(5, static_cast<long long>(ci.entry.mtime));
                 insertQ->bind(6, static_cast<long long>(ci.entry.size));
                 insertQ->bind(7, ci.entry.depth);
-                insertQ->bind(8, ci.entry.point_geom.toWkt());
-                insertQ->bind(9, ci.entry.polygon_geom.toWkt());
+                bindGeometry(insertQ.get(), 8, ci.entry.point_geom);
+                bindGeometry(insertQ.get(), 9, ci.entry.polygon_geom);
                 insertQ->execute();
             } else {
                 doUpdate(updateQ.get(), ci.entry);
             }
 
+            if (ci.hasIdentity)
+                cache.store(ci.identity, ci.entry);
+
             tentative.push_back({ci.entry, actuallyInsert});
 
             if (callback != nullptr)
@@ -859,7 +1280,7 @@ static std::mutex g_dbOpenMutex;
                     // tx's destructor rolls back; log it explicitly so a canceled batch
                     // is never a silent loss (C8).
                     LOGD << "Add operation canceled by callback, rolling back transaction";
-                    return;
+                    return false;
                 }
         }
 
@@ -867,12 +1288,118 @@ static std::mutex g_dbOpenMutex;
 
         if (accepted != nullptr)
             accepted->insert(accepted->end(), tentative.begin(), tentative.end());
+
+        return true;
+    }
+
+    int resolveJobs(int jobs) {
+        if (jobs > 0)
+            return jobs;
+        return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    // COMPUTE + COMMIT with a pool of `jobs` worker threads. Workers claim the next unclaimed
+    // item from a shared cursor, so one slow GeoTIFF never stalls the rest of the queue. The
+    // calling thread is the only one that touches the database connection: it consumes
+    // outcomes strictly in input order (deterministic output and callback order) and, when
+    // `stopOnError` is false, commits every `commitBatchSize` computed items while the
+    // workers keep going. With `stopOnError` true everything is committed in a single
+    // transaction at the end, preserving the all-or-nothing semantics of the serial path.
+    // Returns false if the callback canceled the operation.
+    bool computeAndCommitParallel(Database *db, const std::vector<PlannedAddItem> &planned,
+                                  const fs::path &directory, const AddOptions &options,
+                                  AddCallback callback, AddResult &result,
+                                  std::vector<fs::path> &conflicts) {
+        const size_t count = planned.size();
+        if (count == 0)
+            return true;
+
+        const size_t numThreads = std::min(static_cast<size_t>(resolveJobs(options.jobs)), count);
+        const size_t batchSize = options.commitBatchSize > 0 ? static_cast<size_t>(options.commitBatchSize)
+                                                             : static_cast<size_t>(AddOptions{}.commitBatchSize);
+
+        std::vector<ComputeOutcome> outcomes(count);
+        std::vector<std::exception_ptr> failures(count);
+        std::vector<char> ready(count, 0);
+        std::mutex readyMutex;
+        std::condition_variable readyCv;
+        std::atomic<size_t> cursor{0};
+        std::atomic<bool> stop{false};
+
+        auto worker = [&]() {
+            while (!stop) {
+                const size_t i = cursor.fetch_add(1);
+                if (i >= count)
+                    break;
+
+                ComputeOutcome out;
+                std::exception_ptr failure;
+                try {
+                    out = computeAddItem(planned[i], directory, options.stopOnError);
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    outcomes[i] = std::move(out);
+                    failures[i] = failure;
+                    ready[i] = 1;
+                }
+                readyCv.notify_one();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(numThreads);
+
+        // Always join the pool, including when an exception or a cancel unwinds this frame.
+        struct PoolGuard {
+            std::atomic<bool> &stop;
+            std::vector<std::thread> &workers;
+            ~PoolGuard() {
+                stop = true;
+                for (auto &t : workers)
+                    if (t.joinable()) t.join();
+            }
+        } guard{stop, workers};
+
+        for (size_t t = 0; t < numThreads; t++)
+            workers.emplace_back(worker);
+
+        LOGD << "Computing " << count << " entries on " << numThreads << " threads";
+
+        ComputedBatch pending;
+        pending.items.reserve(options.stopOnError ? count : std::min(batchSize, count));
+
+        for (size_t i = 0; i < count; i++) {
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyCv.wait(lock, [&] { return ready[i] != 0; });
+            }
+
+            // First failure in input order wins, independent of thread scheduling
+            if (failures[i])
+                std::rethrow_exception(failures[i]);
+
+            collectOutcome(std::move(outcomes[i]), planned[i], pending, result.errors, result.unchanged);
+
+            if (!options.stopOnError && pending.items.size() >= batchSize) {
+                if (!commitAddEntries(db, pending, directory, callback, &result.entries, &conflicts,
+                                      &result.unchanged))
+                    return false;
+                pending.clear();
+            }
+        }
+
+        return commitAddEntries(db, pending, directory, callback, &result.entries, &conflicts,
+                                &result.unchanged);
     }
 
     } // namespace
 
     void addToIndex(Database *db, const std::vector<std::string> &paths,
-                    AddCallback callback)
+                    AddCallback callback, const std::unordered_map<std::string, std::string> &knownHashes)
     {
         if (paths.empty())
             return; // Nothing to do
@@ -881,7 +1408,7 @@ static std::mutex g_dbOpenMutex;
 
         std::vector<AddItemError> discardedErrors;
         std::vector<std::string> discardedUnchanged;
-        auto planned = planAddCandidates(db, pathList, directory);
+        auto planned = planAddCandidates(db, pathList, directory, knownHashes);
         auto computed = computeAddEntries(planned, directory, /*stopOnError=*/true, discardedErrors, discardedUnchanged);
         commitAddEntries(db, computed, directory, callback, nullptr, nullptr, nullptr);
     }
@@ -900,12 +1427,21 @@ static std::mutex g_dbOpenMutex;
 
         for (int pass = 0; pass <= maxRetries && !pathList.empty(); ++pass) {
             auto planned = planAddCandidates(db, pathList, directory);
-            auto computed = computeAddEntries(planned, directory, options.stopOnError,
-                                              result.errors, result.unchanged);
 
             std::vector<fs::path> conflicts;
-            commitAddEntries(db, computed, directory, callback, &result.entries, &conflicts,
-                             &result.unchanged);
+            bool completed;
+            if (options.jobs == 1) {
+                auto computed = computeAddEntries(planned, directory, options.stopOnError,
+                                                  result.errors, result.unchanged);
+                completed = commitAddEntries(db, computed, directory, callback, &result.entries,
+                                             &conflicts, &result.unchanged);
+            } else {
+                completed = computeAndCommitParallel(db, planned, directory, options, callback,
+                                                     result, conflicts);
+            }
+
+            if (!completed)
+                return; // canceled by callback
 
             pathList = conflicts; // bounded re-plan: only what actually changed under us
         }
@@ -957,6 +1493,9 @@ static std::mutex g_dbOpenMutex;
             if (!tot)
                 throw FSException("No matching entries");
         }
+
+        FingerprintCache cache(db);
+        executeWithRetry([&cache] { cache.prune(); }, "removeFromIndex");
     }
 
     std::string sanitize_query_param(const std::string &str)
@@ -1116,7 +1655,8 @@ static std::mutex g_dbOpenMutex;
     }
 
     std::vector<Entry> getMatchingEntries(Database *db, const fs::path &path,
-                                          int maxRecursionDepth, bool isFolder)
+                                          int maxRecursionDepth, bool isFolder,
+                                          const std::vector<double> &bbox)
     {
         // 0 is ALL_DEPTHS
         if (maxRecursionDepth < 0)
@@ -1142,25 +1682,20 @@ static std::mutex g_dbOpenMutex;
 
         std::string sql = R"<<<(
         SELECT e.path, e.hash, e.type, e.properties, e.mtime, e.size, e.depth,
-        json_extract(AsGeoJSON(e.point_geom), '$.coordinates'), json_extract(AsGeoJSON(e.polygon_geom), '$.coordinates'),
-        CASE
-            WHEN em.id IS NULL THEN NULL
-            WHEN em.id IS NOT NULL THEN (
-                SELECT json_group_object(key, meta)
-                FROM (
-                    SELECT key, CASE WHEN substr(key, -1, 1) = 's'
-                                    THEN json_group_array(json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime))
-                                    ELSE json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime)
-                                END AS meta
-                    FROM entries_meta emi
-                    WHERE path = e.path
-                    GROUP BY key
-                )
+        e.point_geom, e.polygon_geom,
+        (
+            SELECT json_group_object(key, meta)
+            FROM (
+                SELECT key, CASE WHEN substr(key, -1, 1) = 's'
+                                THEN json_group_array(json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime))
+                                ELSE json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime)
+                            END AS meta
+                FROM entries_meta emi
+                WHERE path = e.path
+                GROUP BY key
             )
-        END AS meta
+        ) AS meta
         FROM entries e
-        LEFT JOIN entries_meta em
-        ON e.path = em.path
         WHERE
         e.path LIKE ? ESCAPE '/'
     )<<<";
@@ -1168,18 +1703,23 @@ static std::mutex g_dbOpenMutex;
         if (maxRecursionDepth > 0)
             sql += " AND e.depth <= " + std::to_string(maxRecursionDepth - 1);
 
-        auto q = db->query(sql);
+        if (!bbox.empty())
+            sql += " AND " + db->bboxFilter(2, "e");
+
+        auto q = db->cachedQuery(sql);
 
         std::vector<Entry> entries;
 
         q->bind(1, sanitized);
+        if (!bbox.empty())
+            bindBbox(q, 2, bbox);
 
         while (q->fetch())
         {
             Entry e(q->getText(0), q->getText(1), q->getInt(2), q->getText(3),
                     q->getInt64(4), q->getInt64(5), q->getInt(6),
-                    q->getText(7), q->getText(8),
-                    q->getText(9));
+                    "", "", q->getText(9));
+            e.parseGeometryBlobs(q->getBlob(7), q->getBlobSize(7), q->getBlob(8), q->getBlobSize(8));
             entries.push_back(e);
         }
 
@@ -1195,6 +1735,7 @@ static std::mutex g_dbOpenMutex;
         auto q = db->query("SELECT path,mtime,hash FROM entries");
         auto deleteQ = db->query("DELETE FROM entries WHERE path = ?");
         const auto updateQ = db->query(UPDATE_QUERY);
+        FingerprintCache cache(db);
 
         // Deliberately one IMMEDIATE transaction for the whole re-index (design choice, kept):
         // the entries table is always left in a consistent, fully re-parsed state, even for
@@ -1202,6 +1743,7 @@ static std::mutex g_dbOpenMutex;
         // writer lock for its entire duration; concurrent addToIndexEx callers see busy and
         // retry/jitter per RetryPolicy.
         Transaction tx(db, Transaction::Mode::Immediate);
+        bool deleted = false;
 
         while (q->fetch())
         {
@@ -1222,6 +1764,7 @@ static std::mutex g_dbOpenMutex;
                 checkDeleteBuild(db, hash);
                 checkDeleteMeta(db, relPath.generic());
                 std::cout << "D\t" << relPath.generic() << std::endl;
+                deleted = true;
                 break;
 
             case Modified:
@@ -1235,6 +1778,9 @@ static std::mutex g_dbOpenMutex;
             }
         }
 
+        if (deleted)
+            cache.prune();
+
         tx.commit();
     }
 
@@ -1270,6 +1816,7 @@ static std::mutex g_dbOpenMutex;
         }
 
         const auto updateQ = db->query(UPDATE_QUERY);
+        FingerprintCache cache(db);
 
         // Deliberately one IMMEDIATE transaction for the whole rescan (design choice, kept):
         // the entries table is always left in a consistent, fully re-parsed state, even for
@@ -1307,9 +1854,27 @@ static std::mutex g_dbOpenMutex;
             try
             {
                 Entry e;
-                parseEntry(fullPath, directory, e, true);
+
+                // Unchanged files (same identity as when last fingerprinted) are not re-read
+                FileIdentity identity;
+                CachedFingerprint cached;
+                const bool hasIdentity = getFileIdentity(fullPath, identity);
+                if (hasIdentity && cache.lookup(identity, cached) && cached.hasEntry)
+                {
+                    cached.toEntry(fullPath, directory, identity, e);
+                }
+                else
+                {
+                    if (!cached.hash.empty())
+                        e.hash = cached.hash;
+                    parseEntry(fullPath, directory, e, true);
+                }
+
                 doUpdate(updateQ.get(), e);
 
+                if (hasIdentity)
+                    cache.store(identity, e);
+
                 if (callback != nullptr)
                 {
                     if (!callback(e, true, ""))
@@ -1521,17 +2086,21 @@ static std::mutex g_dbOpenMutex;
 
     bool getEntry(Database *db, const std::string &path, Entry &entry)
     {
-        auto q = db->query("SELECT path, hash, type, properties, mtime, size, depth, "
-                           "json_extract(AsGeoJSON(point_geom), '$.coordinates'), json_extract(AsGeoJSON(polygon_geom), '$.coordinates') FROM entries WHERE path = ? LIMIT 1");
+        auto q = db->cachedQuery("SELECT path, hash, type, properties, mtime, size, depth, "
+                                 "point_geom, polygon_geom FROM entries WHERE path = ? LIMIT 1");
 
         q->bind(1, path);
 
         if (!q->fetch())
+        {
+            q->reset();
             return false;
+        }
 
         entry.parseFields(q->getText(0), q->getText(1), q->getInt(2), q->getText(3),
-                          q->getInt64(4), q->getInt64(5), q->getInt(6),
-                          q->getText(7), q->getText(8));
+                          q->getInt64(4), q->getInt64(5), q->getInt(6));
+        entry.parseGeometryBlobs(q->getBlob(7), q->getBlobSize(7), q->getBlob(8), q->getBlobSize(8));
+        q->reset();
         return true;
     }
 
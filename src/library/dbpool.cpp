@@ -0,0 +1,209 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "dbpool.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+
+#include "dbops.h"
+#include "fingerprintcache.h"
+#include "logger.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        // Idle connections kept open, across all databases
+        const size_t MaxIdleConnections = 64;
+
+        struct PooledConnection
+        {
+            std::string key;
+            std::unique_ptr<Database> db;
+
+            // Identity of the database file when the connection was opened; a database
+            // replaced on disk (clone, pull) must not be served from a stale connection
+            long long device = 0;
+            long long inode = 0;
+        };
+        typedef std::list<PooledConnection> ConnectionList;
+
+        bool isSameFile(const PooledConnection &c)
+        {
+            FileIdentity id;
+            return getFileIdentity(c.db->getOpenFile(), id) && id.device == c.device && id.inode == c.inode;
+        }
+
+        class DatabasePool
+        {
+            std::mutex mutex;
+            ConnectionList idle; // Most recently used first
+            unsigned long long generation = 0;
+            size_t hits = 0;
+            size_t misses = 0;
+
+        public:
+            std::atomic<bool> enabled{false};
+
+            static DatabasePool &instance()
+            {
+                // Never destroyed: connections must not be closed during static
+                // destruction, after SpatiaLite might have been torn down
+                static DatabasePool *pool = new DatabasePool();
+                return *pool;
+            }
+
+            // Returns an idle connection for key (or an empty one on a miss) and the
+            // pool generation it must be returned with
+            PooledConnection acquire(const std::string &key, unsigned long long &gen)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                gen = generation;
+
+                for (auto it = idle.begin(); it != idle.end(); ++it)
+                {
+                    if (it->key == key)
+                    {
+                        PooledConnection c = std::move(*it);
+                        idle.erase(it);
+                        hits++;
+                        return c;
+                    }
+                }
+
+                misses++;
+                return PooledConnection();
+            }
+
+            void release(PooledConnection c, unsigned long long gen)
+            {
+                ConnectionList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+
+                // Closed while leased, or pooling was turned off
+                if (gen != generation || !enabled)
+                {
+                    evicted.push_back(std::move(c));
+                    return;
+                }
+
+                idle.push_front(std::move(c));
+                while (idle.size() > MaxIdleConnections)
+                    evicted.splice(evicted.end(), idle, std::prev(idle.end()));
+            }
+
+            void clear()
+            {
+                ConnectionList closed;
+                std::lock_guard<std::mutex> lock(mutex);
+                closed.swap(idle);
+                generation++;
+                hits = misses = 0;
+            }
+
+            DatabasePoolStats getStats()
+            {
+                DatabasePoolStats stats;
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.hits = hits;
+                stats.misses = misses;
+                stats.idle = idle.size();
+                return stats;
+            }
+        };
+
+        // Whether a pooled connection can still be used
+        bool isValid(PooledConnection &c)
+        {
+            try
+            {
+                // Another process might have migrated or replaced the database
+                return isSameFile(c) && c.db->getUserVersion() == DDB_SCHEMA_VERSION;
+            }
+            catch (const DBException &e)
+            {
+                LOGD << "Discarding pooled connection to " << c.db->getOpenFile() << ": " << e.what();
+                return false;
+            }
+        }
+    }
+
+    void setDatabasePoolEnabled(bool enabled)
+    {
+        auto &pool = DatabasePool::instance();
+        pool.enabled = enabled;
+        if (!enabled)
+            pool.clear();
+    }
+
+    bool isDatabasePoolEnabled()
+    {
+        return DatabasePool::instance().enabled;
+    }
+
+    std::shared_ptr<Database> openPooled(const std::string &directory, bool traverseUp)
+    {
+        auto &pool = DatabasePool::instance();
+        if (!pool.enabled)
+            return open(directory, traverseUp);
+
+        std::error_code ec;
+        fs::path canonical = fs::weakly_canonical(fs::absolute(directory), ec);
+        if (ec)
+            canonical = fs::absolute(directory);
+        const std::string key = canonical.string() + (traverseUp ? "*up" : "");
+
+        unsigned long long gen;
+        PooledConnection c = pool.acquire(key, gen);
+
+        if (c.db && !isValid(c))
+            c.db.reset();
+
+        if (!c.db)
+        {
+            c.key = key;
+            c.db = open(directory, traverseUp);
+
+            FileIdentity id;
+            if (getFileIdentity(c.db->getOpenFile(), id))
+            {
+                c.device = id.device;
+                c.inode = id.inode;
+            }
+        }
+
+        Database *db = c.db.get();
+        auto lease = std::make_shared<PooledConnection>(std::move(c));
+
+        // The connection goes back to the pool when the last reference is released
+        return std::shared_ptr<Database>(
+            db,
+            [lease, gen](Database *)
+            {
+                try
+                {
+                    lease->db->resetCachedQueries();
+                    DatabasePool::instance().release(std::move(*lease), gen);
+                }
+                catch (const std::exception &e)
+                {
+                    LOGD << "Cannot return connection to pool: " << e.what();
+                }
+            });
+    }
+
+    void closePooledDatabases()
+    {
+        DatabasePool::instance().clear();
+    }
+
+    DatabasePoolStats getDatabasePoolStats()
+    {
+        return DatabasePool::instance().getStats();
+    }
+
+} // namespace ddb
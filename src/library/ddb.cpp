@@ -22,10 +22,12 @@
 #include <windows.h>
 #endif
 
+#include "../../vendor/base64/base64.h"
 #include "../../vendor/segvcatch/segvcatch.h"
 #include "build.h"
 #include "database.h"
 #include "dbops.h"
+#include "dbpool.h"
 #include "delta.h"
 #include "entry.h"
 #include "entry_types.h"
@@ -338,6 +340,15 @@ void DDBRegisterProcess(bool verbose) {
     });
 }
 
+void DDBSetDatabasePooling(bool enabled) {
+    ddb::setDatabasePoolEnabled(enabled);
+}
+
+void DDBCloseAll() {
+    ddb::closePooledDatabases();
+    ddb::TilerHelper::clearTilerPool();
+}
+
 const char* DDBGetVersion() {
     return APP_VERSION;
 }
@@ -551,7 +562,7 @@ DDBErr DDBGet(const char* ddbPath, const char* path, char** output) {
     if (utils::isNullOrEmptyOrWhitespace(path))
         throw InvalidArgsException("No path provided");
 
-    const auto db = ddb::open(std::string(ddbPath), false);
+    const auto db = ddb::openPooled(std::string(ddbPath), false);
 
     auto entries = ddb::getMatchingEntries(db.get(), std::string(path));
     std::string entryJson;
@@ -597,7 +608,7 @@ DDBErr DDBList(const char* ddbPath,
     if (maxRecursionDepth < 0)
         throw InvalidArgsException("Invalid max recursion depth");
 
-    const auto db = ddb::open(std::string(ddbPath), true);
+    const auto db = ddb::openPooled(std::string(ddbPath), true);
     const std::vector<std::string> pathList(paths, paths + numPaths);
 
     std::ostringstream ss;
@@ -608,6 +619,62 @@ DDBErr DDBList(const char* ddbPath,
     DDB_C_END
 }
 
+DDBErr DDBListPage(const char* ddbPath,
+                   const char** paths,
+                   int numPaths,
+                   const char* format,
+                   bool recursive,
+                   int maxRecursionDepth,
+                   const char* token,
+                   int pageSize,
+                   char** output,
+                   char** nextToken) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(ddbPath))
+        throw InvalidArgsException("No directory provided");
+
+    if (!utils::isValidNonEmptyStringParam(format))
+        throw InvalidArgsException("No format provided");
+
+    if (!utils::isValidArrayParam(paths, numPaths))
+        throw InvalidArgsException("Invalid paths array parameter");
+
+    if (utils::isNullOrEmptyOrWhitespace(paths, numPaths))
+        throw InvalidArgsException("No paths provided");
+
+    if (utils::hasNullStringInArray(paths, numPaths))
+        throw InvalidArgsException("Path array contains null elements");
+
+    if (output == nullptr || nextToken == nullptr)
+        throw InvalidArgsException("Output pointer is null");
+
+    if (maxRecursionDepth < 0)
+        throw InvalidArgsException("Invalid max recursion depth");
+
+    if (pageSize <= 0)
+        throw InvalidArgsException("Invalid page size");
+
+    // The token is the path of the last entry of the previous page
+    std::string after;
+    if (token != nullptr && token[0] != '\0') {
+        after = Base64::decode(token);
+        if (after.empty() || Base64::encode(after) != token)
+            throw InvalidArgsException("Invalid continuation token: " + std::string(token));
+    }
+
+    const auto db = ddb::openPooled(std::string(ddbPath), true);
+    const std::vector<std::string> pathList(paths, paths + numPaths);
+
+    std::ostringstream ss;
+    const auto last = listIndex(db.get(), pathList, ss, format, recursive, maxRecursionDepth, after, pageSize);
+
+    utils::copyToPtr(ss.str(), output);
+    utils::copyToPtr(last.empty() ? "" : Base64::encode(last), nextToken);
+
+    DDB_C_END
+}
+
 DDBErr DDBSearch(const char* ddbPath, const char* query, char** output, const char* format) {
     DDB_C_BEGIN
 
@@ -623,7 +690,7 @@ DDBErr DDBSearch(const char* ddbPath, const char* query, char** output, const ch
     if (output == nullptr)
         throw InvalidArgsException("Output pointer is null");
 
-    const auto db = ddb::open(std::string(ddbPath), false);
+    const auto db = ddb::openPooled(std::string(ddbPath), false);
 
     std::ostringstream ss;
     searchIndex(db.get(), query, ss, format);
@@ -633,6 +700,39 @@ DDBErr DDBSearch(const char* ddbPath, const char* query, char** output, const ch
     DDB_C_END
 }
 
+DDBErr DDBSearchBbox(const char* ddbPath,
+                     const char* query,
+                     const char* bbox,
+                     char** output,
+                     const char* format) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(ddbPath))
+        throw InvalidArgsException("No directory provided");
+
+    if (!utils::isValidStringParam(query))
+        throw InvalidArgsException("No query provided");
+
+    if (utils::isNullOrEmptyOrWhitespace(bbox))
+        throw InvalidArgsException("No bbox provided");
+
+    if (!utils::isValidNonEmptyStringParam(format))
+        throw InvalidArgsException("No format provided");
+
+    if (output == nullptr)
+        throw InvalidArgsException("Output pointer is null");
+
+    const auto bboxVec = ddb::parseBbox(bbox);
+    const auto db = ddb::openPooled(std::string(ddbPath), false);
+
+    std::ostringstream ss;
+    searchIndex(db.get(), query, ss, format, bboxVec);
+
+    utils::copyToPtr(ss.str(), output);
+
+    DDB_C_END
+}
+
 DDBErr DDBAppendPassword(const char* ddbPath, const char* password) {
     DDB_C_BEGIN
 
@@ -664,7 +764,7 @@ DDBErr DDBVerifyPassword(const char* ddbPath, const char* password, bool* verifi
     if (verified == nullptr)
         throw InvalidArgsException("Output parameter pointer is null");
 
-    const auto db = ddb::open(std::string(ddbPath), true);
+    const auto db = ddb::openPooled(std::string(ddbPath), true);
 
     PasswordManager manager(db.get());
 
@@ -938,6 +1038,114 @@ DDBErr DDBMemoryTileFmt(const char* inputPath,
     DDB_C_END
 }
 
+DDBErr DDBPointCloudTile(const char* inputPath,
+                         int tz,
+                         int tx,
+                         int ty,
+                         char** outputTilePath,
+                         int tileSize,
+                         bool tms,
+                         bool forceRecreate,
+                         const char* pointCloudColor) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(inputPath))
+        throw InvalidArgsException("No input path provided");
+    if (outputTilePath == nullptr)
+        throw InvalidArgsException("Output tile path pointer is null");
+    if (tileSize < 0)
+        throw InvalidArgsException("Invalid tile size parameter");
+    if (tz < 0 || tx < 0 || ty < 0)
+        throw InvalidArgsException("Invalid tile coordinates");
+
+    const std::string colorStr = pointCloudColor ? std::string(pointCloudColor) : "auto";
+
+    utils::copyToPtr("", outputTilePath);
+    const auto tilePath = ddb::TilerHelper::getFromUserCache(std::string(inputPath),
+                                                             tz, tx, ty,
+                                                             tileSize, tms,
+                                                             forceRecreate,
+                                                             "",
+                                                             colorStr);
+    utils::copyToPtr(tilePath.string(), outputTilePath);
+    DDB_C_END
+}
+
+DDBErr DDBMemoryPointCloudTile(const char* inputPath,
+                               int tz,
+                               int tx,
+                               int ty,
+                               uint8_t** outBuffer,
+                               int* outBufferSize,
+                               int tileSize,
+                               bool tms,
+                               bool forceRecreate,
+                               const char* inputPathHash,
+                               const char* pointCloudColor) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(inputPath))
+        throw InvalidArgsException("No input path provided");
+    if (outBuffer == nullptr)
+        throw InvalidArgsException("Output buffer pointer is null");
+    if (outBufferSize == nullptr)
+        throw InvalidArgsException("Output buffer size pointer is null");
+    if (tileSize < 0)
+        throw InvalidArgsException("Invalid tile size parameter");
+    if (tz < 0 || tx < 0 || ty < 0)
+        throw InvalidArgsException("Invalid tile coordinates");
+
+    const std::string hashStr = inputPathHash ? std::string(inputPathHash) : "";
+    const std::string colorStr = pointCloudColor ? std::string(pointCloudColor) : "auto";
+
+    ddb::TilerHelper::getTile(std::string(inputPath),
+                              tz, tx, ty,
+                              tileSize, tms,
+                              forceRecreate,
+                              "",
+                              outBuffer, outBufferSize,
+                              hashStr,
+                              colorStr);
+    DDB_C_END
+}
+
+DDBErr DDBMemoryCachedTile(const char* inputPath,
+                           int tz,
+                           int tx,
+                           int ty,
+                           uint8_t** outBuffer,
+                           int* outBufferSize,
+                           int tileSize,
+                           bool tms,
+                           bool forceRecreate,
+                           const char* inputPathHash,
+                           const char* pointCloudColor) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(inputPath))
+        throw InvalidArgsException("No input path provided");
+    if (outBuffer == nullptr)
+        throw InvalidArgsException("Output buffer pointer is null");
+    if (outBufferSize == nullptr)
+        throw InvalidArgsException("Output buffer size pointer is null");
+    if (tileSize < 0)
+        throw InvalidArgsException("Invalid tile size parameter");
+    if (tz < 0 || tx < 0 || ty < 0)
+        throw InvalidArgsException("Invalid tile coordinates");
+
+    const std::string hashStr = inputPathHash ? std::string(inputPathHash) : "";
+    const std::string colorStr = pointCloudColor ? std::string(pointCloudColor) : "auto";
+
+    ddb::TilerHelper::getFromUserCache(std::string(inputPath),
+                                       tz, tx, ty,
+                                       tileSize, tms,
+                                       forceRecreate,
+                                       outBuffer, outBufferSize,
+                                       hashStr,
+                                       colorStr);
+    DDB_C_END
+}
+
 DDBErr DDBDelta(const char* ddbSourceStamp,
                 const char* ddbTargetStamp,
                 char** output,
@@ -1085,7 +1293,7 @@ DDB_DLL DDBErr DDBGetTag(const char* ddbPath, char** outTag) {
     if (outTag == nullptr)
         throw InvalidArgsException("Output tag pointer is null");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     TagManager manager(ddb.get());
     const auto tag = manager.getTag();
 
@@ -1103,12 +1311,33 @@ DDB_DLL DDBErr DDBGetStamp(const char* ddbPath, char** output) {
     if (output == nullptr)
         throw InvalidArgsException("No output provided");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     utils::copyToPtr(ddb->getStamp().dump(), output);
 
     DDB_C_END
 }
 
+DDB_DLL DDBErr DDBGetBinaryStamp(const char* ddbPath, uint8_t** outBuffer, int* outBufferSize) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(ddbPath))
+        throw InvalidArgsException("No directory provided");
+
+    if (outBuffer == nullptr || outBufferSize == nullptr)
+        throw InvalidArgsException("No output provided");
+
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
+    const std::string stamp = encodeStamp(ddb->getStamp());
+
+    *outBuffer = static_cast<uint8_t*>(VSIMalloc(stamp.size()));
+    if (*outBuffer == nullptr)
+        throw AppException("Cannot allocate stamp buffer");
+    memcpy(*outBuffer, stamp.data(), stamp.size());
+    *outBufferSize = static_cast<int>(stamp.size());
+
+    DDB_C_END
+}
+
 DDB_DLL DDBErr DDBRescan(const char* ddbPath, char** output, const char* types, bool stopOnError) {
     DDB_C_BEGIN
 
@@ -1196,6 +1425,52 @@ DDBBuild(const char* ddbPath, const char* source, const char* dest, bool force,
     DDB_C_END
 }
 
+DDB_DLL DDBErr DDBBuildEx(const char* ddbPath,
+                          const char* dest,
+                          bool force,
+                          bool pendingOnly,
+                          int jobs,
+                          int order,
+                          DDBBuildProgressCallback progress,
+                          void* progressUserData) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(ddbPath))
+        throw InvalidArgsException("No ddb path provided");
+
+    if (order < 0 || order > static_cast<int>(ddb::BuildOrder::LargestFirst))
+        throw InvalidArgsException("Invalid build order");
+
+    const auto ddb = ddb::open(std::string(ddbPath), true);
+
+    // dest can be null (optional parameter)
+    const auto destPath = dest != nullptr ? std::string(dest) : "";
+
+    ddb::BuildOptions options;
+    options.force = force;
+    options.jobs = jobs;
+    options.order = static_cast<ddb::BuildOrder>(order);
+
+    ddb::BuildProgressCallback callback = nullptr;
+    if (progress != nullptr) {
+        callback = [progress, progressUserData](const ddb::BuildProgress& p) {
+            return progress(static_cast<int>(p.completed),
+                            static_cast<int>(p.failed),
+                            static_cast<int>(p.total),
+                            p.eta,
+                            p.path.c_str(),
+                            progressUserData) == 0;
+        };
+    }
+
+    const bool completed = pendingOnly ? buildPendingEx(ddb.get(), destPath, options, callback)
+                                       : buildAllEx(ddb.get(), destPath, options, callback);
+    if (!completed)
+        return DDBERR_CANCELED;
+
+    DDB_C_END
+}
+
 DDB_DLL DDBErr DDBCleanup(const char* ddbPath, char** output) {
     DDB_C_BEGIN
 
@@ -1232,7 +1507,7 @@ DDB_DLL DDBErr DDBIsBuildable(const char* ddbPath, const char* path, bool* isBui
 
     const auto ddbPathStr = std::string(ddbPath);
 
-    const auto ddb = ddb::open(ddbPathStr, true);
+    const auto ddb = ddb::openPooled(ddbPathStr, true);
 
     std::string subfolder;
 
@@ -1250,7 +1525,7 @@ DDB_DLL DDBErr DDBIsBuildPending(const char* ddbPath, bool* isBuildPending) {
     if (isBuildPending == nullptr)
         throw InvalidArgsException("isBuildPending parameter is null");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     *isBuildPending = ddb::isBuildPending(ddb.get());
 
     DDB_C_END
@@ -1265,7 +1540,7 @@ DDB_DLL DDBErr DDBGetPendingBuildInfo(const char* ddbPath, char** output) {
     if (output == nullptr)
         throw InvalidArgsException("Output pointer is null");
 
-    const auto db = ddb::open(std::string(ddbPath), true);
+    const auto db = ddb::openPooled(std::string(ddbPath), true);
     const auto pending = ddb::getPendingBuildInfo(db.get());
 
     auto outJson = json::array();
@@ -1295,7 +1570,7 @@ DDB_DLL DDBErr DDBIsBuildActive(const char* ddbPath, const char* path, bool* isB
     if (isBuildActive == nullptr)
         throw InvalidArgsException("isBuildActive parameter is null");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     *isBuildActive = ddb::isBuildActive(ddb.get(), std::string(path));
 
     DDB_C_END
@@ -1313,7 +1588,7 @@ DDB_DLL DDBErr DDBIsBuildComplete(const char* ddbPath, const char* path, bool* i
     if (isBuildComplete == nullptr)
         throw InvalidArgsException("isBuildComplete parameter is null");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     *isBuildComplete = ddb::isBuildComplete(ddb.get(), std::string(path));
 
     DDB_C_END
@@ -1426,7 +1701,7 @@ DDB_DLL DDBErr DDBMetaGet(const char* ddbPath, const char* path, const char* key
 
     const auto ddbPathStr = std::string(ddbPath);
 
-    const auto ddb = ddb::open(ddbPathStr, true);
+    const auto ddb = ddb::openPooled(ddbPathStr, true);
     auto json = ddb->getMetaManager()->get(std::string(key), std::string(path), ddbPathStr);
 
     utils::copyToPtr(json.dump(), output);
@@ -1472,7 +1747,7 @@ DDB_DLL DDBErr DDBMetaList(const char* ddbPath, const char* path, char** output)
 
     const auto ddbPathStr = std::string(ddbPath);
 
-    const auto ddb = ddb::open(ddbPathStr, true);
+    const auto ddb = ddb::openPooled(ddbPathStr, true);
     auto json = ddb->getMetaManager()->list(std::string(path), ddbPathStr);
 
     utils::copyToPtr(json.dump(), output);
@@ -1499,7 +1774,7 @@ DDB_DLL DDBErr DDBMetaDump(const char* ddbPath, const char* ids, char** output)
         throw InvalidArgsException(e.what());
     }
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), true);
     auto json = ddb->getMetaManager()->dump(jIds);
 
     utils::copyToPtr(json.dump(), output);
@@ -1556,7 +1831,7 @@ DDB_DLL DDBErr DDBStac(const char* ddbPath,
     const std::string idStr = id ? std::string(id) : "";
     const std::string stacCatalogRootStr = stacCatalogRoot ? std::string(stacCatalogRoot) : "";
 
-    const auto ddb = ddb::open(std::string(ddbPath), false);
+    const auto ddb = ddb::openPooled(std::string(ddbPath), false);
     auto json = ddb::generateStac(std::string(ddbPath),
                                   entryStr,
                                   stacCollectionRootStr,
@@ -1577,6 +1852,21 @@ DDB_DLL DDBErr DDBStacItemCollection(const char* ddbPath,
                                      int limit,
                                      int offset,
                                      char** output) {
+    return DDBStacItemCollectionEx(ddbPath, stacCollectionRoot, id, stacCatalogRoot, bbox,
+                                   datetime, limit, offset, nullptr, false, output);
+}
+
+DDB_DLL DDBErr DDBStacItemCollectionEx(const char* ddbPath,
+                                       const char* stacCollectionRoot,
+                                       const char* id,
+                                       const char* stacCatalogRoot,
+                                       const char* bbox,
+                                       const char* datetime,
+                                       int limit,
+                                       int offset,
+                                       const char* token,
+                                       bool approximateCount,
+                                       char** output) {
     DDB_C_BEGIN
 
     if (utils::isNullOrEmptyOrWhitespace(ddbPath))
@@ -1592,19 +1882,8 @@ DDB_DLL DDBErr DDBStacItemCollection(const char* ddbPath,
 
     // Parse bbox "minX,minY,maxX,maxY" into a vector of doubles (empty if absent; throws on invalid)
     std::vector<double> bboxVec;
-    if (bbox != nullptr && !utils::isNullOrEmptyOrWhitespace(bbox)) {
-        std::stringstream ss(bbox);
-        std::string token;
-        while (std::getline(ss, token, ',')) {
-            try {
-                bboxVec.push_back(std::stod(token));
-            } catch (...) {
-                throw InvalidArgsException("Invalid bbox value: " + token);
-            }
-        }
-        if (bboxVec.size() != 4)
-            throw InvalidArgsException("bbox must contain exactly 4 comma-separated values");
-    }
+    if (bbox != nullptr && !utils::isNullOrEmptyOrWhitespace(bbox))
+        bboxVec = ddb::parseBbox(bbox);
 
     // Parse datetime: single instant or interval "start/end" ("../end" or "start/.." for open ends)
     std::string datetimeStart;
@@ -1633,7 +1912,9 @@ DDB_DLL DDBErr DDBStacItemCollection(const char* ddbPath,
                                                 datetimeStart,
                                                 datetimeEnd,
                                                 limit,
-                                                offset);
+                                                offset,
+                                                token ? std::string(token) : "",
+                                                approximateCount);
 
     utils::copyToPtr(json.dump(), output);
 
@@ -1717,7 +1998,7 @@ DDB_DLL DDBErr DDBGetRasterMetadata(const char* path, const char* formula,
         premaskNodata(bandDataPtrs, pixCount, nBands, nodataInfo, nodata);
 
         std::vector<float> formulaResult(pixCount);
-        const auto* formulaObj = ve.getFormula(formulaStr);
+        const auto formulaObj = ve.getFormula(formulaStr);
         if (!formulaObj) {
             GDALClose(hDs);
             throw InvalidArgsException("Unknown formula: " + formulaStr);
@@ -1828,6 +2109,21 @@ DDB_DLL DDBErr DDBGetRasterMetadata(const char* path, const char* formula,
     DDB_C_END
 }
 
+DDB_DLL DDBErr DDBRegisterFormulas(const char* formulasJson) {
+    DDB_C_BEGIN
+
+    if (utils::isNullOrEmptyOrWhitespace(formulasJson))
+        throw InvalidArgsException("No formulas provided");
+
+    try {
+        ddb::VegetationEngine::instance().loadFormulas(std::string(formulasJson));
+    } catch (const json::exception& e) {
+        throw InvalidArgsException(e.what());
+    }
+
+    DDB_C_END
+}
+
 DDB_DLL DDBErr DDBGenerateMemoryThumbnailEx(const char* filePath, int size,
                                              const char* preset, const char* bands,
                                              const char* formula, const char* bandFilter,
@@ -2189,7 +2485,7 @@ static int exportRasterImpl(const char* inputPath, const char* outputPath,
             bf = ve.autoDetectFilter(std::string(inputPath));
         }
 
-        const auto* formulaPtr = ve.getFormula(formulaStr);
+        const auto formulaPtr = ve.getFormula(formulaStr);
         if (!formulaPtr)
             throw InvalidArgsException("Unknown formula: " + formulaStr);
         std::string cmId = colormapStr.empty() ? "rdylgn" : colormapStr;
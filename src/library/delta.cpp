@@ -5,6 +5,8 @@
 #include "mio.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <optional>
 #include <utility>
 #include <vector>
@@ -12,10 +14,175 @@
 #include "dbops.h"
 #include "exceptions.h"
 #include "delta.h"
+#include "merkle.h"
 
 namespace ddb
 {
 
+    namespace
+    {
+        void printDelta(const Delta &delta, std::ostream &output, const std::string &format)
+        {
+            if (format == "json")
+            {
+                json j = delta;
+
+                output << j.dump();
+            }
+            else if (format == "text")
+            {
+                for (const AddAction &add : delta.adds)
+                    output << "A\t" << add.path << (add.isDirectory() ? " (D)" : "") << std::endl;
+
+                for (const RemoveAction &rem : delta.removes)
+                    output << "D\t" << rem.path << (rem.isDirectory() ? " (D)" : "") << std::endl;
+            }
+        }
+
+        // Binary stamp: "DDBS", version, then varint counts and lengths. Paths and
+        // meta ids are front-coded against the previous one (stamps are sorted),
+        // SHA-256 hex digests are stored as 32 raw bytes.
+        const char StampMagic[] = {'D', 'D', 'B', 'S'};
+        const uint8_t StampVersion = 1;
+
+        enum StampHash : uint8_t
+        {
+            EmptyHash = 0,
+            Sha256Hash = 1,
+            RawHash = 2
+        };
+
+        void writeVarint(std::string &out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<char>(v));
+        }
+
+        void writeFrontCoded(std::string &out, const std::string &s, std::string &previous)
+        {
+            size_t shared = 0;
+            const size_t max = std::min(s.size(), previous.size());
+            while (shared < max && s[shared] == previous[shared])
+                shared++;
+
+            writeVarint(out, shared);
+            writeVarint(out, s.size() - shared);
+            out.append(s, shared, std::string::npos);
+            previous = s;
+        }
+
+        bool isSha256Hex(const std::string &h)
+        {
+            return h.size() == 64 && std::all_of(h.begin(), h.end(), [](char c)
+                                                 { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+        }
+
+        void writeHash(std::string &out, const std::string &h)
+        {
+            if (h.empty())
+            {
+                out.push_back(static_cast<char>(EmptyHash));
+            }
+            else if (isSha256Hex(h))
+            {
+                out.push_back(static_cast<char>(Sha256Hash));
+                for (size_t i = 0; i < h.size(); i += 2)
+                    out.push_back(static_cast<char>(std::stoi(h.substr(i, 2), nullptr, 16)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(RawHash));
+                writeVarint(out, h.size());
+                out.append(h);
+            }
+        }
+
+        class StampReader
+        {
+            const std::string &data;
+            size_t pos = 0;
+
+            void need(uint64_t n) const
+            {
+                if (n > data.size() - pos)
+                    throw InvalidArgsException("Truncated binary stamp");
+            }
+
+        public:
+            explicit StampReader(const std::string &data) : data(data) {}
+
+            bool atEnd() const { return pos == data.size(); }
+
+            uint8_t byte()
+            {
+                need(1);
+                return static_cast<uint8_t>(data[pos++]);
+            }
+
+            std::string bytes(uint64_t n)
+            {
+                need(n);
+                std::string s = data.substr(pos, static_cast<size_t>(n));
+                pos += static_cast<size_t>(n);
+                return s;
+            }
+
+            uint64_t varint()
+            {
+                uint64_t v = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    const uint8_t b = byte();
+                    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                    if ((b & 0x80) == 0)
+                        return v;
+                }
+                throw InvalidArgsException("Invalid varint in binary stamp");
+            }
+
+            std::string frontCoded(std::string &previous)
+            {
+                const uint64_t shared = varint();
+                if (shared > previous.size())
+                    throw InvalidArgsException("Invalid prefix in binary stamp");
+                const uint64_t suffix = varint();
+                previous = previous.substr(0, static_cast<size_t>(shared)) + bytes(suffix);
+                return previous;
+            }
+
+            std::string hash()
+            {
+                static const char hex[] = "0123456789abcdef";
+
+                switch (byte())
+                {
+                case EmptyHash:
+                    return "";
+                case Sha256Hash:
+                {
+                    const std::string raw = bytes(32);
+                    std::string h;
+                    h.reserve(64);
+                    for (unsigned char c : raw)
+                    {
+                        h.push_back(hex[c >> 4]);
+                        h.push_back(hex[c & 0xf]);
+                    }
+                    return h;
+                }
+                case RawHash:
+                    return bytes(varint());
+                default:
+                    throw InvalidArgsException("Invalid hash in binary stamp");
+                }
+            }
+        };
+    }
+
     void to_json(json &j, const SimpleEntry &e)
     {
         j = json{{"path", e.path}, {"hash", e.hash}};
@@ -73,33 +240,19 @@ namespace ddb
 
     Delta getDelta(Database *sourceDb, Database *targetDb)
     {
-        return getDelta(sourceDb->getStamp(), targetDb->getStamp());
+        MerkleIndex source(sourceDb);
+        MerkleIndex target(targetDb);
+        return getMerkleDelta(source, target);
     }
 
     void delta(Database *sourceDb, Database *targetDb, std::ostream &output, const std::string &format)
     {
-        delta(sourceDb->getStamp(), targetDb->getStamp(), output, format);
+        printDelta(getDelta(sourceDb, targetDb), output, format);
     }
 
     void delta(const json &sourceDbStamp, const json &targetDbStamp, std::ostream &output, const std::string &format)
     {
-        auto delta = getDelta(sourceDbStamp, targetDbStamp);
-
-        if (format == "json")
-        {
-
-            json j = delta;
-
-            output << j.dump();
-        }
-        else if (format == "text")
-        {
-            for (const AddAction &add : delta.adds)
-                output << "A\t" << add.path << (add.isDirectory() ? " (D)" : "") << std::endl;
-
-            for (const RemoveAction &rem : delta.removes)
-                output << "D\t" << rem.path << (rem.isDirectory() ? " (D)" : "") << std::endl;
-        }
+        printDelta(getDelta(sourceDbStamp, targetDbStamp), output, format);
     }
 
     Delta getDelta(const json &sourceDbStamp,
@@ -108,61 +261,57 @@ namespace ddb
         std::vector<SimpleEntry> source = parseStampEntries(sourceDbStamp);
         std::vector<SimpleEntry> destination = parseStampEntries(destinationDbStamp);
 
-        std::vector<RemoveAction> removes;
-        std::vector<AddAction> adds;
-
-        std::vector<std::string> metaAdds;
-        std::vector<std::string> metaRemoves;
-
-        // Sort by path
-        std::sort(source.begin(), source.end(),
-                  [](const SimpleEntry &l, const SimpleEntry &r)
-                  {
-                      return l.path < r.path;
-                  });
+        Delta d;
 
         // Sort by path
-        std::sort(destination.begin(), destination.end(),
-                  [](const SimpleEntry &l, const SimpleEntry &r)
-                  {
-                      return l.path < r.path;
-                  });
-
-        for (const SimpleEntry &entry : source)
+        const auto byPath = [](const SimpleEntry &l, const SimpleEntry &r)
         {
-            const auto inDestWithSameHashAndPath =
-                std::find_if(destination.begin(), destination.end(),
-                             [&entry](const SimpleEntry &e)
-                             {
-                                 return e.hash == entry.hash &&
-                                        e.path == entry.path;
-                             }) != destination.end();
-
-            if (inDestWithSameHashAndPath)
+            return l.path < r.path;
+        };
+        std::sort(source.begin(), source.end(), byPath);
+        std::sort(destination.begin(), destination.end(), byPath);
+
+        // Entries of source that are not in destination with the same hash are added,
+        // entries of destination that are not in source with the same kind are removed
+        size_t i = 0, j = 0;
+        while (i < source.size() || j < destination.size())
+        {
+            if (j == destination.size() || (i < source.size() && source[i].path < destination[j].path))
             {
-                LOGD << "SKIP -> " << entry.toString();
-                continue;
+                LOGD << "ADD  -> " << source[i].toString();
+                d.adds.emplace_back(source[i].path, source[i].hash);
+                i++;
             }
-
-            LOGD << "ADD  -> " << entry.toString();
-            adds.emplace_back(AddAction(entry.path, entry.hash));
-        }
-
-        for (const SimpleEntry &entry : destination)
-        {
-            const auto notInSourceWithSamePath = std::find_if(
-                source.begin(), source.end(), [&entry](const SimpleEntry &e)
-                { return e.path == entry.path && e.isDirectory() == entry.isDirectory(); });
-
-            if (notInSourceWithSamePath == source.end())
+            else if (i == source.size() || destination[j].path < source[i].path)
+            {
+                LOGD << "DEL  -> " << destination[j].toString();
+                d.removes.emplace_back(destination[j].path, destination[j].hash);
+                j++;
+            }
+            else
             {
-                LOGD << "DEL  -> " << entry.toString();
-                removes.emplace_back(RemoveAction(entry.path, entry.hash));
+                const SimpleEntry &src = source[i++];
+                const SimpleEntry &dst = destination[j++];
+
+                if (src.hash == dst.hash)
+                {
+                    LOGD << "SKIP -> " << src.toString();
+                    continue;
+                }
+
+                LOGD << "ADD  -> " << src.toString();
+                d.adds.emplace_back(src.path, src.hash);
+
+                if (src.isDirectory() != dst.isDirectory())
+                {
+                    LOGD << "DEL  -> " << dst.toString();
+                    d.removes.emplace_back(dst.path, dst.hash);
+                }
             }
         }
 
         // Sort removes by path descending
-        std::sort(removes.begin(), removes.end(),
+        std::sort(d.removes.begin(), d.removes.end(),
                   [](const RemoveAction &l, const RemoveAction &r)
                   {
                       return l.path > r.path;
@@ -174,33 +323,18 @@ namespace ddb
         if (!destinationDbStamp.contains("meta"))
             throw InvalidArgsException("Stamp meta not found");
 
-        // Find meta IDs in source that are not in destination
-        std::unordered_map<std::string, bool> metaIds;
         std::vector<std::string> sourceMetaIds = sourceDbStamp["meta"].get<std::vector<std::string>>();
         std::vector<std::string> destinationMetaIds = destinationDbStamp["meta"].get<std::vector<std::string>>();
+        std::sort(sourceMetaIds.begin(), sourceMetaIds.end());
+        std::sort(destinationMetaIds.begin(), destinationMetaIds.end());
 
-        for (auto &id : sourceMetaIds)
-            metaIds[id] = true;
-        for (auto &id : destinationMetaIds)
-            metaIds.erase(id);
-        for (auto &it : metaIds)
-            metaAdds.push_back(it.first);
-
-        metaIds.clear();
-
-        // Find meta IDs in destination that are not in source
-        for (auto &id : destinationMetaIds)
-            metaIds[id] = true;
-        for (auto &id : sourceMetaIds)
-            metaIds.erase(id);
-        for (auto &it : metaIds)
-            metaRemoves.push_back(it.first);
-
-        Delta d;
-        d.removes = removes;
-        d.adds = adds;
-        d.metaAdds = metaAdds;
-        d.metaRemoves = metaRemoves;
+        // Meta IDs in source that are not in destination and vice versa
+        std::set_difference(sourceMetaIds.begin(), sourceMetaIds.end(),
+                            destinationMetaIds.begin(), destinationMetaIds.end(),
+                            std::back_inserter(d.metaAdds));
+        std::set_difference(destinationMetaIds.begin(), destinationMetaIds.end(),
+                            sourceMetaIds.begin(), sourceMetaIds.end(),
+                            std::back_inserter(d.metaRemoves));
 
         return d;
     }
@@ -221,4 +355,64 @@ namespace ddb
         return result;
     }
 
+    std::string encodeStamp(const json &stamp)
+    {
+        if (!stamp.contains("meta"))
+            throw InvalidArgsException("Stamp meta not found");
+
+        const auto entries = parseStampEntries(stamp);
+        const auto &meta = stamp["meta"];
+
+        std::string out(StampMagic, sizeof(StampMagic));
+        out.push_back(static_cast<char>(StampVersion));
+
+        std::string previous;
+        writeVarint(out, entries.size());
+        for (const auto &e : entries)
+        {
+            writeFrontCoded(out, e.path, previous);
+            writeHash(out, e.hash);
+        }
+
+        previous.clear();
+        writeVarint(out, meta.size());
+        for (const auto &id : meta)
+            writeFrontCoded(out, id.get<std::string>(), previous);
+
+        writeHash(out, stamp.value("checksum", ""));
+
+        return out;
+    }
+
+    json decodeStamp(const std::string &data)
+    {
+        StampReader in(data);
+        if (in.bytes(sizeof(StampMagic)) != std::string(StampMagic, sizeof(StampMagic)))
+            throw InvalidArgsException("Not a binary stamp");
+        if (in.byte() != StampVersion)
+            throw InvalidArgsException("Unsupported binary stamp version");
+
+        json j;
+        std::string previous;
+
+        j["entries"] = json::array();
+        for (uint64_t n = in.varint(); n > 0; n--)
+        {
+            const std::string path = in.frontCoded(previous);
+            j["entries"].push_back(json::object({{path, in.hash()}}));
+        }
+
+        previous.clear();
+        j["meta"] = json::array();
+        for (uint64_t n = in.varint(); n > 0; n--)
+            j["meta"].push_back(in.frontCoded(previous));
+
+        j["checksum"] = in.hash();
+
+        if (!in.atEnd())
+            throw InvalidArgsException("Trailing data in binary stamp");
+
+        return j;
+    }
+
 } // namespace ddb
@@ -2,6 +2,8 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
+#include <cmath>
 #include <regex>
 #include <cstdlib>
 #include <ogrsf_frmts.h>
@@ -18,6 +20,10 @@ DSMService *DSMService::instance = nullptr;
 
 DSMService *DSMService::get()
 {
+    // Ingest workers look up altitudes concurrently
+    static std::mutex instanceMutex;
+    std::lock_guard<std::mutex> guard(instanceMutex);
+
     if (!instance)
     {
         instance = new DSMService();
@@ -34,96 +40,230 @@ void DSMService::cleanup()
     instance = nullptr;
 }
 
-DSMService::DSMService()
+DSMService::DSMService() : blockCache(static_cast<size_t>(utils::getEnvLong("DDB_DSM_CACHE_MB", 256)) * 1024 * 1024)
 {
+    if (const char *env = std::getenv("DDB_DSM_DIR"); env && *env)
+        demDir = env;
 }
 
 DSMService::~DSMService()
 {
 }
 
+namespace
+{
+    // Key of the 1x1 degree cell containing (latitude, longitude)
+    long long cellKey(int latitude, int longitude)
+    {
+        return static_cast<long long>(latitude + 90) * 361 + (longitude + 180);
+    }
+
+    int cellOf(double v, int min, int max)
+    {
+        return std::max(min, std::min(max, static_cast<int>(std::floor(v))));
+    }
+} // namespace
+
+DSMCacheEntry *DSMService::findEntry(double latitude, double longitude)
+{
+    const auto it = grid.find(cellKey(cellOf(latitude, -90, 90), cellOf(longitude, -180, 180)));
+    if (it == grid.end())
+        return nullptr;
+
+    for (auto *e : it->second)
+        if (e->bbox.contains(longitude, latitude))
+            return e;
+
+    return nullptr;
+}
+
+bool DSMService::sampleEntries(double latitude, double longitude, float &elevation)
+{
+    const auto it = grid.find(cellKey(cellOf(latitude, -90, 90), cellOf(longitude, -180, 180)));
+    if (it == grid.end())
+        return false;
+
+    // DEMs can overlap: a hole in one is filled by the next
+    for (auto *e : it->second)
+    {
+        if (!e->bbox.contains(longitude, latitude))
+            continue;
+
+        const float v = e->getElevation(latitude, longitude);
+        if (e->hasNodata && utils::sameFloat(v, e->nodata))
+            continue;
+
+        elevation = v;
+        return true;
+    }
+
+    return false;
+}
+
 float DSMService::getAltitude(double latitude, double longitude)
 {
-    Point2D point(longitude, latitude);
+    std::unique_lock<std::recursive_mutex> guard(mutex);
+    return lookupAltitude(latitude, longitude, guard);
+}
+
+void DSMService::getAltitudes(size_t count, const double *latitudes, const double *longitudes, float *altitudes)
+{
+    std::unique_lock<std::recursive_mutex> guard(mutex);
+    for (size_t i = 0; i < count; i++)
+        altitudes[i] = lookupAltitude(latitudes[i], longitudes[i], guard);
+}
+
+float DSMService::lookupAltitude(double latitude, double longitude, std::unique_lock<std::recursive_mutex> &guard)
+{
+    DSMCacheEntry *e = findEntry(latitude, longitude);
 
-    // Search cache
-    for (auto &it : cache)
+    if (e == nullptr)
     {
-        if (it.second.bbox.contains(point))
+        // Index the DSMs on disk, then attempt to load from the network
+        if (loadDiskCache(latitude, longitude))
+            e = findEntry(latitude, longitude);
+        else if (demDir.empty())
         {
-            // Skip entries whose raster data has not been loaded
-            if (it.second.data.empty()) continue;
+            // Other workers keep reading the cached DSMs during the download.
+            // The file lock only serializes downloads (also across processes)
+            // and is never requested while holding the mutex.
+            guard.unlock();
 
-            float elevation = it.second.getElevation(latitude, longitude);
-            if (!it.second.hasNodata || !utils::sameFloat(elevation, it.second.nodata))
+            std::string filePath;
+            try
             {
-                return elevation;
+                // TODO: we can probably optimize this
+                // to lock based on the bounding box of the point
+                io::FileLock lock(getCacheDir() / ".." / "dsm_service");
+
+                // Another worker might have downloaded it while we waited
+                guard.lock();
+                const bool found = loadDiskCache(latitude, longitude);
+                guard.unlock();
+
+                if (!found)
+                    filePath = loadFromNetwork(latitude, longitude);
             }
-            else
+            catch (const AppException &ex)
             {
-                LOGD << "DSM does not have a value for " << point;
-                return 0.0;
+                LOGD << ex.what();
             }
+
+            if (!guard.owns_lock())
+                guard.lock();
+
+            if (!filePath.empty())
+            {
+                try
+                {
+                    addGeoTIFFToCache(filePath, latitude, longitude);
+                }
+                catch (const AppException &ex)
+                {
+                    LOGD << ex.what();
+                }
+            }
+
+            // The index might have changed while unlocked
+            e = findEntry(latitude, longitude);
         }
     }
 
-    // TODO: we can probably optimize this
-    // to lock based on the bounding box of the point
+    if (e == nullptr)
     {
-        io::FileLock lock(getCacheDir() / ".." / "dsm_service");
+        LOGD << "Cannot get elevation from DSM service";
+        return 0;
+    }
 
-        // Load existing DSMs in cache until we find a matching one
-        if (loadDiskCache(latitude, longitude))
-        {
-            return getAltitude(latitude, longitude);
-        }
+    float elevation;
+    if (!sampleEntries(latitude, longitude, elevation))
+    {
+        LOGD << "DSM does not have a value for " << Point2D(longitude, latitude);
+        return 0;
+    }
 
-        // Attempt to load from the network and recurse
-        try
-        {
-            if (addGeoTIFFToCache(loadFromNetwork(latitude, longitude), latitude, longitude))
-            {
-                return getAltitude(latitude, longitude);
-            }
-        }
-        catch (const NetException &e)
+    return elevation;
+}
+
+void DSMService::setDEMDirectory(const fs::path &dir)
+{
+    std::lock_guard<std::recursive_mutex> guard(mutex);
+
+    demDir = dir;
+    demDirScanned = false;
+
+    cache.clear();
+    unusable.clear();
+    grid.clear();
+}
+
+bool DSMService::loadDiskCache(double latitude, double longitude)
+{
+    std::lock_guard<std::recursive_mutex> guard(mutex);
+
+    // The DEM folder is not expected to change, it's indexed once
+    if (!demDir.empty())
+    {
+        if (!demDirScanned)
         {
-            LOGD << e.what();
+            scanDirectory(demDir, true, false, latitude, longitude);
+            demDirScanned = true;
         }
+        return findEntry(latitude, longitude) != nullptr;
     }
 
-    LOGD << "Cannot get elevation from DSM service";
-    return 0;
+    return scanDirectory(getCacheDir(), false, true, latitude, longitude);
 }
 
-bool DSMService::loadDiskCache(double latitude, double longitude)
+bool DSMService::scanDirectory(const fs::path &dir, bool recursive, bool removeUnusable, double latitude, double longitude)
 {
-    fs::path dsmCacheDir = getCacheDir();
-    for (const auto &entry : fs::directory_iterator(dsmCacheDir))
+    std::vector<fs::path> files;
+    std::error_code ec;
+    if (recursive)
+    {
+        for (const auto &entry : fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec))
+            if (entry.is_regular_file())
+                files.push_back(entry.path());
+    }
+    else
     {
+        for (const auto &entry : fs::directory_iterator(dir, ec))
+            if (entry.is_regular_file())
+                files.push_back(entry.path());
+    }
+
+    if (ec)
+        LOGD << "Cannot list " << dir.string() << ": " << ec.message();
 
-        // Not found in cache?
-        std::string filename = entry.path().filename().string();
-        if (cache.find(filename) == cache.end())
+    bool found = false;
+    for (const auto &file : files)
+    {
+        const auto key = file.string();
+        if (cache.find(key) != cache.end() || unusable.find(key) != unusable.end())
+            continue;
+
+        LOGD << "Adding " << key << " to DSM service cache";
+        try
         {
-            LOGD << "Adding " << entry.path().string() << " to DSM service cache";
-            try
+            found = addGeoTIFFToCache(file, latitude, longitude) || found;
+        }
+        catch (const GDALException &e)
+        {
+            if (removeUnusable)
             {
-                if (addGeoTIFFToCache(entry.path(), latitude, longitude))
-                {
-                    return true; // Stop early, we've found a match
-                }
+                LOGD << "Deleting " << key << " because we can't open it";
+                fs::remove(file, ec);
             }
-            catch (const GDALException)
+            else
             {
-                LOGD << "Deleting " << entry.path().string() << " because we can't open it";
-                fs::remove(entry.path());
-                cache.erase(filename);
+                // A user provided DEM that is silently ignored would leave altitudes at 0
+                LOGW << "Skipping " << key << " from the DEM directory: " << e.what();
+                unusable.insert(key);
             }
         }
     }
 
-    return false; // No match
+    return found;
 }
 
 std::string DSMService::loadFromNetwork(double latitude, double longitude)
@@ -149,123 +289,263 @@ std::string DSMService::loadFromNetwork(double latitude, double longitude)
     std::string filename = std::to_string(static_cast<int>(p.x)) + "_" +
                            std::to_string(static_cast<int>(p.y)) + "_" +
                            std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".tif";
-    std::string filePath = (getCacheDir() / filename).string();
+    const fs::path cacheDir = getCacheDir();
+    const fs::path tmpDir = cacheDir / "tmp";
+    io::assureFolderExists(tmpDir);
+    std::string tmpPath = (tmpDir / filename).string();
+    std::string filePath = (cacheDir / filename).string();
 
     LOGD << "Downloading DSM from " << url << " ...";
 
-    auto response = utils::downloadToFile(url, filePath, true);
+    auto response = utils::downloadToFile(url, tmpPath, true);
 
     // Verify the downloaded file exists and has content
-    if (!fs::exists(filePath) || fs::file_size(filePath) == 0) {
-        throw NetException("Downloaded DSM file is empty or does not exist: " + filePath);
+    if (!fs::exists(tmpPath) || fs::file_size(tmpPath) == 0) {
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        throw NetException("Downloaded DSM file is empty or does not exist: " + tmpPath);
     }
 
+    // Downloaded outside of the cache folder, so that concurrent scans
+    // never see (and delete) a partial file
+    io::rename(tmpPath, filePath);
+
     return filePath;
 }
 
 bool DSMService::addGeoTIFFToCache(const fs::path &filePath, double latitude, double longitude)
 {
-    GDALDatasetH hDataset = GDALOpen(filePath.string().c_str(), GA_ReadOnly);
-    if (hDataset == nullptr)
-        throw GDALException("Cannot open " + filePath.string());
+    std::lock_guard<std::recursive_mutex> guard(mutex);
+
+    auto e = std::make_unique<DSMCacheEntry>(filePath, blockCache);
+    DSMCacheEntry *entry = e.get();
+
+    const auto key = filePath.string();
+    if (cache.find(key) != cache.end())
+    {
+        // Replaced, drop the old entry from the index
+        const DSMCacheEntry *old = cache[key].get();
+        for (auto &cell : grid)
+            cell.second.erase(std::remove(cell.second.begin(), cell.second.end(), old), cell.second.end());
+    }
+    cache[key] = std::move(e);
+
+    // Index only the header, the data is read on demand
+    const int minLat = cellOf(entry->bbox.min.y, -90, 90);
+    const int maxLat = cellOf(entry->bbox.max.y, -90, 90);
+    const int minLon = cellOf(entry->bbox.min.x, -180, 180);
+    const int maxLon = cellOf(entry->bbox.max.x, -180, 180);
+    for (int lat = minLat; lat <= maxLat; lat++)
+        for (int lon = minLon; lon <= maxLon; lon++)
+            grid[cellKey(lat, lon)].push_back(entry);
+
+    const bool contained = entry->bbox.contains(longitude, latitude);
+    if (contained)
+        LOGD << Point2D(longitude, latitude) << " inside raster boundary of " << key;
+
+    return contained;
+}
+
+fs::path DSMService::getCacheDir()
+{
+    return UserProfile::get()->getProfilePath("dsm_service_cache", true);
+}
 
-    DSMCacheEntry e;
-    e.width = static_cast<unsigned int>(GDALGetRasterXSize(hDataset));
-    e.height = static_cast<unsigned int>(GDALGetRasterYSize(hDataset));
+DSMBlockCache::DSMBlockCache(size_t maxBytes) : maxBytes(maxBytes)
+{
+}
 
-    if (GDALGetGeoTransform(hDataset, e.geoTransform) != CE_None)
-        throw GDALException("Cannot get geotransform for " + filePath.string());
+DSMBlockCache::BlockRef DSMBlockCache::add(DSMCacheEntry *entry, unsigned int key, size_t blockBytes)
+{
+    blocks.push_front({entry, key, blockBytes});
+    bytes += blockBytes;
 
-    std::string wkt = GDALGetProjectionRef(hDataset);
-    if (wkt.empty())
-        throw GDALException("Cannot get projection ref for " + filePath.string());
-    //    char *wktp = const_cast<char *>(wkt.c_str());
-    // OGRSpatialReference *srs = new OGRSpatialReference();
-    // if (srs->importFromWkt(&wktp) != OGRERR_NONE) throw GDALException("Cannot read spatial reference system for " + filePath.string() + ". Is PROJ installed?");
+    // The new block is always kept, even if it's larger than the budget
+    while (bytes > maxBytes && blocks.size() > 1)
+    {
+        const Block &lru = blocks.back();
+        lru.entry->blocks.erase(lru.key);
+        bytes -= lru.bytes;
+        blocks.pop_back();
+    }
+
+    return blocks.begin();
+}
 
-    // OGRSpatialReference *compare = new OGRSpatialReference();
-    // compare->importFromEPSG(4326);
+void DSMBlockCache::touch(BlockRef block)
+{
+    blocks.splice(blocks.begin(), blocks, block);
+}
 
-    // TODO: support for DSM with EPSG different than 4326
-    // if (!srs->IsSame(compare)) throw GDALException("Cannot read DSM values from raster: " + filePath.string() + " (EPSG != 4326)");
-    if (GDALGetRasterCount(hDataset) != 1)
-        throw GDALException("More than 1 raster band found in elevation raster: " + filePath.string());
+void DSMBlockCache::release(BlockRef block)
+{
+    bytes -= block->bytes;
+    blocks.erase(block);
+}
 
-    GDALRasterBandH hBand = GDALGetRasterBand(hDataset, 1);
-    e.nodata = static_cast<float>(GDALGetRasterNoDataValue(hBand, &e.hasNodata));
+DSMBlockCache::DatasetRef DSMBlockCache::addDataset(DSMCacheEntry *entry)
+{
+    datasets.push_front(entry);
 
-    Point2D min(0, e.height);
-    Point2D max(e.width, 0);
-    min.transform(e.geoTransform);
-    max.transform(e.geoTransform);
+    while (datasets.size() > MaxOpenDatasets)
+        datasets.back()->closeDataset();
 
-    e.bbox.min = min;
-    e.bbox.max = max;
-    Point2D position(longitude, latitude);
-    bool contained = e.bbox.contains(position);
+    return datasets.begin();
+}
 
-    if (contained)
+void DSMBlockCache::touchDataset(DatasetRef dataset)
+{
+    datasets.splice(datasets.begin(), datasets, dataset);
+}
+
+void DSMBlockCache::releaseDataset(DatasetRef dataset)
+{
+    datasets.erase(dataset);
+}
+
+DSMCacheEntry::DSMCacheEntry(const fs::path &path, DSMBlockCache &blockCache) : path(path), width(0), height(0), hasNodata(0), nodata(0), blockCache(blockCache)
+{
+    GDALDatasetH hDs = GDALOpen(path.string().c_str(), GA_ReadOnly);
+    if (hDs == nullptr)
+        throw GDALException("Cannot open " + path.string());
+
+    try
     {
-        // Inside the boundaries, load data
-        LOGD << position << " inside raster boundary, loading data from " << filePath.string();
-        e.loadData(hDataset);
-    }
+        width = static_cast<unsigned int>(GDALGetRasterXSize(hDs));
+        height = static_cast<unsigned int>(GDALGetRasterYSize(hDs));
 
-    // Always cache the entry (at least with bbox) to avoid
-    // repeated GDALOpen calls for files outside query bounds
-    cache[filePath.filename().string()] = e;
+        if (GDALGetGeoTransform(hDs, geoTransform) != CE_None)
+            throw GDALException("Cannot get geotransform for " + path.string());
 
-    GDALClose(hDataset);
-    // delete srs;
-    // delete compare;
+        std::string wkt = GDALGetProjectionRef(hDs);
+        if (wkt.empty())
+            throw GDALException("Cannot get projection ref for " + path.string());
 
-    return contained;
+        // TODO: support for DSM with EPSG different than 4326
+        OGRSpatialReferenceH hSrs = OSRNewSpatialReference(wkt.c_str());
+        const bool geographic = hSrs != nullptr && OSRIsGeographic(hSrs);
+        if (hSrs != nullptr)
+            OSRDestroySpatialReference(hSrs);
+        if (!geographic)
+            throw GDALException("Elevation raster is not in geographic coordinates: " + path.string());
+
+        if (GDALGetRasterCount(hDs) != 1)
+            throw GDALException("More than 1 raster band found in elevation raster: " + path.string());
+
+        if (geoTransform[2] != 0 || geoTransform[4] != 0)
+            throw GDALException("Rotated elevation rasters are not supported: " + path.string());
+
+        GDALRasterBandH hBand = GDALGetRasterBand(hDs, 1);
+        nodata = static_cast<float>(GDALGetRasterNoDataValue(hBand, &hasNodata));
+
+        const double x1 = geoTransform[0], x2 = geoTransform[0] + width * geoTransform[1];
+        const double y1 = geoTransform[3], y2 = geoTransform[3] + height * geoTransform[5];
+        bbox.min = Point2D(std::min(x1, x2), std::min(y1, y2));
+        bbox.max = Point2D(std::max(x1, x2), std::max(y1, y2));
+
+        if (bbox.min.x < -180.5 || bbox.max.x > 180.5 || bbox.min.y < -90.5 || bbox.max.y > 90.5)
+            throw GDALException("Elevation raster is not in geographic coordinates: " + path.string());
+    }
+    catch (...)
+    {
+        GDALClose(hDs);
+        throw;
+    }
+
+    GDALClose(hDs);
 }
 
-fs::path DSMService::getCacheDir()
+DSMCacheEntry::~DSMCacheEntry()
 {
-    return UserProfile::get()->getProfilePath("dsm_service_cache", true);
+    for (const auto &b : blocks)
+        blockCache.release(b.second.second);
+    closeDataset();
 }
 
-void DSMCacheEntry::loadData(GDALDatasetH hDataset)
+void DSMCacheEntry::closeDataset()
 {
-    GDALRasterBandH hBand = GDALGetRasterBand(hDataset, 1);
-    data.clear();
-    data.assign(width * height, 0.0f);
-    if (GDALRasterIO(hBand, GF_Read, 0, 0, static_cast<int>(width),
-                     static_cast<int>(height),
-                     &data[0],
-                     static_cast<int>(width),
-                     static_cast<int>(height),
-                     GDT_Float32, 0, 0) != CE_None)
+    if (hDataset == nullptr)
+        return;
+
+    GDALClose(hDataset);
+    hDataset = nullptr;
+    blockCache.releaseDataset(datasetRef);
+}
+
+float DSMCacheEntry::getPixel(unsigned int x, unsigned int y)
+{
+    const unsigned int bx = x / BlockSize;
+    const unsigned int by = y / BlockSize;
+    const unsigned int blockWidth = std::min(BlockSize, width - bx * BlockSize);
+    const unsigned int key = by * ((width + BlockSize - 1) / BlockSize) + bx;
+
+    auto it = blocks.find(key);
+    if (it == blocks.end())
     {
-        throw GDALException("Cannot read raster data");
+        if (hDataset == nullptr)
+        {
+            hDataset = GDALOpen(path.string().c_str(), GA_ReadOnly);
+            if (hDataset == nullptr)
+                throw GDALException("Cannot open " + path.string());
+            datasetRef = blockCache.addDataset(this);
+        }
+        else
+            blockCache.touchDataset(datasetRef);
+
+        const unsigned int blockHeight = std::min(BlockSize, height - by * BlockSize);
+        std::vector<float> block(static_cast<size_t>(blockWidth) * blockHeight);
+
+        if (GDALRasterIO(GDALGetRasterBand(hDataset, 1), GF_Read,
+                         static_cast<int>(bx * BlockSize), static_cast<int>(by * BlockSize),
+                         static_cast<int>(blockWidth), static_cast<int>(blockHeight),
+                         block.data(), static_cast<int>(blockWidth), static_cast<int>(blockHeight),
+                         GDT_Float32, 0, 0) != CE_None)
+            throw GDALException("Cannot read raster data from " + path.string());
+
+        const size_t bytes = block.size() * sizeof(float);
+        it = blocks.emplace(key, std::make_pair(std::move(block), DSMBlockCache::BlockRef())).first;
+
+        // Evicts only other blocks, it stays valid
+        it->second.second = blockCache.add(this, key, bytes);
     }
+    else
+        blockCache.touch(it->second.second);
+
+    return it->second.first[(y - by * BlockSize) * blockWidth + (x - bx * BlockSize)];
 }
 
 float DSMCacheEntry::getElevation(double latitude, double longitude)
 {
-    // TODO: This could be empty if the DSM is not loaded, we should understand why this could happen
-    if (data.empty())
-        throw AppException("Cannot get elevation, need to call loadData() first.");
     if (width == 0 || height == 0)
         throw AppException("Cannot get elevation, need to populate width/height first.");
 
-    double originX, originY, pixelSizeX, pixelSizeY;
-    originX = geoTransform[0];
-    originY = geoTransform[3];
-    pixelSizeX = geoTransform[1];
-    pixelSizeY = geoTransform[5];
+    // Pixel coordinates relative to the pixel centers
+    const double fx = (longitude - geoTransform[0]) / geoTransform[1] - 0.5;
+    const double fy = (latitude - geoTransform[3]) / geoTransform[5] - 0.5;
+
+    if (fx < -0.5 || fy < -0.5 || fx > width - 0.5 || fy > height - 0.5)
+        return nodata;
+
+    const double cx = std::max(0.0, std::min(static_cast<double>(width - 1), fx));
+    const double cy = std::max(0.0, std::min(static_cast<double>(height - 1), fy));
+    const auto x0 = static_cast<unsigned int>(cx);
+    const auto y0 = static_cast<unsigned int>(cy);
+    const unsigned int x1 = std::min(x0 + 1, width - 1);
+    const unsigned int y1 = std::min(y0 + 1, height - 1);
+    const double tx = cx - x0;
+    const double ty = cy - y0;
 
-    unsigned int pixelX = static_cast<unsigned int>((longitude - originX) / pixelSizeX);
-    unsigned int pixelY = static_cast<unsigned int>((latitude - originY) / pixelSizeY);
+    const float v00 = getPixel(x0, y0), v10 = getPixel(x1, y0);
+    const float v01 = getPixel(x0, y1), v11 = getPixel(x1, y1);
 
-    if (pixelX > width || pixelY > height)
+    if (hasNodata && (utils::sameFloat(v00, nodata) || utils::sameFloat(v10, nodata) ||
+                      utils::sameFloat(v01, nodata) || utils::sameFloat(v11, nodata)))
     {
-        throw AppException("Pixel coordinates (" +
-                           std::to_string(pixelX) + "," + std::to_string(pixelY) + ") " +
-                           "are outside of raster boundaries (" + std::to_string(width) + "x" + std::to_string(height) + ")");
+        // Don't blend with missing values, use the pixel containing the point
+        return getPixel(std::min(static_cast<unsigned int>(fx + 0.5), width - 1),
+                        std::min(static_cast<unsigned int>(fy + 0.5), height - 1));
     }
 
-    return data[pixelX + pixelY * width];
+    return static_cast<float>((v00 * (1 - tx) + v10 * tx) * (1 - ty) +
+                              (v01 * (1 - tx) + v11 * tx) * ty);
 }
@@ -7,6 +7,7 @@
 #include <limits>
 #include "dbops.h"
 #include "entry.h"
+#include "exifreader.h"
 
 #include "ddb.h"
 #include "constants.h"
@@ -31,6 +32,80 @@ namespace ddb
     static void parseModelEntry(const fs::path &path, Entry &entry);
     static void parseTiles3DEntry(const fs::path &path, Entry &entry);
 
+    // Files up to this size are read into memory while hashing, so that EXIF and
+    // GDAL probing reuse the bytes instead of reading the file again.
+    // Configurable via DDB_INGEST_BUFFER_MB (0 disables it)
+    static size_t ingestBufferBytes()
+    {
+        static const size_t bytes = []
+        {
+            const long long mb = utils::getEnvLong("DDB_INGEST_BUFFER_MB", 32);
+            return static_cast<size_t>(mb) * 1024 * 1024;
+        }();
+        return bytes;
+    }
+
+    // JPEG metadata (APP segments) precedes the image data, so for larger
+    // files the head of the file is usually enough for Exiv2
+    static const size_t JpegHeadBytes = 1024 * 1024;
+
+    // How many leading bytes of a file to keep while hashing it (0 = none)
+    static size_t ingestCaptureBytes(const io::Path &p, std::uintmax_t size)
+    {
+        if (!p.checkExtension({"jpg", "jpeg", "dng", "tif", "tiff", "png", "gif", "webp",
+                               "mp4", "mov", "webm", "m4v", "avi", "mkv"}))
+            return 0;
+
+        const size_t limit = ingestBufferBytes();
+        if (limit == 0)
+            return 0;
+        if (size <= limit)
+            return static_cast<size_t>(size);
+        if (p.checkExtension({"jpg", "jpeg"}))
+            return JpegHeadBytes;
+        return 0;
+    }
+
+    // Path of a /vsimem/ copy of the bytes captured while hashing, or "" if the
+    // raster must be opened from disk. Sidecars (world files, .aux.xml) are not
+    // visible from /vsimem/, so rasters that have them are always read from disk.
+    static std::string memoryRasterPath(const fs::path &path, const FingerprintContext &ctx)
+    {
+        if (!ctx.completeData || ctx.fileData.empty())
+            return "";
+
+        std::error_code ec;
+        for (const char *ext : {".tfw", ".tifw", ".tiffw", ".wld", ".prj"})
+        {
+            if (fs::exists(fs::path(path).replace_extension(ext), ec))
+                return "";
+        }
+        if (fs::exists(path.string() + ".aux.xml", ec))
+            return "";
+
+        const std::string vsiPath = "/vsimem/ingest_" + utils::generateRandomString(16) + path.extension().string();
+        VSILFILE *f = VSIFileFromMemBuffer(vsiPath.c_str(), const_cast<GByte *>(ctx.fileData.data()),
+                                           static_cast<vsi_l_offset>(ctx.fileData.size()), FALSE);
+        if (f == nullptr)
+            return "";
+        VSIFCloseL(f);
+
+        return vsiPath;
+    }
+
+    // Removes a /vsimem/ file when going out of scope
+    struct VsiMemFile
+    {
+        std::string path;
+
+        explicit VsiMemFile(const std::string &path) : path(path) {}
+        ~VsiMemFile()
+        {
+            if (!path.empty())
+                VSIUnlink(path.c_str());
+        }
+    };
+
     void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entry, bool withHash)
     {
         FingerprintContext ctx;
@@ -82,10 +157,24 @@ namespace ddb
         }
         else
         {
+            entry.size = p.getSize();
+
             if (entry.hash == "" && withHash)
-                entry.hash = Hash::fileSHA256(path.string());
+            {
+                const size_t captureBytes = ingestCaptureBytes(p, entry.size);
+                if (captureBytes > 0)
+                {
+                    // Single read: the digest and the metadata probes share the same bytes
+                    entry.hash = Hash::fileSHA256(path.string(), ctx.fileData, captureBytes);
+                    ctx.dataPath = path.string();
+                    ctx.completeData = ctx.fileData.size() == entry.size;
+                }
+                else
+                {
+                    entry.hash = Hash::fileSHA256(path.string());
+                }
+            }
 
-            entry.size = p.getSize();
             entry.type = fingerprint(p.get(), ctx);
 
             bool pano = entry.type == EntryType::Panorama || entry.type == EntryType::GeoPanorama;
@@ -284,8 +373,10 @@ namespace ddb
 
                 LOGV << "Processing GeoRaster file: " << path.string();
 
+                const VsiMemFile memFile(memoryRasterPath(path, ctx));
+
                 GDALDatasetH hDataset;
-                hDataset = GDALOpen(path.string().c_str(), GA_ReadOnly);
+                hDataset = GDALOpen(memFile.path.empty() ? path.string().c_str() : memFile.path.c_str(), GA_ReadOnly);
                 if (!hDataset)
                 {
                     LOGV << "GDAL failed to open dataset: " << path.string();
@@ -822,17 +913,15 @@ namespace ddb
         //    LOGD << "LL: " << lowerLeft;
         //    LOGD << "LR: " << lowerRight;
 
-        // Convert to geographic
-        auto ul = fromUTM(upperLeft, utmZone);
-        auto ur = fromUTM(upperRight, utmZone);
-        auto ll = fromUTM(lowerLeft, utmZone);
-        auto lr = fromUTM(lowerRight, utmZone);
-
-        geom.addPoint(ul.longitude, ul.latitude, groundHeight);
-        geom.addPoint(ll.longitude, ll.latitude, groundHeight);
-        geom.addPoint(lr.longitude, lr.latitude, groundHeight);
-        geom.addPoint(ur.longitude, ur.latitude, groundHeight);
-        geom.addPoint(ul.longitude, ul.latitude, groundHeight);
+        // Convert to geographic (ring order: UL, LL, LR, UR)
+        const double xs[4] = {upperLeft.x, lowerLeft.x, lowerRight.x, upperRight.x};
+        const double ys[4] = {upperLeft.y, lowerLeft.y, lowerRight.y, upperRight.y};
+        double lats[4], lons[4];
+        fromUTM(4, xs, ys, lats, lons, utmZone);
+
+        for (int i = 0; i < 4; i++)
+            geom.addPoint(lons[i], lats[i], groundHeight);
+        geom.addPoint(lons[0], lats[0], groundHeight);
     }
 
     void Entry::toJSON(json &j) const
@@ -979,6 +1068,39 @@ namespace ddb
         }
     }
 
+    // Opens and reads the metadata of an image, from the bytes captured while
+    // hashing when possible
+    static std::unique_ptr<Exiv2::Image> openExivImage(const fs::path &path, const FingerprintContext &ctx)
+    {
+        if (!ctx.fileData.empty())
+        {
+            try
+            {
+                auto image = Exiv2::ImageFactory::open(ctx.fileData.data(), ctx.fileData.size());
+                if (image.get())
+                {
+                    image->readMetadata();
+
+                    // A head of the file that stops before the frame header is not enough
+                    if (ctx.completeData || (image->pixelWidth() > 0 && image->pixelHeight() > 0))
+                        return image;
+                }
+            }
+            catch (Exiv2::Error &)
+            {
+                if (ctx.completeData)
+                    throw;
+            }
+
+            LOGD << "Cannot read metadata from the head of " << path.string() << ", reading the file";
+        }
+
+        auto image = Exiv2::ImageFactory::open(path.string());
+        if (image.get())
+            image->readMetadata();
+        return image;
+    }
+
     EntryType fingerprint(const fs::path &path)
     {
         FingerprintContext ctx;
@@ -992,6 +1114,14 @@ namespace ddb
         ctx.exivImage.reset();
         ctx.parser.reset();
 
+        // Captured bytes of another file are of no use
+        if (ctx.dataPath != path.string())
+        {
+            ctx.fileData.clear();
+            ctx.dataPath.clear();
+            ctx.completeData = false;
+        }
+
         EntryType type = EntryType::Generic;
         io::Path p(path);
 
@@ -1044,8 +1174,10 @@ namespace ddb
 
         if (tif)
         {
+            const VsiMemFile memFile(memoryRasterPath(path, ctx));
+
             GDALDatasetH hDataset;
-            hDataset = GDALOpen(p.string().c_str(), GA_ReadOnly);
+            hDataset = GDALOpen(memFile.path.empty() ? p.string().c_str() : memFile.path.c_str(), GA_ReadOnly);
             if (hDataset != NULL)
             {
                 const char *proj = GDALGetProjectionRef(hDataset);
@@ -1059,6 +1191,7 @@ namespace ddb
             {
                 LOGD << "Cannot open " << p.string().c_str() << " for georaster test";
             }
+
         }
 
         bool image = (jpg || tif || dng || nongeoImage) && !georaster;
@@ -1070,18 +1203,25 @@ namespace ddb
 
             try
             {
-                ctx.exivImage = Exiv2::ImageFactory::open(path.string());
-                if (!ctx.exivImage.get())
-                    throw IndexException("Cannot open " + path.string());
+                // JPEG metadata is read natively from the captured bytes when possible
+                if (jpg && !ctx.fileData.empty())
+                    ctx.parser = readJpegMetadata(ctx.fileData.data(), ctx.fileData.size());
 
-                ctx.exivImage->readMetadata();
-                ctx.parser = std::make_unique<ExifParser>(ctx.exivImage.get());
+                if (!ctx.parser)
+                {
+                    ctx.exivImage = openExivImage(path, ctx);
+                    if (!ctx.exivImage.get())
+                        throw IndexException("Cannot open " + path.string());
+
+                    ctx.parser = std::make_unique<ExifParser>(ctx.exivImage.get());
+                }
                 ctx.populated = true;
 
                 if (type == EntryType::Image)
                 {
                     // Panorama?
-                    if (ctx.exivImage->pixelWidth() / ctx.exivImage->pixelHeight() >= 2)
+                    const auto size = ctx.parser->extractImageSize();
+                    if (size.height > 0 && size.width / size.height >= 2)
                         type = EntryType::Panorama;
                 }
 
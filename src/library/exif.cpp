@@ -10,6 +10,16 @@
 namespace ddb
 {
 
+    void ExifParser::buildIndex()
+    {
+        // Keep the first datum of each key, as findKey does
+        for (auto it = exifData.begin(); it != exifData.end(); ++it)
+            exifIndex.emplace(it->key(), it);
+        for (auto it = xmpData.begin(); it != xmpData.end(); ++it)
+            xmpIndex.emplace(it->key(), it);
+        indexed = true;
+    }
+
     Exiv2::ExifData::const_iterator ExifParser::findExifKey(const std::string &key)
     {
         return findExifKey({key});
@@ -18,11 +28,15 @@ namespace ddb
     // Find the first available key, or exifData::end() if none exist
     Exiv2::ExifData::const_iterator ExifParser::findExifKey(const std::initializer_list<std::string> &keys)
     {
+        if (!indexed)
+            buildIndex();
+
         for (auto &k : keys)
         {
-            auto it = exifData.findKey(Exiv2::ExifKey(k));
-            if (it != exifData.end())
-                return it;
+            // Normalized the same way as the datum keys
+            auto it = exifIndex.find(Exiv2::ExifKey(k).key());
+            if (it != exifIndex.end())
+                return it->second;
         }
         return exifData.end();
     }
@@ -35,13 +49,16 @@ namespace ddb
     // Find the first available key, or xmpData::end() if none exist
     Exiv2::XmpData::const_iterator ExifParser::findXmpKey(const std::initializer_list<std::string> &keys)
     {
+        if (!indexed)
+            buildIndex();
+
         for (auto &k : keys)
         {
             try
             {
-                auto it = xmpData.findKey(Exiv2::XmpKey(k));
-                if (it != xmpData.end())
-                    return it;
+                auto it = xmpIndex.find(Exiv2::XmpKey(k).key());
+                if (it != xmpIndex.end())
+                    return it->second;
             }
             catch (Exiv2::Error &)
             {
@@ -60,6 +77,9 @@ namespace ddb
         //        return ImageSize(static_cast<int>(imgWidth->toInt64()), static_cast<int>(imgHeight->toInt64()));
         //    }
 
+        if (image == nullptr)
+            return pixelSize;
+
         return ImageSize(image->pixelWidth(), image->pixelHeight());
     }
 
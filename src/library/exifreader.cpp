@@ -0,0 +1,562 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "exifreader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        const char ExifHeader[] = "Exif\0\0";
+        const size_t ExifHeaderSize = 6;
+        const char XmpHeader[] = "http://ns.adobe.com/xap/1.0/";
+        const char XmpExtensionHeader[] = "http://ns.adobe.com/xmp/extension/";
+
+        bool startsWith(const uint8_t *data, size_t size, const char *prefix, size_t prefixSize)
+        {
+            return size >= prefixSize && memcmp(data, prefix, prefixSize) == 0;
+        }
+
+        bool nativeExifEnabled()
+        {
+            static const bool enabled = []
+            {
+                const char *env = std::getenv("DDB_NATIVE_EXIF");
+                return env == nullptr || std::string(env) != "0";
+            }();
+            return enabled;
+        }
+
+        // Bounds-checked reads of a TIFF structure
+        class TiffData
+        {
+            const uint8_t *data;
+            size_t size;
+            bool littleEndian;
+
+        public:
+            TiffData(const uint8_t *data, size_t size, bool littleEndian) : data(data), size(size), littleEndian(littleEndian) {}
+
+            bool contains(size_t offset, size_t length) const
+            {
+                return offset <= size && length <= size - offset;
+            }
+
+            uint16_t u16(size_t offset) const
+            {
+                const uint8_t *p = data + offset;
+                return littleEndian ? static_cast<uint16_t>(p[0] | (p[1] << 8))
+                                    : static_cast<uint16_t>((p[0] << 8) | p[1]);
+            }
+
+            uint32_t u32(size_t offset) const
+            {
+                const uint8_t *p = data + offset;
+                return littleEndian ? (static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                                       (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24))
+                                    : ((static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                                       (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]));
+            }
+
+            const uint8_t *at(size_t offset) const { return data + offset; }
+
+            Exiv2::ByteOrder byteOrder() const { return littleEndian ? Exiv2::littleEndian : Exiv2::bigEndian; }
+        };
+
+        // Size in bytes of the TIFF field types (0 = unknown)
+        size_t typeSize(uint16_t type)
+        {
+            static const size_t sizes[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 4};
+            return type < sizeof(sizes) / sizeof(sizes[0]) ? sizes[type] : 0;
+        }
+
+        const uint16_t ExifIfdPointer = 0x8769;
+        const uint16_t GpsIfdPointer = 0x8825;
+        const uint16_t MakerNoteTag = 0x927c;
+
+        // Adds the entries of the IFD at offset to exifData under group, and
+        // returns the sub-IFD pointers it contains
+        bool decodeIfd(const TiffData &tiff, uint32_t offset, const char *group, Exiv2::ExifData &exifData,
+                       uint32_t *exifIfd, uint32_t *gpsIfd)
+        {
+            if (!tiff.contains(offset, 2))
+                return false;
+
+            const uint16_t count = tiff.u16(offset);
+            if (!tiff.contains(offset + 2, static_cast<size_t>(count) * 12))
+                return false;
+
+            for (uint16_t i = 0; i < count; i++)
+            {
+                const size_t entry = offset + 2 + static_cast<size_t>(i) * 12;
+                const uint16_t tag = tiff.u16(entry);
+                const uint16_t type = tiff.u16(entry + 2);
+                const uint32_t components = tiff.u32(entry + 4);
+
+                const size_t unit = typeSize(type);
+                if (unit == 0)
+                    return false;
+
+                if (tag == MakerNoteTag)
+                    continue;
+
+                const size_t length = static_cast<size_t>(components) * unit;
+                size_t valueOffset = entry + 8;
+                if (length > 4)
+                {
+                    valueOffset = tiff.u32(entry + 8);
+                    if (!tiff.contains(valueOffset, length))
+                        return false;
+                }
+
+                if (tag == ExifIfdPointer && exifIfd != nullptr && length == 4)
+                    *exifIfd = tiff.u32(valueOffset);
+                else if (tag == GpsIfdPointer && gpsIfd != nullptr && length == 4)
+                    *gpsIfd = tiff.u32(valueOffset);
+
+                auto value = Exiv2::Value::create(static_cast<Exiv2::TypeId>(type));
+                value->read(tiff.at(valueOffset), length, tiff.byteOrder());
+                exifData.add(Exiv2::ExifKey(tag, group), value.get());
+            }
+
+            return true;
+        }
+
+        // Minimal XML scanning over the XMP packet
+        class XmpScanner
+        {
+            std::string_view s;
+            std::vector<std::pair<std::string_view, std::string_view>> namespaces; // prefix --> URI
+            Exiv2::XmpData &xmpData;
+
+            static bool isSpace(char c)
+            {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            }
+
+            size_t skipSpaces(size_t p) const
+            {
+                while (p < s.size() && isSpace(s[p]))
+                    p++;
+                return p;
+            }
+
+            size_t nameEnd(size_t p) const
+            {
+                while (p < s.size() && !isSpace(s[p]) && s[p] != '=' && s[p] != '>' && s[p] != '/')
+                    p++;
+                return p;
+            }
+
+            // Parses name="value" at p, moving p past it
+            bool attribute(size_t &p, std::string_view &name, std::string_view &value) const
+            {
+                const size_t end = nameEnd(p);
+                name = s.substr(p, end - p);
+                p = skipSpaces(end);
+                if (p >= s.size() || s[p] != '=')
+                    return false;
+                p = skipSpaces(p + 1);
+                if (p >= s.size() || (s[p] != '"' && s[p] != '\''))
+                    return false;
+                const size_t close = s.find(s[p], p + 1);
+                if (close == std::string_view::npos)
+                    return false;
+                value = s.substr(p + 1, close - p - 1);
+                p = close + 1;
+                return !name.empty();
+            }
+
+            static void appendUtf8(std::string &out, unsigned long cp)
+            {
+                if (cp < 0x80)
+                    out += static_cast<char>(cp);
+                else if (cp < 0x800)
+                {
+                    out += static_cast<char>(0xC0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                    out += static_cast<char>(0xE0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += static_cast<char>(0xF0 | (cp >> 18));
+                    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+            }
+
+            static bool unescape(std::string_view v, std::string &out)
+            {
+                out.clear();
+                out.reserve(v.size());
+                for (size_t i = 0; i < v.size(); i++)
+                {
+                    if (v[i] != '&')
+                    {
+                        out += v[i];
+                        continue;
+                    }
+
+                    const size_t semi = v.find(';', i);
+                    if (semi == std::string_view::npos)
+                        return false;
+                    const auto entity = v.substr(i + 1, semi - i - 1);
+                    if (entity == "amp")
+                        out += '&';
+                    else if (entity == "lt")
+                        out += '<';
+                    else if (entity == "gt")
+                        out += '>';
+                    else if (entity == "quot")
+                        out += '"';
+                    else if (entity == "apos")
+                        out += '\'';
+                    else if (entity.size() > 1 && entity[0] == '#')
+                    {
+                        const bool hex = entity[1] == 'x' || entity[1] == 'X';
+                        const std::string digits(entity.substr(hex ? 2 : 1));
+                        char *endp = nullptr;
+                        const unsigned long cp = std::strtoul(digits.c_str(), &endp, hex ? 16 : 10);
+                        if (digits.empty() || *endp != '\0' || cp > 0x10FFFF)
+                            return false;
+                        appendUtf8(out, cp);
+                    }
+                    else
+                        return false;
+                    i = semi;
+                }
+                return true;
+            }
+
+            bool add(std::string_view qname, std::string_view rawValue)
+            {
+                const size_t colon = qname.find(':');
+                if (colon == std::string_view::npos)
+                    return false;
+                const auto prefix = qname.substr(0, colon);
+                const auto name = qname.substr(colon + 1);
+
+                std::string_view uri;
+                for (const auto &ns : namespaces)
+                    if (ns.first == prefix)
+                        uri = ns.second;
+                if (uri.empty())
+                    return false;
+
+                // Keys use the prefix Exiv2 has registered for the URI
+                const std::string nsUri(uri);
+                std::string exivPrefix = Exiv2::XmpProperties::prefix(nsUri);
+                if (exivPrefix.empty())
+                {
+                    try
+                    {
+                        Exiv2::XmpProperties::ns(std::string(prefix));
+                        return false; // Prefix taken by another namespace
+                    }
+                    catch (Exiv2::Error &)
+                    {
+                        Exiv2::XmpProperties::registerNs(nsUri, std::string(prefix));
+                        exivPrefix = prefix;
+                    }
+                }
+
+                std::string value;
+                if (!unescape(rawValue, value))
+                    return false;
+
+                Exiv2::XmpTextValue v;
+                v.read(value);
+                xmpData.add(Exiv2::XmpKey("Xmp." + exivPrefix + "." + std::string(name)), &v);
+                return true;
+            }
+
+            // Parses the rdf:Description starting at p, moving p past it
+            bool description(size_t &p)
+            {
+                p += strlen("<rdf:Description");
+
+                // Properties as attributes
+                while (true)
+                {
+                    p = skipSpaces(p);
+                    if (p >= s.size())
+                        return false;
+                    if (s.compare(p, 2, "/>") == 0)
+                    {
+                        p += 2;
+                        return true;
+                    }
+                    if (s[p] == '>')
+                    {
+                        p++;
+                        break;
+                    }
+
+                    std::string_view name, value;
+                    if (!attribute(p, name, value))
+                        return false;
+                    if (name.substr(0, 5) == "xmlns" || name == "rdf:about")
+                        continue;
+                    if (name.substr(0, 4) == "rdf:")
+                        return false;
+                    if (!add(name, value))
+                        return false;
+                }
+
+                // Properties as text elements
+                while (true)
+                {
+                    p = skipSpaces(p);
+                    if (s.compare(p, 18, "</rdf:Description>") == 0)
+                    {
+                        p += 18;
+                        return true;
+                    }
+                    if (p >= s.size() || s[p] != '<' || s.compare(p, 2, "</") == 0 || s.compare(p, 2, "<!") == 0 ||
+                        s.compare(p, 2, "<?") == 0)
+                        return false;
+
+                    const size_t nameStart = p + 1;
+                    const size_t end = nameEnd(nameStart);
+                    const auto name = s.substr(nameStart, end - nameStart);
+                    p = end;
+
+                    // Only namespace declarations, no qualifiers or rdf attributes
+                    while (true)
+                    {
+                        p = skipSpaces(p);
+                        if (p >= s.size() || s[p] == '/')
+                            return false;
+                        if (s[p] == '>')
+                            break;
+                        std::string_view attrName, attrValue;
+                        if (!attribute(p, attrName, attrValue) || attrName.substr(0, 5) != "xmlns")
+                            return false;
+                    }
+                    p++;
+
+                    // Text up to the closing tag, no nested elements
+                    const size_t textEnd = s.find('<', p);
+                    if (textEnd == std::string_view::npos || s.compare(textEnd, 2, "</") != 0 ||
+                        s.compare(textEnd + 2, name.size(), name) != 0)
+                        return false;
+                    const auto text = s.substr(p, textEnd - p);
+                    p = skipSpaces(textEnd + 2 + name.size());
+                    if (p >= s.size() || s[p] != '>')
+                        return false;
+                    p++;
+
+                    if (!add(name, text))
+                        return false;
+                }
+            }
+
+        public:
+            XmpScanner(std::string_view packet, Exiv2::XmpData &xmpData) : s(packet), xmpData(xmpData) {}
+
+            bool decode()
+            {
+                // Namespace declarations, wherever they are
+                for (size_t p = s.find("xmlns:"); p != std::string_view::npos; p = s.find("xmlns:", p))
+                {
+                    std::string_view name, uri;
+                    if (!attribute(p, name, uri))
+                        return false;
+                    namespaces.emplace_back(name.substr(6), uri);
+                }
+
+                // Everything meaningful is in rdf:Description elements
+                size_t p = s.find("<rdf:RDF");
+                if (p == std::string_view::npos)
+                    return false;
+                p = s.find('>', p);
+                if (p == std::string_view::npos)
+                    return false;
+                p++;
+
+                while (true)
+                {
+                    p = skipSpaces(p);
+                    if (s.compare(p, 10, "</rdf:RDF>") == 0)
+                        return true;
+                    if (s.compare(p, 16, "<rdf:Description") != 0 || p + 16 >= s.size() ||
+                        (!isSpace(s[p + 16]) && s[p + 16] != '>' && s[p + 16] != '/'))
+                        return false;
+                    if (!description(p))
+                        return false;
+                }
+            }
+        };
+
+    } // namespace
+
+    bool scanJpegSegments(const uint8_t *data, size_t size, JpegSegments &segments)
+    {
+        segments = JpegSegments();
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+            return false;
+
+        size_t p = 2;
+        while (p + 4 <= size)
+        {
+            if (data[p] != 0xFF)
+                return false;
+
+            // Fill bytes
+            while (p + 1 < size && data[p + 1] == 0xFF)
+                p++;
+            if (p + 4 > size)
+                return false;
+
+            const uint8_t marker = data[p + 1];
+            if (marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                p += 2;
+                continue;
+            }
+
+            // Metadata and frame header precede the image data
+            if (marker == 0xDA || marker == 0xD9)
+                return segments.width > 0 && segments.height > 0;
+
+            const size_t length = (static_cast<size_t>(data[p + 2]) << 8) | data[p + 3];
+            if (length < 2 || p + 2 + length > size)
+                return false;
+
+            const uint8_t *payload = data + p + 4;
+            const size_t payloadSize = length - 2;
+
+            if (marker == 0xE1)
+            {
+                if (startsWith(payload, payloadSize, ExifHeader, ExifHeaderSize))
+                {
+                    if (segments.exif != nullptr)
+                        return false;
+                    segments.exif = payload + ExifHeaderSize;
+                    segments.exifSize = payloadSize - ExifHeaderSize;
+                }
+                else if (startsWith(payload, payloadSize, XmpHeader, sizeof(XmpHeader)))
+                {
+                    if (segments.xmp != nullptr)
+                        return false;
+                    segments.xmp = reinterpret_cast<const char *>(payload) + sizeof(XmpHeader);
+                    segments.xmpSize = payloadSize - sizeof(XmpHeader);
+                }
+                else if (startsWith(payload, payloadSize, XmpExtensionHeader, sizeof(XmpExtensionHeader)))
+                    return false;
+            }
+            else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                // Start of frame: precision, height, width
+                if (payloadSize < 5)
+                    return false;
+                segments.height = (payload[1] << 8) | payload[2];
+                segments.width = (payload[3] << 8) | payload[4];
+            }
+
+            p += 2 + length;
+        }
+
+        return false;
+    }
+
+    bool decodeExifIfds(const uint8_t *data, size_t size, Exiv2::ExifData &exifData)
+    {
+        if (size < 8)
+            return false;
+
+        bool littleEndian;
+        if (data[0] == 'I' && data[1] == 'I')
+            littleEndian = true;
+        else if (data[0] == 'M' && data[1] == 'M')
+            littleEndian = false;
+        else
+            return false;
+
+        const TiffData tiff(data, size, littleEndian);
+        if (tiff.u16(2) != 42)
+            return false;
+
+        try
+        {
+            uint32_t exifIfd = 0, gpsIfd = 0;
+            if (!decodeIfd(tiff, tiff.u32(4), "Image", exifData, &exifIfd, &gpsIfd))
+                return false;
+            if (exifIfd != 0 && !decodeIfd(tiff, exifIfd, "Photo", exifData, nullptr, nullptr))
+                return false;
+            if (gpsIfd != 0 && !decodeIfd(tiff, gpsIfd, "GPSInfo", exifData, nullptr, nullptr))
+                return false;
+        }
+        catch (Exiv2::Error &e)
+        {
+            LOGD << "Cannot decode EXIF natively: " << e.what();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool decodeSimpleXmp(const char *packet, size_t size, Exiv2::XmpData &xmpData)
+    {
+        // Trailing padding and NULs are not part of the packet
+        while (size > 0 && packet[size - 1] == '\0')
+            size--;
+
+        bool ok;
+        try
+        {
+            ok = XmpScanner(std::string_view(packet, size), xmpData).decode();
+        }
+        catch (Exiv2::Error &e)
+        {
+            LOGD << "Cannot decode XMP natively: " << e.what();
+            ok = false;
+        }
+
+        if (!ok)
+            xmpData.clear();
+        return ok;
+    }
+
+    std::unique_ptr<ExifParser> readJpegMetadata(const uint8_t *data, size_t size)
+    {
+        if (!nativeExifEnabled())
+            return nullptr;
+
+        JpegSegments segments;
+        if (!scanJpegSegments(data, size, segments))
+            return nullptr;
+
+        Exiv2::ExifData exifData;
+        if (segments.exif != nullptr && !decodeExifIfds(segments.exif, segments.exifSize, exifData))
+        {
+            exifData.clear();
+            Exiv2::ExifParser::decode(exifData, segments.exif, segments.exifSize);
+        }
+
+        Exiv2::XmpData xmpData;
+        if (segments.xmp != nullptr && !decodeSimpleXmp(segments.xmp, segments.xmpSize, xmpData))
+        {
+            if (Exiv2::XmpParser::decode(xmpData, std::string(segments.xmp, segments.xmpSize)) > 1)
+                LOGD << "Failed to decode XMP metadata";
+        }
+
+        return std::make_unique<ExifParser>(std::move(exifData), std::move(xmpData), ImageSize(segments.width, segments.height));
+    }
+
+}
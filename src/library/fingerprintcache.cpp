@@ -0,0 +1,207 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "fingerprintcache.h"
+
+#include <chrono>
+
+#include "exceptions.h"
+#include "logger.h"
+#include "mio.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace ddb
+{
+
+    namespace
+    {
+        // Cached metadata is only reused by the DroneDB version that produced it,
+        // so upgrading and rescanning still picks up newly extracted properties
+        const char *parserVersion = APP_VERSION;
+
+        const long long racyWindowNs = 2000000000LL;
+
+        json geometryToJson(const BasicGeometry &g)
+        {
+            json coords = json::array();
+            for (const auto &p : g.points)
+                coords.push_back(json::array({p.x, p.y, p.z}));
+            return coords;
+        }
+
+        void geometryFromJson(const json &coords, BasicGeometry &g)
+        {
+            g.clear();
+            if (!coords.is_array())
+                return;
+            for (const auto &c : coords)
+            {
+                if (c.is_array() && c.size() >= 3)
+                    g.addPoint(c[0].get<double>(), c[1].get<double>(), c[2].get<double>());
+            }
+        }
+    }
+
+    bool getFileIdentity(const fs::path &p, FileIdentity &id)
+    {
+#ifdef WIN32
+        HANDLE hFile = CreateFileW(p.wstring().c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return false;
+
+        BY_HANDLE_FILE_INFORMATION info;
+        const bool ok = GetFileInformationByHandle(hFile, &info) != 0;
+        CloseHandle(hFile);
+
+        if (!ok || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            return false;
+
+        const int64_t UNIX_TIME_START = 0x019DB1DED53E8000; // January 1, 1970 in 100ns ticks
+
+        LARGE_INTEGER mtime;
+        mtime.LowPart = info.ftLastWriteTime.dwLowDateTime;
+        mtime.HighPart = info.ftLastWriteTime.dwHighDateTime;
+
+        id.device = static_cast<long long>(info.dwVolumeSerialNumber);
+        id.inode = static_cast<long long>((static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow);
+        id.size = static_cast<long long>((static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow);
+        id.mtimeNs = (mtime.QuadPart - UNIX_TIME_START) * 100;
+        return true;
+#else
+        struct stat st;
+        if (::stat(p.string().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            return false;
+
+        id.device = static_cast<long long>(st.st_dev);
+        id.inode = static_cast<long long>(st.st_ino);
+        id.size = static_cast<long long>(st.st_size);
+#ifdef __APPLE__
+        id.mtimeNs = static_cast<long long>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+        id.mtimeNs = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        return true;
+#endif
+    }
+
+    void CachedFingerprint::toEntry(const fs::path &path, const fs::path &rootDirectory, const FileIdentity &id, Entry &e) const
+    {
+        io::Path p = io::Path(path);
+        io::Path relPath = p.relativeTo(rootDirectory);
+
+        e.path = relPath.generic();
+        e.depth = relPath.depth();
+        if (e.mtime == 0)
+            e.mtime = p.getModifiedTime();
+        e.size = static_cast<std::uintmax_t>(id.size);
+        e.hash = hash;
+        e.type = type;
+        e.properties = properties;
+        e.point_geom = point_geom;
+        e.polygon_geom = polygon_geom;
+    }
+
+    bool FingerprintCache::lookup(const FileIdentity &id, CachedFingerprint &out)
+    {
+        auto q = db->query("SELECT hash, type, entry, parser FROM fingerprint_cache "
+                           "WHERE device = ? AND inode = ? AND size = ? AND mtime_ns = ?");
+        q->bind(1, id.device);
+        q->bind(2, id.inode);
+        q->bind(3, id.size);
+        q->bind(4, id.mtimeNs);
+
+        if (!q->fetch())
+            return false;
+
+        out.hash = q->getText(0);
+        out.hasEntry = false;
+
+        if (q->getText(3) == parserVersion)
+        {
+            const auto blob = json::parse(q->getText(2), nullptr, false);
+            if (blob.is_object())
+            {
+                out.type = static_cast<EntryType>(q->getInt(1));
+                out.properties = blob.value("properties", json::object());
+                geometryFromJson(blob.value("point", json::array()), out.point_geom);
+                geometryFromJson(blob.value("polygon", json::array()), out.polygon_geom);
+                out.hasEntry = true;
+            }
+            else
+            {
+                LOGD << "Corrupted fingerprint cache entry for inode " << id.inode;
+            }
+        }
+
+        return !out.hash.empty();
+    }
+
+    void FingerprintCache::store(const FileIdentity &id, const Entry &e)
+    {
+        if (!isCacheable(id) || e.hash.empty())
+            return;
+
+        json blob;
+        blob["properties"] = e.properties;
+        blob["point"] = geometryToJson(e.point_geom);
+        blob["polygon"] = geometryToJson(e.polygon_geom);
+
+        auto q = db->query("INSERT OR REPLACE INTO fingerprint_cache "
+                           "(device, inode, size, mtime_ns, hash, type, entry, parser) "
+                           "VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+        q->bind(1, id.device);
+        q->bind(2, id.inode);
+        q->bind(3, id.size);
+        q->bind(4, id.mtimeNs);
+        q->bind(5, e.hash);
+        q->bind(6, static_cast<int>(e.type));
+        q->bind(7, blob.dump());
+        q->bind(8, std::string(parserVersion));
+        q->execute();
+    }
+
+    void FingerprintCache::storeHash(const FileIdentity &id, const std::string &hash)
+    {
+        if (!isCacheable(id) || hash.empty())
+            return;
+
+        auto q = db->query("INSERT OR REPLACE INTO fingerprint_cache "
+                           "(device, inode, size, mtime_ns, hash, type, entry, parser) "
+                           "VALUES (?, ?, ?, ?, ?, 0, '', '')");
+        q->bind(1, id.device);
+        q->bind(2, id.inode);
+        q->bind(3, id.size);
+        q->bind(4, id.mtimeNs);
+        q->bind(5, hash);
+        q->execute();
+    }
+
+    int FingerprintCache::prune()
+    {
+        // One pass over the cache, each row is looked up through ix_entries_hash
+        auto q = db->query("DELETE FROM fingerprint_cache WHERE NOT EXISTS "
+                           "(SELECT 1 FROM entries WHERE entries.hash = fingerprint_cache.hash)");
+        q->execute();
+
+        const int deleted = db->changes();
+        if (deleted > 0)
+            LOGD << "Pruned " << deleted << " fingerprints";
+        return deleted;
+    }
+
+    bool FingerprintCache::isCacheable(const FileIdentity &id)
+    {
+        const long long nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count();
+        return id.mtimeNs < nowNs - racyWindowNs;
+    }
+
+} // namespace ddb
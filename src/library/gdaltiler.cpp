@@ -569,7 +569,7 @@ namespace ddb
 
             // Apply formula
             std::vector<float> result(wSize);
-            const auto* formulaPtr = ve.getFormula(visParams.formula);
+            const auto formulaPtr = ve.getFormula(visParams.formula);
             if (!formulaPtr)
                 throw InvalidArgsException("Unknown formula: " + visParams.formula);
 
@@ -3,8 +3,10 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 #include "gdal_inc.h"
 
+#include <cmath>
 #include <sstream>
 #include "geo.h"
+#include "utm.h"
 
 namespace ddb
 {
@@ -77,54 +79,40 @@ namespace ddb
         return ss.str();
     }
 
-    Projected2D toUTM(double latitude, double longitude, const UTMZone &zone)
+    double centralMeridian(const UTMZone &zone)
     {
-        Projected2D result;
-
-        OGRSpatialReferenceH hSrs = OSRNewSpatialReference(nullptr);
-
-        if (hSrs == nullptr)
-            throw GDALException("Cannot create spatial reference system for UTM zone " + std::to_string(zone.zone) + (zone.north ? "N" : "S"));
+        return zone.zone * 6.0 - 183.0;
+    }
 
-        std::string proj = getProjForUTM(zone);
+    static double falseNorthing(const UTMZone &zone)
+    {
+        return zone.north ? 0.0 : 10000000.0;
+    }
 
+    Projected2D toUTM(double latitude, double longitude, const UTMZone &zone)
+    {
+        Projected2D p;
+        toUTM(1, &latitude, &longitude, &p.x, &p.y, zone);
+        return p;
+    }
 
-        if (OSRImportFromProj4(hSrs, proj.c_str()) != OGRERR_NONE)
+    void toUTM(size_t count, const double *latitudes, const double *longitudes, double *x, double *y, const UTMZone &zone)
+    {
+        // The kernel returns NaN outside of its domain instead of failing
+        for (size_t i = 0; i < count; i++)
         {
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot import spatial reference system " + proj + ". Is PROJ available?");
+            if (!std::isfinite(latitudes[i]) || !std::isfinite(longitudes[i]) || std::fabs(latitudes[i]) > 90.0)
+                throw GDALException("Cannot transform coordinates to UTM " + std::to_string(latitudes[i]) + "," + std::to_string(longitudes[i]));
         }
 
-        OGRSpatialReferenceH hWgs84 = OSRNewSpatialReference(nullptr);
-
-        if (hWgs84 == nullptr)
-        {
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot create WGS84 spatial reference system for UTM zone " + std::to_string(zone.zone) + (zone.north ? "N" : "S"));
-        }
+        TransverseMercator::utm().forward(centralMeridian(zone), count, latitudes, longitudes, x, y);
 
-        if (OSRImportFromEPSG(hWgs84, 4326) != OGRERR_NONE)
+        const double fn = falseNorthing(zone);
+        for (size_t i = 0; i < count; i++)
         {
-            OSRDestroySpatialReference(hWgs84);
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot import EPSG:4326 spatial reference system. Is PROJ available?");
+            x[i] += 500000.0;
+            y[i] += fn;
         }
-
-        OGRCoordinateTransformationH hTransform = OCTNewCoordinateTransformation(hWgs84, hSrs);
-
-        double geoX = longitude;
-        double geoY = latitude;
-
-        const auto success = OCTTransform(hTransform, 1, &geoX, &geoY, nullptr) == TRUE;
-
-        OCTDestroyCoordinateTransformation(hTransform);
-        OSRDestroySpatialReference(hWgs84);
-        OSRDestroySpatialReference(hSrs);
-
-        if (!success)
-            throw GDALException("Cannot transform coordinates to UTM " + std::to_string(latitude) + "," + std::to_string(longitude));
-
-        return Projected2D(geoX, geoY);
     }
 
     Geographic2D fromUTM(const Projected2D &p, const UTMZone &zone)
@@ -134,49 +122,25 @@ namespace ddb
 
     Geographic2D fromUTM(double x, double y, const UTMZone &zone)
     {
-        OGRSpatialReferenceH hSrs = OSRNewSpatialReference(nullptr);
-        if (hSrs == nullptr)
-            throw GDALException("Cannot create spatial reference system for UTM zone " + std::to_string(zone.zone) + (zone.north ? "N" : "S"));
-
-        OGRSpatialReferenceH hWgs84 = OSRNewSpatialReference(nullptr);
+        Geographic2D g;
+        fromUTM(1, &x, &y, &g.latitude, &g.longitude, zone);
+        return g;
+    }
 
-        if (hWgs84 == nullptr)
-        {
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot create WGS84 spatial reference system for UTM zone " + std::to_string(zone.zone) + (zone.north ? "N" : "S"));
-        }
+    void fromUTM(size_t count, const double *x, const double *y, double *latitudes, double *longitudes, const UTMZone &zone)
+    {
+        const double lon0 = centralMeridian(zone);
+        const double fn = falseNorthing(zone);
+        const auto &tm = TransverseMercator::utm();
 
-        std::string proj = getProjForUTM(zone);
-        if (OSRImportFromProj4(hSrs, proj.c_str()) != OGRERR_NONE)
+        for (size_t i = 0; i < count; i++)
         {
-            OSRDestroySpatialReference(hWgs84);
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot import spatial reference system " + proj + ". Is PROJ available?");
-        }
+            if (std::isfinite(x[i]) && std::isfinite(y[i]))
+                tm.reverse(lon0, x[i] - 500000.0, y[i] - fn, latitudes[i], longitudes[i]);
 
-        if (OSRImportFromEPSG(hWgs84, 4326) != OGRERR_NONE)
-        {
-            OSRDestroySpatialReference(hWgs84);
-            OSRDestroySpatialReference(hSrs);
-            throw GDALException("Cannot import EPSG:4326 spatial reference system. Is PROJ available?");
+            if (!std::isfinite(x[i]) || !std::isfinite(y[i]) || !std::isfinite(latitudes[i]) || !std::isfinite(longitudes[i]))
+                throw GDALException("Cannot transform coordinates from UTM " + std::to_string(x[i]) + "," + std::to_string(y[i]));
         }
-
-        OGRCoordinateTransformationH hTransform = OCTNewCoordinateTransformation(hSrs, hWgs84);
-
-        double geoX = x;
-        double geoY = y;
-
-        const auto success = OCTTransform(hTransform, 1, &geoX, &geoY, nullptr) == TRUE;
-
-        OCTDestroyCoordinateTransformation(hTransform);
-        OSRDestroySpatialReference(hWgs84);
-        OSRDestroySpatialReference(hSrs);
-
-        if (!success)
-            throw GDALException("Cannot transform coordinates from UTM " + std::to_string(x) + "," + std::to_string(y));
-
-        return Geographic2D(geoX, geoY);
-
     }
 
 }
@@ -4,9 +4,22 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include "hash.h"
 #include "exceptions.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
 using namespace ddb;
 
 namespace {
@@ -18,43 +31,296 @@ namespace {
         }
         return oss.str();
     }
+
+    const size_t BlockSize = 4 * 1024 * 1024;
+
+    // Number of blocks in flight between the reader thread and the digest loop
+    const size_t PipelineDepth = 3;
+
+    // Files smaller than this are hashed inline: a thread hand-off costs more than it saves
+    const uint64_t PipelineThreshold = 2 * BlockSize;
+
+    // Sequential block reader. On POSIX it uses a raw descriptor so the kernel can be told
+    // the access pattern (aggressive read-ahead, early page reclaim).
+    class BlockReader {
+#ifndef _WIN32
+        int fd;
+#else
+        std::ifstream f;
+#endif
+        std::string path;
+        uint64_t fileSize = 0;
+
+    public:
+        explicit BlockReader(const std::string &path) : path(path) {
+#ifndef _WIN32
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw FSException("Cannot open " + path + " for hashing");
+
+            struct stat st;
+            if (::fstat(fd, &st) == 0)
+                fileSize = static_cast<uint64_t>(st.st_size);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+            f.open(path, std::ios::binary | std::ios::ate);
+            if (!f.is_open())
+                throw FSException("Cannot open " + path + " for hashing");
+
+            fileSize = static_cast<uint64_t>(f.tellg());
+            f.seekg(0);
+#endif
+        }
+
+        ~BlockReader() {
+#ifndef _WIN32
+            ::close(fd);
+#endif
+        }
+
+        BlockReader(const BlockReader &) = delete;
+        BlockReader &operator=(const BlockReader &) = delete;
+
+        uint64_t size() const { return fileSize; }
+
+        // Fills buf with up to len bytes; returns fewer only at end of file
+        size_t read(char *buf, size_t len) {
+            size_t total = 0;
+#ifndef _WIN32
+            while (total < len) {
+                const ssize_t n = ::read(fd, buf + total, len - total);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    throw FSException("Cannot read " + path + " for hashing");
+                }
+                if (n == 0) break;
+                total += static_cast<size_t>(n);
+            }
+#else
+            f.read(buf, len);
+            total = static_cast<size_t>(f.gcount());
+            if (f.bad())
+                throw FSException("Cannot read " + path + " for hashing");
+#endif
+            return total;
+        }
+    };
+
+    EvpMdCtxPtr newSHA256Context() {
+        EvpMdCtxPtr ctx(EVP_MD_CTX_new());
+        if (!ctx)
+            throw AppException("Failed to create EVP_MD_CTX for SHA256");
+
+        if (EVP_DigestInit_ex(ctx.get(), EVP_sha256(), NULL) != 1) {
+            throw AppException("Failed to initialize SHA256 digest");
+        }
+
+        return ctx;
+    }
+
+    std::string finalizeHex(EVP_MD_CTX *ctx) {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int hashLen;
+        safeDigestFinal(ctx, hash, &hashLen);
+
+        return bytesToHex(hash, hashLen);
+    }
+
+    void digestSerial(BlockReader &reader, EVP_MD_CTX *ctx, std::vector<char> &buffer) {
+        size_t n;
+        while ((n = reader.read(buffer.data(), buffer.size())) > 0) {
+            safeDigestUpdate(ctx, buffer.data(), n);
+            if (n < buffer.size()) break;
+        }
+    }
+
+    // Reads on a dedicated thread into a ring of PipelineDepth blocks while the calling
+    // thread digests, so disk and CPU work overlap.
+    void digestPipelined(BlockReader &reader, EVP_MD_CTX *ctx) {
+        std::vector<std::vector<char>> ring(PipelineDepth, std::vector<char>(BlockSize));
+        std::vector<size_t> sizes(PipelineDepth, 0);
+
+        std::mutex m;
+        std::condition_variable cv;
+        size_t produced = 0;
+        size_t consumed = 0;
+        bool eof = false;
+        bool cancel = false;
+        std::exception_ptr readError;
+
+        std::thread producer([&]() {
+            try {
+                for (;;) {
+                    {
+                        std::unique_lock<std::mutex> lock(m);
+                        cv.wait(lock, [&] { return cancel || produced - consumed < PipelineDepth; });
+                        if (cancel) return;
+                    }
+
+                    const size_t slot = produced % PipelineDepth;
+                    const size_t n = reader.read(ring[slot].data(), BlockSize);
+
+                    {
+                        std::lock_guard<std::mutex> lock(m);
+                        sizes[slot] = n;
+                        if (n > 0) produced++;
+                        if (n < BlockSize) eof = true;
+                    }
+                    cv.notify_all();
+
+                    if (n < BlockSize) return;
+                }
+            } catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    readError = std::current_exception();
+                    eof = true;
+                }
+                cv.notify_all();
+            }
+        });
+
+        try {
+            for (;;) {
+                size_t slot;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    cv.wait(lock, [&] { return consumed < produced || eof; });
+                    if (consumed == produced) break;
+                    slot = consumed % PipelineDepth;
+                }
+
+                safeDigestUpdate(ctx, ring[slot].data(), sizes[slot]);
+
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    consumed++;
+                }
+                cv.notify_all();
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                cancel = true;
+            }
+            cv.notify_all();
+            producer.join();
+            throw;
+        }
+
+        producer.join();
+
+        if (readError)
+            std::rethrow_exception(readError);
+    }
 }
 
 std::string Hash::fileSHA256(const std::string &path) {
-    std::ifstream f(path, std::ios::binary);
+    BlockReader reader(path);
+    EvpMdCtxPtr ctx = newSHA256Context();
+
+    if (reader.size() >= PipelineThreshold) {
+        digestPipelined(reader, ctx.get());
+    } else {
+        std::vector<char> buffer(static_cast<size_t>(std::max<uint64_t>(1, std::min<uint64_t>(reader.size() + 1, BlockSize))));
+        digestSerial(reader, ctx.get(), buffer);
+    }
 
-    if (!f.is_open())
-        throw FSException("Cannot open " + path + " for hashing");
+    return finalizeHex(ctx.get());
+}
 
-    EvpMdCtxPtr ctx(EVP_MD_CTX_new());
-    if (!ctx)
-        throw AppException("Failed to create EVP_MD_CTX for SHA256");
+std::string Hash::fileSHA256(const std::string &path, std::vector<uint8_t> &head, size_t maxHeadBytes) {
+    BlockReader reader(path);
+    EvpMdCtxPtr ctx = newSHA256Context();
 
-    if (EVP_DigestInit_ex(ctx.get(), EVP_sha256(), NULL) != 1) {
-        throw AppException("Failed to initialize SHA256 digest");
+    const size_t headSize = static_cast<size_t>(std::min<uint64_t>(reader.size(), maxHeadBytes));
+    head.resize(headSize);
+    const size_t n = reader.read(reinterpret_cast<char *>(head.data()), headSize);
+    head.resize(n);
+    safeDigestUpdate(ctx.get(), head.data(), n);
+
+    // Then the rest, if any
+    const uint64_t remaining = reader.size() > n ? reader.size() - n : 0;
+    if (remaining >= PipelineThreshold) {
+        digestPipelined(reader, ctx.get());
+    } else if (n == headSize) {
+        std::vector<char> buffer(static_cast<size_t>(std::max<uint64_t>(1, std::min<uint64_t>(remaining + 1, BlockSize))));
+        digestSerial(reader, ctx.get(), buffer);
     }
 
-    const size_t BufferSize = 144*7*1024;
-    std::vector<char> buffer(BufferSize);
+    return finalizeHex(ctx.get());
+}
+
+std::vector<std::string> Hash::filesSHA256(const std::vector<std::string> &paths, int maxThreads, size_t ioBudgetBytes) {
+    const size_t count = paths.size();
+    std::vector<std::string> hashes(count);
+    if (count == 0)
+        return hashes;
+
+    // Each worker owns one block buffer; the I/O budget bounds how many can be alive at once.
+    // Workers read serially: concurrency comes from hashing several files at the same time.
+    size_t numThreads = maxThreads > 0 ? static_cast<size_t>(maxThreads)
+                                       : std::max<size_t>(1, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, std::max<size_t>(1, ioBudgetBytes / BlockSize));
+    numThreads = std::min(numThreads, count);
+
+    std::vector<std::exception_ptr> failures(count);
+    std::atomic<size_t> cursor{0};
+    std::atomic<bool> failed{false};
 
-    while (f) {
-        f.read(buffer.data(), BufferSize);
-        size_t numBytesRead = size_t(f.gcount());
-        if (numBytesRead > 0) {
-            safeDigestUpdate(ctx.get(), buffer.data(), numBytesRead);
+    auto worker = [&]() {
+        std::vector<char> buffer(BlockSize);
+        while (!failed) {
+            const size_t i = cursor.fetch_add(1);
+            if (i >= count) break;
+
+            try {
+                BlockReader reader(paths[i]);
+                EvpMdCtxPtr ctx = newSHA256Context();
+                digestSerial(reader, ctx.get(), buffer);
+                hashes[i] = finalizeHex(ctx.get());
+            } catch (...) {
+                failures[i] = std::current_exception();
+                failed = true;
+            }
         }
+    };
+
+    if (numThreads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> workers;
+        workers.reserve(numThreads);
+        for (size_t t = 0; t < numThreads; t++)
+            workers.emplace_back(worker);
+        for (auto &t : workers)
+            t.join();
     }
 
-    f.close();
+    for (auto &failure : failures)
+        if (failure) std::rethrow_exception(failure);
 
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hashLen;
-    safeDigestFinal(ctx.get(), hash, &hashLen);
+    return hashes;
+}
 
-    return bytesToHex(hash, hashLen);
+SHA256Digest::SHA256Digest() : ctx(newSHA256Context()) {}
+
+void SHA256Digest::update(const void *data, size_t size){
+    safeDigestUpdate(ctx.get(), data, size);
+}
+
+std::string SHA256Digest::hex(){
+    return finalizeHex(ctx.get());
 }
 
 std::string Hash::strSHA256(const std::string &str){
+    return Hash::strSHA256(str.c_str(), str.length());
+}
+
+std::string Hash::strSHA256(const char *data, size_t size){
     EvpMdCtxPtr ctx(EVP_MD_CTX_new());
     if (!ctx)
         throw AppException("Failed to create EVP_MD_CTX for SHA256");
@@ -63,7 +329,7 @@ std::string Hash::strSHA256(const std::string &str){
         throw AppException("Failed to initialize SHA256 digest");
     }
 
-    safeDigestUpdate(ctx.get(), str.c_str(), str.length());
+    safeDigestUpdate(ctx.get(), data, size);
 
     unsigned char hash[EVP_MAX_MD_SIZE];
     unsigned int hashLen;
@@ -0,0 +1,490 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "merkle.h"
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <tuple>
+
+#include "entry_types.h"
+#include "exceptions.h"
+#include "hash.h"
+#include "logger.h"
+#include "transaction.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        // Upper bound of the paths starting with prefix (0xFF never occurs in UTF-8)
+        std::string prefixEnd(const std::string &prefix)
+        {
+            return prefix + '\xff';
+        }
+
+        int nodeDepth(MerkleTree tree, const std::string &path)
+        {
+            if (path.empty())
+                return -1;
+            if (tree == MerkleTree::Meta)
+                return 0;
+            return static_cast<int>(std::count(path.begin(), path.end(), '/'));
+        }
+
+        std::string parentNode(MerkleTree tree, const std::string &path)
+        {
+            if (tree == MerkleTree::Meta)
+                return "";
+            const auto slash = path.rfind('/');
+            return slash == std::string::npos ? "" : path.substr(0, slash);
+        }
+
+        char typeCode(MerkleNodeType type)
+        {
+            switch (type)
+            {
+            case MerkleNodeType::File:
+                return 'f';
+            case MerkleNodeType::Directory:
+                return 'd';
+            case MerkleNodeType::ImpliedDirectory:
+                return 'i';
+            case MerkleNodeType::MetaBucket:
+                return 'b';
+            default:
+                return 'm';
+            }
+        }
+
+        std::string hashChildren(const std::vector<MerkleChild> &children)
+        {
+            SHA256Digest digest;
+            for (const auto &c : children)
+            {
+                const char code = typeCode(c.type);
+                digest.update(&code, 1);
+                digest.update(c.path.data(), c.path.size());
+                digest.update("", 1);
+                digest.update(c.hash.data(), c.hash.size());
+                digest.update("\n", 1);
+            }
+            return digest.hex();
+        }
+
+        struct DirtyNode
+        {
+            MerkleTree tree;
+            int depth;
+            std::string path;
+
+            // Deepest first, so that children are rehashed before their parents
+            bool operator<(const DirtyNode &o) const
+            {
+                return std::tie(o.depth, tree, path) < std::tie(depth, o.tree, o.path);
+            }
+        };
+
+        void addSubtree(MerkleSource &source, const MerkleChild &c, Delta &d)
+        {
+            if (c.type == MerkleNodeType::File)
+            {
+                d.adds.emplace_back(c.path, c.hash);
+                return;
+            }
+
+            if (c.type == MerkleNodeType::Directory)
+                d.adds.emplace_back(c.path, "");
+            for (const auto &child : source.children(MerkleTree::Entries, c.path))
+                addSubtree(source, child, d);
+        }
+
+        void removeSubtree(MerkleSource &destination, const MerkleChild &c, Delta &d)
+        {
+            if (c.type == MerkleNodeType::File)
+            {
+                d.removes.emplace_back(c.path, c.hash);
+                return;
+            }
+
+            if (c.type == MerkleNodeType::Directory)
+                d.removes.emplace_back(c.path, "");
+            for (const auto &child : destination.children(MerkleTree::Entries, c.path))
+                removeSubtree(destination, child, d);
+        }
+
+        // Same rules as getDelta: entries of source not in destination with the same
+        // hash are added, entries of destination not in source with the same kind
+        // (file or directory) are removed
+        void diffEntries(MerkleSource &source, MerkleSource &destination, const std::string &dir, Delta &d)
+        {
+            const auto src = source.children(MerkleTree::Entries, dir);
+            const auto dst = destination.children(MerkleTree::Entries, dir);
+
+            size_t i = 0, j = 0;
+            while (i < src.size() || j < dst.size())
+            {
+                if (j == dst.size() || (i < src.size() && src[i].path < dst[j].path))
+                {
+                    addSubtree(source, src[i++], d);
+                    continue;
+                }
+                if (i == src.size() || dst[j].path < src[i].path)
+                {
+                    removeSubtree(destination, dst[j++], d);
+                    continue;
+                }
+
+                const auto &a = src[i++];
+                const auto &b = dst[j++];
+
+                if (!a.isDirectory() && !b.isDirectory())
+                {
+                    if (a.hash != b.hash)
+                        d.adds.emplace_back(a.path, a.hash);
+                }
+                else if (a.isDirectory() && b.isDirectory())
+                {
+                    if (a.type == MerkleNodeType::Directory && b.type != MerkleNodeType::Directory)
+                        d.adds.emplace_back(a.path, "");
+                    if (b.type == MerkleNodeType::Directory && a.type != MerkleNodeType::Directory)
+                        d.removes.emplace_back(b.path, "");
+                    if (a.hash != b.hash)
+                        diffEntries(source, destination, a.path, d);
+                }
+                else if (!a.isDirectory())
+                {
+                    d.adds.emplace_back(a.path, a.hash);
+                    removeSubtree(destination, b, d);
+                }
+                else
+                {
+                    addSubtree(source, a, d);
+                    d.removes.emplace_back(b.path, b.hash);
+                }
+            }
+        }
+
+        std::vector<std::string> metaIds(MerkleSource &source, const std::string &bucket)
+        {
+            std::vector<std::string> ids;
+            for (const auto &c : source.children(MerkleTree::Meta, bucket))
+                ids.push_back(c.path);
+            return ids;
+        }
+
+        void diffMeta(MerkleSource &source, MerkleSource &destination, Delta &d)
+        {
+            const auto src = source.children(MerkleTree::Meta, "");
+            const auto dst = destination.children(MerkleTree::Meta, "");
+
+            size_t i = 0, j = 0;
+            while (i < src.size() || j < dst.size())
+            {
+                if (j == dst.size() || (i < src.size() && src[i].path < dst[j].path))
+                {
+                    for (const auto &id : metaIds(source, src[i++].path))
+                        d.metaAdds.push_back(id);
+                    continue;
+                }
+                if (i == src.size() || dst[j].path < src[i].path)
+                {
+                    for (const auto &id : metaIds(destination, dst[j++].path))
+                        d.metaRemoves.push_back(id);
+                    continue;
+                }
+
+                const auto &a = src[i++];
+                const auto &b = dst[j++];
+                if (a.hash == b.hash)
+                    continue;
+
+                const auto srcIds = metaIds(source, a.path);
+                const auto dstIds = metaIds(destination, b.path);
+                std::set_difference(srcIds.begin(), srcIds.end(), dstIds.begin(), dstIds.end(),
+                                    std::back_inserter(d.metaAdds));
+                std::set_difference(dstIds.begin(), dstIds.end(), srcIds.begin(), srcIds.end(),
+                                    std::back_inserter(d.metaRemoves));
+            }
+        }
+    }
+
+    size_t MerkleIndex::rehashDirty(bool persist)
+    {
+        std::set<DirtyNode> pending;
+        {
+            auto q = db->query("SELECT tree, path FROM merkle_dirty");
+            while (q->fetch())
+            {
+                const auto tree = static_cast<MerkleTree>(q->getInt(0));
+                const auto path = q->getText(1);
+                pending.insert({tree, nodeDepth(tree, path), path});
+            }
+        }
+
+        std::unique_ptr<Statement> upsert, remove;
+        if (persist)
+        {
+            upsert = db->query("INSERT OR REPLACE INTO merkle_nodes (tree, path, depth, hash) VALUES (?, ?, ?, ?)");
+            remove = db->query("DELETE FROM merkle_nodes WHERE tree = ? AND path = ?");
+        }
+
+        size_t rehashed = 0;
+        while (!pending.empty())
+        {
+            const DirtyNode node = *pending.begin();
+            pending.erase(pending.begin());
+
+            std::string oldHash;
+            const bool exists = storedHash(node.tree, node.path, oldHash);
+
+            const auto kids = children(node.tree, node.path);
+
+            // Nodes without children are dropped, except the roots
+            std::string hash;
+            if (!kids.empty() || node.path.empty())
+                hash = hashChildren(kids);
+
+            if (!persist)
+            {
+                overlay[{node.tree, node.path}] = hash;
+            }
+            else if (!hash.empty())
+            {
+                upsert->bind(1, static_cast<int>(node.tree));
+                upsert->bind(2, node.path);
+                upsert->bind(3, node.depth);
+                upsert->bind(4, hash);
+                upsert->execute();
+            }
+            else if (exists)
+            {
+                remove->bind(1, static_cast<int>(node.tree));
+                remove->bind(2, node.path);
+                remove->execute();
+            }
+            rehashed++;
+
+            if (hash != oldHash && !node.path.empty())
+            {
+                const auto parent = parentNode(node.tree, node.path);
+                pending.insert({node.tree, nodeDepth(node.tree, parent), parent});
+            }
+        }
+
+        return rehashed;
+    }
+
+    void MerkleIndex::refresh()
+    {
+        overlay.clear();
+
+        {
+            auto q = db->query("SELECT 1 FROM merkle_dirty LIMIT 1");
+            if (!q->fetch())
+                return;
+        }
+
+        if (!db->isReadOnly())
+        {
+            // Readers do not wait for writers: if the index is locked the nodes
+            // are rehashed again by a later refresh
+            RetryPolicy noWait;
+            noWait.deadlineMs = 0;
+
+            try
+            {
+                Transaction tx(db, Transaction::Mode::Immediate, noWait);
+                const size_t rehashed = rehashDirty(true);
+                db->exec("DELETE FROM merkle_dirty");
+                tx.commit();
+
+                LOGD << "Rehashed " << rehashed << " Merkle nodes";
+                return;
+            }
+            catch (const DBBusyException &e)
+            {
+                LOGD << "Cannot store Merkle nodes: " << e.what();
+            }
+        }
+
+        const size_t rehashed = rehashDirty(false);
+        LOGD << "Rehashed " << rehashed << " Merkle nodes in memory";
+    }
+
+    bool MerkleIndex::storedHash(MerkleTree tree, const std::string &path, std::string &hash)
+    {
+        const auto it = overlay.find({tree, path});
+        if (it != overlay.end())
+        {
+            hash = it->second;
+            return !hash.empty();
+        }
+
+        auto q = db->query("SELECT hash FROM merkle_nodes WHERE tree = ? AND path = ?");
+        q->bind(1, static_cast<int>(tree));
+        q->bind(2, path);
+        if (!q->fetch())
+        {
+            hash.clear();
+            return false;
+        }
+        hash = q->getText(0);
+        return true;
+    }
+
+    // Applies the overlay to the stored nodes at depth within [lo, hi), sorted by path
+    void MerkleIndex::applyOverlay(MerkleTree tree, int depth, const std::string &lo, const std::string &hi,
+                                   MerkleNodeType type, std::vector<MerkleChild> &nodes) const
+    {
+        for (auto it = overlay.lower_bound({tree, lo});
+             it != overlay.end() && it->first.first == tree && it->first.second < hi; ++it)
+        {
+            const auto &path = it->first.second;
+            if (nodeDepth(tree, path) != depth)
+                continue;
+
+            auto pos = std::lower_bound(nodes.begin(), nodes.end(), path,
+                                        [](const MerkleChild &c, const std::string &p)
+                                        { return c.path < p; });
+            const bool found = pos != nodes.end() && pos->path == path;
+
+            if (it->second.empty())
+            {
+                if (found)
+                    nodes.erase(pos);
+            }
+            else if (found)
+                pos->hash = it->second;
+            else
+                nodes.insert(pos, {path, it->second, type});
+        }
+    }
+
+    std::string MerkleIndex::rootHash()
+    {
+        refresh();
+
+        SHA256Digest digest;
+        const auto entries = nodeHash(MerkleTree::Entries, "");
+        const auto meta = nodeHash(MerkleTree::Meta, "");
+        digest.update("e", 1);
+        digest.update(entries.data(), entries.size());
+        digest.update("\nm", 2);
+        digest.update(meta.data(), meta.size());
+        return digest.hex();
+    }
+
+    std::string MerkleIndex::nodeHash(MerkleTree tree, const std::string &path)
+    {
+        std::string hash;
+        storedHash(tree, path, hash);
+        return hash;
+    }
+
+    std::vector<MerkleChild> MerkleIndex::children(MerkleTree tree, const std::string &path)
+    {
+        std::vector<MerkleChild> result;
+
+        if (tree == MerkleTree::Meta)
+        {
+            if (path.empty())
+            {
+                auto q = db->query("SELECT path, hash FROM merkle_nodes WHERE tree = 1 AND depth = 0 ORDER BY path");
+                while (q->fetch())
+                    result.push_back({q->getText(0), q->getText(1), MerkleNodeType::MetaBucket});
+                applyOverlay(tree, 0, "", prefixEnd(""), MerkleNodeType::MetaBucket, result);
+            }
+            else
+            {
+                auto q = db->query("SELECT id FROM entries_meta WHERE id >= ? AND id < ? AND substr(id, 1, 2) = ? ORDER BY id");
+                q->bind(1, path);
+                q->bind(2, prefixEnd(path));
+                q->bind(3, path);
+                while (q->fetch())
+                    result.push_back({q->getText(0), "", MerkleNodeType::Meta});
+            }
+            return result;
+        }
+
+        // Direct children are the entries one level deeper within the directory's
+        // path range, plus the directories that have a node but no entry
+        const int depth = nodeDepth(tree, path) + 1;
+        const std::string lo = path.empty() ? "" : path + "/";
+        const std::string hi = prefixEnd(lo);
+
+        std::vector<MerkleChild> implied;
+        {
+            auto q = db->query("SELECT path, hash FROM merkle_nodes WHERE tree = 0 AND depth = ? AND path >= ? AND path < ? ORDER BY path");
+            q->bind(1, depth);
+            q->bind(2, lo);
+            q->bind(3, hi);
+            while (q->fetch())
+                implied.push_back({q->getText(0), q->getText(1), MerkleNodeType::ImpliedDirectory});
+        }
+        applyOverlay(tree, depth, lo, hi, MerkleNodeType::ImpliedDirectory, implied);
+
+        auto q = db->query("SELECT e.path, e.hash, e.type, n.hash FROM entries e "
+                           "LEFT JOIN merkle_nodes n ON n.tree = 0 AND n.path = e.path "
+                           "WHERE e.depth = ? AND e.path >= ? AND e.path < ? ORDER BY e.path");
+        q->bind(1, depth);
+        q->bind(2, lo);
+        q->bind(3, hi);
+
+        size_t k = 0;
+        while (q->fetch())
+        {
+            MerkleChild c;
+            c.path = q->getText(0);
+            if (q->getInt(2) == static_cast<int>(EntryType::Directory))
+            {
+                c.type = MerkleNodeType::Directory;
+                const auto it = overlay.find({tree, c.path});
+                c.hash = it != overlay.end() ? it->second : q->getText(3);
+            }
+            else
+            {
+                c.type = MerkleNodeType::File;
+                c.hash = q->getText(1);
+            }
+
+            while (k < implied.size() && implied[k].path < c.path)
+                result.push_back(implied[k++]);
+            if (k < implied.size() && implied[k].path == c.path)
+                k++;
+
+            result.push_back(c);
+        }
+        while (k < implied.size())
+            result.push_back(implied[k++]);
+
+        return result;
+    }
+
+    Delta getMerkleDelta(MerkleSource &source, MerkleSource &destination)
+    {
+        Delta d;
+        if (source.rootHash() == destination.rootHash())
+            return d;
+
+        if (source.nodeHash(MerkleTree::Entries, "") != destination.nodeHash(MerkleTree::Entries, ""))
+            diffEntries(source, destination, "", d);
+        if (source.nodeHash(MerkleTree::Meta, "") != destination.nodeHash(MerkleTree::Meta, ""))
+            diffMeta(source, destination, d);
+
+        std::sort(d.adds.begin(), d.adds.end(),
+                  [](const AddAction &l, const AddAction &r)
+                  { return l.path < r.path; });
+        std::sort(d.removes.begin(), d.removes.end(),
+                  [](const RemoveAction &l, const RemoveAction &r)
+                  { return l.path > r.path; });
+        std::sort(d.metaAdds.begin(), d.metaAdds.end());
+        std::sort(d.metaRemoves.begin(), d.metaRemoves.end());
+
+        return d;
+    }
+
+} // namespace ddb
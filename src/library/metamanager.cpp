@@ -21,9 +21,11 @@ namespace ddb
 
         std::string relPath = p.relativeTo(db->rootDirectory()).generic();
 
-        const auto q = db->query("SELECT 1 FROM entries WHERE path = ?");
+        const auto q = db->cachedQuery("SELECT 1 FROM entries WHERE path = ?");
         q->bind(1, relPath);
-        if (!q->fetch())
+        const bool found = q->fetch();
+        q->reset();
+        if (!found)
             throw InvalidArgsException("Path " + relPath + " not available in index");
 
         return relPath;
@@ -166,14 +168,15 @@ namespace ddb
         const auto ePath = entryPath(path, cwd);
         json result = json::array();
 
-        const auto q = db->query("SELECT id, data, mtime FROM entries_meta WHERE key = ? AND path = ?");
+        const auto q = db->cachedQuery("SELECT id, data, mtime FROM entries_meta WHERE key = ? AND path = ?");
         q->bind(1, key);
         q->bind(2, ePath);
 
         while (q->fetch())
         {
-            result.push_back(metaStmtToJson(q.get()));
+            result.push_back(metaStmtToJson(q));
         }
+        q->reset();
 
         if (result.empty())
             throw InvalidArgsException("No metadata found for key " + key + (path.empty() ? "" : " and path " + path));
@@ -6,9 +6,14 @@
 #include "mio.h"
 #include "logger.h"
 #include "exceptions.h"
+#include "hash.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <system_error>
+#include <zlib.h>
 
 namespace ddb::zip
 {
@@ -289,4 +294,373 @@ namespace ddb::zip
         }
     }
 
+    namespace
+    {
+        const uint32_t LocalFileHeaderSig = 0x04034b50;
+        const uint32_t DataDescriptorSig = 0x08074b50;
+        const uint32_t CentralDirectorySig = 0x02014b50;
+        const uint32_t EndOfCentralDirectorySig = 0x06054b50;
+        const uint32_t Zip64EndOfCentralDirectorySig = 0x06064b50;
+        const size_t LocalFileHeaderSize = 30;
+        const size_t InflateBufSize = 64 * 1024;
+
+        uint16_t le16(const char *p)
+        {
+            const auto *b = reinterpret_cast<const unsigned char *>(p);
+            return static_cast<uint16_t>(b[0] | (b[1] << 8));
+        }
+
+        uint32_t le32(const char *p)
+        {
+            return le16(p) | (static_cast<uint32_t>(le16(p + 2)) << 16);
+        }
+
+        uint64_t le64(const char *p)
+        {
+            return le32(p) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+        }
+    }
+
+    struct ZipStreamExtractor::State
+    {
+        enum class Stage
+        {
+            Header,
+            Data,
+            Descriptor,
+            Done
+        };
+
+        std::string outdir;
+        std::unordered_map<std::string, std::string> expectedHashes;
+
+        Stage stage = Stage::Header;
+        std::string pending; // Received, not yet decoded
+        size_t pos = 0;
+        size_t extracted = 0;
+
+        // Current entry
+        std::string name;
+        fs::path path;
+        bool isDirectory = false;
+        uint16_t method = 0;
+        bool hasDescriptor = false;
+        bool zip64 = false;
+        uint32_t crc = 0;
+        uint64_t compressedSize = 0;
+        uint64_t size = 0;
+        uint64_t consumed = 0;
+        uint64_t written = 0;
+        uLong runningCrc = 0;
+        std::ofstream of;
+        std::unique_ptr<SHA256Digest> digest;
+
+        z_stream zs;
+        bool zsInit = false;
+        std::vector<char> inflateBuf;
+
+        ~State()
+        {
+            if (zsInit)
+                inflateEnd(&zs);
+            abortEntry();
+        }
+
+        size_t available() const { return pending.size() - pos; }
+        const char *head() const { return pending.data() + pos; }
+
+        void abortEntry()
+        {
+            if (of.is_open())
+            {
+                of.close();
+                std::error_code ec;
+                fs::remove(path, ec);
+            }
+        }
+
+        void emit(const char *data, size_t n)
+        {
+            if (n == 0)
+                return;
+            if (isDirectory)
+                throw ZipException("Directory entry " + name + " has content");
+
+            of.write(data, static_cast<std::streamsize>(n));
+            if (!of)
+                throw ZipException("Cannot write " + path.string());
+            runningCrc = crc32(runningCrc, reinterpret_cast<const Bytef *>(data), static_cast<uInt>(n));
+            if (digest)
+                digest->update(data, n);
+            written += n;
+        }
+
+        // Returns false if more bytes are needed
+        bool readHeader()
+        {
+            if (available() < 4)
+                return false;
+
+            const uint32_t sig = le32(head());
+            if (sig == CentralDirectorySig || sig == EndOfCentralDirectorySig ||
+                sig == Zip64EndOfCentralDirectorySig)
+            {
+                // Everything after the last entry is index data we don't need
+                stage = Stage::Done;
+                pending.clear();
+                pos = 0;
+                return true;
+            }
+            if (sig != LocalFileHeaderSig)
+                throw ZipException("Invalid zip stream: unexpected signature after " +
+                                   std::to_string(extracted) + " entries");
+
+            if (available() < LocalFileHeaderSize)
+                return false;
+
+            const char *h = head();
+            const uint16_t flags = le16(h + 6);
+            const uint16_t nameLength = le16(h + 26);
+            const uint16_t extraLength = le16(h + 28);
+            if (available() < LocalFileHeaderSize + nameLength + extraLength)
+                return false;
+
+            if (flags & 1)
+                throw ZipException("Encrypted zip entries are not supported");
+
+            method = le16(h + 8);
+            hasDescriptor = (flags & 8) != 0;
+            crc = le32(h + 14);
+            compressedSize = le32(h + 18);
+            size = le32(h + 22);
+            name.assign(h + LocalFileHeaderSize, nameLength);
+
+            // ZIP64 sizes live in the extra field
+            zip64 = false;
+            const char *extra = h + LocalFileHeaderSize + nameLength;
+            for (size_t i = 0; i + 4 <= extraLength;)
+            {
+                const uint16_t id = le16(extra + i);
+                const uint16_t len = le16(extra + i + 2);
+                if (i + 4 + len > extraLength)
+                    break;
+                if (id == 0x0001)
+                {
+                    zip64 = true;
+                    size_t off = i + 4;
+                    if (size == 0xFFFFFFFF && off + 8 <= i + 4 + len)
+                    {
+                        size = le64(extra + off);
+                        off += 8;
+                    }
+                    if (compressedSize == 0xFFFFFFFF && off + 8 <= i + 4 + len)
+                        compressedSize = le64(extra + off);
+                }
+                i += 4 + len;
+            }
+
+            if (method != 0 && method != Z_DEFLATED)
+                throw ZipException("Unsupported compression method " + std::to_string(method) + " for " + name);
+            if (method == 0 && hasDescriptor && compressedSize == 0)
+                throw ZipException("Cannot stream stored entry " + name + " without sizes");
+
+            pos += LocalFileHeaderSize + nameLength + extraLength;
+            beginEntry();
+            return true;
+        }
+
+        void beginEntry()
+        {
+            // Reject unsafe entry names (Zip-Slip) before touching the filesystem.
+            ensureSafeZipEntry(outdir, name.c_str());
+
+            path = fs::path(outdir) / fs::path(name);
+            isDirectory = !name.empty() && name.back() == '/';
+            consumed = 0;
+            written = 0;
+            runningCrc = crc32(0L, Z_NULL, 0);
+            digest.reset();
+
+            if (isDirectory)
+            {
+                io::assureFolderExists(path);
+            }
+            else
+            {
+                io::assureFolderExists(path.parent_path());
+                of.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+                if (!of.is_open())
+                    throw ZipException("Cannot open " + path.string() + " for writing");
+
+                if (expectedHashes.find(name) != expectedHashes.end())
+                    digest = std::make_unique<SHA256Digest>();
+            }
+
+            if (method == Z_DEFLATED)
+            {
+                if (!zsInit)
+                {
+                    std::memset(&zs, 0, sizeof(zs));
+                    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+                        throw ZipException("Cannot initialize inflate");
+                    zsInit = true;
+                    inflateBuf.resize(InflateBufSize);
+                }
+                else if (inflateReset(&zs) != Z_OK)
+                {
+                    throw ZipException("Cannot reset inflate");
+                }
+            }
+
+            stage = Stage::Data;
+        }
+
+        bool readData()
+        {
+            if (method == 0)
+            {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(available(), compressedSize - consumed));
+                emit(head(), n);
+                pos += n;
+                consumed += n;
+                if (consumed < compressedSize)
+                    return false;
+            }
+            else
+            {
+                if (available() == 0)
+                    return false;
+
+                zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(head()));
+                zs.avail_in = static_cast<uInt>(std::min<size_t>(available(), UINT32_MAX));
+                int ret;
+                do
+                {
+                    zs.next_out = reinterpret_cast<Bytef *>(inflateBuf.data());
+                    zs.avail_out = static_cast<uInt>(inflateBuf.size());
+                    ret = inflate(&zs, Z_NO_FLUSH);
+                    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                        throw ZipException("Corrupted data in " + name);
+                    emit(inflateBuf.data(), inflateBuf.size() - zs.avail_out);
+                } while (ret == Z_OK && (zs.avail_in > 0 || zs.avail_out == 0));
+
+                const size_t used = available() - zs.avail_in;
+                pos += used;
+                consumed += used;
+                if (ret != Z_STREAM_END)
+                    return false;
+            }
+
+            if (hasDescriptor)
+            {
+                stage = Stage::Descriptor;
+                return true;
+            }
+
+            endEntry();
+            return true;
+        }
+
+        bool readDescriptor()
+        {
+            if (available() < 4)
+                return false;
+            const size_t sigSize = le32(head()) == DataDescriptorSig ? 4 : 0;
+            const size_t fieldsSize = 4 + (zip64 ? 16 : 8);
+            if (available() < sigSize + fieldsSize)
+                return false;
+
+            const char *d = head() + sigSize;
+            crc = le32(d);
+            compressedSize = zip64 ? le64(d + 4) : le32(d + 4);
+            size = zip64 ? le64(d + 12) : le32(d + 8);
+            pos += sigSize + fieldsSize;
+
+            endEntry();
+            return true;
+        }
+
+        void endEntry()
+        {
+            if (written != size || consumed != compressedSize)
+                throw ZipException("Size mismatch for " + name);
+            if (runningCrc != crc)
+                throw ZipException("CRC mismatch for " + name);
+
+            if (of.is_open())
+            {
+                of.close();
+                if (of.fail())
+                    throw ZipException("Cannot write " + path.string());
+            }
+
+            if (digest)
+            {
+                const auto &expected = expectedHashes[name];
+                if (digest->hex() != expected)
+                {
+                    std::error_code ec;
+                    fs::remove(path, ec);
+                    throw ZipException("Checksum mismatch for " + name);
+                }
+                digest.reset();
+            }
+
+            extracted++;
+            stage = Stage::Header;
+        }
+    };
+
+    ZipStreamExtractor::ZipStreamExtractor(const std::string &outdir,
+                                           const std::unordered_map<std::string, std::string> &expectedHashes)
+        : s(std::make_unique<State>())
+    {
+        s->outdir = outdir;
+        s->expectedHashes = expectedHashes;
+        io::createDirectories(outdir);
+    }
+
+    ZipStreamExtractor::~ZipStreamExtractor() = default;
+
+    void ZipStreamExtractor::write(const char *data, size_t size)
+    {
+        if (s->stage == State::Stage::Done)
+            return;
+
+        s->pending.append(data, size);
+
+        bool progress = true;
+        while (progress)
+        {
+            switch (s->stage)
+            {
+            case State::Stage::Header:
+                progress = s->readHeader();
+                break;
+            case State::Stage::Data:
+                progress = s->readData();
+                break;
+            case State::Stage::Descriptor:
+                progress = s->readDescriptor();
+                break;
+            case State::Stage::Done:
+                return;
+            }
+        }
+
+        s->pending.erase(0, s->pos);
+        s->pos = 0;
+    }
+
+    void ZipStreamExtractor::finish()
+    {
+        if (s->stage != State::Stage::Done)
+            throw ZipException("Truncated zip stream after " + std::to_string(s->extracted) + " entries");
+    }
+
+    size_t ZipStreamExtractor::extracted() const
+    {
+        return s->extracted;
+    }
+
 }
@@ -0,0 +1,118 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "pcrasterizer.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace ddb
+{
+
+    namespace
+    {
+        // Below this many rows per band the per-band z-buffer setup dominates
+        const int MinBandRows = 32;
+
+        // Renders the output rows [rowStart, rowEnd)
+        void rasterizeBand(const RasterPoints &points, int radius, int tileSize,
+                           uint8_t *buffer, uint8_t *alpha, int rowStart, int rowEnd)
+        {
+            const int paddedTileSize = tileSize + radius * 2;
+            const int wSize = tileSize * tileSize;
+            const int r2 = radius * radius;
+            const int rr = radius << 1;
+
+            // A circle centered at py covers the output rows [py - 2r, py - 1],
+            // so only centers in [rowStart, rowEnd + 2r) can reach this band.
+            // Points sharing a center pixel always land in the same bands, which
+            // is what makes the per-band z-buffers match a single shared one.
+            const int zRows = rowEnd - rowStart + rr;
+            std::vector<float> zBuffer(static_cast<size_t>(zRows) * paddedTileSize, -99999.0f);
+
+            const size_t count = points.size();
+            for (size_t i = 0; i < count; i++)
+            {
+                const int px = points.px[i];
+                const int py = points.py[i];
+
+                if (px < 0 || px >= paddedTileSize || py < 0 || py >= paddedTileSize)
+                    continue;
+                if (py - rr >= rowEnd || py - 1 < rowStart)
+                    continue;
+
+                float &zb = zBuffer[static_cast<size_t>(py - rowStart) * paddedTileSize + px];
+                if (!(zb < points.z[i]))
+                    continue;
+                zb = static_cast<float>(points.z[i]);
+
+                const int cx = px - radius;
+                const int cy = py - radius;
+                const int yMin = std::max(cy - radius, rowStart);
+                const int yMax = std::min(cy + radius, rowEnd);
+                const int xMin = std::max(cx - radius, 0);
+                const int xMax = std::min(cx + radius, tileSize);
+
+                for (int dy = yMin; dy < yMax; dy++)
+                {
+                    const int ty = dy - cy;
+                    for (int dx = xMin; dx < xMax; dx++)
+                    {
+                        const int tx = dx - cx;
+                        if (tx * tx + ty * ty <= r2)
+                        {
+                            const int off = dy * tileSize + dx;
+                            buffer[off] = points.r[i];
+                            buffer[off + wSize] = points.g[i];
+                            buffer[off + wSize * 2] = points.b[i];
+                            alpha[off] = 255;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void RasterPoints::resize(size_t count)
+    {
+        px.resize(count);
+        py.resize(count);
+        z.resize(count);
+        r.resize(count);
+        g.resize(count);
+        b.resize(count);
+    }
+
+    void rasterizePoints(const RasterPoints &points, int radius, int tileSize,
+                         uint8_t *buffer, uint8_t *alpha, int threads)
+    {
+        const int bands = std::max(1, std::min(threads, tileSize / MinBandRows));
+        if (bands == 1)
+        {
+            rasterizeBand(points, radius, tileSize, buffer, alpha, 0, tileSize);
+            return;
+        }
+
+        const int bandRows = (tileSize + bands - 1) / bands;
+        std::vector<std::thread> workers;
+        workers.reserve(bands - 1);
+
+        // Bands write disjoint rows of the output buffers
+        for (int band = 1; band < bands; band++)
+        {
+            const int rowStart = band * bandRows;
+            const int rowEnd = std::min(tileSize, rowStart + bandRows);
+            if (rowStart >= rowEnd)
+                break;
+            workers.emplace_back(rasterizeBand, std::cref(points), radius, tileSize,
+                                 buffer, alpha, rowStart, rowEnd);
+        }
+
+        rasterizeBand(points, radius, tileSize, buffer, alpha, 0, std::min(tileSize, bandRows));
+
+        for (auto &t : workers)
+            t.join();
+    }
+
+} // namespace ddb
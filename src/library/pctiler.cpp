@@ -4,14 +4,15 @@
 
 #include "pctiler.h"
 
+#include <algorithm>
 #include <mutex>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <pdal/Options.hpp>
 #include <pdal/PointTable.hpp>
 #include <pdal/io/CopcReader.hpp>
-#include <pdal/filters/ColorinterpFilter.hpp>
 
 #include "entry.h"
 #include "exceptions.h"
@@ -20,19 +21,96 @@
 #include "logger.h"
 #include "mio.h"
 #include "userprofile.h"
+#include "vegetation.h"
 
 namespace ddb
 {
 
+    namespace
+    {
+        // Views smaller than this are rasterized on the calling thread
+        const size_t ParallelRasterMinPoints = 100000;
+
+        int rasterThreads()
+        {
+            // Tiles are often requested concurrently, don't take over the machine
+            return static_cast<int>(std::min(8u, std::max(1u, std::thread::hardware_concurrency())));
+        }
+
+        bool hasDimension(const PointCloudInfo &info, const std::string &name)
+        {
+            return std::find(info.dimensions.begin(), info.dimensions.end(), name) != info.dimensions.end();
+        }
+
+        // ASPRS standard point classes (LAS 1.4)
+        void classificationColor(uint8_t cls, uint8_t &r, uint8_t &g, uint8_t &b)
+        {
+            static const uint8_t palette[19][3] = {
+                {190, 190, 190}, // Created, never classified
+                {170, 170, 170}, // Unclassified
+                {166, 116, 63},  // Ground
+                {144, 238, 144}, // Low vegetation
+                {50, 205, 50},   // Medium vegetation
+                {0, 128, 0},     // High vegetation
+                {220, 60, 50},   // Building
+                {255, 0, 255},   // Low point (noise)
+                {255, 255, 0},   // Reserved / model key-point
+                {0, 100, 255},   // Water
+                {128, 64, 0},    // Rail
+                {80, 80, 80},    // Road surface
+                {230, 230, 120}, // Reserved / overlap
+                {255, 200, 0},   // Wire - guard
+                {255, 160, 0},   // Wire - conductor
+                {160, 0, 160},   // Transmission tower
+                {255, 120, 200}, // Wire-structure connector
+                {120, 120, 180}, // Bridge deck
+                {255, 0, 0}      // High noise
+            };
+
+            if (cls < 19)
+            {
+                r = palette[cls][0];
+                g = palette[cls][1];
+                b = palette[cls][2];
+            }
+            else
+            {
+                r = g = b = 200;
+            }
+        }
+    }
+
+    PointCloudRenderMode parsePointCloudRenderMode(const std::string &mode)
+    {
+        if (mode.empty() || mode == "auto")
+            return PointCloudRenderMode::Auto;
+        if (mode == "rgb")
+            return PointCloudRenderMode::RGB;
+        if (mode == "elevation")
+            return PointCloudRenderMode::Elevation;
+        if (mode == "intensity")
+            return PointCloudRenderMode::Intensity;
+        if (mode == "classification")
+            return PointCloudRenderMode::Classification;
+
+        throw InvalidArgsException("Invalid point cloud render mode: " + mode + " (auto|rgb|elevation|intensity|classification)");
+    }
+
     PointCloudTiler::PointCloudTiler(const std::string &inputPath, const std::string &outputFolder,
-                       int tileSize, bool tms)
+                       int tileSize, bool tms, PointCloudRenderMode renderMode)
         : Tiler(inputPath, outputFolder, tileSize, tms),
-          wSize(tileSize * tileSize)
+          wSize(tileSize * tileSize), renderMode(renderMode)
     {
 
         // Open COPC and gather metadata
         int span;
-        if (!getCopcInfo(inputPath, pcInfo, 3857, &span))
+        if (!utils::isNetworkPath(inputPath))
+        {
+            source = CopcSource::open(inputPath);
+            if (!source->getInfo(pcInfo, 3857, &span))
+                throw InvalidArgsException("Cannot get COPC info for " + inputPath);
+        }
+        else if (!getCopcInfo(inputPath, pcInfo, 3857, &span))
             throw InvalidArgsException("Cannot get COPC info for " + inputPath);
 
         if (pcInfo.wktProjection.empty())
@@ -53,11 +131,20 @@ namespace ddb
         LOGD << "MinZ: " << tMinZ;
         LOGD << "MaxZ: " << tMaxZ;
 
-        hasColors = std::find(pcInfo.dimensions.begin(), pcInfo.dimensions.end(), "Red") != pcInfo.dimensions.end() &&
-                    std::find(pcInfo.dimensions.begin(), pcInfo.dimensions.end(), "Green") != pcInfo.dimensions.end() &&
-                    std::find(pcInfo.dimensions.begin(), pcInfo.dimensions.end(), "Blue") != pcInfo.dimensions.end();
+        hasColors = hasDimension(pcInfo, "Red") && hasDimension(pcInfo, "Green") && hasDimension(pcInfo, "Blue");
         LOGD << "Has colors: " << (hasColors ? "true" : "false");
 
+        // Fall back to the elevation ramp when the requested dimension is missing
+        if (this->renderMode == PointCloudRenderMode::Auto ||
+            (this->renderMode == PointCloudRenderMode::RGB && !hasColors))
+            this->renderMode = hasColors ? PointCloudRenderMode::RGB : PointCloudRenderMode::Elevation;
+        else if ((this->renderMode == PointCloudRenderMode::Intensity && !hasDimension(pcInfo, "Intensity")) ||
+                 (this->renderMode == PointCloudRenderMode::Classification && !hasDimension(pcInfo, "Classification")))
+        {
+            LOGD << "Render mode not supported by " << inputPath << ", using elevation";
+            this->renderMode = PointCloudRenderMode::Elevation;
+        }
+
 #ifdef _WIN32
         const fs::path caBundlePath = io::getDataPath("curl-ca-bundle.crt");
         if (!caBundlePath.empty())
@@ -109,72 +196,19 @@ namespace ddb
         bounds.max.y += boundsBufSize;
 
         CoordsTransformer ct(3857, pcInfo.wktProjection);
-        ct.transform(&bounds.min.x, &bounds.min.y);
-        ct.transform(&bounds.max.x, &bounds.max.y);
-
-        pdal::Options copcOpts;
-        fs::path path(inputPath);
-        copcOpts.add("filename", (!utils::isNetworkPath(inputPath) && path.is_relative()) ? ("." / path).string() : inputPath);
-
-        std::stringstream ss;
-        ss << std::setprecision(14) << "([" << bounds.min.x << "," << bounds.max.x << "]," << "[" << bounds.min.y << "," << bounds.max.y << "])";
-        copcOpts.add("bounds", ss.str());
-        LOGD << "COPC bounds: " << ss.str();
+        double boundsX[2] = {bounds.min.x, bounds.max.x};
+        double boundsY[2] = {bounds.min.y, bounds.max.y};
+        ct.transform(2, boundsX, boundsY);
+        bounds.min.x = boundsX[0];
+        bounds.min.y = boundsY[0];
+        bounds.max.x = boundsX[1];
+        bounds.max.y = boundsY[1];
 
         double copcResolution = mercator.resolution(tz - 2);
-        copcOpts.add("resolution", copcResolution);
         LOGD << "COPC resolution: " << copcResolution;
 
-        std::unique_ptr<pdal::CopcReader> copcReader = std::make_unique<pdal::CopcReader>();
-        pdal::Stage *main = copcReader.get();
-        copcReader->setOptions(copcOpts);
-        LOGD << "Options set";
-
-        std::unique_ptr<pdal::ColorinterpFilter> colorFilter;
-        bool colorFilterFailed = false;
-        if (!hasColors)
-        {
-            try
-            {
-                colorFilter.reset(new pdal::ColorinterpFilter());
-
-                // Add ramp filter
-                LOGD << "Adding ramp filter (" << pcInfo.bounds[2] << ", " << pcInfo.bounds[5] << ")";
-
-                pdal::Options cfOpts;
-                cfOpts.add("ramp", "pestel_shades");
-                cfOpts.add("minimum", pcInfo.bounds[2]);
-                cfOpts.add("maximum", pcInfo.bounds[5]);
-                colorFilter->setOptions(cfOpts);
-                colorFilter->setInput(*copcReader);
-                main = colorFilter.get();
-            }
-            catch (const pdal::pdal_error &e)
-            {
-                LOGD << "ColorinterpFilter failed: " << e.what() << ". Proceeding without color filter.";
-                colorFilterFailed = true;
-                colorFilter.reset();
-                main = copcReader.get();
-            }
-        }
-
-        pdal::PointTable table;
-        main->prepare(table);
-        pdal::PointViewSet point_view_set;
-
-        LOGD << "PointTable prepared";
-
-        try
-        {
-            point_view_set = main->execute(table);
-        }
-        catch (const pdal::pdal_error &e)
-        {
-            throw PDALException(e.what());
-        }
-
-        pdal::PointViewPtr point_view = *point_view_set.begin();
-        pdal::Dimension::IdList dims = point_view->dims();
+        CopcPoints cloud;
+        readPoints(bounds.min.x, bounds.min.y, bounds.max.x, bounds.max.y, copcResolution, cloud);
 
         const int nBands = 3;
         const int bufSize = GDALGetDataTypeSizeBytes(GDT_Byte) * wSize;
@@ -182,90 +216,39 @@ namespace ddb
         const int pointRadius = 2;
         const double pointRadiusMeters = pointRadius * tileResolution;
         const int paddedTileSize = tileSize + pointRadius * 2;
-        const int paddedWSize = paddedTileSize * paddedTileSize;
-        const int paddedBufSize = GDALGetDataTypeSizeBytes(GDT_Byte) * paddedWSize;
 
         std::unique_ptr<uint8_t[]> buffer(new uint8_t[bufSize * nBands]);
         std::unique_ptr<uint8_t[]> alphaBuffer(new uint8_t[bufSize]);
-        std::unique_ptr<float[]> zBuffer(new float[paddedBufSize]);
 
         memset(buffer.get(), 0, bufSize * nBands);
         memset(alphaBuffer.get(), 0, bufSize);
 
-        for (int i = 0; i < paddedWSize; i++)
-        {
-            zBuffer.get()[i] = -99999.0;
-        }
-
-        LOGD << "Fetched " << point_view->size() << " points";
+        const size_t numPoints = cloud.size();
+        LOGD << "Fetched " << numPoints << " points";
 
-        const double tileScaleW = tileSize / (tileBounds.max.x - tileBounds.min.x);
-        const double tileScaleH = tileSize / (tileBounds.max.y - tileBounds.min.y);
         const double paddedTileScaleW = paddedTileSize / (tileBounds.max.x - tileBounds.min.x + pointRadiusMeters * 2.0);
         const double paddedTileScaleH = paddedTileSize / (tileBounds.max.y - tileBounds.min.y + pointRadiusMeters * 2.0);
 
+        // Reproject with a single PROJ call
+        std::vector<double> &xs = cloud.x, &ys = cloud.y;
         CoordsTransformer ict(pcInfo.wktProjection, 3857);
+        ict.transform(numPoints, xs.data(), ys.data());
 
-        bool normalize = false;
-        for (pdal::PointId idx = 0; idx < point_view->size(); ++idx)
-        {
-            auto p = point_view->point(idx);
-            uint16_t red = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Red);
-            uint16_t green = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Green);
-            uint16_t blue = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Blue);
-
-            if (red > 255 || green > 255 || blue > 255)
-            {
-                normalize = true;
-                break;
-            }
-        }
+        RasterPoints points;
+        points.resize(numPoints);
+        std::copy(cloud.z.begin(), cloud.z.end(), points.z.begin());
 
-        for (pdal::PointId idx = 0; idx < point_view->size(); ++idx)
+        // Map projected coordinates to local (padded) PNG coordinates
+        for (size_t i = 0; i < numPoints; i++)
         {
-            auto p = point_view->point(idx);
-            double x = p.getFieldAs<double>(pdal::Dimension::Id::X);
-            double y = p.getFieldAs<double>(pdal::Dimension::Id::Y);
-            double z = p.getFieldAs<double>(pdal::Dimension::Id::Z);
-
-            ict.transform(&x, &y);
-
-            // Map projected coordinates to local PNG coordinates
-            int px = std::round((x - tileBounds.min.x - pointRadiusMeters) * paddedTileScaleW);
-            int py = paddedTileSize - 1 - std::round((y - tileBounds.min.y + pointRadiusMeters) * paddedTileScaleH);
-
-            if (px >= 0 && px < paddedTileSize && py >= 0 && py < paddedTileSize)
-            {
-                // Within bounds
-                PointColor color;
-                uint16_t red = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Red);
-                uint16_t green = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Green);
-                uint16_t blue = p.getFieldAs<uint16_t>(pdal::Dimension::Id::Blue);
-
-                if (normalize)
-                {
-                    color.r = red >> 8;
-                    color.g = green >> 8;
-                    color.b = blue >> 8;
-                }
-                else
-                {
-                    color.r = static_cast<uint8_t>(red);
-                    color.g = static_cast<uint8_t>(green);
-                    color.b = static_cast<uint8_t>(blue);
-                }
+            points.px[i] = static_cast<int>(std::round((xs[i] - tileBounds.min.x - pointRadiusMeters) * paddedTileScaleW));
+            points.py[i] = paddedTileSize - 1 - static_cast<int>(std::round((ys[i] - tileBounds.min.y + pointRadiusMeters) * paddedTileScaleH));
+        }
 
-                int off_px = px - pointRadius;
-                int off_py = py - pointRadius;
+        colorizePoints(cloud, points);
 
-                if (zBuffer.get()[py * paddedTileSize + px] < z)
-                {
-                    zBuffer.get()[py * paddedTileSize + px] = z;
-                    drawCircle(buffer.get(), alphaBuffer.get(), off_px, off_py,
-                               pointRadius, color.r, color.g, color.b, tileSize, wSize);
-                }
-            }
-        }
+        const int threads = numPoints >= ParallelRasterMinPoints ? rasterThreads() : 1;
+        rasterizePoints(points, pointRadius, tileSize, buffer.get(), alphaBuffer.get(), threads);
 
         GDALDriverH memDrv = GDALGetDriverByName("MEM");
         if (memDrv == nullptr)
@@ -324,6 +307,113 @@ namespace ddb
         }
     }
 
+    void PointCloudTiler::readPoints(double minX, double minY, double maxX, double maxY,
+                                     double resolution, CopcPoints &points)
+    {
+        if (source)
+        {
+            source->read(minX, minY, maxX, maxY, resolution, points);
+            return;
+        }
+
+        pdal::Options copcOpts;
+        copcOpts.add("filename", inputPath);
+
+        std::stringstream ss;
+        ss << std::setprecision(14) << "([" << minX << "," << maxX << "]," << "[" << minY << "," << maxY << "])";
+        copcOpts.add("bounds", ss.str());
+        copcOpts.add("resolution", resolution);
+        LOGD << "COPC bounds: " << ss.str();
+
+        pdal::CopcReader copcReader;
+        copcReader.setOptions(copcOpts);
+
+        pdal::PointTable table;
+        pdal::PointViewSet pointViewSet;
+        try
+        {
+            copcReader.prepare(table);
+            pointViewSet = copcReader.execute(table);
+        }
+        catch (const pdal::pdal_error &e)
+        {
+            throw PDALException(e.what());
+        }
+
+        const pdal::PointView &view = **pointViewSet.begin();
+        const size_t numPoints = view.size();
+        const bool hasIntensity = view.hasDim(pdal::Dimension::Id::Intensity);
+        const bool hasClassification = view.hasDim(pdal::Dimension::Id::Classification);
+
+        points.reserve(numPoints);
+        for (pdal::PointId idx = 0; idx < numPoints; ++idx)
+        {
+            points.x.push_back(view.getFieldAs<double>(pdal::Dimension::Id::X, idx));
+            points.y.push_back(view.getFieldAs<double>(pdal::Dimension::Id::Y, idx));
+            points.z.push_back(view.getFieldAs<double>(pdal::Dimension::Id::Z, idx));
+            points.red.push_back(hasColors ? view.getFieldAs<uint16_t>(pdal::Dimension::Id::Red, idx) : 0);
+            points.green.push_back(hasColors ? view.getFieldAs<uint16_t>(pdal::Dimension::Id::Green, idx) : 0);
+            points.blue.push_back(hasColors ? view.getFieldAs<uint16_t>(pdal::Dimension::Id::Blue, idx) : 0);
+            points.intensity.push_back(hasIntensity ? view.getFieldAs<uint16_t>(pdal::Dimension::Id::Intensity, idx) : 0);
+            points.classification.push_back(hasClassification ? view.getFieldAs<uint8_t>(pdal::Dimension::Id::Classification, idx) : 0);
+        }
+    }
+
+    void PointCloudTiler::colorizePoints(const CopcPoints &cloud, RasterPoints &points) const
+    {
+        const size_t numPoints = points.size();
+
+        switch (renderMode)
+        {
+        case PointCloudRenderMode::RGB:
+        {
+            uint16_t maxValue = 0;
+            for (size_t i = 0; i < numPoints; i++)
+                maxValue = std::max({maxValue, cloud.red[i], cloud.green[i], cloud.blue[i]});
+
+            // 16 bit colors
+            const int shift = maxValue > 255 ? 8 : 0;
+            for (size_t i = 0; i < numPoints; i++)
+            {
+                points.r[i] = static_cast<uint8_t>(cloud.red[i] >> shift);
+                points.g[i] = static_cast<uint8_t>(cloud.green[i] >> shift);
+                points.b[i] = static_cast<uint8_t>(cloud.blue[i] >> shift);
+            }
+            break;
+        }
+        case PointCloudRenderMode::Intensity:
+        {
+            const uint16_t maxValue = numPoints > 0 ? *std::max_element(cloud.intensity.begin(), cloud.intensity.end()) : 0;
+            const int shift = maxValue > 255 ? 8 : 0;
+            for (size_t i = 0; i < numPoints; i++)
+                points.r[i] = points.g[i] = points.b[i] = static_cast<uint8_t>(cloud.intensity[i] >> shift);
+            break;
+        }
+        case PointCloudRenderMode::Classification:
+            for (size_t i = 0; i < numPoints; i++)
+                classificationColor(cloud.classification[i], points.r[i], points.g[i], points.b[i]);
+            break;
+        default:
+        {
+            const Colormap *cmap = VegetationEngine::instance().getColormap("terrain");
+            if (cmap == nullptr)
+                throw AppException("Cannot find terrain colormap");
+
+            const double minZ = pcInfo.bounds[2];
+            const double range = pcInfo.bounds[5] - minZ;
+            for (size_t i = 0; i < numPoints; i++)
+            {
+                const double t = range > 0 ? (points.z[i] - minZ) / range : 0.5;
+                const auto &c = cmap->entries[static_cast<int>(std::clamp(t, 0.0, 1.0) * 255.0)];
+                points.r[i] = c.r;
+                points.g[i] = c.g;
+                points.b[i] = c.b;
+            }
+            break;
+        }
+        }
+    }
+
     void drawCircle(uint8_t *buffer, uint8_t *alpha, int px, int py, int radius,
                     uint8_t r, uint8_t g, uint8_t b, int tileSize, int wSize)
     {
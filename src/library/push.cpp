@@ -19,7 +19,7 @@
 namespace ddb
 {
 
-    DDB_DLL void push(const std::string &registry, bool sslVerify)
+    DDB_DLL void push(const std::string &registry, bool sslVerify, const PushOptions &options)
     {
 
         const auto currentPath = fs::current_path().string();
@@ -59,14 +59,14 @@ namespace ddb
                 UserProfile::get()->getAuthManager()->saveCredentials(
                     registryUrl, AuthCredentials(username, password));
 
-                reg.push(currentPath, std::cout);
+                reg.push(currentPath, std::cout, options);
             }
             else
             {
                 if (reg.login(ac.username, ac.password).length() <= 0)
                     throw AuthException("Cannot authenticate with " + reg.getUrl());
 
-                reg.push(currentPath, std::cout);
+                reg.push(currentPath, std::cout, options);
             }
         }
         catch (const AuthException &)
@@ -79,7 +79,7 @@ namespace ddb
                 UserProfile::get()->getAuthManager()->saveCredentials(
                     registryUrl, AuthCredentials(username, password));
 
-                reg.push(currentPath, std::cout);
+                reg.push(currentPath, std::cout, options);
             }
             else
             {
@@ -15,6 +15,33 @@
 namespace ddb
 {
 
+    namespace
+    {
+        // Dropped connections, server errors and rejected chunks can be retried
+        void checkTransient(const cpr::Response &res)
+        {
+            if (res.error)
+                throw NetException(res.error.message);
+            if (res.status_code >= 500 || res.status_code == 408 || res.status_code == 409 || res.status_code == 429)
+                throw NetException("Registry returned status " + std::to_string(res.status_code));
+        }
+
+        uint64_t parseReceived(Registry *registry, cpr::Response &res)
+        {
+            json j = json::parse(res.text);
+            if (!j.contains("received"))
+                registry->handleError(res);
+            return j["received"].get<uint64_t>();
+        }
+    }
+
+    std::string PushManager::validAuthToken()
+    {
+        std::lock_guard<std::mutex> lock(tokenMutex);
+        this->registry->ensureTokenValidity();
+        return this->registry->getAuthToken();
+    }
+
     DDB_DLL PushInitResponse PushManager::init(const std::string &registryStampChecksum, const json &dbStamp)
     {
         this->registry->ensureTokenValidity();
@@ -40,25 +67,83 @@ namespace ddb
         pir.neededFiles = j["neededFiles"].get<std::vector<std::string>>();
         pir.neededMeta = j["neededMeta"].get<std::vector<std::string>>();
         pir.token = j["token"].get<std::string>();
+        if (j.contains("chunkSize"))
+            pir.chunkSize = j["chunkSize"].get<size_t>();
         return pir;
     }
 
-    DDB_DLL void PushManager::upload(const std::string &fullPath, const std::string &file, const std::string &token)
+    DDB_DLL void PushManager::upload(const std::string &fullPath, const std::string &file, const std::string &token,
+                                     const std::function<void(uint64_t bytes)> &onSent)
     {
-        this->registry->ensureTokenValidity();
+        const auto authToken = this->validAuthToken();
+
+        // Reports the bytes sent since the previous call. Blocking here stalls
+        // the transfer, which is how the caller throttles it.
+        uint64_t reported = 0;
+        auto progressCb = [&onSent, &reported](size_t, size_t, size_t, size_t txBytes, intptr_t) -> bool {
+            if (onSent != nullptr && txBytes > reported) {
+                onSent(txBytes - reported);
+                reported = txBytes;
+            }
+            return true;
+        };
 
         auto res = cpr::Post(cpr::Url(this->registry->getUrl("/orgs/" + this->organization + "/ds/" +
                                                              this->dataset + "/push/upload")),
                              cpr::Multipart{{"file", cpr::File{fullPath}},
                                             {"path", file},
                                             {"token", token}},
-                             utils::authHeader(this->registry->getAuthToken()),
+                             utils::authHeader(authToken),
+                             cpr::ProgressCallback(progressCb),
                              cpr::VerifySsl(this->registry->getSslVerify()));
 
+        checkTransient(res);
         if (res.status_code != 200)
             this->registry->handleError(res);
     }
 
+    DDB_DLL uint64_t PushManager::uploadStatus(const std::string &file, const std::string &token)
+    {
+        const auto authToken = this->validAuthToken();
+
+        auto res = cpr::Post(cpr::Url(this->registry->getUrl("/orgs/" + this->organization + "/ds/" +
+                                                             this->dataset + "/push/upload/status")),
+                             cpr::Payload{{"path", file},
+                                          {"token", token}},
+                             utils::authHeader(authToken),
+                             cpr::VerifySsl(this->registry->getSslVerify()));
+
+        checkTransient(res);
+        if (res.status_code != 200)
+            this->registry->handleError(res);
+
+        return parseReceived(this->registry, res);
+    }
+
+    DDB_DLL uint64_t PushManager::uploadChunk(const std::string &file, const std::string &token,
+                                              uint64_t offset, uint64_t fileSize, const std::string &checksum,
+                                              const char *data, size_t size)
+    {
+        const auto authToken = this->validAuthToken();
+
+        auto res = cpr::Post(cpr::Url(this->registry->getUrl("/orgs/" + this->organization + "/ds/" +
+                                                             this->dataset + "/push/upload/chunk")),
+                             cpr::Multipart{{"chunk", cpr::Buffer{data, data + size, "chunk"}},
+                                            {"path", file},
+                                            {"token", token},
+                                            {"offset", std::to_string(offset)},
+                                            {"size", std::to_string(fileSize)},
+                                            {"checksum", checksum}},
+                             utils::authHeader(authToken),
+                             cpr::VerifySsl(this->registry->getSslVerify()));
+
+        checkTransient(res);
+        if (res.status_code != 200)
+            this->registry->handleError(res);
+
+        return parseReceived(this->registry, res);
+    }
+
     void PushManager::meta(const json &metaDump, const std::string &token)
     {
         auto res = cpr::Post(cpr::Url(this->registry->getUrl("/orgs/" + this->organization + "/ds/" +
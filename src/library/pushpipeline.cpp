@@ -0,0 +1,218 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "pushpipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <thread>
+
+#include "exceptions.h"
+#include "hash.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        const int MaxRetryDelayMs = 60000;
+
+        size_t defaultChunkSize()
+        {
+            const long long mb = utils::getEnvLong("DDB_PUSH_CHUNK_MB", 8, 1);
+            return static_cast<size_t>(mb) * 1024 * 1024;
+        }
+
+        // Runs fn until it succeeds, retrying transient failures with exponential backoff.
+        // fn receives whether it is being retried.
+        template <typename Fn>
+        void withRetries(const std::string &path, const PushOptions &options, Fn fn)
+        {
+            int failures = 0;
+            while (true)
+            {
+                try
+                {
+                    if (fn(failures > 0))
+                        return;
+                    failures = 0; // Progress was made
+                }
+                catch (const NetException &e)
+                {
+                    if (++failures > options.retries)
+                        throw;
+
+                    const int delay = std::min(MaxRetryDelayMs,
+                                               options.retryDelayMs << std::min(failures - 1, 16));
+                    LOGD << e.what() << ", retrying upload of " << path << " in " << delay
+                         << " ms (attempt " << failures << ")";
+                    utils::sleep(delay);
+                }
+            }
+        }
+
+        void pushChunked(PushTransport &transport, BandwidthLimiter &limiter, const std::string &path,
+                         const fs::path &fullPath, size_t chunkSize, const PushOptions &options)
+        {
+            std::ifstream in(fullPath, std::ios::binary);
+            if (!in.is_open())
+                throw FSException("Cannot open " + fullPath.string());
+
+            const uint64_t fileSize = fs::file_size(fullPath);
+            std::vector<char> buf(static_cast<size_t>(std::min<uint64_t>(chunkSize, std::max<uint64_t>(fileSize, 1))));
+
+            // Single chunk files are sent right away; anything larger may have been
+            // partially received by a previous attempt
+            uint64_t offset = 0;
+            bool resume = fileSize > chunkSize;
+
+            withRetries(path, options, [&](bool retrying)
+                        {
+                if (resume || retrying)
+                {
+                    offset = transport.received(path);
+                    resume = false;
+
+                    if (offset > fileSize)
+                        throw RegistryException("The registry acknowledged more bytes than the size of " + path);
+                    if (offset == fileSize && fileSize > 0)
+                        return true;
+                    if (offset > 0)
+                        LOGD << "Resuming upload of " << path << " at " << offset << " / " << fileSize;
+                }
+
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(chunkSize, fileSize - offset));
+                in.clear();
+                in.seekg(static_cast<std::streamoff>(offset));
+                in.read(buf.data(), static_cast<std::streamsize>(n));
+                if (static_cast<size_t>(in.gcount()) != n)
+                    throw FSException("Cannot read " + fullPath.string());
+
+                limiter.acquire(n);
+                const uint64_t ack = transport.sendChunk(path, offset, fileSize,
+                                                         Hash::strSHA256(buf.data(), n), buf.data(), n);
+                if (ack > fileSize)
+                    throw RegistryException("The registry acknowledged more bytes than the size of " + path);
+                if (n > 0 && ack <= offset)
+                    throw NetException("The registry did not acknowledge chunk at " +
+                                       std::to_string(offset) + " of " + path);
+
+                offset = ack;
+                return offset == fileSize; });
+        }
+
+        void pushWhole(PushTransport &transport, BandwidthLimiter &limiter, const std::string &path,
+                       const fs::path &fullPath, const PushOptions &options)
+        {
+            // Throttled while the file is read, so a large file doesn't go out at full speed
+            withRetries(path, options, [&](bool)
+                        {
+                transport.sendFile(path, fullPath, [&limiter](uint64_t bytes)
+                                   { limiter.acquire(bytes); });
+                return true; });
+        }
+    }
+
+    BandwidthLimiter::BandwidthLimiter(long long bytesPerSecond)
+        : bytesPerSecond(bytesPerSecond), next(std::chrono::steady_clock::now())
+    {
+    }
+
+    void BandwidthLimiter::acquire(uint64_t bytes)
+    {
+        if (bytesPerSecond <= 0 || bytes == 0)
+            return;
+
+        std::chrono::steady_clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // Unused budget does not accumulate: an idle limiter allows
+            // at most one transfer to start right away
+            start = std::max(next, std::chrono::steady_clock::now());
+            next = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(static_cast<double>(bytes) / bytesPerSecond));
+        }
+
+        std::this_thread::sleep_until(start);
+    }
+
+    void pushFiles(PushTransport &transport, const fs::path &basePath,
+                   const std::vector<std::string> &paths, const PushOptions &options,
+                   const PushFileCallback &callback)
+    {
+        if (paths.empty())
+            return;
+
+        size_t chunkSize = options.chunkSize > 0 ? options.chunkSize : defaultChunkSize();
+        const size_t maxChunkSize = transport.maxChunkSize();
+        const bool chunked = maxChunkSize > 0;
+        if (chunked)
+            chunkSize = std::min(chunkSize, maxChunkSize);
+
+        BandwidthLimiter limiter(options.maxBytesPerSecond);
+
+        std::mutex mutex;
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+        std::atomic<size_t> nextPath(0);
+
+        auto worker = [&]()
+        {
+            while (!failed)
+            {
+                const size_t i = nextPath++;
+                if (i >= paths.size())
+                    return;
+
+                const auto &path = paths[i];
+                const auto fullPath = basePath / path;
+
+                // A throwing callback aborts the push like a failed upload
+                // (an exception escaping a worker thread would terminate)
+                try
+                {
+                    if (callback != nullptr)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        callback(path);
+                    }
+
+                    if (chunked)
+                        pushChunked(transport, limiter, path, fullPath, chunkSize, options);
+                    else
+                        pushWhole(transport, limiter, path, fullPath, options);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                    failed = true;
+                    return;
+                }
+            }
+        };
+
+        const size_t jobs = std::min(paths.size(), static_cast<size_t>(std::max(1, options.jobs)));
+        std::vector<std::thread> workers;
+        workers.reserve(jobs - 1);
+        for (size_t i = 1; i < jobs; i++)
+            workers.emplace_back(worker);
+
+        worker();
+
+        for (auto &t : workers)
+            t.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+} // namespace ddb
@@ -58,6 +58,33 @@ bool detectIsThermal(const std::string &filePath, std::string &outSensorId) {
     return false;
 }
 
+// Raw value -> itself, for UInt16 rasters that need no conversion
+const std::vector<float> &identityLut() {
+    static const std::vector<float> lut = [] {
+        std::vector<float> v(65536);
+        for (size_t i = 0; i < v.size(); i++) v[i] = static_cast<float>(i);
+        return v;
+    }();
+    return lut;
+}
+
+json areaStatsJson(const ThermalAreaStats &stats, int x0, int y0, int x1, int y1,
+                   const std::string &unit, bool isThermal) {
+    json result;
+    result["min"] = stats.min;
+    result["max"] = stats.max;
+    result["mean"] = stats.mean;
+    result["stddev"] = stats.stddev;
+    result["median"] = stats.median;
+    result["pixelCount"] = stats.pixelCount;
+    result["bounds"] = {
+        {"x0", x0}, {"y0", y0}, {"x1", x1}, {"y1", y1}
+    };
+    result["unit"] = unit;
+    result["isThermal"] = isThermal;
+    return result;
+}
+
 } // anonymous namespace
 
 std::string readGdalUnitType(const std::string &filePath) {
@@ -121,14 +148,14 @@ std::string getRasterValueInfoJson(const std::string &filePath) {
 
     // Fallback for small R-JPEG thermal images not fully handled by GDAL stats.
     if (!hasStats && isThermal) {
-        TemperatureData td = readTemperatureData(filePath);
-        if (!td.temperatures.empty()) {
-            width = td.width;
-            height = td.height;
+        const auto td = readTemperatureDataCached(filePath);
+        if (!td->temperatures.empty()) {
+            width = td->width;
+            height = td->height;
             bandCount = 1;
             vMin = std::numeric_limits<float>::max();
             vMax = std::numeric_limits<float>::lowest();
-            for (float t : td.temperatures) {
+            for (float t : td->temperatures) {
                 if (std::isfinite(t) && t > -273.15f && t < 1000.0f) {
                     vMin = std::min(vMin, t);
                     vMax = std::max(vMax, t);
@@ -275,19 +302,19 @@ std::string getRasterPointJson(const std::string &filePath, int x, int y) {
         throw AppException("Cannot read raster data from " + filePath);
     }
 
-    TemperatureData td = readTemperatureData(filePath);
-    if (td.temperatures.empty()) {
+    const auto td = readTemperatureDataCached(filePath);
+    if (td->temperatures.empty()) {
         throw AppException("Cannot read raster data from " + filePath);
     }
 
-    if (x < 0 || x >= td.width || y < 0 || y >= td.height) {
+    if (x < 0 || x >= td->width || y < 0 || y >= td->height) {
         throw InvalidArgsException("Pixel coordinates out of bounds: (" +
             std::to_string(x) + ", " + std::to_string(y) + ") for image " +
-            std::to_string(td.width) + "x" + std::to_string(td.height));
+            std::to_string(td->width) + "x" + std::to_string(td->height));
     }
 
-    size_t idx = static_cast<size_t>(y) * td.width + x;
-    float value = td.temperatures[idx];
+    size_t idx = static_cast<size_t>(y) * td->width + x;
+    float value = td->temperatures[idx];
 
     json result;
     result["value"] = value;
@@ -295,16 +322,15 @@ std::string getRasterPointJson(const std::string &filePath, int x, int y) {
     result["y"] = y;
     result["isThermal"] = true;
 
-    RawThermalData raw = extractRawThermalData(filePath);
-    if (raw.valid && idx < raw.data.size()) {
-        result["rawValue"] = raw.data[idx];
+    if (idx < td->rawValues.size()) {
+        result["rawValue"] = td->rawValues[idx];
     } else {
         result["rawValue"] = value;
     }
 
-    if (td.hasGeoTransform && !td.projection.empty()) {
+    if (td->hasGeoTransform && !td->projection.empty()) {
         double geoX = 0, geoY = 0;
-        pixelToGeo(x + 0.5, y + 0.5, td.geoTransform, td.projection, geoX, geoY);
+        pixelToGeo(x + 0.5, y + 0.5, td->geoTransform, td->projection, geoX, geoY);
         result["geoX"] = geoX;
         result["geoY"] = geoY;
         result["hasGeo"] = true;
@@ -351,86 +377,53 @@ std::string getRasterAreaStatsJson(const std::string &filePath,
             const int roiW = x1 - x0 + 1;
             const int roiH = y1 - y0 + 1;
             const size_t roiCount = static_cast<size_t>(roiW) * roiH;
-            std::vector<float> roiData(roiCount);
+
+            // Respect nodata.
+            int hasNoData = 0;
+            double noData = GDALGetRasterNoDataValue(hBand, &hasNoData);
 
             bool gotData = false;
-            if (dt == GDT_Float32 || dt == GDT_Float64) {
-                gotData = (GDALRasterIO(hBand, GF_Read, x0, y0, roiW, roiH,
-                    roiData.data(), roiW, roiH, GDT_Float32, 0, 0) == CE_None);
-            } else if (dt == GDT_UInt16) {
+            ThermalAreaStats stats;
+            if (dt == GDT_UInt16) {
+                // Histogram of the raw counts: converted once per distinct value
                 std::vector<uint16_t> rawRoi(roiCount);
                 if (GDALRasterIO(hBand, GF_Read, x0, y0, roiW, roiH,
                                  rawRoi.data(), roiW, roiH,
                                  GDT_UInt16, 0, 0) == CE_None) {
-                    for (size_t i = 0; i < roiCount; i++) {
-                        roiData[i] = needsConversion
-                            ? static_cast<float>(rawToTemperature(rawRoi[i], cal))
-                            : static_cast<float>(rawRoi[i]);
+                    std::vector<uint64_t> histogram(65536, 0);
+                    for (uint16_t raw : rawRoi) histogram[raw]++;
+                    if (hasNoData && noData >= 0.0 && noData <= 65535.0 && noData == std::floor(noData)) {
+                        histogram[static_cast<size_t>(noData)] = 0;
                     }
+
+                    const auto lut = needsConversion ? temperatureLut(cal) : nullptr;
+                    stats = computeAreaStats(histogram, lut ? *lut : identityLut());
                     gotData = true;
                 }
             } else {
-                gotData = (GDALRasterIO(hBand, GF_Read, x0, y0, roiW, roiH,
-                    roiData.data(), roiW, roiH, GDT_Float32, 0, 0) == CE_None);
-            }
+                std::vector<float> values(roiCount);
+                if (GDALRasterIO(hBand, GF_Read, x0, y0, roiW, roiH,
+                                 values.data(), roiW, roiH, GDT_Float32, 0, 0) == CE_None) {
+                    values.erase(std::remove_if(values.begin(), values.end(), [&](float v) {
+                        if (!std::isfinite(v)) return true;
+                        return hasNoData && std::abs(static_cast<double>(v) - noData) < 1e-6;
+                    }), values.end());
 
-            if (gotData) {
-                // Respect nodata.
-                int hasNoData = 0;
-                double noData = GDALGetRasterNoDataValue(hBand, &hasNoData);
-
-                std::vector<float> values;
-                values.reserve(roiCount);
-                for (float v : roiData) {
-                    if (!std::isfinite(v)) continue;
-                    if (hasNoData && std::abs(static_cast<double>(v) - noData) < 1e-6) continue;
-                    values.push_back(v);
+                    stats = computeAreaStats(values);
+                    gotData = true;
                 }
+            }
 
+            if (gotData) {
                 GDALClose(hDs);
 
-                if (values.empty()) {
+                if (stats.pixelCount == 0) {
                     throw AppException("No valid data in the specified area");
                 }
 
-                std::sort(values.begin(), values.end());
-                const float vMin = values.front();
-                const float vMax = values.back();
-
-                double sum = 0;
-                for (float v : values) sum += v;
-                const double mean = sum / values.size();
-
-                double sqSum = 0;
-                for (float v : values) {
-                    double diff = v - mean;
-                    sqSum += diff * diff;
-                }
-                const double stddev = std::sqrt(sqSum / values.size());
-
-                float median;
-                const size_t n = values.size();
-                if (n % 2 == 0) {
-                    median = (values[n / 2 - 1] + values[n / 2]) / 2.0f;
-                } else {
-                    median = values[n / 2];
-                }
-
                 if (unit.empty() && isThermal) unit = "\xC2\xB0\x43";
 
-                json result;
-                result["min"] = vMin;
-                result["max"] = vMax;
-                result["mean"] = mean;
-                result["stddev"] = stddev;
-                result["median"] = median;
-                result["pixelCount"] = static_cast<int>(values.size());
-                result["bounds"] = {
-                    {"x0", x0}, {"y0", y0}, {"x1", x1}, {"y1", y1}
-                };
-                result["unit"] = unit;
-                result["isThermal"] = isThermal;
-                return result.dump();
+                return areaStatsJson(stats, x0, y0, x1, y1, unit, isThermal).dump();
             }
         }
         GDALClose(hDs);
@@ -441,15 +434,15 @@ std::string getRasterAreaStatsJson(const std::string &filePath,
         throw AppException("Cannot read raster data from " + filePath);
     }
 
-    TemperatureData td = readTemperatureData(filePath);
-    if (td.temperatures.empty()) {
+    const auto td = readTemperatureDataCached(filePath);
+    if (td->temperatures.empty()) {
         throw AppException("Cannot read raster data from " + filePath);
     }
 
-    x0 = std::max(0, std::min(x0, td.width - 1));
-    y0 = std::max(0, std::min(y0, td.height - 1));
-    x1 = std::max(0, std::min(x1, td.width - 1));
-    y1 = std::max(0, std::min(y1, td.height - 1));
+    x0 = std::max(0, std::min(x0, td->width - 1));
+    y0 = std::max(0, std::min(y0, td->height - 1));
+    x1 = std::max(0, std::min(x1, td->width - 1));
+    y1 = std::max(0, std::min(y1, td->height - 1));
     if (x0 > x1) std::swap(x0, x1);
     if (y0 > y1) std::swap(y0, y1);
 
@@ -457,7 +450,7 @@ std::string getRasterAreaStatsJson(const std::string &filePath,
     values.reserve(static_cast<size_t>(x1 - x0 + 1) * (y1 - y0 + 1));
     for (int row = y0; row <= y1; row++) {
         for (int col = x0; col <= x1; col++) {
-            float t = td.temperatures[static_cast<size_t>(row) * td.width + col];
+            float t = td->temperatures[static_cast<size_t>(row) * td->width + col];
             if (std::isfinite(t) && t > -273.15f && t < 1000.0f) {
                 values.push_back(t);
             }
@@ -468,42 +461,8 @@ std::string getRasterAreaStatsJson(const std::string &filePath,
         throw AppException("No valid data in the specified area");
     }
 
-    std::sort(values.begin(), values.end());
-    const float vMin = values.front();
-    const float vMax = values.back();
-
-    double sum = 0;
-    for (float v : values) sum += v;
-    const double mean = sum / values.size();
-
-    double sqSum = 0;
-    for (float v : values) {
-        double diff = v - mean;
-        sqSum += diff * diff;
-    }
-    const double stddev = std::sqrt(sqSum / values.size());
-
-    float median;
-    const size_t n = values.size();
-    if (n % 2 == 0) {
-        median = (values[n / 2 - 1] + values[n / 2]) / 2.0f;
-    } else {
-        median = values[n / 2];
-    }
-
-    json result;
-    result["min"] = vMin;
-    result["max"] = vMax;
-    result["mean"] = mean;
-    result["stddev"] = stddev;
-    result["median"] = median;
-    result["pixelCount"] = static_cast<int>(values.size());
-    result["bounds"] = {
-        {"x0", x0}, {"y0", y0}, {"x1", x1}, {"y1", y1}
-    };
-    result["unit"] = std::string("\xC2\xB0\x43");
-    result["isThermal"] = true;
-    return result.dump();
+    return areaStatsJson(computeAreaStats(values), x0, y0, x1, y1,
+                         std::string("\xC2\xB0\x43"), true).dump();
 }
 
 } // namespace ddb
@@ -2,6 +2,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 #include "raster_profile.h"
+#include "coordstransformer.h"
 #include "raster_analysis.h"
 #include "thermal.h"
 #include "sensorprofile.h"
@@ -74,11 +75,6 @@ struct SrsHandle {
     SrsHandle &operator=(const SrsHandle &) = delete;
 };
 
-struct CtHandle {
-    OGRCoordinateTransformationH h = nullptr;
-    ~CtHandle() { if (h) OCTDestroyCoordinateTransformation(h); }
-};
-
 } // anonymous namespace
 
 std::string getRasterProfileJson(const std::string &filePath,
@@ -147,10 +143,6 @@ std::string getRasterProfileJson(const std::string &filePath,
     if (unit.empty() && isThermal) unit = "\xC2\xB0\x43"; // UTF-8 "°C"
 
     // --- Setup coordinate transforms (WGS84 <-> raster CRS) ---
-    SrsHandle wgs84(OSRNewSpatialReference(nullptr));
-    OSRImportFromEPSG(wgs84.h, 4326);
-    OSRSetAxisMappingStrategy(wgs84.h, OAMS_TRADITIONAL_GIS_ORDER);
-
     SrsHandle rasterSrs;
     bool rasterIsGeographic = false;
     if (!projection.empty()) {
@@ -160,28 +152,31 @@ std::string getRasterProfileJson(const std::string &filePath,
             OSRDestroySpatialReference(rasterSrs.h);
             rasterSrs.h = nullptr;
         } else {
-            OSRSetAxisMappingStrategy(rasterSrs.h, OAMS_TRADITIONAL_GIS_ORDER);
             rasterIsGeographic = (OSRIsGeographic(rasterSrs.h) != 0);
         }
     }
 
-    CtHandle wgsToRaster;
+    std::unique_ptr<CoordsTransformer> wgsToRaster;
     if (rasterSrs.h) {
-        wgsToRaster.h = OCTNewCoordinateTransformation(wgs84.h, rasterSrs.h);
+        try {
+            wgsToRaster = std::make_unique<CoordsTransformer>(4326, projection);
+        } catch (const GDALException &e) {
+            LOGD << "Cannot create profile transformation: " << e.what();
+        }
     }
 
     // --- Transform vertices WGS84 -> raster map coords ---
     std::vector<double> mapX(nVertices);
     std::vector<double> mapY(nVertices);
     for (int i = 0; i < nVertices; i++) {
-        double mx = line->getX(i); // lon
-        double my = line->getY(i); // lat
-        if (wgsToRaster.h) {
-            if (!OCTTransform(wgsToRaster.h, 1, &mx, &my, nullptr))
-                throw AppException("Cannot transform profile vertex to raster CRS");
-        }
-        mapX[i] = mx;
-        mapY[i] = my;
+        mapX[i] = line->getX(i); // lon
+        mapY[i] = line->getY(i); // lat
+    }
+    if (wgsToRaster) {
+        std::vector<int> ok(nVertices);
+        if (wgsToRaster->transform(nVertices, mapX.data(), mapY.data(), nullptr, ok.data()) !=
+            static_cast<size_t>(nVertices))
+            throw AppException("Cannot transform profile vertex to raster CRS");
     }
 
     // --- Segment lengths in meters + total length ---
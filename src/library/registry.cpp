@@ -4,13 +4,13 @@
 
 #include "registry.h"
 
-#include <boolinq/boolinq.h>
 #include <cpr/cpr.h>
 
 #include "build.h"
 #include "ddb.h"
 #include "delta.h"
 #include "exceptions.h"
+#include "hash.h"
 #include "json.h"
 #include "mio.h"
 #include "mzip.h"
@@ -25,6 +25,66 @@ using homer6::Url;
 
 namespace ddb {
 
+namespace {
+
+// Extracts a ZIP response body as it arrives. The body of a failed
+// request is kept instead, so that it can be reported by handleError.
+class ZipResponseSink {
+    zip::ZipStreamExtractor extractor;
+    long status = 0;
+    std::string errorBody;
+    std::exception_ptr error;
+
+   public:
+    ZipResponseSink(const std::string& folder,
+                    const std::unordered_map<std::string, std::string>& expectedHashes = {})
+        : extractor(folder, expectedHashes) {}
+
+    cpr::HeaderCallback headerCallback() {
+        return cpr::HeaderCallback([this](const std::string_view& header, intptr_t) -> bool {
+            // Status line; the last one wins (redirects, 100 Continue)
+            if (header.rfind("HTTP/", 0) == 0) {
+                const auto sp = header.find(' ');
+                if (sp != std::string_view::npos)
+                    status = std::atol(std::string(header.substr(sp + 1, 3)).c_str());
+            }
+            return true;
+        });
+    }
+
+    cpr::WriteCallback writeCallback() {
+        return cpr::WriteCallback([this](const std::string_view& data, intptr_t) -> bool {
+            if (status != 200) {
+                errorBody.append(data.data(), data.size());
+                return true;
+            }
+
+            // Exceptions must not cross libcurl: abort the transfer and rethrow later
+            try {
+                extractor.write(data.data(), data.size());
+                return true;
+            } catch (...) {
+                error = std::current_exception();
+                return false;
+            }
+        });
+    }
+
+    void finish(Registry* registry, cpr::Response& res) {
+        if (error)
+            std::rethrow_exception(error);
+
+        if (res.error.code != cpr::ErrorCode::OK || res.status_code != 200) {
+            res.text = errorBody;
+            registry->handleError(res);
+        }
+
+        extractor.finish();
+    }
+};
+
+}  // namespace
+
 Registry::Registry(const std::string& url, bool sslVerify) {
     this->sslVerify = sslVerify;
     std::string urlStr = url;
@@ -183,38 +243,45 @@ void Registry::downloadDdb(const std::string& organization,
     this->ensureTokenValidity();
     const auto downloadUrl = url + "/orgs/" + organization + "/ds/" + dataset + "/ddb";
 
+    // The archive is extracted as it arrives instead of being buffered in memory
+    ZipResponseSink sink(folder);
     auto res = cpr::Get(cpr::Url(downloadUrl),
                         utils::authCookie(this->authToken),
+                        sink.headerCallback(),
+                        sink.writeCallback(),
                         cpr::VerifySsl(this->sslVerify));
 
-    // 1. Controllo errori di rete/SSL prima di qualsiasi accesso al payload
-    if (res.error.code != cpr::ErrorCode::OK) {
-        this->handleError(res);
-        return;
-    }
-
-    // 2. Controllo HTTP status code
-    if (res.status_code != 200) {
-        this->handleError(res);
-        return;
-    }
-
-    // 3. Estrazione ZIP con buffer binario sicuro
-    zip::extractAllFromBuffer(res.text.c_str(), res.text.size(), folder);
+    sink.finish(this, res);
 }
 
 json Registry::getStamp(const std::string& organization, const std::string& dataset) {
     this->ensureTokenValidity();
     const auto stampUrl = url + "/orgs/" + organization + "/ds/" + dataset + "/stamp";
 
+    // Registries that support it answer with the binary stamp, which is
+    // several times smaller than the JSON one on large datasets
+    auto headers = utils::authCookie(this->authToken);
+    headers["Accept"] = std::string(BinaryStampContentType) + ", application/json";
+
     auto res = cpr::Get(cpr::Url(stampUrl),
-                        utils::authCookie(this->authToken),
+                        headers,
                         cpr::VerifySsl(this->sslVerify));
 
     if (res.status_code != 200)
         this->handleError(res);
 
-    json stamp = res.text;
+    json stamp;
+    try {
+        const auto contentType = res.header["content-type"];
+        if (contentType.rfind(BinaryStampContentType, 0) == 0)
+            stamp = decodeStamp(res.text);
+        else
+            stamp = json::parse(res.text);
+    } catch (const json::exception& e) {
+        throw RegistryException("Invalid stamp: " + std::string(e.what()));
+    } catch (const InvalidArgsException& e) {
+        throw RegistryException("Invalid stamp: " + std::string(e.what()));
+    }
 
     // Quick sanity check<< ", diff = " << now - this->tokenExpiration;
     if (stamp.contains("checksum")) {
@@ -228,7 +295,8 @@ void Registry::downloadFiles(const std::string& organization,
                              const std::string& dataset,
                              const std::vector<std::string>& files,
                              const std::string& folder,
-                             std::ostream& out) {
+                             std::ostream& out,
+                             const std::unordered_map<std::string, std::string>& expectedHashes) {
     if (files.empty()) {
         // LOGD << "Asked to download an empty list of files...";
         return;
@@ -275,50 +343,47 @@ void Registry::downloadFiles(const std::string& organization,
 
         io::createDirectories(destPath.parent_path());
 
+        // Hash while writing, rather than reading the file back
+        SHA256Digest digest;
         std::ofstream of(destPath, std::ios::binary);
-        auto res = cpr::Download(of,
-                                 cpr::Url(downloadUrl),
-                                 utils::authCookie(this->authToken),
-                                 cpr::ProgressCallback(progressCb),
-                                 cpr::VerifySsl(this->sslVerify));
+        auto res = cpr::Get(cpr::Url(downloadUrl),
+                            utils::authCookie(this->authToken),
+                            cpr::ProgressCallback(progressCb),
+                            cpr::WriteCallback([&of, &digest](const std::string_view& data, intptr_t) -> bool {
+                                of.write(data.data(), data.size());
+                                digest.update(data.data(), data.size());
+                                return true;
+                            }),
+                            cpr::VerifySsl(this->sslVerify));
+        of.close();
 
         if (res.status_code != 200)
             this->handleError(res);
-    } else {
-        const auto tempFile = (fs::path(folder) / (utils::generateRandomString(8) + ".tmp"));
-        io::assureFolderExists(tempFile.parent_path());
 
+        const auto expected = expectedHashes.find(files[0]);
+        if (expected != expectedHashes.end() && digest.hex() != expected->second) {
+            io::assureIsRemoved(destPath);
+            throw RegistryException("Checksum mismatch for " + files[0]);
+        }
+    } else {
         // Joins path list
         const auto paths = utils::join(files);
 
         // LOGD << "Paths = " << paths;
 
-        std::ofstream of(tempFile, std::ios::binary);
-
-        auto res =
-            cpr::Post(cpr::Url(downloadUrl),
-                      utils::authCookie(this->authToken),
-                      cpr::Payload{{"path", paths}},
-                      cpr::WriteCallback([&of](const std::string_view& data, intptr_t) -> bool {
-                          of.write(data.data(), data.size());
-                          return true;
-                      }),
-                      cpr::VerifySsl(this->sslVerify));
-
-        of.close();
-
-        if (res.status_code != 200)
-            this->handleError(res);
-
-        // LOGD << "Files archive downloaded, extracting";
+        // Entries are written to folder as the archive arrives
+        ZipResponseSink sink(folder, expectedHashes);
+        auto res = cpr::Post(cpr::Url(downloadUrl),
+                             utils::authCookie(this->authToken),
+                             cpr::Payload{{"path", paths}},
+                             cpr::ProgressCallback(progressCb),
+                             sink.headerCallback(),
+                             sink.writeCallback(),
+                             cpr::VerifySsl(this->sslVerify));
 
         try {
-            zip::extractAll(tempFile.string(), folder);
-            io::assureIsRemoved(tempFile);
-
-            // LOGD << "Done";
-        } catch (const std::runtime_error& e) {
-            io::assureIsRemoved(tempFile);
+            sink.finish(this, res);
+        } catch (const ZipException& e) {
             throw AppException(e.what());
         }
     }
@@ -360,7 +425,8 @@ std::vector<Conflict> applyDelta(const Delta& d,
                                  Database* destination,
                                  const MergeStrategy mergeStrategy,
                                  const json& sourceMetaDump,
-                                 std::ostream& out) {
+                                 std::ostream& out,
+                                 const std::unordered_map<std::string, std::string>& verifiedHashes) {
     std::vector<Conflict> conflicts;
 
     // File operations
@@ -458,13 +524,11 @@ std::vector<Conflict> applyDelta(const Delta& d,
                     io::copy(source, dest);
                 }
 
-                // TODO: this could be made faster for large files
-                // by passing the already known hash instead
-                // of computing it
+                // Verified files are not hashed again
                 addToIndex(destination, {dest.string()}, [&out](const Entry& e, bool updated) {
                     out << (updated ? "U" : "A") << "\t" << e.path << std::endl;
                     return true;
-                });
+                }, verifiedHashes);
             }
         }
 
@@ -556,26 +620,36 @@ void Registry::pull(const std::string& path, const MergeStrategy mergeStrategy,
 
     const auto tempNewFolder = tempDdbFolder / std::to_string(time(nullptr));
 
+    // Hashes of the files in tempNewFolder: checked by computeDeltaLocals for the
+    // local copies and while streaming for the downloads
+    std::unordered_map<std::string, std::string> verifiedHashes;
+
     // Let's download only if we have anything to download
     if (!delta.adds.empty()) {
         // LOGD << "Temp new folder = " << tempNewFolder;
 
         auto localMap = computeDeltaLocals(delta, db.get(), tempNewFolder.string());
 
-        const auto filesToDownload =
-            boolinq::from(delta.adds)
-                .where([&localMap](const AddAction& add) {
-                    return !add.isDirectory() && localMap.find(add.hash) == localMap.end();
-                })
-                .select([](const AddAction& add) { return add.path; })
-                .toStdVector();
+        std::vector<std::string> filesToDownload;
+        std::unordered_map<std::string, std::string> expectedHashes;
+        for (const auto& add : delta.adds) {
+            if (add.isDirectory())
+                continue;
+
+            if (localMap.find(add.hash) == localMap.end()) {
+                filesToDownload.push_back(add.path);
+                expectedHashes[add.path] = add.hash;
+            }
+            verifiedHashes[add.path] = add.hash;
+        }
 
-        // Download all the missing files
+        // Download all the missing files, verifying them as they arrive
         this->downloadFiles(tagInfo.organization,
                             tagInfo.dataset,
                             filesToDownload,
                             tempNewFolder.string(),
-                            out);
+                            out,
+                            expectedHashes);
 
         // LOGD << "Files downloaded";
     } else {
@@ -586,7 +660,7 @@ void Registry::pull(const std::string& path, const MergeStrategy mergeStrategy,
     // before we download the files
 
     // Apply changes to local files
-    auto conflicts = applyDelta(delta, tempNewFolder, db.get(), mergeStrategy, remoteMetaDump, out);
+    auto conflicts = applyDelta(delta, tempNewFolder, db.get(), mergeStrategy, remoteMetaDump, out, verifiedHashes);
     io::assureIsRemoved(tempNewFolder);
 
     if (conflicts.size() == 0) {
@@ -635,6 +709,17 @@ std::unordered_map<std::string, bool> computeDeltaLocals(Delta d,
         addsMap[add.path] = true;
     }
 
+    // Resolve local candidates first, then verify the ones whose mtime changed
+    // with a single concurrent hashing batch
+    struct LocalCandidate {
+        const AddAction* add;
+        std::string ePath;
+        io::Path p;
+        bool needsHash;
+    };
+    std::vector<LocalCandidate> candidates;
+    std::vector<std::string> toHash;
+
     for (auto& add : d.adds) {
         if (add.hash.empty())
             continue;
@@ -645,38 +730,44 @@ std::unordered_map<std::string, bool> computeDeltaLocals(Delta d,
             // Check the filesystem to make sure this hasn't been modified
             io::Path p(db->rootDirectory() / ePath);
             long long eMtime = q->getInt64(1);
-            bool valid = false;
-            if (p.getModifiedTime() == eMtime) {
-                valid = true;
-            } else {
-                // Actually compute hash
-                valid = Hash::fileSHA256(p.get().string()) == add.hash;
-            }
+            const bool needsHash = p.getModifiedTime() != eMtime;
+            if (needsHash)
+                toHash.push_back(p.get().string());
+            candidates.push_back({&add, ePath, p, needsHash});
+        }
+        q->reset();
+    }
 
-            if (valid) {
-                if (!hlDestFolder.empty()) {
-                    const auto destPath = fs::path(hlDestFolder) / add.path;
-                    io::createDirectories(destPath.parent_path());
-
-                    // We can leverage hard links ONLY
-                    // if the path we are linking is not itself
-                    // part of an add operation (otherwise it could be
-                    // overwritten)
-                    if (addsMap.find(ePath) == addsMap.end())
-                        io::hardlinkSafe(p.get(), destPath);
-                    else
-                        io::copy(p.get(), destPath);
-                }
-                localMap[add.hash] = true;
+    // Actually compute hashes
+    const auto hashes = Hash::filesSHA256(toHash);
+    size_t hashIdx = 0;
+
+    for (auto& c : candidates) {
+        const auto& add = *c.add;
+        const bool valid = c.needsHash ? hashes[hashIdx++] == add.hash : true;
+
+        if (valid) {
+            if (!hlDestFolder.empty()) {
+                const auto destPath = fs::path(hlDestFolder) / add.path;
+                io::createDirectories(destPath.parent_path());
+
+                // We can leverage hard links ONLY
+                // if the path we are linking is not itself
+                // part of an add operation (otherwise it could be
+                // overwritten)
+                if (addsMap.find(c.ePath) == addsMap.end())
+                    io::hardlinkSafe(c.p.get(), destPath);
+                else
+                    io::copy(c.p.get(), destPath);
             }
+            localMap[add.hash] = true;
         }
-        q->reset();
     }
 
     return localMap;
 }
 
-void Registry::push(const std::string& path, std::ostream& out) {
+void Registry::push(const std::string& path, std::ostream& out, const PushOptions& options) {
     auto db = open(path, true);
 
     TagManager tagManager(db.get());
@@ -729,14 +820,10 @@ void Registry::push(const std::string& path, std::ostream& out) {
 
     const auto basePath = db->rootDirectory();
 
-    for (const auto& file : pir.neededFiles) {
-        const auto fullPath = basePath / file;
-
-        out << "Transfering '" << file << "'" << std::endl;
-
-        // Foreach of the needed files call POST endpoint
-        pushManager.upload(fullPath.generic_string(), file, pir.token);
-    }
+    // Upload the needed files, options.jobs at a time
+    PushManagerTransport transport(pushManager, pir);
+    pushFiles(transport, basePath, pir.neededFiles, options,
+              [&out](const std::string& file) { out << "Transfering '" << file << "'" << std::endl; });
 
     // When done call commit endpoint
     pushManager.commit(pir.token);
@@ -36,6 +36,8 @@ namespace ddb
 
     SqliteDatabase &SqliteDatabase::close()
     {
+        statementCache.clear();
+
         if (db != nullptr)
         {
             LOGD << "Closing connection to " << openFile;
@@ -101,6 +103,11 @@ namespace ddb
         return sqlite3_changes(db);
     }
 
+    bool SqliteDatabase::isReadOnly() const
+    {
+        return sqlite3_db_readonly(db, "main") == 1;
+    }
+
     void SqliteDatabase::setJournalMode(const std::string &mode)
     {
         this->exec("PRAGMA journal_mode=" + mode + ";");
@@ -144,6 +151,45 @@ namespace ddb
         return std::make_unique<Statement>(db, query);
     }
 
+    Statement *SqliteDatabase::cachedQuery(const std::string &query)
+    {
+        const auto it = statementCache.find(query);
+        if (it != statementCache.end())
+        {
+            try
+            {
+                it->second->reset();
+                return it->second.get();
+            }
+            catch (const SQLException &)
+            {
+                // reset() reports the error of a failed previous run; prepare a fresh statement
+                statementCache.erase(it);
+            }
+        }
+
+        auto stmt = this->query(query);
+        Statement *s = stmt.get();
+        statementCache[query] = std::move(stmt);
+        return s;
+    }
+
+    void SqliteDatabase::resetCachedQueries()
+    {
+        for (auto it = statementCache.begin(); it != statementCache.end();)
+        {
+            try
+            {
+                it->second->reset();
+                ++it;
+            }
+            catch (const SQLException &)
+            {
+                it = statementCache.erase(it);
+            }
+        }
+    }
+
     int SqliteDatabase::getUserVersion() const
     {
         auto q = this->query("PRAGMA user_version");
@@ -15,6 +15,7 @@
 #include <functional>
 #include <limits>
 #include "ddb.h"
+#include "dbpool.h"
 #include "thumbs.h"
 #include "../../vendor/base64/base64.h"
 
@@ -333,11 +334,26 @@ namespace ddb
         return true;
     }
 
+    // GeoJSON geometry of an entry from its SpatiaLite geometry columns,
+    // preferring the footprint over the point
+    static json entryGeometry(Statement *q, int polygonColumn, int pointColumn)
+    {
+        BasicPolygonGeometry polygon;
+        if (polygon.fromSpatialiteBlob(q->getBlob(polygonColumn), q->getBlobSize(polygonColumn)))
+            return polygon.toGeoJSON()["geometry"];
+
+        BasicPointGeometry point;
+        if (point.fromSpatialiteBlob(q->getBlob(pointColumn), q->getBlobSize(pointColumn)))
+            return point.toGeoJSON()["geometry"];
+
+        return json();
+    }
+
     // Build a complete STAC Item (Feature) JSON for a single entry row.
     // Shared by the single-item endpoint and the ItemCollection endpoint (DRY).
     static json buildStacItem(const std::string &path,
                               const std::string &propertiesText,
-                              const std::string &geomText,
+                              const json &geometry,
                               int entryTypeInt,
                               long long mtime,
                               const std::string &stacCollectionRoot,
@@ -354,7 +370,7 @@ namespace ddb
             j["properties"] = json::parse(propertiesText, nullptr, false);
             // Add title to properties for better display in STAC browsers
             j["properties"]["title"] = path;
-            j["geometry"] = json::parse(geomText, nullptr, false);
+            j["geometry"] = geometry;
         }
         catch (json::exception &e)
         {
@@ -493,7 +509,7 @@ namespace ddb
         //CURLInstance curl; // for urlEncode
 
         // What kind of STAC element are we generating?
-        auto db = open(ddbPath, false);
+        auto db = openPooled(ddbPath, false);
 
         const auto rootId = !id.empty() ? id : fs::weakly_canonical(db->rootDirectory()).filename().string();
         const auto rootTitle = db->getMetaManager()->getString("name", "", "", rootId);
@@ -503,11 +519,8 @@ namespace ddb
             const auto q = db->query(R"<<<(
                     SELECT path,
                            properties,
-                           CASE
-                                WHEN polygon_geom IS NOT NULL THEN AsGeoJSON(polygon_geom)
-                                WHEN point_geom IS NOT NULL THEN AsGeoJSON(point_geom)
-                                ELSE NULL
-                           END AS geom,
+                           polygon_geom,
+                           point_geom,
                            type,
                            mtime
                     FROM entries WHERE path = ?
@@ -516,8 +529,8 @@ namespace ddb
             if (q->fetch())
             {
                 // STAC Item (delegates to the shared builder)
-                j = buildStacItem(q->getText(0), q->getText(1), q->getText(2),
-                                  q->getInt(3), q->getInt64(4),
+                j = buildStacItem(q->getText(0), q->getText(1), entryGeometry(q.get(), 2, 3),
+                                  q->getInt(4), q->getInt64(5),
                                   stacCollectionRoot, stacCatalogRoot, rootId);
             }
             else
@@ -594,6 +607,9 @@ namespace ddb
         return j;
     }
 
+    // Approximate numberMatched counts stop after this many matches
+    static const long long APPROXIMATE_COUNT_LIMIT = 10000;
+
     json generateStacItemCollection(const std::string &ddbPath,
                                     const std::string &stacCollectionRoot,
                                     const std::string &id,
@@ -602,7 +618,9 @@ namespace ddb
                                     const std::string &datetimeStart,
                                     const std::string &datetimeEnd,
                                     int limit,
-                                    int offset)
+                                    int offset,
+                                    const std::string &token,
+                                    bool approximateCount)
     {
         if (ddbPath.empty())
             throw AppException("No ddbPath is set for generating STAC");
@@ -612,78 +630,94 @@ namespace ddb
         if (offset < 0)
             offset = 0;
 
-        auto db = open(ddbPath, false);
-        const auto rootId = !id.empty() ? id : fs::weakly_canonical(db->rootDirectory()).filename().string();
-
-        // High-precision double formatter for inlining bbox literals (bind() has no double overload)
-        const auto fmtD = [](double v)
+        // Keyset paging: the token is the path of the last item of the previous page
+        std::string afterPath;
+        if (!token.empty())
         {
-            std::ostringstream o;
-            o << std::setprecision(15) << v;
-            return o.str();
-        };
+            if (offset > 0)
+                throw InvalidArgsException("Cannot use both token and offset paging");
+
+            afterPath = Base64::decode(token);
+            if (afterPath.empty())
+                throw InvalidArgsException("Invalid paging token: " + token);
+        }
+
+        auto db = openPooled(ddbPath, false);
+        const auto rootId = !id.empty() ? id : fs::weakly_canonical(db->rootDirectory()).filename().string();
 
         // Shared WHERE clause for the data and count queries
         std::string where = "(polygon_geom IS NOT NULL OR point_geom IS NOT NULL)";
 
+        // Geometries are stored in EPSG:4326; the bbox takes parameters ?1..?4
         const bool hasBbox = bbox.size() == 4;
         if (hasBbox)
-        {
-            // Geometries are stored in EPSG:4326; intersect against the request MBR
-            where += " AND MbrIntersects(BuildMbr(" + fmtD(bbox[0]) + ", " + fmtD(bbox[1]) +
-                     ", " + fmtD(bbox[2]) + ", " + fmtD(bbox[3]) + ", 4326), "
-                     "CASE WHEN polygon_geom IS NOT NULL THEN polygon_geom ELSE point_geom END)";
-        }
+            where += " AND " + db->bboxFilter(1);
 
         time_t dtStart = 0, dtEnd = 0;
         const bool hasStart = parseIso8601ToEpochSecs(datetimeStart, dtStart);
         const bool hasEnd = parseIso8601ToEpochSecs(datetimeEnd, dtEnd);
 
-        // Per-entry instant (seconds): captureTime (ms) if present and > 0, else mtime
-        const std::string instantExpr =
-            "(CASE WHEN json_extract(properties, '$.captureTime') IS NOT NULL "
-            "AND json_extract(properties, '$.captureTime') > 0 "
-            "THEN json_extract(properties, '$.captureTime') / 1000.0 ELSE mtime END)";
-
+        // capture_time is the per-entry instant in seconds (captureTime if present, else mtime)
         if (hasStart)
-            where += " AND " + instantExpr + " >= ?";
+            where += " AND capture_time >= ?";
         if (hasEnd)
-            where += " AND " + instantExpr + " <= ?";
+            where += " AND capture_time <= ?";
 
-        // numberMatched (total entries matching the filters, ignoring paging)
-        long long numberMatched = 0;
+        const auto bindFilters = [&](Statement *q)
         {
-            const auto cq = db->query("SELECT COUNT(*) FROM entries WHERE " + where);
-            int idx = 1;
+            int idx = hasBbox ? bindBbox(q, 1, bbox) : 1;
             if (hasStart)
-                cq->bind(idx++, static_cast<long long>(dtStart));
+                q->bind(idx++, static_cast<long long>(dtStart));
             if (hasEnd)
-                cq->bind(idx++, static_cast<long long>(dtEnd));
+                q->bind(idx++, static_cast<long long>(dtEnd));
+            return idx;
+        };
+
+        // numberMatched (total entries matching the filters, ignoring paging).
+        // An approximate count gives up past APPROXIMATE_COUNT_LIMIT matches and
+        // numberMatched is then left out, as allowed by the STAC API.
+        long long numberMatched = -1;
+        {
+            const std::string countSql = approximateCount
+                                             ? "SELECT COUNT(*) FROM (SELECT 1 FROM entries WHERE " + where +
+                                                   " LIMIT " + std::to_string(APPROXIMATE_COUNT_LIMIT + 1) + ")"
+                                             : "SELECT COUNT(*) FROM entries WHERE " + where;
+            const auto cq = db->query(countSql);
+            bindFilters(cq.get());
             if (cq->fetch())
-                numberMatched = cq->getInt64(0);
+            {
+                const long long count = cq->getInt64(0);
+                if (!approximateCount || count <= APPROXIMATE_COUNT_LIMIT)
+                    numberMatched = count;
+            }
         }
 
+        // One extra row tells whether there is a next page
         const std::string sql =
-            "SELECT path, properties, "
-            "CASE WHEN polygon_geom IS NOT NULL THEN AsGeoJSON(polygon_geom) "
-            "WHEN point_geom IS NOT NULL THEN AsGeoJSON(point_geom) ELSE NULL END AS geom, "
-            "type, mtime FROM entries WHERE " +
-            where + " ORDER BY path LIMIT ? OFFSET ?";
+            "SELECT path, properties, polygon_geom, point_geom, type, mtime FROM entries WHERE " +
+            where + (afterPath.empty() ? "" : " AND path > ?") + " ORDER BY path LIMIT ? OFFSET ?";
 
         const auto q = db->query(sql);
-        int idx = 1;
-        if (hasStart)
-            q->bind(idx++, static_cast<long long>(dtStart));
-        if (hasEnd)
-            q->bind(idx++, static_cast<long long>(dtEnd));
-        q->bind(idx++, static_cast<long long>(limit));
+        int idx = bindFilters(q.get());
+        if (!afterPath.empty())
+            q->bind(idx++, afterPath);
+        q->bind(idx++, static_cast<long long>(limit) + 1);
         q->bind(idx++, static_cast<long long>(offset));
 
         json features = json::array();
+        std::string lastPath;
+        bool hasNext = false;
         while (q->fetch())
         {
-            features.push_back(buildStacItem(q->getText(0), q->getText(1), q->getText(2),
-                                             q->getInt(3), q->getInt64(4),
+            if (static_cast<int>(features.size()) == limit)
+            {
+                hasNext = true;
+                break;
+            }
+
+            lastPath = q->getText(0);
+            features.push_back(buildStacItem(lastPath, q->getText(1), entryGeometry(q.get(), 2, 3),
+                                             q->getInt(4), q->getInt64(5),
                                              stacCollectionRoot, stacCatalogRoot, rootId));
         }
 
@@ -691,7 +725,8 @@ namespace ddb
         fc["type"] = "FeatureCollection";
         fc["features"] = features;
         fc["numberReturned"] = features.size();
-        fc["numberMatched"] = numberMatched;
+        if (numberMatched >= 0)
+            fc["numberMatched"] = numberMatched;
 
         json links = json::array();
         if (!stacCatalogRoot.empty())
@@ -707,6 +742,28 @@ namespace ddb
                              {"href", stacCollectionRoot + STAC_ENDPOINT},
                              {"type", "application/json"}});
         }
+
+        if (hasNext)
+        {
+            // The next page continues after the last returned item, with the same filters
+            std::ostringstream qs;
+            qs << "?limit=" << limit << "&token=" << std::string(cpr::util::urlEncode(Base64::encode(lastPath)));
+            if (hasBbox)
+                qs << "&bbox=" << std::setprecision(15) << bbox[0] << "," << bbox[1] << "," << bbox[2] << "," << bbox[3];
+            if (!datetimeStart.empty() || !datetimeEnd.empty())
+            {
+                const std::string datetime = datetimeStart == datetimeEnd
+                                                 ? datetimeStart
+                                                 : (datetimeStart.empty() ? ".." : datetimeStart) + "/" +
+                                                       (datetimeEnd.empty() ? ".." : datetimeEnd);
+                qs << "&datetime=" << std::string(cpr::util::urlEncode(datetime));
+            }
+
+            const std::string itemsHref = stacCollectionRoot != "." ? stacCollectionRoot + STAC_ENDPOINT + "/items" : "items";
+            links.push_back({{"rel", "next"},
+                             {"href", itemsHref + qs.str()},
+                             {"type", "application/geo+json"}});
+        }
         fc["links"] = links;
 
         return fc;
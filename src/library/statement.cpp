@@ -54,6 +54,20 @@ Statement &Statement::bind(int paramNum, long long value)
     return *this;
 }
 
+Statement &Statement::bind(int paramNum, double value)
+{
+    assert(stmt != nullptr && db != nullptr);
+    bindCheck(sqlite3_bind_double(stmt, paramNum, value));
+    return *this;
+}
+
+Statement &Statement::bind(int paramNum, const void *data, int size)
+{
+    assert(stmt != nullptr && db != nullptr);
+    bindCheck(sqlite3_bind_blob(stmt, paramNum, data, size, SQLITE_TRANSIENT));
+    return *this;
+}
+
 Statement &Statement::step()
 {
     assert(stmt != nullptr);
@@ -116,6 +130,12 @@ const void *Statement::getBlob(int columnId)
     return sqlite3_column_blob(stmt, columnId);
 }
 
+int Statement::getBlobSize(int columnId)
+{
+    assert(stmt != nullptr);
+    return sqlite3_column_bytes(stmt, columnId);
+}
+
 double Statement::getDouble(int columnId)
 {
     assert(stmt != nullptr);
@@ -15,13 +15,17 @@
 #include <cpl_conv.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
+#include <exception>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <stack>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace ddb {
@@ -63,7 +67,7 @@ void gaussianFilter(std::vector<float> &data, int width, int height, float sigma
     std::vector<float> tmp(data.size(), 0.0f);
     // Horizontal pass
     for (int r = 0; r < height; r++) {
-        const int rowBase = r * width;
+        const size_t rowBase = static_cast<size_t>(r) * width;
         for (int c = 0; c < width; c++) {
             float v = 0;
             for (int i = 0; i < ksize; i++) {
@@ -73,15 +77,16 @@ void gaussianFilter(std::vector<float> &data, int width, int height, float sigma
             tmp[rowBase + c] = v;
         }
     }
-    // Vertical pass
-    for (int c = 0; c < width; c++) {
-        for (int r = 0; r < height; r++) {
-            float v = 0;
-            for (int i = 0; i < ksize; i++) {
-                const int rr = std::clamp(r + i - half, 0, height - 1);
-                v += tmp[rr * width + c] * k[i];
-            }
-            data[r * width + c] = v;
+    // Vertical pass, accumulated a whole row at a time so that both grids are
+    // walked sequentially (same summation order as a per-pixel loop)
+    std::fill(data.begin(), data.end(), 0.0f);
+    for (int r = 0; r < height; r++) {
+        float *out = data.data() + static_cast<size_t>(r) * width;
+        for (int i = 0; i < ksize; i++) {
+            const int rr = std::clamp(r + i - half, 0, height - 1);
+            const float *in = tmp.data() + static_cast<size_t>(rr) * width;
+            const float w = k[i];
+            for (int c = 0; c < width; c++) out[c] += in[c] * w;
         }
     }
 }
@@ -551,14 +556,248 @@ std::vector<int32_t> labelConnectedComponents(const std::vector<uint8_t> &binary
     return labels;
 }
 
-// Extract a single-component mask from the labels image.
-std::vector<uint8_t> extractComponentMask(const std::vector<int32_t> &labels,
-                                          int32_t componentId) {
-    std::vector<uint8_t> mask(labels.size(), 0);
-    for (size_t i = 0; i < labels.size(); i++) {
-        if (labels[i] == componentId) mask[i] = 1;
+// Histogram of the valid elevations, for a streaming median. Values outside
+// the range given at construction fall in the first/last bin.
+class ElevationHistogram {
+    double minValue;
+    double binWidth;
+    std::vector<uint64_t> bins;
+    uint64_t count = 0;
+
+public:
+    ElevationHistogram(double minValue, double maxValue, size_t numBins = 65536)
+        : minValue(minValue),
+          binWidth(std::max(maxValue - minValue, 1e-6) / static_cast<double>(numBins)),
+          bins(numBins, 0) {}
+
+    void add(float v) {
+        const double b = std::floor((static_cast<double>(v) - minValue) / binWidth);
+        bins[static_cast<size_t>(std::clamp(b, 0.0, static_cast<double>(bins.size() - 1)))]++;
+        count++;
+    }
+
+    void merge(const ElevationHistogram &other) {
+        for (size_t i = 0; i < bins.size(); i++) bins[i] += other.bins[i];
+        count += other.count;
+    }
+
+    bool empty() const { return count == 0; }
+
+    // Center of the bin holding the upper median
+    double median() const {
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bins.size(); i++) {
+            seen += bins[i];
+            if (seen > count / 2) return minValue + (static_cast<double>(i) + 0.5) * binWidth;
+        }
+        return minValue;
+    }
+};
+
+// Per-component statistics, in raster pixel coordinates
+struct CompStat {
+    size_t pixelCount = 0;
+    double estVolume = 0.0;
+    double sumX = 0.0; // pixel X centroid accumulator
+    double sumY = 0.0;
+    double maxDiff = 0.0;
+    int minX = std::numeric_limits<int>::max();
+    int minY = std::numeric_limits<int>::max();
+    int maxX = -1;
+    int maxY = -1;
+    int seedX = 0; // First pixel of the component in scan order
+    int seedY = 0;
+
+    void merge(const CompStat &o) {
+        if (o.seedY < seedY || (o.seedY == seedY && o.seedX < seedX)) {
+            seedX = o.seedX;
+            seedY = o.seedY;
+        }
+        pixelCount += o.pixelCount;
+        estVolume += o.estVolume;
+        sumX += o.sumX;
+        sumY += o.sumY;
+        maxDiff = std::max(maxDiff, o.maxDiff);
+        minX = std::min(minX, o.minX);
+        minY = std::min(minY, o.minY);
+        maxX = std::max(maxX, o.maxX);
+        maxY = std::max(maxY, o.maxY);
+    }
+};
+
+// Components found in a tile, with the local labels along its edges for stitching
+struct TileComponents {
+    std::vector<CompStat> stats; // Indexed by local label - 1
+    std::vector<int32_t> top, bottom, left, right;
+};
+
+// Detection state shared by the tile passes. The raster is processed in
+// square tiles read with a halo wide enough for the diff blur, so that
+// every pass is exact at tile seams and memory does not grow with the raster.
+struct StockpileScan {
+    std::string path;
+    int width = 0; // Raster size
+    int height = 0;
+    bool hasNoData = false;
+    double noData = 0.0;
+
+    int tileSize = 1024;
+    int tilesX = 0;
+    int tilesY = 0;
+    int jobs = 1;
+
+    // Terrain trend on a grid `factor` times coarser than the raster. The trend
+    // is a strong low-pass, so a coarse grid loses nothing and keeps its blur
+    // kernel (proportional to the raster size) affordable.
+    int factor = 1;
+    int trendW = 0;
+    int trendH = 0;
+    std::vector<float> trend;
+
+    float sigmaDiff = 0.0f;
+    int halo = 0;
+
+    bool isValid(float v) const {
+        if (!std::isfinite(v)) return false;
+        if (hasNoData && std::fabs(static_cast<double>(v) - noData) < 1e-9) return false;
+        return true;
+    }
+
+    size_t tileCount() const { return static_cast<size_t>(tilesX) * tilesY; }
+
+    void tileRect(size_t t, int &x0, int &y0, int &w, int &h) const {
+        x0 = static_cast<int>(t % tilesX) * tileSize;
+        y0 = static_cast<int>(t / tilesX) * tileSize;
+        w = std::min(tileSize, width - x0);
+        h = std::min(tileSize, height - y0);
+    }
+
+    // Bilinear trend at raster pixel coordinates (pixel centers at +0.5)
+    double trendAt(double px, double py) const {
+        const double u = std::clamp(px / factor - 0.5, 0.0, static_cast<double>(trendW - 1));
+        const double v = std::clamp(py / factor - 0.5, 0.0, static_cast<double>(trendH - 1));
+        const int u0 = static_cast<int>(u);
+        const int v0 = static_cast<int>(v);
+        const int u1 = std::min(u0 + 1, trendW - 1);
+        const int v1 = std::min(v0 + 1, trendH - 1);
+        const double fu = u - u0;
+        const double fv = v - v0;
+        const float *r0 = trend.data() + static_cast<size_t>(v0) * trendW;
+        const float *r1 = trend.data() + static_cast<size_t>(v1) * trendW;
+        return (r0[u0] * (1.0 - fu) + r0[u1] * fu) * (1.0 - fv) +
+               (r1[u0] * (1.0 - fu) + r1[u1] * fu) * fv;
+    }
+
+    void read(GDALRasterBandH band, int x0, int y0, int w, int h, std::vector<float> &out) const {
+        out.resize(static_cast<size_t>(w) * h);
+        if (GDALRasterIO(band, GF_Read, x0, y0, w, h,
+                         out.data(), w, h, GDT_Float32, 0, 0) != CE_None)
+            throw AppException("Cannot read raster data");
     }
-    return mask;
+
+    // Smoothed elevation - trend over a window of the raster; valid flags the
+    // pixels with data
+    void computeDiff(GDALRasterBandH band, int x0, int y0, int w, int h,
+                     std::vector<float> &diff, std::vector<uint8_t> &valid) const {
+        const int wx0 = std::max(0, x0 - halo);
+        const int wy0 = std::max(0, y0 - halo);
+        const int ww = std::min(width, x0 + w + halo) - wx0;
+        const int wh = std::min(height, y0 + h + halo) - wy0;
+
+        std::vector<float> region;
+        read(band, wx0, wy0, ww, wh, region);
+
+        std::vector<float> d(region.size(), 0.0f);
+        for (int y = 0; y < wh; y++) {
+            for (int x = 0; x < ww; x++) {
+                const size_t i = static_cast<size_t>(y) * ww + x;
+                if (isValid(region[i]))
+                    d[i] = region[i] - static_cast<float>(trendAt(wx0 + x + 0.5, wy0 + y + 0.5));
+            }
+        }
+        gaussianFilter(d, ww, wh, sigmaDiff);
+
+        diff.resize(static_cast<size_t>(w) * h);
+        valid.resize(diff.size());
+        for (int y = 0; y < h; y++) {
+            const size_t src = static_cast<size_t>(y0 - wy0 + y) * ww + (x0 - wx0);
+            const size_t dst = static_cast<size_t>(y) * w;
+            for (int x = 0; x < w; x++) {
+                diff[dst + x] = d[src + x];
+                valid[dst + x] = isValid(region[src + x]) ? 1 : 0;
+            }
+        }
+    }
+
+    // Runs fn(worker, tile, band) for every tile on `jobs` threads, each with
+    // its own dataset handle (GDAL handles are not thread safe)
+    template <typename Fn>
+    void forEachTile(Fn fn) const {
+        const size_t count = tileCount();
+        const size_t workers = std::min(count, static_cast<size_t>(std::max(1, jobs)));
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::mutex mutex;
+        std::exception_ptr error;
+
+        auto worker = [&](size_t w) {
+            try {
+                DsGuard ds{GDALOpen(path.c_str(), GA_ReadOnly)};
+                if (!ds.h) throw AppException("Cannot open raster: " + path);
+                GDALRasterBandH band = GDALGetRasterBand(ds.h, 1);
+
+                while (!failed) {
+                    const size_t t = next++;
+                    if (t >= count) return;
+                    fn(w, t, band);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t w = 1; w < workers; w++) threads.emplace_back(worker, w);
+        worker(0);
+        for (auto &t : threads) t.join();
+
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+struct UnionFind {
+    std::vector<uint32_t> parent;
+
+    explicit UnionFind(size_t n) : parent(n) {
+        for (size_t i = 0; i < n; i++) parent[i] = static_cast<uint32_t>(i);
+    }
+
+    uint32_t find(uint32_t a) {
+        while (parent[a] != a) {
+            parent[a] = parent[parent[a]];
+            a = parent[a];
+        }
+        return a;
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+        if (a < b) parent[b] = a; else parent[a] = b;
+    }
+};
+
+json emptyDetection(float sensitivity, double minAreaM2) {
+    json result;
+    result["stockpiles"] = json::array();
+    result["totalFound"] = 0;
+    result["sensitivityUsed"] = sensitivity;
+    result["minAreaUsed"] = minAreaM2;
+    return result;
 }
 
 } // anonymous namespace
@@ -567,6 +806,14 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
                                     float sensitivity,
                                     double minAreaM2,
                                     int maxResults) {
+    return detectAllStockpilesJson(rasterPath, sensitivity, minAreaM2, maxResults, StockpileScanOptions());
+}
+
+std::string detectAllStockpilesJson(const std::string &rasterPath,
+                                    float sensitivity,
+                                    double minAreaM2,
+                                    int maxResults,
+                                    const StockpileScanOptions &options) {
     sensitivity = std::clamp(sensitivity, 0.0f, 1.0f);
     if (minAreaM2 < 0.0) minAreaM2 = 0.0;
     if (maxResults <= 0) maxResults = 50;
@@ -628,133 +875,233 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
         metersPerPixelY = std::fabs(gt[5]) * mPerDeg;
         if (metersPerPixelX < 1e-6) metersPerPixelX = mPerDeg * std::fabs(gt[1]);
     }
-    const double pixelArea = metersPerPixelX * metersPerPixelY;
-    if (!(pixelArea > 0))
+    const double cellArea = metersPerPixelX * metersPerPixelY;
+    if (!(cellArea > 0))
         throw AppException("Cannot compute pixel area for raster");
 
-    // --- Decide reading scale (downsample huge rasters) ---
-    // Cap working buffer at ~16M pixels to avoid OOM/DoS.
-    const size_t maxPixels = 16ull * 1024ull * 1024ull;
-    int scale = 1;
-    while (static_cast<size_t>(rasterW / scale) * static_cast<size_t>(rasterH / scale) > maxPixels) {
-        scale *= 2;
+    // --- Tiling ---
+    StockpileScan scan;
+    scan.path = rasterPath;
+    scan.width = rasterW;
+    scan.height = rasterH;
+    scan.hasNoData = hasNoData != 0;
+    scan.noData = noData;
+    scan.jobs = options.threads > 0
+        ? options.threads
+        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    // Cap the trend grid at ~4M cells; tiles are a multiple of the trend
+    // factor so that each trend cell is filled by a single tile.
+    const size_t maxTrendPixels = 4ull * 1024ull * 1024ull;
+    while (static_cast<size_t>((rasterW + scan.factor - 1) / scan.factor) *
+           static_cast<size_t>((rasterH + scan.factor - 1) / scan.factor) > maxTrendPixels) {
+        scan.factor *= 2;
     }
-    const int width = std::max(3, rasterW / scale);
-    const int height = std::max(3, rasterH / scale);
-    const double pxX = metersPerPixelX * static_cast<double>(scale);
-    const double pxY = metersPerPixelY * static_cast<double>(scale);
-    const double cellArea = pxX * pxY;
+    scan.trendW = (rasterW + scan.factor - 1) / scan.factor;
+    scan.trendH = (rasterH + scan.factor - 1) / scan.factor;
 
-    LOGD << "detectAll: rasterW=" << rasterW << " rasterH=" << rasterH
-         << " scale=" << scale << " width=" << width << " height=" << height;
+    const int tileSize = options.tileSize > 0 ? options.tileSize : 1024;
+    scan.tileSize = (tileSize + scan.factor - 1) / scan.factor * scan.factor;
+    scan.tilesX = (rasterW + scan.tileSize - 1) / scan.tileSize;
+    scan.tilesY = (rasterH + scan.tileSize - 1) / scan.tileSize;
 
-    // --- Read full raster (downsampled if needed) ---
-    std::vector<float> region(static_cast<size_t>(width) * height);
-    if (GDALRasterIO(hBand, GF_Read, 0, 0, rasterW, rasterH,
-                     region.data(), width, height, GDT_Float32, 0, 0) != CE_None)
-        throw AppException("Cannot read raster data");
+    // Light smoothing on diff to suppress noise.
+    scan.sigmaDiff = (1.0f - sensitivity) * 4.0f + 0.5f;
+    scan.halo = std::max(1, static_cast<int>(std::ceil(scan.sigmaDiff * 3.0f)));
 
-    const auto isValid = [&](float v) {
-        if (!std::isfinite(v)) return false;
-        if (hasNoData && std::fabs(static_cast<double>(v) - noData) < 1e-9) return false;
-        return true;
-    };
+    LOGD << "detectAll: rasterW=" << rasterW << " rasterH=" << rasterH
+         << " tiles=" << scan.tilesX << "x" << scan.tilesY << " (" << scan.tileSize << " px)"
+         << " trendFactor=" << scan.factor << " jobs=" << scan.jobs;
 
-    // --- Global low-pass base plane ---
+    // --- Pass 1: median elevation and trend grid ---
     // Strong smoothing of the elevation gives an approximation of the terrain trend.
     // Then diff = elevation - trend isolates the prominent positive features.
-    std::vector<float> trend(region.size(), 0.0f);
     {
-        // Replace nodata with median of valid values to keep the smoothing stable.
-        std::vector<double> valid;
-        valid.reserve(region.size() / 4);
-        for (float v : region) if (isValid(v)) valid.push_back(v);
-        if (valid.empty())
+        double minMax[2] = {std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()};
+        GDALComputeRasterMinMax(hBand, TRUE, minMax);
+        if (!std::isfinite(minMax[0]) || !std::isfinite(minMax[1]) || minMax[0] > minMax[1]) {
+            minMax[0] = -1e4;
+            minMax[1] = 1e4;
+        }
+
+        const size_t workers = std::min(scan.tileCount(), static_cast<size_t>(scan.jobs));
+        std::vector<ElevationHistogram> histograms(workers, ElevationHistogram(minMax[0], minMax[1]));
+
+        const size_t cells = static_cast<size_t>(scan.trendW) * scan.trendH;
+        std::vector<double> sums(cells, 0.0);
+        std::vector<uint32_t> validCounts(cells, 0);
+        std::vector<uint32_t> totalCounts(cells, 0);
+
+        scan.forEachTile([&](size_t w, size_t t, GDALRasterBandH band) {
+            int x0, y0, tw, th;
+            scan.tileRect(t, x0, y0, tw, th);
+
+            std::vector<float> region;
+            scan.read(band, x0, y0, tw, th, region);
+
+            auto &histogram = histograms[w];
+            for (int y = 0; y < th; y++) {
+                const size_t row = static_cast<size_t>((y0 + y) / scan.factor) * scan.trendW;
+                for (int x = 0; x < tw; x++) {
+                    const size_t cell = row + (x0 + x) / scan.factor;
+                    const float v = region[static_cast<size_t>(y) * tw + x];
+                    totalCounts[cell]++;
+                    if (!scan.isValid(v)) continue;
+                    histogram.add(v);
+                    sums[cell] += v;
+                    validCounts[cell]++;
+                }
+            }
+        });
+
+        for (size_t w = 1; w < histograms.size(); w++) histograms[0].merge(histograms[w]);
+        if (histograms[0].empty())
             throw AppException("Raster contains no valid elevation data");
-        std::sort(valid.begin(), valid.end());
-        const float fillVal = static_cast<float>(valid[valid.size() / 2]);
-        for (size_t i = 0; i < region.size(); i++) {
-            trend[i] = isValid(region[i]) ? region[i] : fillVal;
+
+        // Nodata counts as the median, to keep the smoothing stable.
+        const double fillVal = histograms[0].median();
+        scan.trend.resize(cells);
+        for (size_t i = 0; i < cells; i++) {
+            scan.trend[i] = static_cast<float>(
+                (sums[i] + fillVal * (totalCounts[i] - validCounts[i])) / std::max<uint32_t>(1, totalCounts[i]));
         }
+
         // Sigma scales with image size and inversely with sensitivity:
         // bigger sigma -> smoother trend -> more features come out.
-        const float baseSigma = std::max(8.0f, std::min(width, height) / 16.0f);
+        const float baseSigma = std::max(8.0f, std::min(rasterW, rasterH) / 16.0f);
         const float sigmaTrend = baseSigma * (1.5f - sensitivity);
-        gaussianFilter(trend, width, height, sigmaTrend);
-    }
-
-    // --- Difference map ---
-    std::vector<float> diff(region.size(), 0.0f);
-    for (size_t i = 0; i < region.size(); i++) {
-        if (isValid(region[i])) diff[i] = region[i] - trend[i];
+        gaussianFilter(scan.trend, scan.trendW, scan.trendH, sigmaTrend / static_cast<float>(scan.factor));
     }
 
-    // Light smoothing on diff to suppress noise.
-    const float sigmaDiff = (1.0f - sensitivity) * 4.0f + 0.5f;
-    gaussianFilter(diff, width, height, sigmaDiff);
+    // --- Pass 2: adaptive threshold on positive diff (we only care about mounds) ---
+    std::vector<double> tileSumPos(scan.tileCount(), 0.0);
+    std::vector<size_t> tileCntPos(scan.tileCount(), 0);
+    scan.forEachTile([&](size_t, size_t t, GDALRasterBandH band) {
+        int x0, y0, tw, th;
+        scan.tileRect(t, x0, y0, tw, th);
+
+        std::vector<float> diff;
+        std::vector<uint8_t> valid;
+        scan.computeDiff(band, x0, y0, tw, th, diff, valid);
+        for (float v : diff) {
+            if (v > 0.0f) { tileSumPos[t] += v; tileCntPos[t]++; }
+        }
+    });
 
-    // Adaptive threshold on positive diff (we only care about mounds).
     double sumPos = 0.0;
     size_t cntPos = 0;
-    for (float v : diff) {
-        if (v > 0.0f) { sumPos += v; cntPos++; }
-    }
-    if (cntPos == 0) {
-        json result;
-        result["stockpiles"] = json::array();
-        result["totalFound"] = 0;
-        result["sensitivityUsed"] = sensitivity;
-        result["minAreaUsed"] = minAreaM2;
-        return result.dump();
+    for (size_t t = 0; t < scan.tileCount(); t++) {
+        sumPos += tileSumPos[t];
+        cntPos += tileCntPos[t];
     }
+    if (cntPos == 0) return emptyDetection(sensitivity, minAreaM2).dump();
+
     const double meanPos = sumPos / static_cast<double>(cntPos);
     const double threshold = meanPos * (1.5 - sensitivity);
 
-    std::vector<uint8_t> binary(diff.size(), 0);
-    for (size_t i = 0; i < diff.size(); i++) {
-        if (diff[i] > threshold && isValid(region[i])) binary[i] = 1;
-    }
-
-    // --- Connected components ---
-    int32_t numLabels = 0;
-    auto labels = labelConnectedComponents(binary, width, height, numLabels);
-    LOGD << "detectAll: components=" << numLabels;
-
-    if (numLabels == 0) {
-        json result;
-        result["stockpiles"] = json::array();
-        result["totalFound"] = 0;
-        result["sensitivityUsed"] = sensitivity;
-        result["minAreaUsed"] = minAreaM2;
-        return result.dump();
-    }
-
-    // --- Compute per-component stats ---
-    struct CompStat {
-        int32_t id = 0;
-        size_t pixelCount = 0;
-        double estVolume = 0.0;
-        double sumX = 0.0; // pixel X centroid accumulator
-        double sumY = 0.0;
-        double maxDiff = 0.0;
+    // --- Pass 3: connected components per tile ---
+    std::vector<TileComponents> tiles(scan.tileCount());
+    scan.forEachTile([&](size_t, size_t t, GDALRasterBandH band) {
+        int x0, y0, tw, th;
+        scan.tileRect(t, x0, y0, tw, th);
+
+        std::vector<float> diff;
+        std::vector<uint8_t> binary;
+        scan.computeDiff(band, x0, y0, tw, th, diff, binary);
+        for (size_t i = 0; i < diff.size(); i++) {
+            binary[i] = (binary[i] && diff[i] > threshold) ? 1 : 0;
+        }
+
+        int32_t numLabels = 0;
+        const auto labels = labelConnectedComponents(binary, tw, th, numLabels);
+
+        auto &tile = tiles[t];
+        tile.stats.resize(static_cast<size_t>(numLabels));
+        for (int y = 0; y < th; y++) {
+            for (int x = 0; x < tw; x++) {
+                const size_t idx = static_cast<size_t>(y) * tw + x;
+                const int32_t lab = labels[idx];
+                if (lab == 0) continue;
+                auto &s = tile.stats[lab - 1];
+                const int gx = x0 + x;
+                const int gy = y0 + y;
+                if (s.pixelCount++ == 0) { s.seedX = gx; s.seedY = gy; }
+                const double d = diff[idx];
+                if (d > 0.0) s.estVolume += d * cellArea;
+                s.sumX += gx;
+                s.sumY += gy;
+                if (d > s.maxDiff) s.maxDiff = d;
+                s.minX = std::min(s.minX, gx);
+                s.minY = std::min(s.minY, gy);
+                s.maxX = std::max(s.maxX, gx);
+                s.maxY = std::max(s.maxY, gy);
+            }
+        }
+
+        tile.top.assign(labels.begin(), labels.begin() + tw);
+        tile.bottom.assign(labels.end() - tw, labels.end());
+        tile.left.resize(th);
+        tile.right.resize(th);
+        for (int y = 0; y < th; y++) {
+            tile.left[y] = labels[static_cast<size_t>(y) * tw];
+            tile.right[y] = labels[static_cast<size_t>(y) * tw + tw - 1];
+        }
+    });
+
+    // --- Stitch components across tile seams ---
+    std::vector<uint32_t> offsets(scan.tileCount() + 1, 0);
+    for (size_t t = 0; t < scan.tileCount(); t++) {
+        const size_t next = offsets[t] + tiles[t].stats.size();
+        if (next > std::numeric_limits<uint32_t>::max())
+            throw AppException("Too many candidate stockpiles in raster");
+        offsets[t + 1] = static_cast<uint32_t>(next);
+    }
+
+    UnionFind components(offsets.back());
+    auto stitch = [&](size_t a, const std::vector<int32_t> &edgeA,
+                      size_t b, const std::vector<int32_t> &edgeB) {
+        for (size_t i = 0; i < edgeA.size(); i++) {
+            if (edgeA[i] != 0 && edgeB[i] != 0)
+                components.unite(offsets[a] + edgeA[i] - 1, offsets[b] + edgeB[i] - 1);
+        }
     };
-    std::vector<CompStat> stats(numLabels + 1);
-    for (int32_t i = 0; i <= numLabels; i++) stats[i].id = i;
+    for (size_t t = 0; t < scan.tileCount(); t++) {
+        if (t % scan.tilesX > 0) stitch(t - 1, tiles[t - 1].right, t, tiles[t].left);
+        if (t >= static_cast<size_t>(scan.tilesX)) stitch(t - scan.tilesX, tiles[t - scan.tilesX].bottom, t, tiles[t].top);
+    }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            const size_t idx = static_cast<size_t>(y) * width + x;
-            const int32_t lab = labels[idx];
-            if (lab == 0) continue;
-            auto &s = stats[lab];
-            s.pixelCount++;
-            const double d = diff[idx];
-            if (d > 0.0) s.estVolume += d * cellArea;
-            s.sumX += x;
-            s.sumY += y;
-            if (d > s.maxDiff) s.maxDiff = d;
+    std::vector<CompStat> stats(offsets.back());
+    std::vector<uint32_t> roots;
+    for (size_t t = 0; t < scan.tileCount(); t++) {
+        for (size_t l = 0; l < tiles[t].stats.size(); l++) {
+            const uint32_t id = offsets[t] + static_cast<uint32_t>(l);
+            const uint32_t root = components.find(id);
+            if (root == id) {
+                stats[root] = tiles[t].stats[l];
+                roots.push_back(root);
+            } else {
+                stats[root].merge(tiles[t].stats[l]);
+            }
         }
+        tiles[t] = TileComponents();
     }
+    LOGD << "detectAll: components=" << roots.size();
+
+    if (roots.empty()) return emptyDetection(sensitivity, minAreaM2).dump();
+
+    // Only the components that can make it to the output are traced,
+    // largest volume first.
+    std::vector<uint32_t> candidates;
+    for (uint32_t r : roots) {
+        const auto &s = stats[r];
+        const double areaM2 = static_cast<double>(s.pixelCount) * cellArea;
+        if (areaM2 < minAreaM2) continue;
+        if (s.pixelCount < 4) continue;
+        candidates.push_back(r);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+        return stats[a].estVolume > stats[b].estVolume;
+    });
 
     // --- Build coord transformer raster->WGS84 (reused for all components) ---
     std::unique_ptr<CtHandle> rasterToWgs;
@@ -766,11 +1113,8 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
     }
 
     auto pixelToMap = [&](double px, double py, double &mx, double &my) {
-        // px, py are in the downsampled grid; convert to original raster coords.
-        const double opx = px * static_cast<double>(scale);
-        const double opy = py * static_cast<double>(scale);
-        mx = gt[0] + opx * gt[1] + opy * gt[2];
-        my = gt[3] + opx * gt[4] + opy * gt[5];
+        mx = gt[0] + px * gt[1] + py * gt[2];
+        my = gt[3] + px * gt[4] + py * gt[5];
     };
 
     auto mapToWgs = [&](double mx, double my, double &lon, double &lat) {
@@ -782,25 +1126,31 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
     };
 
     // --- For each qualifying component, build polygon + result entry ---
-    struct Detection {
-        int32_t id;
-        json entry;
-        double estVolume;
-    };
-    std::vector<Detection> detections;
-    detections.reserve(numLabels);
+    json arr = json::array();
 
     const double epsPx = (1.0 - sensitivity) * 4.0 + 0.5;
-    const double epsMeters = epsPx * 0.5 * (pxX + pxY);
+    const double epsMeters = epsPx * 0.5 * (metersPerPixelX + metersPerPixelY);
 
-    for (int32_t lab = 1; lab <= numLabels; lab++) {
-        const auto &s = stats[lab];
+    for (uint32_t r : candidates) {
+        if (static_cast<int>(arr.size()) >= maxResults) break;
+        const auto &s = stats[r];
         const double areaM2 = static_cast<double>(s.pixelCount) * cellArea;
-        if (areaM2 < minAreaM2) continue;
-        if (s.pixelCount < 4) continue;
 
-        auto mask = extractComponentMask(labels, lab);
-        auto contourPx = traceContour(mask, width, height);
+        // Recompute the mask of the component within its bounding box
+        const int bx = s.minX;
+        const int by = s.minY;
+        const int bw = s.maxX - s.minX + 1;
+        const int bh = s.maxY - s.minY + 1;
+        std::vector<float> diff;
+        std::vector<uint8_t> binary;
+        scan.computeDiff(hBand, bx, by, bw, bh, diff, binary);
+        for (size_t i = 0; i < diff.size(); i++) {
+            binary[i] = (binary[i] && diff[i] > threshold) ? 1 : 0;
+        }
+        size_t count = 0;
+        const auto mask = floodFill(binary, bw, bh, s.seedX - bx, s.seedY - by, count);
+
+        auto contourPx = traceContour(mask, bw, bh);
         if (contourPx.size() < 3) continue;
 
         // Convert to map coords
@@ -808,7 +1158,7 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
         contourMap.reserve(contourPx.size());
         for (const auto &p : contourPx) {
             double mx, my;
-            pixelToMap(p.first + 0.5, p.second + 0.5, mx, my);
+            pixelToMap(bx + p.first + 0.5, by + p.second + 0.5, mx, my);
             contourMap.push_back({mx, my});
         }
         auto simplified = douglasPeucker(contourMap, epsMeters);
@@ -841,10 +1191,9 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
         double cLon, cLat;
         mapToWgs(cMx, cMy, cLon, cLat);
 
-        // Base elevation: average trend at component centroid (meters).
-        const size_t cIdx = static_cast<size_t>(std::clamp<int>(static_cast<int>(cyPx), 0, height - 1)) * width
-                          + std::clamp<int>(static_cast<int>(cxPx), 0, width - 1);
-        const double baseElev = trend[cIdx];
+        // Base elevation: trend at the pixel of the component centroid (meters).
+        const double baseElev = scan.trendAt(std::clamp(std::floor(cxPx), 0.0, rasterW - 1.0) + 0.5,
+                                             std::clamp(std::floor(cyPx), 0.0, rasterH - 1.0) + 0.5);
 
         json coords = json::array();
         json outerRing = json::array();
@@ -853,6 +1202,7 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
         json polygon = { {"type", "Polygon"}, {"coordinates", coords} };
 
         json entry;
+        entry["id"] = static_cast<int>(arr.size());
         entry["polygon"] = polygon;
         entry["estimatedVolume"] = s.estVolume;
         entry["confidence"] = confidence;
@@ -861,20 +1211,7 @@ std::string detectAllStockpilesJson(const std::string &rasterPath,
         entry["areaM2"] = areaM2;
         entry["pixelCount"] = static_cast<uint64_t>(s.pixelCount);
 
-        detections.push_back({ lab, std::move(entry), s.estVolume });
-    }
-
-    // Sort by estimated volume desc, truncate to maxResults.
-    std::sort(detections.begin(), detections.end(),
-              [](const Detection &a, const Detection &b) { return a.estVolume > b.estVolume; });
-    if (static_cast<int>(detections.size()) > maxResults)
-        detections.resize(static_cast<size_t>(maxResults));
-
-    // Assign sequential ids.
-    json arr = json::array();
-    for (size_t i = 0; i < detections.size(); i++) {
-        detections[i].entry["id"] = static_cast<int>(i);
-        arr.push_back(std::move(detections[i].entry));
+        arr.push_back(std::move(entry));
     }
 
     json result;
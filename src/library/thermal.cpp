@@ -4,8 +4,10 @@
 #include "thermal.h"
 #include "exif.h"
 #include "exceptions.h"
+#include "fingerprintcache.h"
 #include "logger.h"
 #include "sensorprofile.h"
+#include "utils.h"
 
 #include <exiv2/exiv2.hpp>
 #include <gdal_priv.h>
@@ -15,7 +17,12 @@
 #include <fstream>
 #include <cmath>
 #include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <tuple>
+#include <unordered_map>
 
 namespace ddb {
 
@@ -395,13 +402,39 @@ std::vector<float> rawToTemperatureMap(const RawThermalData &raw, const ThermalC
     size_t pixelCount = raw.data.size();
     std::vector<float> temps(pixelCount);
 
+    const auto lut = temperatureLut(cal);
+    const float *t = lut->data();
     for (size_t i = 0; i < pixelCount; i++) {
-        temps[i] = static_cast<float>(rawToTemperature(raw.data[i], cal));
+        temps[i] = t[raw.data[i]];
     }
 
     return temps;
 }
 
+std::shared_ptr<const std::vector<float>> temperatureLut(const ThermalCalibration &cal) {
+    // Only the Planck constants enter rawToTemperature
+    typedef std::tuple<double, double, double, double, double> LutKey;
+    static std::mutex mutex;
+    static std::map<LutKey, std::shared_ptr<const std::vector<float>>> luts;
+    const size_t maxLuts = 32;
+
+    const LutKey key(cal.planckR1, cal.planckB, cal.planckF, cal.planckO, cal.planckR2);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = luts.find(key);
+        if (it != luts.end()) return it->second;
+    }
+
+    auto lut = std::make_shared<std::vector<float>>(65536);
+    for (size_t raw = 0; raw < lut->size(); raw++) {
+        (*lut)[raw] = static_cast<float>(rawToTemperature(static_cast<uint16_t>(raw), cal));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (luts.size() >= maxLuts) luts.clear();
+    return luts.emplace(key, std::move(lut)).first->second;
+}
+
 // ---- Direct temperature raster detection ----
 //
 // A "direct temperature raster" is a raster whose pixel values are already
@@ -655,6 +688,7 @@ TemperatureData readTemperatureData(const std::string &filePath) {
                             td.temperatures[p] = static_cast<float>(raw.data[p]);
                         }
                     }
+                    td.rawValues = std::move(raw.data);
                     GDALClose(hDs);
                     return td;
                 }
@@ -680,12 +714,202 @@ TemperatureData readTemperatureData(const std::string &filePath) {
         }
         td.width = raw.width;
         td.height = raw.height;
+        td.rawValues = std::move(raw.data);
         return td;
     }
 
     return td;
 }
 
+// ---- Decoded frame cache ----
+
+namespace {
+
+// Byte budget of the decoded frame cache. Configurable via the
+// DDB_THERMAL_CACHE_MB environment variable; defaults to 256 MB.
+size_t temperatureCacheMaxBytes() {
+    const long long maxMb = utils::getEnvLong("DDB_THERMAL_CACHE_MB", 256);
+    return static_cast<size_t>(maxMb) * 1024 * 1024;
+}
+
+class TemperatureCache {
+    struct Frame {
+        std::string path;
+        FileIdentity identity;
+        std::shared_ptr<const TemperatureData> data;
+        size_t bytes;
+    };
+    typedef std::list<Frame> FrameList;
+
+    std::mutex mutex;
+    FrameList frames; // Most recently used first
+    std::unordered_map<std::string, FrameList::iterator> index;
+    size_t bytes = 0;
+    size_t maxBytes = temperatureCacheMaxBytes();
+
+    void erase(FrameList::iterator it, FrameList &evicted) {
+        bytes -= it->bytes;
+        index.erase(it->path);
+        evicted.splice(evicted.end(), frames, it);
+    }
+
+public:
+    static TemperatureCache &instance() {
+        static TemperatureCache *cache = new TemperatureCache();
+        return *cache;
+    }
+
+    std::shared_ptr<const TemperatureData> get(const std::string &path, const FileIdentity &identity) {
+        FrameList evicted;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(path);
+        if (it == index.end()) return nullptr;
+
+        // The file changed since it was decoded
+        if (it->second->identity != identity) {
+            erase(it->second, evicted);
+            return nullptr;
+        }
+
+        frames.splice(frames.begin(), frames, it->second);
+        return it->second->data;
+    }
+
+    void put(const std::string &path, const FileIdentity &identity,
+             std::shared_ptr<const TemperatureData> data) {
+        const size_t size = data->temperatures.size() * sizeof(float) +
+                            data->rawValues.size() * sizeof(uint16_t);
+        FrameList evicted;
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (size > maxBytes) return;
+
+        auto it = index.find(path);
+        if (it != index.end()) erase(it->second, evicted);
+
+        frames.push_front(Frame{path, identity, std::move(data), size});
+        index[path] = frames.begin();
+        bytes += size;
+
+        while (bytes > maxBytes) erase(std::prev(frames.end()), evicted);
+    }
+
+    void clear() {
+        FrameList evicted;
+        std::lock_guard<std::mutex> lock(mutex);
+        evicted.swap(frames);
+        index.clear();
+        bytes = 0;
+    }
+};
+
+} // anonymous namespace
+
+std::shared_ptr<const TemperatureData> readTemperatureDataCached(const std::string &filePath) {
+    FileIdentity identity;
+    if (!getFileIdentity(filePath, identity)) {
+        // Not a local file (e.g. a GDAL virtual path): nothing to key on
+        return std::make_shared<const TemperatureData>(readTemperatureData(filePath));
+    }
+
+    auto &cache = TemperatureCache::instance();
+    if (auto data = cache.get(filePath, identity)) return data;
+
+    auto data = std::make_shared<const TemperatureData>(readTemperatureData(filePath));
+    if (!data->temperatures.empty()) cache.put(filePath, identity, data);
+    return data;
+}
+
+void clearTemperatureDataCache() {
+    TemperatureCache::instance().clear();
+}
+
+// ---- Area statistics ----
+
+ThermalAreaStats computeAreaStats(std::vector<float> &values) {
+    ThermalAreaStats stats;
+    const size_t n = values.size();
+    if (n == 0) return stats;
+
+    float vMin = values[0];
+    float vMax = values[0];
+    double sum = 0;
+    for (float v : values) {
+        vMin = std::min(vMin, v);
+        vMax = std::max(vMax, v);
+        sum += v;
+    }
+    const double mean = sum / n;
+
+    double sqSum = 0;
+    for (float v : values) {
+        const double diff = v - mean;
+        sqSum += diff * diff;
+    }
+
+    // Selection instead of a full sort; for an even count the lower middle
+    // value is the largest of the lower half
+    auto mid = values.begin() + n / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    float median = *mid;
+    if (n % 2 == 0) {
+        median = (*std::max_element(values.begin(), mid) + median) / 2.0f;
+    }
+
+    stats.min = vMin;
+    stats.max = vMax;
+    stats.mean = mean;
+    stats.stddev = std::sqrt(sqSum / n);
+    stats.median = median;
+    stats.pixelCount = static_cast<int>(n);
+    return stats;
+}
+
+ThermalAreaStats computeAreaStats(const std::vector<uint64_t> &histogram,
+                                  const std::vector<float> &lut) {
+    ThermalAreaStats stats;
+
+    // Distinct values with their counts, sorted by value
+    std::vector<std::pair<float, uint64_t>> bins;
+    uint64_t n = 0;
+    double sum = 0;
+    for (size_t raw = 0; raw < histogram.size() && raw < lut.size(); raw++) {
+        if (histogram[raw] == 0 || !std::isfinite(lut[raw])) continue;
+        bins.emplace_back(lut[raw], histogram[raw]);
+        n += histogram[raw];
+        sum += static_cast<double>(lut[raw]) * histogram[raw];
+    }
+    if (n == 0) return stats;
+    std::sort(bins.begin(), bins.end());
+
+    const double mean = sum / n;
+    double sqSum = 0;
+    for (const auto &b : bins) {
+        const double diff = b.first - mean;
+        sqSum += diff * diff * b.second;
+    }
+
+    // Value at a rank of the sorted values
+    auto valueAt = [&bins](uint64_t rank) {
+        for (const auto &b : bins) {
+            if (rank < b.second) return b.first;
+            rank -= b.second;
+        }
+        return bins.back().first;
+    };
+    const float median = n % 2 == 0
+        ? (valueAt(n / 2 - 1) + valueAt(n / 2)) / 2.0f
+        : valueAt(n / 2);
+
+    stats.min = bins.front().first;
+    stats.max = bins.back().first;
+    stats.mean = mean;
+    stats.stddev = std::sqrt(sqSum / n);
+    stats.median = median;
+    stats.pixelCount = static_cast<int>(n);
+    return stats;
+}
+
 // ---- Helper: convert pixel to geo coordinates ----
 void pixelToGeo(double px, double py, const double geoTransform[6],
                 const std::string &projection, double &geoX, double &geoY) {
@@ -544,7 +544,7 @@ void generateImageThumbEx(const fs::path& imagePath,
 
         // Apply formula
         std::vector<float> result(pixCount);
-        const auto* formulaPtr = ve.getFormula(visParams.formula);
+        const auto formulaPtr = ve.getFormula(visParams.formula);
         if (!formulaPtr) {
             GDALClose(hSrcDataset);
             throw InvalidArgsException("Unknown formula: " + visParams.formula);
@@ -943,13 +943,18 @@ int renderPoints(pdal::PointViewPtr point_view,
     if (hasSpatialSystem) {
         CoordsTransformer ict(wktProjection, 3857);
 
-        for (pdal::PointId idx = 0; idx < point_view->size(); ++idx) {
-            auto p = point_view->point(idx);
-            auto x = p.getFieldAs<double>(pdal::Dimension::Id::X);
-            auto y = p.getFieldAs<double>(pdal::Dimension::Id::Y);
-            auto z = p.getFieldAs<double>(pdal::Dimension::Id::Z);
+        const size_t numPoints = point_view->size();
+        std::vector<double> xs(numPoints), ys(numPoints);
+        for (pdal::PointId idx = 0; idx < numPoints; ++idx) {
+            xs[idx] = point_view->getFieldAs<double>(pdal::Dimension::Id::X, idx);
+            ys[idx] = point_view->getFieldAs<double>(pdal::Dimension::Id::Y, idx);
+        }
+        ict.transform(numPoints, xs.data(), ys.data());
 
-            ict.transform(&x, &y);
+        for (pdal::PointId idx = 0; idx < numPoints; ++idx) {
+            const double x = xs[idx];
+            const double y = ys[idx];
+            auto z = point_view->getFieldAs<double>(pdal::Dimension::Id::Z, idx);
 
             // Map projected coordinates to local PNG coordinates
             int px = std::round((x - oMinX) * tileScale + offsetX);
@@ -9,11 +9,17 @@
 
 #include <memory>
 #include <vector>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <thread>
+#include <list>
+#include <mutex>
 
 #include "entry.h"
 #include "exceptions.h"
+#include "fingerprintcache.h"
 #include "geoproject.h"
 #include "hash.h"
 #include "logger.h"
@@ -24,6 +30,295 @@
 namespace ddb
 {
 
+    namespace
+    {
+        // Idle tilers kept open per tiler type (GDAL datasets, COPC metadata)
+        const size_t MaxPooledTilers = 16;
+
+        // Idle tilers are closed after this long, so open handles do not linger on
+        // files that are about to be rebuilt or removed (which fails on Windows)
+        const std::chrono::seconds MaxTilerIdleTime(30);
+
+        // LRU list of idle tilers. A tiler is removed from the list while leased,
+        // so a GDAL dataset is never used by two threads at the same time.
+        template <typename T>
+        class TilerPool
+        {
+            struct IdleTiler
+            {
+                std::string key;
+                std::unique_ptr<T> tiler;
+                std::chrono::steady_clock::time_point lastUsed;
+            };
+            typedef std::list<IdleTiler> IdleList;
+
+            std::mutex mutex;
+            IdleList idle; // Most recently used first
+            size_t hits = 0;
+            size_t misses = 0;
+
+            // Moves expired tilers into evicted; they are destroyed by the caller
+            // outside of the lock
+            void expire(IdleList &evicted)
+            {
+                const auto threshold = std::chrono::steady_clock::now() - MaxTilerIdleTime;
+                while (!idle.empty() && idle.back().lastUsed < threshold)
+                    evicted.splice(evicted.end(), idle, std::prev(idle.end()));
+            }
+
+        public:
+            static TilerPool &instance()
+            {
+                // Never destroyed: closing datasets during static destruction
+                // could run after GDAL has been torn down
+                static TilerPool *pool = new TilerPool();
+                return *pool;
+            }
+
+            std::unique_ptr<T> acquire(const std::string &key)
+            {
+                IdleList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+                expire(evicted);
+
+                for (auto it = idle.begin(); it != idle.end(); ++it)
+                {
+                    if (it->key == key)
+                    {
+                        std::unique_ptr<T> tiler = std::move(it->tiler);
+                        idle.erase(it);
+                        hits++;
+                        return tiler;
+                    }
+                }
+                misses++;
+                return nullptr;
+            }
+
+            void release(const std::string &key, std::unique_ptr<T> tiler)
+            {
+                IdleList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+                idle.push_front({key, std::move(tiler), std::chrono::steady_clock::now()});
+                while (idle.size() > MaxPooledTilers)
+                    evicted.splice(evicted.end(), idle, std::prev(idle.end()));
+                expire(evicted);
+            }
+
+            void invalidate(const std::string &key)
+            {
+                IdleList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = idle.begin(); it != idle.end();)
+                {
+                    auto next = std::next(it);
+                    if (it->key == key)
+                        evicted.splice(evicted.end(), idle, it);
+                    it = next;
+                }
+            }
+
+            void clear()
+            {
+                IdleList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+                evicted.swap(idle);
+                hits = misses = 0;
+            }
+
+            void addStats(TilerPoolStats &stats)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.hits += hits;
+                stats.misses += misses;
+                stats.idle += idle.size();
+            }
+        };
+
+        // Identifies a tiler configuration. Local files are keyed by their identity so an
+        // overwritten file never hits a stale tiler. Network paths are only pooled when the
+        // caller supplies the content hash; empty means "do not pool".
+        std::string tilerPoolKey(const fs::path &tileablePath, int tileSize, bool tms,
+                                 const fs::path &outputFolder, const std::string &tileablePathHash)
+        {
+            std::ostringstream os;
+
+            if (utils::isNetworkPath(tileablePath.string()))
+            {
+                if (tileablePathHash.empty())
+                    return "";
+                os << tileablePathHash;
+            }
+            else
+            {
+                FileIdentity id;
+                if (!getFileIdentity(tileablePath, id))
+                    return "";
+                os << tileablePath.string() << "*" << id.device << "*" << id.inode << "*"
+                   << id.size << "*" << id.mtimeNs;
+            }
+
+            os << "*" << tileSize << "*" << tms << "*" << outputFolder.string();
+            return os.str();
+        }
+
+        // Runs fn on a pooled tiler for key, creating one with create() on a miss.
+        // The tiler goes back to the pool only if fn succeeds.
+        template <typename T, typename Create, typename Fn>
+        fs::path withPooledTiler(const std::string &key, bool forceRecreate, Create create, Fn fn)
+        {
+            auto &pool = TilerPool<T>::instance();
+
+            std::unique_ptr<T> tiler;
+            if (!key.empty())
+            {
+                if (forceRecreate)
+                    pool.invalidate(key);
+                else
+                    tiler = pool.acquire(key);
+            }
+
+            if (!tiler)
+                tiler = create();
+
+            const fs::path result = fn(*tiler);
+
+            if (!key.empty())
+                pool.release(key, std::move(tiler));
+
+            return result;
+        }
+
+        // Tile stores kept open, so consecutive tiles of a dataset share one connection
+        const size_t MaxOpenTileStores = 32;
+
+        // Cleanup of the tiles folder runs at most this often (seconds)
+        const long long UserCacheCleanupInterval = 60 * 60;
+
+        // Spooled tile files only need to outlive the request that asked for them
+        const time_t MaxSpoolAge = 60 * 60;
+
+        // Tile data budget of each dataset store. Configurable via the
+        // DDB_TILE_CACHE_MB environment variable; defaults to 512 MB.
+        long long tileCacheMaxBytes()
+        {
+            return utils::getEnvLong("DDB_TILE_CACHE_MB", 512, 1) * 1024 * 1024;
+        }
+
+        std::shared_ptr<TileStore> createDefaultTileStore(const std::string &name)
+        {
+            const fs::path file = UserProfile::get()->getTilesDir() / (name + ".mbtiles");
+
+            // Keeps the store from being picked up by cleanupUserCache
+            std::error_code ec;
+            if (fs::exists(file, ec))
+                fs::last_write_time(file, fs::file_time_type::clock::now(), ec);
+
+            return std::make_shared<MBTilesStore>(file, tileCacheMaxBytes());
+        }
+
+        // LRU list of the open tile stores of the user cache
+        class UserCacheStores
+        {
+            typedef std::list<std::pair<std::string, std::shared_ptr<TileStore>>> StoreList;
+
+            std::mutex mutex;
+            StoreList stores; // Most recently used first
+            TileStoreFactory factory;
+
+        public:
+            std::atomic<size_t> hits{0};
+            std::atomic<size_t> misses{0};
+
+            static UserCacheStores &instance()
+            {
+                // Never destroyed, like the tiler pools
+                static UserCacheStores *s = new UserCacheStores();
+                return *s;
+            }
+
+            std::shared_ptr<TileStore> get(const std::string &name)
+            {
+                // Closed (if unused elsewhere) after the lock is released
+                StoreList evicted;
+                std::lock_guard<std::mutex> lock(mutex);
+
+                for (auto it = stores.begin(); it != stores.end(); ++it)
+                {
+                    if (it->first == name)
+                    {
+                        stores.splice(stores.begin(), stores, it);
+                        return it->second;
+                    }
+                }
+
+                std::shared_ptr<TileStore> store = factory ? factory(name) : createDefaultTileStore(name);
+                stores.emplace_front(name, store);
+                while (stores.size() > MaxOpenTileStores)
+                    evicted.splice(evicted.end(), stores, std::prev(stores.end()));
+
+                return store;
+            }
+
+            bool isOpen(const std::string &name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const auto &s : stores)
+                    if (s.first == name)
+                        return true;
+                return false;
+            }
+
+            void setFactory(TileStoreFactory f)
+            {
+                StoreList closed;
+                std::lock_guard<std::mutex> lock(mutex);
+                factory = std::move(f);
+                closed.swap(stores);
+                hits = 0;
+                misses = 0;
+            }
+
+            TileStoreStats getStats()
+            {
+                TileStoreStats stats;
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.hits = hits;
+                stats.misses = misses;
+                stats.open = stores.size();
+                return stats;
+            }
+        };
+
+        std::atomic<long long> lastUserCacheCleanup(0);
+
+        // Runs cleanupUserCache on a background thread, at most once per
+        // UserCacheCleanupInterval, so tile requests never wait for it
+        void scheduleUserCacheCleanup()
+        {
+            const long long now = static_cast<long long>(utils::currentUnixTimestamp());
+            long long last = lastUserCacheCleanup.load();
+            if (now - last < UserCacheCleanupInterval)
+                return;
+            if (!lastUserCacheCleanup.compare_exchange_strong(last, now))
+                return; // Another thread got there first
+
+            std::thread(
+                []()
+                {
+                    try
+                    {
+                        TilerHelper::cleanupUserCache();
+                    }
+                    catch (const std::exception &e)
+                    {
+                        LOGD << "Cannot cleanup tiles user cache: " << e.what();
+                    }
+                })
+                .detach();
+        }
+    }
+
     BoundingBox<int> TilerHelper::parseZRange(const std::string &zRange)
     {
         BoundingBox<int> r;
@@ -54,45 +349,163 @@ namespace ddb
         return Hash::strCRC64(os.str());
     }
 
+    std::string TilerHelper::userCacheStoreName(const fs::path &tileablePath, time_t modifiedTime,
+                                                int tileSize, const std::string &pointCloudColor)
+    {
+        const std::string name = getCacheFolderName(tileablePath, modifiedTime, tileSize).string();
+        if (!isCopcPath(tileablePath.string()))
+            return name;
+
+        // Validated before it becomes part of a file name
+        const PointCloudRenderMode renderMode = parsePointCloudRenderMode(pointCloudColor);
+        if (renderMode == PointCloudRenderMode::Auto)
+            return name;
+        return name + "_" + std::to_string(static_cast<int>(renderMode));
+    }
+
     fs::path TilerHelper::getFromUserCache(const fs::path &tileablePath, int tz,
                                            int tx, int ty, int tileSize, bool tms,
                                            bool forceRecreate,
-                                           const std::string &tileablePathHash)
+                                           const std::string &tileablePathHash,
+                                           const std::string &pointCloudColor)
     {
         if (!fs::exists(tileablePath))
             throw FSException(tileablePath.string() + " does not exist");
-        if (std::rand() % 1000 == 0)
-            cleanupUserCache();
 
         const time_t modifiedTime = io::Path(tileablePath).getModifiedTime();
-        const fs::path tileCacheFolder =
-            UserProfile::get()->getTilesDir() /
-            getCacheFolderName(tileablePath, modifiedTime, tileSize);
-        fs::path outputFile = tileCacheFolder / std::to_string(tz) /
-                              std::to_string(tx) / (std::to_string(ty) + ".png");
+        std::ostringstream os;
+        os << userCacheStoreName(tileablePath, modifiedTime, tileSize, pointCloudColor) << "*"
+           << tz << "*" << tx << "*" << ty << "*" << tms;
 
-        // Cache hit
+        const fs::path spoolDir = UserProfile::get()->getTilesDir() / "spool";
+        io::assureFolderExists(spoolDir);
+        const fs::path outputFile = spoolDir / (Hash::strCRC64(os.str()) + ".png");
+
+        // Recently served
         if (fs::exists(outputFile) && !forceRecreate)
-        {
             return outputFile;
+
+        uint8_t *buffer = nullptr;
+        int bufferSize = 0;
+        getFromUserCache(tileablePath, tz, tx, ty, tileSize, tms, forceRecreate,
+                         &buffer, &bufferSize, tileablePathHash, pointCloudColor);
+
+        // Write to a temporary file first, so concurrent readers never see a partial tile
+        const fs::path tmpFile = spoolDir / (outputFile.filename().string() + "." +
+                                             utils::generateRandomString(8) + ".tmp");
+        {
+            std::ofstream of(tmpFile.string(), std::ios::binary | std::ios::trunc);
+            of.write(reinterpret_cast<const char *>(buffer), bufferSize);
+            VSIFree(buffer);
+            if (!of)
+            {
+                of.close();
+                io::assureIsRemoved(tmpFile);
+                throw FSException("Cannot write " + tmpFile.string());
+            }
         }
 
-        return TilerHelper::getTile(tileablePath, tz, tx, ty, tileSize, tms, forceRecreate, tileCacheFolder, nullptr, nullptr, tileablePathHash);
+        std::error_code ec;
+        fs::rename(tmpFile, outputFile, ec);
+        if (ec)
+        {
+            // Lost a race with another writer of the same tile
+            io::assureIsRemoved(tmpFile);
+            if (!fs::exists(outputFile))
+                throw FSException("Cannot write " + outputFile.string() + ": " + ec.message());
+        }
+
+        return outputFile;
     }
 
-    fs::path TilerHelper::getTile(const fs::path &tileablePath, int tz, int tx, int ty, int tileSize, bool tms, bool forceRecreate, const fs::path &outputFolder, uint8_t **outBuffer, int *outBufferSize, const std::string &tileablePathHash)
+    void TilerHelper::getFromUserCache(const fs::path &tileablePath, int tz,
+                                       int tx, int ty, int tileSize, bool tms,
+                                       bool forceRecreate,
+                                       uint8_t **outBuffer, int *outBufferSize,
+                                       const std::string &tileablePathHash,
+                                       const std::string &pointCloudColor)
     {
+        if (!fs::exists(tileablePath))
+            throw FSException(tileablePath.string() + " does not exist");
+        scheduleUserCacheCleanup();
+
+        const time_t modifiedTime = io::Path(tileablePath).getModifiedTime();
+        const std::string storeName = userCacheStoreName(tileablePath, modifiedTime, tileSize, pointCloudColor);
+
+        // Stores are addressed in XYZ, so TMS and XYZ requests share tiles
+        const int y = tms ? (1 << tz) - 1 - ty : ty;
+
+        // The cache is best effort: if the store cannot be used, tiles are still rendered
+        auto &stores = UserCacheStores::instance();
+        std::shared_ptr<TileStore> store;
+        try
+        {
+            store = stores.get(storeName);
+
+            std::vector<uint8_t> data;
+            if (!forceRecreate && store->get(tz, tx, y, data))
+            {
+                stores.hits++;
+                *outBuffer = static_cast<uint8_t *>(VSIMalloc(data.size()));
+                if (*outBuffer == nullptr)
+                    throw AppException("Cannot allocate tile buffer");
+                memcpy(*outBuffer, data.data(), data.size());
+                *outBufferSize = static_cast<int>(data.size());
+                return;
+            }
+        }
+        catch (const DBException &e)
+        {
+            LOGD << "Tile store " << storeName << " unavailable: " << e.what();
+            store.reset();
+        }
+
+        stores.misses++;
+        getTile(tileablePath, tz, tx, ty, tileSize, tms, forceRecreate, "",
+                outBuffer, outBufferSize, tileablePathHash, pointCloudColor);
+
+        if (store && *outBuffer != nullptr && *outBufferSize > 0)
+        {
+            try
+            {
+                store->put(tz, tx, y, *outBuffer, static_cast<size_t>(*outBufferSize));
+            }
+            catch (const DBException &e)
+            {
+                LOGD << "Cannot cache tile in " << storeName << ": " << e.what();
+            }
+        }
+    }
+
+    fs::path TilerHelper::getTile(const fs::path &tileablePath, int tz, int tx, int ty, int tileSize, bool tms, bool forceRecreate, const fs::path &outputFolder, uint8_t **outBuffer, int *outBufferSize, const std::string &tileablePathHash, const std::string &pointCloudColor)
+    {
+        std::string key = tilerPoolKey(tileablePath, tileSize, tms, outputFolder, tileablePathHash);
+
         if (isCopcPath(tileablePath.string()))
         {
-            // COPC point cloud
-            PointCloudTiler t(tileablePath.string(), outputFolder.string(), tileSize, tms);
-            return t.tile(tz, tx, ty, outBuffer, outBufferSize);
+            // COPC point cloud, tilers render a single coloring
+            const PointCloudRenderMode renderMode = parsePointCloudRenderMode(pointCloudColor);
+            if (!key.empty())
+                key += "*" + std::to_string(static_cast<int>(renderMode));
+
+            return withPooledTiler<PointCloudTiler>(
+                key, forceRecreate,
+                [&]()
+                { return std::unique_ptr<PointCloudTiler>(new PointCloudTiler(tileablePath.string(), outputFolder.string(), tileSize, tms, renderMode)); },
+                [&](PointCloudTiler &t)
+                { return fs::path(t.tile(tz, tx, ty, outBuffer, outBufferSize)); });
         }
         else
         {
-            const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
-            GDALTiler t(fileToTile.string(), outputFolder.string(), tileSize, tms);
-            return t.tile(tz, tx, ty, outBuffer, outBufferSize);
+            return withPooledTiler<GDALTiler>(
+                key, forceRecreate,
+                [&]()
+                {
+                    const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
+                    return std::unique_ptr<GDALTiler>(new GDALTiler(fileToTile.string(), outputFolder.string(), tileSize, tms));
+                },
+                [&](GDALTiler &t)
+                { return fs::path(t.tile(tz, tx, ty, outBuffer, outBufferSize)); });
         }
     }
 
@@ -106,9 +519,16 @@ namespace ddb
         }
         else
         {
-            const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
-            GDALTiler t(fileToTile.string(), outputFolder.string(), tileSize, tms);
-            return t.tile(tz, tx, ty, outputFormat, outBuffer, outBufferSize);
+            const std::string key = tilerPoolKey(tileablePath, tileSize, tms, outputFolder, tileablePathHash);
+            return withPooledTiler<GDALTiler>(
+                key, forceRecreate,
+                [&]()
+                {
+                    const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
+                    return std::unique_ptr<GDALTiler>(new GDALTiler(fileToTile.string(), outputFolder.string(), tileSize, tms));
+                },
+                [&](GDALTiler &t)
+                { return fs::path(t.tile(tz, tx, ty, outputFormat, outBuffer, outBufferSize)); });
         }
     }
 
@@ -117,14 +537,20 @@ namespace ddb
         if (isCopcPath(tileablePath.string()))
         {
             // COPC: vis params not supported, fall through to standard
-            PointCloudTiler t(tileablePath.string(), outputFolder.string(), tileSize, tms);
-            return t.tile(tz, tx, ty, outBuffer, outBufferSize);
+            return getTile(tileablePath, tz, tx, ty, tileSize, tms, forceRecreate, outputFolder, outBuffer, outBufferSize, tileablePathHash);
         }
         else
         {
-            const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
-            GDALTiler t(fileToTile.string(), outputFolder.string(), tileSize, tms);
-            return t.tile(tz, tx, ty, visParams, outBuffer, outBufferSize);
+            const std::string key = tilerPoolKey(tileablePath, tileSize, tms, outputFolder, tileablePathHash);
+            return withPooledTiler<GDALTiler>(
+                key, forceRecreate,
+                [&]()
+                {
+                    const fs::path fileToTile = toGeoTIFF(tileablePath, tileSize, forceRecreate, "", tileablePathHash);
+                    return std::unique_ptr<GDALTiler>(new GDALTiler(fileToTile.string(), outputFolder.string(), tileSize, tms));
+                },
+                [&](GDALTiler &t)
+                { return fs::path(t.tile(tz, tx, ty, visParams, outBuffer, outBufferSize)); });
         }
     }
 
@@ -198,8 +624,7 @@ namespace ddb
             if (outputGeotiff.empty())
             {
                 // Store in user cache if user doesn't specify a preference
-                if (std::rand() % 1000 == 0)
-                    cleanupUserCache();
+                scheduleUserCacheCleanup();
                 const time_t modifiedTime = io::Path(localTileablePath).getModifiedTime();
                 const fs::path tileCacheFolder =
                     UserProfile::get()->getTilesDir() /
@@ -245,38 +670,88 @@ namespace ddb
     {
         LOGD << "Cleaning up tiles user cache";
 
-        const time_t threshold =
-            utils::currentUnixTimestamp() - 60 * 60 * 24 * 5; // 5 days
+        const time_t now = utils::currentUnixTimestamp();
+        const time_t threshold = now - 60 * 60 * 24 * 5; // 5 days
         const fs::path tilesDir = UserProfile::get()->getTilesDir();
+        const fs::path spoolDir = tilesDir / "spool";
+        auto &stores = UserCacheStores::instance();
 
-        // Iterate directories
-        for (auto d = fs::recursive_directory_iterator(tilesDir);
-             d != fs::recursive_directory_iterator(); ++d)
+        // Only the top level is scanned: each dataset is a single store file
+        // (plus a folder for geoprojected images), never one file per tile
+        for (const auto &d : fs::directory_iterator(tilesDir))
         {
-            fs::path dir = d->path();
-            if (fs::is_directory(dir))
+            const fs::path p = d.path();
+            try
             {
-                if (io::Path(dir).getModifiedTime() < threshold)
+                if (p == spoolDir)
                 {
-                    io::assureIsRemoved(dir);
+                    for (const auto &f : fs::directory_iterator(spoolDir))
+                    {
+                        if (io::Path(f.path()).getModifiedTime() < now - MaxSpoolAge)
+                            io::assureIsRemoved(f.path());
+                    }
                 }
+                else if (fs::is_directory(p))
+                {
+                    if (io::Path(p).getModifiedTime() < threshold)
+                        io::assureIsRemoved(p);
+                }
+                else if (p.extension() == ".mbtiles")
+                {
+                    if (io::Path(p).getModifiedTime() < threshold && !stores.isOpen(p.stem().string()))
+                    {
+                        io::assureIsRemoved(p);
+                        io::assureIsRemoved(p.string() + "-wal");
+                        io::assureIsRemoved(p.string() + "-shm");
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                LOGD << "Cannot cleanup " << p.string() << ": " << e.what();
             }
         }
     }
 
+    void TilerHelper::setUserCacheStoreFactory(TileStoreFactory factory)
+    {
+        UserCacheStores::instance().setFactory(std::move(factory));
+    }
+
+    TileStoreStats TilerHelper::getUserCacheStats()
+    {
+        return UserCacheStores::instance().getStats();
+    }
+
+    void TilerHelper::clearTilerPool()
+    {
+        TilerPool<GDALTiler>::instance().clear();
+        TilerPool<PointCloudTiler>::instance().clear();
+    }
+
+    TilerPoolStats TilerHelper::getTilerPoolStats()
+    {
+        TilerPoolStats stats;
+        TilerPool<GDALTiler>::instance().addStats(stats);
+        TilerPool<PointCloudTiler>::instance().addStats(stats);
+        return stats;
+    }
+
     void TilerHelper::runTiler(const fs::path &input,
                                const fs::path &output,
                                int tileSize, bool tms,
                                std::ostream &os,
                                const std::string &format, const std::string &zRange,
-                               const std::string &x, const std::string &y)
+                               const std::string &x, const std::string &y,
+                               const std::string &pointCloudColor)
     {
         Tiler *tiler;
 
         if (isCopcPath(input.string()))
         {
             // COPC point cloud
-            tiler = new PointCloudTiler(input.string(), output.string(), tileSize, tms);
+            tiler = new PointCloudTiler(input.string(), output.string(), tileSize, tms,
+                                        parsePointCloudRenderMode(pointCloudColor));
         }
         else
         {
@@ -0,0 +1,180 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "tilestore.h"
+
+#include "exceptions.h"
+#include "logger.h"
+#include "transaction.h"
+#include "utils.h"
+
+namespace ddb
+{
+
+    namespace
+    {
+        const char *mbtilesDdl = R"<<<(
+  CREATE TABLE IF NOT EXISTS metadata (
+      name TEXT PRIMARY KEY,
+      value TEXT
+  );
+  CREATE TABLE IF NOT EXISTS tiles (
+      zoom_level INTEGER NOT NULL,
+      tile_column INTEGER NOT NULL,
+      tile_row INTEGER NOT NULL,
+      tile_data BLOB NOT NULL,
+      size INTEGER NOT NULL,
+      last_access INTEGER NOT NULL,
+      PRIMARY KEY (zoom_level, tile_column, tile_row)
+  );
+  CREATE INDEX IF NOT EXISTS ix_tiles_last_access ON tiles (last_access);
+  INSERT OR IGNORE INTO metadata (name, value) VALUES ('format', 'png');
+)<<<";
+
+        // Reads refresh last_access at most this often, so hot tiles do not
+        // turn every hit into a write
+        const long long accessGranularity = 60;
+
+        // Eviction frees down to this fraction of the budget, so it runs in batches
+        // rather than on every write once the store is full
+        const double evictionTarget = 0.9;
+
+        // MBTiles rows are addressed in TMS
+        inline int xyzToTmsRow(int tz, int ty)
+        {
+            return (1 << tz) - 1 - ty;
+        }
+    }
+
+    MBTilesStore::MBTilesStore(const fs::path &file, long long maxBytes) : maxBytes(maxBytes)
+    {
+        db.open(file.string());
+
+        // The same store can be shared by several processes (e.g. web workers)
+        db.exec("PRAGMA busy_timeout=200;");
+        db.setJournalMode("wal");
+        db.exec("PRAGMA synchronous=NORMAL;");
+        db.exec(mbtilesDdl);
+
+        auto q = db.query("SELECT COALESCE(SUM(size), 0) FROM tiles");
+        if (q->fetch())
+            totalBytes = q->getInt64(0);
+
+        LOGD << "Opened tile store " << file.string() << " (" << totalBytes << " bytes)";
+    }
+
+    bool MBTilesStore::get(int tz, int tx, int ty, std::vector<uint8_t> &data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const int row = xyzToTmsRow(tz, ty);
+        bool found = false;
+
+        try
+        {
+            auto q = db.query("SELECT tile_data, last_access FROM tiles "
+                              "WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?");
+            q->bind(1, tz);
+            q->bind(2, tx);
+            q->bind(3, row);
+
+            if (!q->fetch())
+                return false;
+
+            const auto *blob = static_cast<const uint8_t *>(q->getBlob(0));
+            data.assign(blob, blob + q->getBlobSize(0));
+            found = true;
+
+            const long long now = static_cast<long long>(utils::currentUnixTimestamp());
+            if (q->getInt64(1) < now - accessGranularity)
+            {
+                auto u = db.query("UPDATE tiles SET last_access = ? "
+                                  "WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?");
+                u->bind(1, now);
+                u->bind(2, tz);
+                u->bind(3, tx);
+                u->bind(4, row);
+                u->execute();
+            }
+
+            return true;
+        }
+        catch (const DBBusyException &e)
+        {
+            // The cache is best effort: a locked store is a miss
+            LOGD << "Tile store busy: " << e.what();
+            return found;
+        }
+    }
+
+    void MBTilesStore::put(int tz, int tx, int ty, const uint8_t *data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        try
+        {
+            auto q = db.query("INSERT OR REPLACE INTO tiles "
+                              "(zoom_level, tile_column, tile_row, tile_data, size, last_access) "
+                              "VALUES (?, ?, ?, ?, ?, ?)");
+            q->bind(1, tz);
+            q->bind(2, tx);
+            q->bind(3, xyzToTmsRow(tz, ty));
+            q->bind(4, data, static_cast<int>(size));
+            q->bind(5, static_cast<long long>(size));
+            q->bind(6, static_cast<long long>(utils::currentUnixTimestamp()));
+            q->execute();
+
+            // A replaced tile is counted twice until the next eviction recount
+            totalBytes += static_cast<long long>(size);
+            if (totalBytes > maxBytes)
+                evict();
+        }
+        catch (const DBBusyException &e)
+        {
+            LOGD << "Tile store busy, tile not cached: " << e.what();
+        }
+    }
+
+    void MBTilesStore::evict()
+    {
+        // Recount first: replaced tiles were added twice
+        auto sum = db.query("SELECT COALESCE(SUM(size), 0) FROM tiles");
+        sum->fetch();
+        totalBytes = sum->getInt64(0);
+
+        const long long target = static_cast<long long>(maxBytes * evictionTarget);
+        if (totalBytes <= maxBytes)
+            return;
+
+        std::vector<long long> victims;
+        long long freed = 0;
+        {
+            auto q = db.query("SELECT rowid, size FROM tiles ORDER BY last_access ASC, rowid ASC");
+            while (totalBytes - freed > target && q->fetch())
+            {
+                victims.push_back(q->getInt64(0));
+                freed += q->getInt64(1);
+            }
+        }
+
+        Transaction tx(&db, Transaction::Mode::Immediate);
+        auto del = db.query("DELETE FROM tiles WHERE rowid = ?");
+        for (const long long rowid : victims)
+        {
+            del->bind(1, rowid);
+            del->execute();
+        }
+        tx.commit();
+
+        totalBytes -= freed;
+        LOGD << "Evicted " << victims.size() << " tiles from " << db.getOpenFile() << ", "
+             << totalBytes << " bytes left";
+    }
+
+    long long MBTilesStore::getTotalBytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalBytes;
+    }
+
+} // namespace ddb
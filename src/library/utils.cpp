@@ -367,6 +367,16 @@ DDB_DLL bool isValidNonEmptyStringParam(const char* str) {
     return str != nullptr && strlen(str) > 0;
 }
 
+DDB_DLL long long getEnvLong(const char* name, long long defaultValue, long long minValue) {
+    if (const char* env = std::getenv(name); env && *env) {
+        char* endp = nullptr;
+        const long long v = std::strtoll(env, &endp, 10);
+        if (endp != env && v >= minValue)
+            return v;
+    }
+    return defaultValue;
+}
+
 DDB_DLL std::vector<ddb::EntryType> parseEntryTypeList(const char* types) {
     std::vector<ddb::EntryType> typeFilter;
 
@@ -16,6 +16,7 @@
 #include "cpl_vsi.h"
 
 #include "vector_query.h"
+#include "coordstransformer.h"
 #include "exceptions.h"
 #include "logger.h"
 #include "utils.h"
@@ -170,29 +171,32 @@ namespace ddb
                 reqSrs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
                 layerSrs.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
                 if (!reqSrs.IsSame(&layerSrs)) {
-                    OGRCoordinateTransformation *t =
-                        OGRCreateCoordinateTransformation(&reqSrs, &layerSrs);
-                    if (!t) {
-                        GDALClose(hSrc);
-                        throw GDALException(
-                            "Cannot create bbox coordinate transformation from " +
-                            requestedSrs + " to layer SRS");
-                    }
+                    // WKT1 cannot carry every CRS (e.g. dynamic datums, epochs):
+                    // export WKT2 so the transformer sees the layer SRS unchanged
+                    const char *const wktOptions[] = {"FORMAT=WKT2_2019", nullptr};
+                    char *layerWkt = nullptr;
+                    layerSrs.exportToWkt(&layerWkt, wktOptions);
+                    const std::string layerDefinition = layerWkt ? layerWkt : "";
+                    CPLFree(layerWkt);
+
                     // Transform all 4 corners
                     double xs[4] = {minX, maxX, maxX, minX};
                     double ys[4] = {minY, minY, maxY, maxY};
-                    int ok;
+                    int ok[4];
+                    size_t transformed;
                     try {
-                        ok = t->Transform(4, xs, ys);
+                        CoordsTransformer t(requestedSrs, layerDefinition);
+                        transformed = t.transform(4, xs, ys, nullptr, ok);
+                    } catch (const GDALException &) {
+                        GDALClose(hSrc);
+                        throw GDALException(
+                            "Cannot create bbox coordinate transformation from " +
+                            requestedSrs + " to layer SRS");
                     } catch (...) {
-                        OCTDestroyCoordinateTransformation(
-                            OGRCoordinateTransformation::ToHandle(t));
                         GDALClose(hSrc);
                         throw;
                     }
-                    OCTDestroyCoordinateTransformation(
-                        OGRCoordinateTransformation::ToHandle(t));
-                    if (!ok) {
+                    if (transformed != 4) {
                         GDALClose(hSrc);
                         throw GDALException(
                             "bbox coordinate transformation failed (" +
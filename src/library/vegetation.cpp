@@ -2,10 +2,12 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 #include "vegetation.h"
+#include "bandmath.h"
 #include "sensorprofile.h"
 #include "thermal.h"
 #include "exceptions.h"
 #include "logger.h"
+#include "userprofile.h"
 
 #include <gdal_priv.h>
 #include <cmath>
@@ -13,6 +15,10 @@
 #include <limits>
 #include <tuple>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
 
 namespace ddb {
 
@@ -75,6 +81,7 @@ BandFilter VegetationEngine::parseFilter(const std::string &filterStr, int bandC
 VegetationEngine::VegetationEngine() {
     initFormulas();
     initColormaps();
+    loadProfileFormulas();
 }
 
 VegetationEngine& VegetationEngine::instance() {
@@ -84,37 +91,63 @@ VegetationEngine& VegetationEngine::instance() {
 
 void VegetationEngine::initFormulas() {
     // Phase 0 - RGB indices
-    formulas_.push_back({"VARI", "Visual Atmospheric Resistance Index", "(G - R) / (G + R - B)", "Areas of green vegetation on RGB images", -1, 1, true, "RGB"});
-    formulas_.push_back({"EXG", "Excess Green Index", "(2 * G) - (R + B)", "Emphasizes green foliage", 0, 0, false, "RGB"});
-    formulas_.push_back({"GLI", "Green Leaf Index", "((G * 2) - R - B) / ((G * 2) + R + B)", "Green leaves and stems", -1, 1, true, "RGB"});
-    formulas_.push_back({"vNDVI", "Visible NDVI", "0.5268 * (R^-0.1294 * G^0.3389 * B^-0.3118)", "Approximated NDVI for RGB sensors", 0, 0, false, "RGB"});
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"VARI", "Visual Atmospheric Resistance Index", "(G - R) / (G + R - B)", "Areas of green vegetation on RGB images", -1, 1, true, "RGB"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"EXG", "Excess Green Index", "(2 * G) - (R + B)", "Emphasizes green foliage", 0, 0, false, "RGB"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"GLI", "Green Leaf Index", "((G * 2) - R - B) / ((G * 2) + R + B)", "Green leaves and stems", -1, 1, true, "RGB"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"vNDVI", "Visible NDVI", "0.5268 * (R^-0.1294 * G^0.3389 * B^-0.3118)", "Approximated NDVI for RGB sensors", 0, 0, false, "RGB"}));
 
     // Phase 0 - NIR indices
-    formulas_.push_back({"NDVI", "Normalized Difference Vegetation Index", "(N - R) / (N + R)", "Amount of green vegetation", -1, 1, true, "RN"});
-    formulas_.push_back({"NDWI", "Normalized Difference Water Index", "(G - N) / (G + N)", "Water content", -1, 1, true, "GN"});
-    formulas_.push_back({"GNDVI", "Green NDVI", "(N - G) / (N + G)", "NDVI on green spectrum", -1, 1, true, "GN"});
-    formulas_.push_back({"SAVI", "Soil Adjusted Vegetation Index", "(1.5 * (N - R)) / (N + R + 0.5)", "NDVI with soil correction", -1, 1, true, "RN"});
-    formulas_.push_back({"EVI", "Enhanced Vegetation Index", "2.5 * (N - R) / (N + 6*R - 7.5*B + 1)", "Better where NDVI saturates", -1, 1, true, "RBN"});
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"NDVI", "Normalized Difference Vegetation Index", "(N - R) / (N + R)", "Amount of green vegetation", -1, 1, true, "RN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"NDWI", "Normalized Difference Water Index", "(G - N) / (G + N)", "Water content", -1, 1, true, "GN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"GNDVI", "Green NDVI", "(N - G) / (N + G)", "NDVI on green spectrum", -1, 1, true, "GN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"SAVI", "Soil Adjusted Vegetation Index", "(1.5 * (N - R)) / (N + R + 0.5)", "NDVI with soil correction", -1, 1, true, "RN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"EVI", "Enhanced Vegetation Index", "2.5 * (N - R) / (N + 6*R - 7.5*B + 1)", "Better where NDVI saturates", -1, 1, true, "RBN"}));
 
     // Phase 0 - Red Edge
-    formulas_.push_back({"NDRE", "Normalized Difference Red Edge", "(N - Re) / (N + Re)", "Green vegetation in mature crops", -1, 1, true, "NRe"});
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"NDRE", "Normalized Difference Red Edge", "(N - Re) / (N + Re)", "Green vegetation in mature crops", -1, 1, true, "NRe"}));
 
     // Phase 1 formulas
-    formulas_.push_back({"NDYI", "Normalized Difference Yellowness Index", "(G - B) / (G + B)", "Yellowness detection", -1, 1, true, "GB"});
-    formulas_.push_back({"MPRI", "Modified Photochemical Reflectance Index", "(G - R) / (G + R)", "Photochemical reflectance", -1, 1, true, "RG"});
-    formulas_.push_back({"OSAVI", "Optimized Soil Adjusted Vegetation Index", "(N - R) / (N + R + 0.16)", "Optimized for sparse vegetation", -1, 1, true, "RN"});
-    formulas_.push_back({"GRVI", "Green Ratio Vegetation Index", "N / G", "Green ratio", 0, 0, false, "GN"});
-    formulas_.push_back({"ENDVI", "Enhanced NDVI", "((N + G) - (2*B)) / ((N + G) + (2*B))", "Enhanced NDVI", 0, 0, false, "GBN"});
-    formulas_.push_back({"ARVI", "Atmospherically Resistant Vegetation Index", "(N - (2*R) + B) / (N + (2*R) + B)", "Corrects atmospheric effects", -1, 1, true, "RBN"});
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"NDYI", "Normalized Difference Yellowness Index", "(G - B) / (G + B)", "Yellowness detection", -1, 1, true, "GB"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"MPRI", "Modified Photochemical Reflectance Index", "(G - R) / (G + R)", "Photochemical reflectance", -1, 1, true, "RG"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"OSAVI", "Optimized Soil Adjusted Vegetation Index", "(N - R) / (N + R + 0.16)", "Optimized for sparse vegetation", -1, 1, true, "RN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"GRVI", "Green Ratio Vegetation Index", "N / G", "Green ratio", 0, 0, false, "GN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"ENDVI", "Enhanced NDVI", "((N + G) - (2*B)) / ((N + G) + (2*B))", "Enhanced NDVI", 0, 0, false, "GBN"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"ARVI", "Atmospherically Resistant Vegetation Index", "(N - (2*R) + B) / (N + (2*R) + B)", "Corrects atmospheric effects", -1, 1, true, "RBN"}));
 
     // Thermal formulas
-    formulas_.push_back({"CELSIUS", "Celsius Temperature", "pixel value (passthrough)", "Temperature in degrees Celsius", -40, 150, true, "T"});
-    formulas_.push_back({"KELVIN", "Kelvin Temperature", "pixel + 273.15", "Temperature in Kelvin", 233.15, 423.15, true, "T"});
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"CELSIUS", "Celsius Temperature", "pixel value (passthrough)", "Temperature in degrees Celsius", -40, 150, true, "T"}));
+    formulas_.push_back(std::make_shared<const VegetationFormula>(VegetationFormula{"KELVIN", "Kelvin Temperature", "pixel + 273.15", "Temperature in Kelvin", 233.15, 423.15, true, "T"}));
+}
+
+void VegetationEngine::loadProfileFormulas() {
+    try {
+        const fs::path path = UserProfile::get()->getProfilePath("formulas.json", false);
+        if (!fs::exists(path)) return;
+
+        std::ifstream ifs(path);
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        loadFormulas(ss.str());
+    } catch (const std::exception &e) {
+        LOGW << "Cannot load user profile formulas: " << e.what();
+    }
+}
+
+std::vector<VegetationFormula> VegetationEngine::getAllFormulas() const {
+    std::shared_lock<std::shared_mutex> lock(formulasMutex_);
+
+    std::vector<VegetationFormula> result;
+    result.reserve(formulas_.size());
+    for (const auto &f : formulas_) result.push_back(*f);
+    return result;
 }
 
 std::vector<VegetationFormula> VegetationEngine::getFormulasForFilter(const BandFilter &filter) const {
+    std::shared_lock<std::shared_mutex> lock(formulasMutex_);
+
     std::vector<VegetationFormula> result;
-    for (const auto &f : formulas_) {
+    for (const auto &fp : formulas_) {
+        const VegetationFormula &f = *fp;
         bool compatible = true;
         // Parse requiredBands token-wise so that "Re" is treated as a single RedEdge band.
         for (std::size_t i = 0; i < f.requiredBands.size() && compatible; ) {
@@ -143,9 +176,11 @@ std::vector<VegetationFormula> VegetationEngine::getFormulasForFilter(const Band
     return result;
 }
 
-const VegetationFormula* VegetationEngine::getFormula(const std::string &id) const {
+std::shared_ptr<const VegetationFormula> VegetationEngine::getFormula(const std::string &id) const {
+    std::shared_lock<std::shared_mutex> lock(formulasMutex_);
+
     for (const auto &f : formulas_) {
-        if (f.id == id) return &f;
+        if (f->id == id) return f;
     }
     return nullptr;
 }
@@ -211,14 +246,171 @@ BandFilter VegetationEngine::autoDetectFilter(const std::string &rasterPath) con
     return bf;
 }
 
+// --- Formula kernels ---
+//
+// Each formula is resolved once per call into a kernel that runs branch-free loops over
+// the buffer: nodata and near-zero denominators are folded into a mask and applied with a
+// select instead of an early `continue`, so compilers can vectorize the loops (SSE/AVX on
+// x86, NEON on ARM) without any per-pixel string or branch dispatch.
+
+namespace {
+
+const float EPS = 1e-10f;
+
+// Pixels are processed in blocks small enough to keep the intermediate results in L1
+const size_t KernelBlockSize = 1024;
+
+struct FormulaInputs {
+    const float *R, *G, *B, *N, *Re;
+    bool hasR, hasG, hasB, hasN, hasRe;
+};
+
+typedef void (*FormulaKernel)(const FormulaInputs &in, const std::vector<float*> &bandData,
+                              float *out, size_t count, float nodata);
+
+#define DDB_RATIO_OP(Name, Num, Den)                                                   \
+    struct Name {                                                                      \
+        static inline float num(float R, float G, float B, float N, float Re) {        \
+            (void)R; (void)G; (void)B; (void)N; (void)Re;                              \
+            return Num;                                                                \
+        }                                                                              \
+        static inline float den(float R, float G, float B, float N, float Re) {        \
+            (void)R; (void)G; (void)B; (void)N; (void)Re;                              \
+            return Den;                                                                \
+        }                                                                              \
+    };
+
+DDB_RATIO_OP(NdviOp, N - R, N + R)
+DDB_RATIO_OP(VariOp, G - R, G + R - B)
+DDB_RATIO_OP(GliOp, (G * 2.0f) - R - B, (G * 2.0f) + R + B)
+DDB_RATIO_OP(NdwiOp, G - N, G + N)
+DDB_RATIO_OP(GndviOp, N - G, N + G)
+DDB_RATIO_OP(SaviOp, 1.5f * (N - R), N + R + 0.5f)
+DDB_RATIO_OP(EviOp, 2.5f * (N - R), N + 6.0f * R - 7.5f * B + 1.0f)
+DDB_RATIO_OP(NdreOp, N - Re, N + Re)
+DDB_RATIO_OP(NdyiOp, G - B, G + B)
+DDB_RATIO_OP(MpriOp, G - R, G + R)
+DDB_RATIO_OP(OsaviOp, N - R, N + R + 0.16f)
+DDB_RATIO_OP(GrviOp, N, G)
+DDB_RATIO_OP(EndviOp, (N + G) - (2.0f * B), (N + G) + (2.0f * B))
+DDB_RATIO_OP(ArviOp, N - (2.0f * R) + B, N + (2.0f * R) + B)
+
+#undef DDB_RATIO_OP
+
+// Overwrites out[i] with nodata wherever a present source band is nodata.
+// extra(i) adds formula-specific invalid conditions.
+template <typename Extra>
+inline void applyNodataMask(const FormulaInputs &in, float *out, size_t count, float nodata, Extra extra) {
+    const float *pR = in.R, *pG = in.G, *pB = in.B, *pN = in.N, *pRe = in.Re;
+    const bool hR = in.hasR, hG = in.hasG, hB = in.hasB, hN = in.hasN, hRe = in.hasRe;
+
+    for (size_t i = 0; i < count; i++) {
+        const bool masked = (hR & (pR[i] == nodata)) | (hG & (pG[i] == nodata)) | (hB & (pB[i] == nodata)) |
+                            (hN & (pN[i] == nodata)) | (hRe & (pRe[i] == nodata)) | extra(i);
+        out[i] = masked ? nodata : out[i];
+    }
+}
+
+// num / den, nodata where any source band is nodata or |den| < EPS.
+// The quotient and the mask are separate passes: a division guarded by a select is not
+// if-converted by GCC under the default -ftrapping-math, which would keep the loop scalar.
+template <typename Op>
+void ratioKernel(const FormulaInputs &in, const std::vector<float*> &, float *out, size_t count, float nodata) {
+    for (size_t start = 0; start < count; start += KernelBlockSize) {
+        const size_t n = std::min(KernelBlockSize, count - start);
+        const float *R = in.R + start, *G = in.G + start, *B = in.B + start, *N = in.N + start, *Re = in.Re + start;
+        float *o = out + start;
+
+        for (size_t i = 0; i < n; i++)
+            o[i] = Op::num(R[i], G[i], B[i], N[i], Re[i]) / Op::den(R[i], G[i], B[i], N[i], Re[i]);
+
+        FormulaInputs block = in;
+        block.R = R; block.G = G; block.B = B; block.N = N; block.Re = Re;
+        applyNodataMask(block, o, n, nodata, [&](size_t i) {
+            return std::abs(Op::den(R[i], G[i], B[i], N[i], Re[i])) < EPS;
+        });
+    }
+}
+
+void exgKernel(const FormulaInputs &in, const std::vector<float*> &, float *out, size_t count, float nodata) {
+    for (size_t i = 0; i < count; i++)
+        out[i] = (2.0f * in.G[i]) - (in.R[i] + in.B[i]);
+
+    applyNodataMask(in, out, count, nodata, [](size_t) { return false; });
+}
+
+// pow() does not vectorize portably; only the mask pass is branch-free here
+void vndviKernel(const FormulaInputs &in, const std::vector<float*> &, float *out, size_t count, float nodata) {
+    const float *R = in.R, *G = in.G, *B = in.B;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (R[i] > EPS && G[i] > EPS && B[i] > EPS)
+                     ? 0.5268f * std::pow(R[i], -0.1294f) * std::pow(G[i], 0.3389f) * std::pow(B[i], -0.3118f)
+                     : nodata;
+    }
+
+    applyNodataMask(in, out, count, nodata, [](size_t) { return false; });
+}
+
+// Thermal formulas read band 0 directly, independently of the band filter
+template <int OffsetCentiK>
+void thermalKernel(const FormulaInputs &in, const std::vector<float*> &bandData, float *out, size_t count, float nodata) {
+    const float offset = OffsetCentiK / 100.0f;
+    const float *t = (bandData.size() > 0) ? bandData[0] : nullptr;
+    if (t == nullptr) {
+        std::fill(out, out + count, nodata);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        out[i] = t[i] + offset;
+
+    applyNodataMask(in, out, count, nodata, [t, nodata](size_t i) { return t[i] == nodata; });
+}
+
+FormulaKernel resolveKernel(const std::string &id) {
+    static const std::map<std::string, FormulaKernel> kernels = {
+        {"NDVI", &ratioKernel<NdviOp>},
+        {"VARI", &ratioKernel<VariOp>},
+        {"EXG", &exgKernel},
+        {"GLI", &ratioKernel<GliOp>},
+        {"vNDVI", &vndviKernel},
+        {"NDWI", &ratioKernel<NdwiOp>},
+        {"GNDVI", &ratioKernel<GndviOp>},
+        {"SAVI", &ratioKernel<SaviOp>},
+        {"EVI", &ratioKernel<EviOp>},
+        {"NDRE", &ratioKernel<NdreOp>},
+        {"NDYI", &ratioKernel<NdyiOp>},
+        {"MPRI", &ratioKernel<MpriOp>},
+        {"OSAVI", &ratioKernel<OsaviOp>},
+        {"GRVI", &ratioKernel<GrviOp>},
+        {"ENDVI", &ratioKernel<EndviOp>},
+        {"ARVI", &ratioKernel<ArviOp>},
+        {"CELSIUS", &thermalKernel<0>},
+        {"KELVIN", &thermalKernel<27315>},
+    };
+
+    const auto it = kernels.find(id);
+    return it != kernels.end() ? it->second : nullptr;
+}
+
+} // namespace
+
 void VegetationEngine::applyFormula(const VegetationFormula &formula,
                                      const BandFilter &filter,
                                      const std::vector<float*> &bandData,
                                      float *outData,
                                      size_t pixelCount,
                                      float nodata) const {
-    const float EPS = 1e-10f;
-    const std::string &id = formula.id;
+    const FormulaKernel kernel = resolveKernel(formula.id);
+    if (kernel == nullptr) {
+        // Custom formula: evaluate its expression
+        if (formula.expr.empty()) {
+            std::fill(outData, outData + pixelCount, nodata);
+            return;
+        }
+        getProgram(formula)->evaluate(filter, bandData, outData, pixelCount, nodata);
+        return;
+    }
 
     // Get band data pointers by symbol
     // bandData indices match the raster band order (0-based)
@@ -228,100 +420,125 @@ void VegetationEngine::applyFormula(const VegetationFormula &formula,
         return bandData[idx];
     };
 
-    const float *pR = getBand('R');
-    const float *pG = getBand('G');
-    const float *pB = getBand('B');
-    const float *pN = getBand('N');
-    const float *pRe = getBand('e');
-
-    for (size_t i = 0; i < pixelCount; i++) {
-        float R = pR ? pR[i] : 0;
-        float G = pG ? pG[i] : 0;
-        float B = pB ? pB[i] : 0;
-        float N = pN ? pN[i] : 0;
-        float Re = pRe ? pRe[i] : 0;
-
-        // Check nodata on any source band used
-        bool isNodata = false;
-        if (pR && R == nodata) isNodata = true;
-        if (pG && G == nodata) isNodata = true;
-        if (pB && B == nodata) isNodata = true;
-        if (pN && N == nodata) isNodata = true;
-        if (pRe && Re == nodata) isNodata = true;
-
-        if (isNodata) {
-            outData[i] = nodata;
-            continue;
+    FormulaInputs in;
+    in.R = getBand('R');
+    in.G = getBand('G');
+    in.B = getBand('B');
+    in.N = getBand('N');
+    in.Re = getBand('e');
+    in.hasR = in.R != nullptr;
+    in.hasG = in.G != nullptr;
+    in.hasB = in.B != nullptr;
+    in.hasN = in.N != nullptr;
+    in.hasRe = in.Re != nullptr;
+
+    // Missing bands read as 0 and are excluded from the nodata mask
+    std::vector<float> zeros;
+    if (!in.hasR || !in.hasG || !in.hasB || !in.hasN || !in.hasRe) {
+        zeros.assign(pixelCount, 0.0f);
+        if (!in.hasR) in.R = zeros.data();
+        if (!in.hasG) in.G = zeros.data();
+        if (!in.hasB) in.B = zeros.data();
+        if (!in.hasN) in.N = zeros.data();
+        if (!in.hasRe) in.Re = zeros.data();
+    }
+
+    kernel(in, bandData, outData, pixelCount, nodata);
+}
+
+VegetationFormula VegetationEngine::prepareFormula(const VegetationFormula &formula,
+                                                   std::shared_ptr<const BandMathProgram> &program) const {
+    if (formula.id.empty())
+        throw InvalidArgsException("Formula id cannot be empty");
+    if (resolveKernel(formula.id) != nullptr)
+        throw InvalidArgsException("Cannot override built-in formula: " + formula.id);
+
+    VegetationFormula f = formula;
+    program = std::make_shared<const BandMathProgram>(BandMathProgram::compile(f.expr));
+    if (f.requiredBands.empty()) f.requiredBands = program->requiredBands();
+    if (f.name.empty()) f.name = f.id;
+    return f;
+}
+
+void VegetationEngine::addFormulas(const std::vector<std::pair<VegetationFormula, std::shared_ptr<const BandMathProgram>>> &formulas) {
+    std::unique_lock<std::shared_mutex> lock(formulasMutex_);
+    std::lock_guard<std::mutex> programsLock(programsMutex_);
+
+    for (const auto &p : formulas) {
+        auto entry = std::make_shared<const VegetationFormula>(p.first);
+        auto it = std::find_if(formulas_.begin(), formulas_.end(),
+            [&entry](const std::shared_ptr<const VegetationFormula> &existing) { return existing->id == entry->id; });
+        if (it != formulas_.end()) {
+            *it = entry;
+        } else {
+            formulas_.push_back(entry);
         }
+        programs_[entry->id] = p.second;
 
-        float result = nodata;
-
-        if (id == "NDVI") {
-            float denom = N + R;
-            result = (std::abs(denom) < EPS) ? nodata : (N - R) / denom;
-        } else if (id == "VARI") {
-            float denom = G + R - B;
-            result = (std::abs(denom) < EPS) ? nodata : (G - R) / denom;
-        } else if (id == "EXG") {
-            result = (2.0f * G) - (R + B);
-        } else if (id == "GLI") {
-            float denom = (G * 2.0f) + R + B;
-            result = (std::abs(denom) < EPS) ? nodata : ((G * 2.0f) - R - B) / denom;
-        } else if (id == "vNDVI") {
-            if (R > EPS && G > EPS && B > EPS) {
-                result = 0.5268f * std::pow(R, -0.1294f) * std::pow(G, 0.3389f) * std::pow(B, -0.3118f);
-            } else {
-                result = nodata;
-            }
-        } else if (id == "NDWI") {
-            float denom = G + N;
-            result = (std::abs(denom) < EPS) ? nodata : (G - N) / denom;
-        } else if (id == "GNDVI") {
-            float denom = N + G;
-            result = (std::abs(denom) < EPS) ? nodata : (N - G) / denom;
-        } else if (id == "SAVI") {
-            float denom = N + R + 0.5f;
-            result = (std::abs(denom) < EPS) ? nodata : (1.5f * (N - R)) / denom;
-        } else if (id == "EVI") {
-            float denom = N + 6.0f * R - 7.5f * B + 1.0f;
-            result = (std::abs(denom) < EPS) ? nodata : 2.5f * (N - R) / denom;
-        } else if (id == "NDRE") {
-            float denom = N + Re;
-            result = (std::abs(denom) < EPS) ? nodata : (N - Re) / denom;
-        } else if (id == "NDYI") {
-            float denom = G + B;
-            result = (std::abs(denom) < EPS) ? nodata : (G - B) / denom;
-        } else if (id == "MPRI") {
-            float denom = G + R;
-            result = (std::abs(denom) < EPS) ? nodata : (G - R) / denom;
-        } else if (id == "OSAVI") {
-            float denom = N + R + 0.16f;
-            result = (std::abs(denom) < EPS) ? nodata : (N - R) / denom;
-        } else if (id == "GRVI") {
-            result = (std::abs(G) < EPS) ? nodata : N / G;
-        } else if (id == "ENDVI") {
-            float denom = (N + G) + (2.0f * B);
-            result = (std::abs(denom) < EPS) ? nodata : ((N + G) - (2.0f * B)) / denom;
-        } else if (id == "ARVI") {
-            float denom = N + (2.0f * R) + B;
-            result = (std::abs(denom) < EPS) ? nodata : (N - (2.0f * R) + B) / denom;
-        } else if (id == "CELSIUS") {
-            // Thermal passthrough: pixel value is already temperature in °C
-            // For single-band thermal rasters, use band index 0 directly
-            if (bandData.size() > 0 && bandData[0] != nullptr) {
-                float val = bandData[0][i];
-                result = (val == nodata) ? nodata : val;
-            }
-        } else if (id == "KELVIN") {
-            // Convert Celsius to Kelvin
-            if (bandData.size() > 0 && bandData[0] != nullptr) {
-                float val = bandData[0][i];
-                result = (val == nodata) ? nodata : val + 273.15f;
-            }
+        LOGD << "Registered formula " << entry->id << ": " << entry->expr;
+    }
+}
+
+void VegetationEngine::registerFormula(const VegetationFormula &formula) {
+    std::shared_ptr<const BandMathProgram> program;
+    VegetationFormula f = prepareFormula(formula, program);
+    addFormulas({{std::move(f), program}});
+}
+
+bool VegetationEngine::unregisterFormula(const std::string &id) {
+    if (resolveKernel(id) != nullptr)
+        throw InvalidArgsException("Cannot remove built-in formula: " + id);
+
+    std::unique_lock<std::shared_mutex> lock(formulasMutex_);
+    auto it = std::find_if(formulas_.begin(), formulas_.end(),
+        [&id](const std::shared_ptr<const VegetationFormula> &existing) { return existing->id == id; });
+    if (it == formulas_.end()) return false;
+
+    formulas_.erase(it);
+    {
+        std::lock_guard<std::mutex> programsLock(programsMutex_);
+        programs_.erase(id);
+    }
+    LOGD << "Unregistered formula " << id;
+    return true;
+}
+
+void VegetationEngine::loadFormulas(const std::string &jsonStr) {
+    json root = json::parse(jsonStr);
+    if (!root.contains("formulas")) return;
+
+    // Everything is validated before anything is registered
+    std::vector<std::pair<VegetationFormula, std::shared_ptr<const BandMathProgram>>> formulas;
+    for (const auto &fj : root["formulas"]) {
+        VegetationFormula f;
+        f.id = fj.value("id", "");
+        f.name = fj.value("name", "");
+        f.expr = fj.value("expr", "");
+        f.help = fj.value("help", "");
+        f.requiredBands = fj.value("requiredBands", "");
+        if (fj.contains("min") && fj.contains("max")) {
+            f.rangeMin = fj.at("min").get<double>();
+            f.rangeMax = fj.at("max").get<double>();
+            f.hasRange = true;
         }
 
-        outData[i] = result;
+        std::shared_ptr<const BandMathProgram> program;
+        f = prepareFormula(f, program);
+        formulas.emplace_back(std::move(f), program);
     }
+
+    addFormulas(formulas);
+}
+
+std::shared_ptr<const BandMathProgram> VegetationEngine::getProgram(const VegetationFormula &formula) const {
+    {
+        std::lock_guard<std::mutex> lock(programsMutex_);
+        auto it = programs_.find(formula.id);
+        if (it != programs_.end() && it->second->expression() == formula.expr) return it->second;
+    }
+
+    // Held by the caller after being replaced or unregistered
+    return std::make_shared<const BandMathProgram>(BandMathProgram::compile(formula.expr));
 }
 
 void VegetationEngine::applyColormap(const float *values,
@@ -333,25 +550,38 @@ void VegetationEngine::applyColormap(const float *values,
     float range = vmax - vmin;
     if (std::abs(range) < 1e-10f) range = 1.0f;
 
-    for (size_t i = 0; i < pixelCount; i++) {
-        float v = values[i];
-        if (v == nodata || std::isnan(v)) {
-            rgba[i * 4 + 0] = 0;
-            rgba[i * 4 + 1] = 0;
-            rgba[i * 4 + 2] = 0;
-            rgba[i * 4 + 3] = 0; // transparent
-            continue;
+    // Packed RGBA lookup table; slot 256 is the transparent nodata color
+    uint32_t lut[257];
+    for (int i = 0; i < 256; i++) {
+        const uint8_t px[4] = {cmap.entries[i].r, cmap.entries[i].g, cmap.entries[i].b, cmap.entries[i].a};
+        std::memcpy(&lut[i], px, 4);
+    }
+    lut[256] = 0;
+
+    // The division runs as its own pass so it vectorizes (see ratioKernel); blocks keep
+    // the intermediate buffers in L1 for the clamp and LUT gather passes
+    const size_t BlockSize = 1024;
+    float normalized[BlockSize];
+    int32_t idx[BlockSize];
+
+    for (size_t start = 0; start < pixelCount; start += BlockSize) {
+        const size_t n = std::min(BlockSize, pixelCount - start);
+        const float *v = values + start;
+
+        for (size_t i = 0; i < n; i++)
+            normalized[i] = (v[i] - vmin) / range;
+
+        for (size_t i = 0; i < n; i++) {
+            const float x = v[i];
+            const bool masked = (x == nodata) | (x != x); // x != x: NaN
+            const float clamped = std::max(0.0f, std::min(1.0f, normalized[i]));
+            const int32_t k = static_cast<int32_t>(clamped * 255.0f);
+            idx[i] = masked ? 256 : k;
         }
 
-        float normalized = (v - vmin) / range;
-        normalized = std::max(0.0f, std::min(1.0f, normalized));
-        int idx = static_cast<int>(normalized * 255.0f);
-        idx = std::max(0, std::min(255, idx));
-
-        rgba[i * 4 + 0] = cmap.entries[idx].r;
-        rgba[i * 4 + 1] = cmap.entries[idx].g;
-        rgba[i * 4 + 2] = cmap.entries[idx].b;
-        rgba[i * 4 + 3] = cmap.entries[idx].a;
+        uint8_t *dst = rgba + start * 4;
+        for (size_t i = 0; i < n; i++)
+            std::memcpy(dst + i * 4, &lut[idx[i]], 4);
     }
 }
 
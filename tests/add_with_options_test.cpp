@@ -85,4 +85,51 @@ TEST(addToIndexEx, completenessContractAcrossCalls) {
     EXPECT_TRUE(second.errors.empty());
 }
 
+// A parallel COMPUTE phase (jobs > 1) with small commit batches must produce the same result as
+// the serial path, in input order.
+TEST(addToIndexEx, parallelComputePreservesOrder) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = ta.getFolder("ds");
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 40; i++) {
+        const auto name = "file" + std::to_string(100 + i) + ".txt";
+        fileWriteAllText(root / name, "content " + std::to_string(i));
+        paths.push_back((root / name).string());
+    }
+
+    initIndex(root.string());
+    auto db = ddb::open(root.string(), true);
+
+    AddOptions opts;
+    opts.stopOnError = false;
+    opts.jobs = 4;
+    opts.commitBatchSize = 7;
+
+    std::vector<std::string> callbackOrder;
+    AddResult result;
+    addToIndexEx(db.get(), paths, opts, result, [&callbackOrder](const Entry &e, bool) {
+        callbackOrder.push_back(e.path);
+        return true;
+    });
+
+    ASSERT_EQ(result.entries.size(), paths.size());
+    EXPECT_TRUE(result.errors.empty());
+    for (size_t i = 0; i < paths.size(); i++) {
+        const auto expected = "file" + std::to_string(100 + i) + ".txt";
+        EXPECT_EQ(result.entries[i].first.path, expected);
+        EXPECT_EQ(callbackOrder[i], expected);
+    }
+
+    auto q = db->query("SELECT COUNT(*) FROM entries");
+    q->fetch();
+    EXPECT_EQ(q->getInt(0), 40);
+
+    // Second pass finds everything unchanged
+    AddResult second;
+    addToIndexEx(db.get(), paths, opts, second);
+    EXPECT_TRUE(second.entries.empty());
+    EXPECT_EQ(second.unchanged.size(), paths.size());
+}
+
 } // namespace
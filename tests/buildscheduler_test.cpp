@@ -0,0 +1,140 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "buildscheduler.h"
+#include "exceptions.h"
+#include "gtest/gtest.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    BuildJob makeJob(const std::string &path, EntryType type, std::uintmax_t size, const std::string &target = "")
+    {
+        BuildJob job;
+        job.entry.path = path;
+        job.entry.type = type;
+        job.entry.size = size;
+        job.target = target.empty() ? path : target;
+        return job;
+    }
+
+    void updateMax(std::atomic<int> &max, int value)
+    {
+        int current = max;
+        while (value > current && !max.compare_exchange_weak(current, value))
+            ;
+    }
+
+    TEST(buildScheduler, respectsClassLimits)
+    {
+        TestArea ta(TEST_NAME, true);
+        BuildOptions options;
+        options.jobs = 0;
+
+        BuildScheduler scheduler(options, ta.getFolder());
+        scheduler.setBudget(64, 1024 * 1024);
+        for (int i = 0; i < 4; i++)
+        {
+            scheduler.add(makeJob("model" + std::to_string(i) + ".obj", Model, 10));
+            scheduler.add(makeJob("vector" + std::to_string(i) + ".geojson", Vector, 10));
+        }
+
+        std::atomic<int> models{0}, maxModels{0}, running{0}, maxRunning{0};
+        EXPECT_TRUE(scheduler.run([&](const BuildJob &job)
+                                  {
+            updateMax(maxRunning, ++running);
+            if (job.entry.type == Model)
+                updateMax(maxModels, ++models);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            if (job.entry.type == Model)
+                models--;
+            running--; }));
+
+        EXPECT_EQ(maxModels, 1);
+        EXPECT_GT(maxRunning, 1);
+    }
+
+    TEST(buildScheduler, serializesSameTarget)
+    {
+        TestArea ta(TEST_NAME, true);
+        BuildOptions options;
+        options.jobs = 4;
+
+        BuildScheduler scheduler(options, ta.getFolder());
+        scheduler.setBudget(64, 1024 * 1024);
+        for (int i = 0; i < 6; i++)
+            scheduler.add(makeJob("file" + std::to_string(i) + ".shp", Vector, 100, "samehash"));
+
+        std::atomic<int> running{0}, maxRunning{0};
+        BuildProgress last;
+        EXPECT_TRUE(scheduler.run([&](const BuildJob &job)
+                                  {
+            updateMax(maxRunning, ++running);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            running--;
+            if (job.entry.path == "file2.shp")
+                throw AppException("Build failed"); },
+                                  [&](const BuildProgress &p)
+                                  {
+            last = p;
+            return true; }));
+
+        EXPECT_EQ(maxRunning, 1);
+        EXPECT_EQ(last.total, 6u);
+        EXPECT_EQ(last.completed, 6u);
+        EXPECT_EQ(last.failed, 1u);
+        EXPECT_EQ(last.eta, 0.0);
+    }
+
+    TEST(buildScheduler, cancel)
+    {
+        TestArea ta(TEST_NAME, true);
+        BuildOptions options;
+        options.jobs = 2;
+
+        BuildScheduler scheduler(options, ta.getFolder());
+        for (int i = 0; i < 20; i++)
+            scheduler.add(makeJob("file" + std::to_string(i) + ".geojson", Vector, 1));
+
+        std::atomic<int> built{0};
+        EXPECT_FALSE(scheduler.run([&](const BuildJob &)
+                                   {
+            built++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5)); },
+                                   [](const BuildProgress &p)
+                                   { return p.completed < 3; }));
+
+        EXPECT_LT(built, 20);
+    }
+
+    TEST(buildScheduler, order)
+    {
+        TestArea ta(TEST_NAME, true);
+        BuildOptions options;
+        options.order = BuildOrder::SmallestFirst;
+        options.priority = {"big.tif"};
+
+        BuildScheduler scheduler(options, ta.getFolder());
+        scheduler.add(makeJob("big.tif", GeoRaster, 1000));
+        scheduler.add(makeJob("medium.tif", GeoRaster, 500));
+        scheduler.add(makeJob("small.tif", GeoRaster, 1));
+
+        std::vector<std::string> built;
+        EXPECT_TRUE(scheduler.run([&](const BuildJob &job)
+                                  { built.push_back(job.entry.path); }));
+
+        EXPECT_EQ(built, std::vector<std::string>({"big.tif", "small.tif", "medium.tif"}));
+    }
+
+} // namespace
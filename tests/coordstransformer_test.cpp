@@ -0,0 +1,88 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "coordstransformer.h"
+#include "exceptions.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    TEST(coordsTransformer, batchMatchesSinglePoint)
+    {
+        std::vector<double> xs, ys;
+        for (int i = 0; i < 100; i++)
+        {
+            xs.push_back(-91.99 + i * 0.001);
+            ys.push_back(46.84 + i * 0.001);
+        }
+
+        std::vector<double> bx = xs, by = ys;
+        {
+            CoordsTransformer ct(4326, 3857);
+            ct.transform(bx.size(), bx.data(), by.data());
+        }
+
+        // Second instance comes from the cache
+        CoordsTransformer ct(4326, 3857);
+        for (size_t i = 0; i < xs.size(); i++)
+        {
+            double x = xs[i], y = ys[i];
+            ct.transform(&x, &y);
+            EXPECT_DOUBLE_EQ(bx[i], x);
+            EXPECT_DOUBLE_EQ(by[i], y);
+        }
+
+        EXPECT_NEAR(bx[0], -10240279.96, 1E-2);
+    }
+
+    TEST(coordsTransformer, reportsFailedPoints)
+    {
+        CoordsTransformer ct("EPSG:4326", "EPSG:32615");
+
+        double xs[2] = {-91.99321949277439, -91.99321949277439};
+        double ys[2] = {46.842979268105516, 1000};
+        int success[2];
+        EXPECT_EQ(ct.transform(2, xs, ys, nullptr, success), 1);
+        EXPECT_TRUE(success[0]);
+        EXPECT_FALSE(success[1]);
+        EXPECT_NEAR(xs[0], 576764.77, 1E-2);
+
+        EXPECT_THROW(ct.transform(2, xs, ys), GDALException);
+        EXPECT_THROW(CoordsTransformer("EPSG:4326", "invalid"), GDALException);
+    }
+
+    TEST(coordsTransformer, concurrentUse)
+    {
+        std::vector<std::thread> threads;
+        std::vector<int> failures(8, 0);
+        for (int t = 0; t < 8; t++)
+        {
+            threads.emplace_back([t, &failures]()
+                                 {
+                for (int i = 0; i < 50; i++)
+                {
+                    CoordsTransformer ct(4326, 3857);
+                    double x = 0, y = 0;
+                    ct.transform(&x, &y);
+                    if (std::abs(x) > 1E-6 || std::abs(y) > 1E-6)
+                        failures[t]++;
+                } });
+        }
+        for (auto &t : threads)
+            t.join();
+
+        for (int f : failures)
+            EXPECT_EQ(f, 0);
+
+        clearCoordsTransformerCache();
+    }
+
+}
@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <pdal/Options.hpp>
+#include <pdal/PointTable.hpp>
+#include <pdal/io/CopcReader.hpp>
+
+#include "copcsource.h"
+#include "pointcloud.h"
+#include "gtest/gtest.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    size_t pdalPointCount(const std::string &copcPath, double minX, double minY, double maxX, double maxY, double resolution)
+    {
+        std::stringstream ss;
+        ss << std::setprecision(14) << "([" << minX << "," << maxX << "],[" << minY << "," << maxY << "])";
+
+        pdal::Options opts;
+        opts.add("filename", copcPath);
+        opts.add("bounds", ss.str());
+        opts.add("resolution", resolution);
+
+        pdal::CopcReader reader;
+        reader.setOptions(opts);
+        pdal::PointTable table;
+        reader.prepare(table);
+        auto views = reader.execute(table);
+        return (*views.begin())->size();
+    }
+
+    TEST(copcSource, matchesCopcReader)
+    {
+        TestArea ta(TEST_NAME);
+        fs::path pc = ta.downloadTestAsset(
+            "https://github.com/DroneDB/test_data/raw/master/brighton/point_cloud.laz",
+            "point_cloud.laz");
+
+        buildCopc({pc.string()}, ta.getFolder("copc").string());
+        const std::string copcPath = (ta.getFolder("copc") / "cloud.copc.laz").string();
+
+        clearCopcCache();
+        auto source = CopcSource::open(copcPath);
+        EXPECT_EQ(CopcSource::open(copcPath), source);
+
+        PointCloudInfo info;
+        ASSERT_TRUE(source->getInfo(info, 4326));
+        ASSERT_EQ(info.bounds.size(), 6);
+
+        // Whole cloud
+        CopcPoints all;
+        source->read(info.bounds[0], info.bounds[1], info.bounds[3], info.bounds[4], 0, all);
+        EXPECT_EQ(all.size(), info.pointCount);
+
+        // A quarter, at a coarse resolution
+        const double midX = (info.bounds[0] + info.bounds[3]) / 2.0;
+        const double midY = (info.bounds[1] + info.bounds[4]) / 2.0;
+        const double resolution = source->getSpacing() / 2.0;
+
+        CopcPoints quarter;
+        source->read(info.bounds[0], info.bounds[1], midX, midY, resolution, quarter);
+        EXPECT_EQ(quarter.size(), pdalPointCount(copcPath, info.bounds[0], info.bounds[1], midX, midY, resolution));
+        EXPECT_GT(quarter.size(), 0);
+        EXPECT_LT(quarter.size(), all.size());
+
+        // Decoded chunks are reused
+        const auto before = getCopcCacheStats();
+        CopcPoints again;
+        source->read(info.bounds[0], info.bounds[1], midX, midY, resolution, again);
+        EXPECT_EQ(again.size(), quarter.size());
+        EXPECT_EQ(getCopcCacheStats().misses, before.misses);
+        EXPECT_GT(getCopcCacheStats().hits, before.hits);
+
+        clearCopcCache();
+    }
+
+} // namespace
@@ -0,0 +1,70 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "dbops.h"
+#include "dbpool.h"
+#include "gtest/gtest.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    TEST(databasePool, disabledByDefault)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder().string());
+
+        ASSERT_FALSE(isDatabasePoolEnabled());
+        {
+            auto db = openPooled(ta.getFolder().string(), false);
+            EXPECT_TRUE(db != nullptr);
+        }
+
+        EXPECT_EQ(getDatabasePoolStats().idle, 0);
+    }
+
+    TEST(databasePool, reusesConnections)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder().string());
+
+        setDatabasePoolEnabled(true);
+
+        Database *first;
+        {
+            auto db = openPooled(ta.getFolder().string(), false);
+            first = db.get();
+
+            // Leased connections are never shared
+            auto other = openPooled(ta.getFolder().string(), false);
+            EXPECT_NE(other.get(), first);
+        }
+
+        auto stats = getDatabasePoolStats();
+        EXPECT_EQ(stats.misses, 2);
+        EXPECT_EQ(stats.idle, 2);
+
+        {
+            auto db = openPooled(ta.getFolder().string(), false);
+            EXPECT_TRUE(db->getMetaManager() != nullptr);
+            EXPECT_EQ(getDatabasePoolStats().hits, 1);
+        }
+
+        closePooledDatabases();
+        EXPECT_EQ(getDatabasePoolStats().idle, 0);
+
+        // Released after a close: not returned to the pool
+        {
+            auto db = openPooled(ta.getFolder().string(), false);
+            closePooledDatabases();
+        }
+        EXPECT_EQ(getDatabasePoolStats().idle, 0);
+
+        setDatabasePoolEnabled(false);
+    }
+
+} // namespace
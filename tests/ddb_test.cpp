@@ -4,6 +4,7 @@
 
 #include "gtest/gtest.h"
 #include "dbops.h"
+#include "ddb.h"
 #include "exceptions.h"
 #include "metamanager.h"
 #include "test.h"
@@ -594,6 +595,112 @@ namespace
         EXPECT_EQ(out.str(), "pics/pics2/IMG_20160826_181305.jpg\npics/pics2/IMG_20160826_181309.jpg\n");
     }
 
+    TEST(listIndex, pagedStreaming)
+    {
+        TestArea ta(TEST_NAME);
+
+        const auto sqlite = ta.downloadTestAsset("https://github.com/DroneDB/test_data/raw/master/ddb-remove-test/.ddb/dbase.sqlite", DDB_DATABASE_FILE);
+
+        const auto testFolder = ta.getFolder("test");
+        create_directory(testFolder / ".ddb");
+        fs::copy(sqlite.string(), testFolder / ".ddb", fs::copy_options::overwrite_existing);
+
+        auto db = ddb::open(testFolder.string(), false);
+
+        MetaManager manager(db.get());
+        manager.add("tags", "first", "pics.JPG", testFolder.string());
+        manager.add("tags", "second", "pics.JPG", testFolder.string());
+        manager.set("note", R"({"a": [1, 2]})", "pics.JPG", testFolder.string());
+        manager.set("name", "dataset", "", testFolder.string());
+
+        const std::vector<std::string> toList = {(testFolder / "*").string()};
+
+        std::ostringstream all;
+        EXPECT_EQ(listIndex(db.get(), toList, all, "json", true), "");
+        const auto entries = json::parse(all.str());
+        ASSERT_EQ(entries.size(), 24);
+
+        // Same fields as Entry::toJSON, one row per entry even with several meta
+        for (const auto &e : entries)
+        {
+            const auto matches = getMatchingEntries(db.get(), e["path"].get<std::string>());
+            ASSERT_EQ(matches.size(), 1);
+            json expected;
+            matches[0].toJSON(expected);
+            EXPECT_EQ(e, expected);
+        }
+        EXPECT_EQ(entries[3]["path"], "pics.JPG");
+        EXPECT_EQ(entries[3]["meta"]["tags"].size(), 2);
+        EXPECT_EQ(entries[3]["meta"]["note"]["data"]["a"][1], 2);
+
+        // Pages continue from the last path of the previous one
+        json paged = json::array();
+        std::string after;
+        int pages = 0;
+        do
+        {
+            std::ostringstream out;
+            after = listIndex(db.get(), toList, out, "json", true, 0, after, 5);
+            for (const auto &e : json::parse(out.str()))
+                paged.push_back(e);
+            pages++;
+        } while (!after.empty());
+
+        EXPECT_EQ(pages, 5);
+        EXPECT_EQ(paged, entries);
+    }
+
+    TEST(listIndex, pagedCApi)
+    {
+        TestArea ta(TEST_NAME);
+
+        const auto sqlite = ta.downloadTestAsset("https://github.com/DroneDB/test_data/raw/master/ddb-remove-test/.ddb/dbase.sqlite", DDB_DATABASE_FILE);
+
+        const auto testFolder = ta.getFolder("test");
+        create_directory(testFolder / ".ddb");
+        fs::copy(sqlite.string(), testFolder / ".ddb", fs::copy_options::overwrite_existing);
+
+        const auto ddbPath = testFolder.string();
+        const auto pattern = (testFolder / "*").string();
+        const char *paths[] = {pattern.c_str()};
+
+        char *output = nullptr;
+        ASSERT_EQ(DDBList(ddbPath.c_str(), paths, 1, &output, "json", true, 0), DDBERR_NONE) << DDBGetLastError();
+        const auto entries = json::parse(output);
+        DDBFree(output);
+        ASSERT_EQ(entries.size(), 24);
+
+        // Each page continues from the token returned by the previous one,
+        // the last page returns an empty token
+        json paged = json::array();
+        std::string token;
+        int pages = 0;
+        do
+        {
+            char *nextToken = nullptr;
+            ASSERT_EQ(DDBListPage(ddbPath.c_str(), paths, 1, "json", true, 0, token.c_str(), 10, &output, &nextToken), DDBERR_NONE)
+                << DDBGetLastError();
+            const auto page = json::parse(output);
+            EXPECT_LE(page.size(), 10);
+            for (const auto &e : page)
+                paged.push_back(e);
+            token = nextToken;
+            DDBFree(output);
+            DDBFree(nextToken);
+            pages++;
+        } while (!token.empty() && pages < 10);
+
+        EXPECT_EQ(pages, 3);
+        EXPECT_TRUE(token.empty());
+        EXPECT_EQ(paged, entries);
+
+        // Tokens that don't round-trip are rejected
+        char *nextToken = nullptr;
+        EXPECT_EQ(DDBListPage(ddbPath.c_str(), paths, 1, "json", true, 0, "not a token!", 10, &output, &nextToken), DDBERR_EXCEPTION);
+        EXPECT_EQ(DDBListPage(ddbPath.c_str(), paths, 1, "json", true, 0, "cGljcy5KUEc", 10, &output, &nextToken), DDBERR_EXCEPTION);
+        EXPECT_EQ(DDBListPage(ddbPath.c_str(), paths, 1, "json", true, 0, "", 0, &output, &nextToken), DDBERR_EXCEPTION);
+    }
+
     TEST(listIndex, fileExactInSubFolderDetails)
     {
 
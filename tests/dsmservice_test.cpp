@@ -2,8 +2,14 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+#include <fstream>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "dsmservice.h"
+#include "gdal_inc.h"
+#include "test.h"
+#include "testarea.h"
 
 namespace
 {
@@ -22,4 +28,90 @@ namespace
         }
     }
 
+    // 4x4 DEM with z = base + col + 10 * row and a nodata pixel at (3, 3)
+    void createDEM(const fs::path &path, double originLon, double originLat, double pixelSize, float base = 0)
+    {
+        GDALDriverH drv = GDALGetDriverByName("GTiff");
+        GDALDatasetH hDs = GDALCreate(drv, path.string().c_str(), 4, 4, 1, GDT_Float32, nullptr);
+        ASSERT_NE(hDs, nullptr);
+
+        double gt[6] = {originLon, pixelSize, 0.0, originLat, 0.0, -pixelSize};
+        GDALSetGeoTransform(hDs, gt);
+
+        OGRSpatialReferenceH srs = OSRNewSpatialReference(nullptr);
+        OSRImportFromEPSG(srs, 4326);
+        char *wkt = nullptr;
+        OSRExportToWkt(srs, &wkt);
+        GDALSetProjection(hDs, wkt);
+        CPLFree(wkt);
+        OSRDestroySpatialReference(srs);
+
+        std::vector<float> data(16);
+        for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+                data[y * 4 + x] = base + static_cast<float>(x + 10 * y);
+        data[15] = -9999.0f;
+
+        GDALRasterBandH band = GDALGetRasterBand(hDs, 1);
+        GDALSetRasterNoDataValue(band, -9999.0);
+        GDALRasterIO(band, GF_Write, 0, 0, 4, 4, data.data(), 4, 4, GDT_Float32, 0, 0);
+        GDALClose(hDs);
+    }
+
+    TEST(dsmServiceAltitude, OverlappingDEMs)
+    {
+        TestArea ta(TEST_NAME);
+        const auto dir = ta.getFolder("dem");
+
+        // b covers the nodata corner of a
+        createDEM(dir / "a.tif", 10.0, 50.0, 0.25);
+        createDEM(dir / "b.tif", 10.75, 49.25, 0.25, 100);
+
+        auto *dsm = DSMService::get();
+        dsm->setDEMDirectory(dir);
+
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.125, 10.875), 100.0f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.875, 10.125), 0.0f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.125, 11.625), 103.0f);
+
+        dsm->setDEMDirectory("");
+    }
+
+    TEST(dsmServiceAltitude, LocalDEMDirectory)
+    {
+        TestArea ta(TEST_NAME);
+        const auto dir = ta.getFolder("dem");
+        create_directories(dir / "sub");
+
+        createDEM(dir / "a.tif", 10.0, 50.0, 0.25);
+        createDEM(dir / "sub" / "b.tif", 20.0, 50.0, 0.25);
+        std::ofstream(dir / "notes.txt") << "not a raster";
+
+        auto *dsm = DSMService::get();
+        dsm->setDEMDirectory(dir);
+
+        // Pixel centers
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.875, 10.125), 0.0f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.375, 10.625), 22.0f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.625, 20.375), 11.0f);
+
+        // Bilinear between centers, nearest next to nodata
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.75, 10.25), 5.5f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.15, 10.85), 0.0f);
+        EXPECT_FLOAT_EQ(dsm->getAltitude(49.3, 10.7), 22.0f);
+
+        // Outside of the DEMs, never from the network
+        EXPECT_FLOAT_EQ(dsm->getAltitude(0.0, 0.0), 0.0f);
+
+        const std::vector<double> lats = {49.875, 49.625, 10.0};
+        const std::vector<double> lons = {10.375, 20.125, 10.0};
+        std::vector<float> altitudes(lats.size());
+        dsm->getAltitudes(lats.size(), lats.data(), lons.data(), altitudes.data());
+        EXPECT_FLOAT_EQ(altitudes[0], 1.0f);
+        EXPECT_FLOAT_EQ(altitudes[1], 10.0f);
+        EXPECT_FLOAT_EQ(altitudes[2], 0.0f);
+
+        dsm->setDEMDirectory("");
+    }
+
 }
@@ -3,7 +3,9 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include "gtest/gtest.h"
+#include "dbops.h"
 #include "entry.h"
+#include "hash.h"
 #include "json.h"
 #include "test.h"
 #include "testarea.h"
@@ -38,6 +40,71 @@ namespace
         EXPECT_EQ(e.polygon_geom.size(), 2);
     }
 
+    TEST(parseBlobGeometries, Normal)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder().string());
+        auto db = open(ta.getFolder().string(), false);
+
+        BasicPointGeometry point;
+        point.addPoint(175.403526123456, -41.066254987654, 12.5);
+        BasicPolygonGeometry polygon;
+        polygon.addPoint(9.0, 45.0, 1.0);
+        polygon.addPoint(9.001, 45.0, 2.0);
+        polygon.addPoint(9.001, 45.002, 3.0);
+        polygon.addPoint(9.0, 45.0, 1.0);
+
+        // Our BLOBs are read by SpatiaLite...
+        const auto pointBlob = point.toSpatialiteBlob();
+        const auto polygonBlob = polygon.toSpatialiteBlob();
+        auto q = db->query("SELECT ST_X(?1), ST_Y(?1), ST_Z(?1), ST_SRID(?1), ST_NumPoints(ST_ExteriorRing(?2)), MbrMaxY(?2), "
+                           "GeomFromText(?3, 4326), CompressGeometry(GeomFromText(?4, 4326)), GeomFromText('POLYGON((1 2, 3 4, 5 6, 1 2), (2 3, 3 3, 2 4, 2 3))', 4326)");
+        q->bind(1, pointBlob.data(), static_cast<int>(pointBlob.size()));
+        q->bind(2, polygonBlob.data(), static_cast<int>(polygonBlob.size()));
+        q->bind(3, point.toWkt());
+        q->bind(4, polygon.toWkt());
+        ASSERT_TRUE(q->fetch());
+        EXPECT_DOUBLE_EQ(q->getDouble(0), 175.403526123456);
+        EXPECT_DOUBLE_EQ(q->getDouble(1), -41.066254987654);
+        EXPECT_DOUBLE_EQ(q->getDouble(2), 12.5);
+        EXPECT_EQ(q->getInt(3), 4326);
+        EXPECT_EQ(q->getInt(4), 4);
+        EXPECT_DOUBLE_EQ(q->getDouble(5), 45.002);
+
+        // ...and theirs by us, compressed or not
+        Entry e;
+        e.parseGeometryBlobs(q->getBlob(6), q->getBlobSize(6), q->getBlob(7), q->getBlobSize(7));
+        ASSERT_EQ(e.point_geom.size(), 1);
+        EXPECT_NEAR(e.point_geom.getPoint(0).x, 175.403526, 1e-6); // WKT keeps 6 decimals
+        EXPECT_NEAR(e.point_geom.getPoint(0).z, 12.5, 1e-9);
+        ASSERT_EQ(e.polygon_geom.size(), 4);
+        for (int i = 0; i < 4; i++)
+        {
+            EXPECT_NEAR(e.polygon_geom.getPoint(i).x, polygon.points[i].x, 1e-6);
+            EXPECT_NEAR(e.polygon_geom.getPoint(i).y, polygon.points[i].y, 1e-6);
+            EXPECT_NEAR(e.polygon_geom.getPoint(i).z, polygon.points[i].z, 1e-6);
+        }
+
+        // Round trip is exact
+        BasicPolygonGeometry decoded;
+        ASSERT_TRUE(decoded.fromSpatialiteBlob(polygonBlob.data(), static_cast<int>(polygonBlob.size())));
+        ASSERT_EQ(decoded.size(), polygon.size());
+        for (int i = 0; i < polygon.size(); i++)
+        {
+            EXPECT_EQ(decoded.points[i].x, polygon.points[i].x);
+            EXPECT_EQ(decoded.points[i].y, polygon.points[i].y);
+            EXPECT_EQ(decoded.points[i].z, polygon.points[i].z);
+        }
+
+        // Wrong type, holes, truncated data and NULL leave the geometry empty
+        EXPECT_FALSE(decoded.fromSpatialiteBlob(pointBlob.data(), static_cast<int>(pointBlob.size())));
+        EXPECT_FALSE(decoded.fromSpatialiteBlob(q->getBlob(8), q->getBlobSize(8)));
+        EXPECT_FALSE(decoded.fromSpatialiteBlob(polygonBlob.data(), static_cast<int>(polygonBlob.size()) - 2));
+        EXPECT_FALSE(decoded.fromSpatialiteBlob(nullptr, 0));
+        EXPECT_TRUE(decoded.empty());
+        EXPECT_EQ(BasicPointGeometry().toSpatialiteBlob(), "");
+    }
+
     TEST(parseEntry, wro_EPSG2193)
     {
         TestArea ta(TEST_NAME);
@@ -443,4 +510,26 @@ namespace
         EXPECT_TRUE(entry.properties.contains("captureTime"));
     }
 
+    TEST(parseEntry, SinglePassMatchesHashAndMetadata)
+    {
+        // Hashing captures the file for EXIF parsing: the result must match a
+        // separate hash + fingerprint of the same file
+        TestArea ta(TEST_NAME);
+        fs::path imagePath = ta.downloadTestAsset(
+            "https://github.com/DroneDB/test_data/raw/refs/heads/master/images/DJI_0018.JPG",
+            "DJI_0018.JPG");
+
+        Entry withHash;
+        parseEntry(imagePath, ta.getFolder(), withHash, true);
+
+        Entry withoutHash;
+        parseEntry(imagePath, ta.getFolder(), withoutHash, false);
+
+        EXPECT_EQ(withHash.hash, Hash::fileSHA256(imagePath.string()));
+        EXPECT_EQ(withHash.type, EntryType::GeoImage);
+        EXPECT_EQ(withHash.type, withoutHash.type);
+        EXPECT_EQ(withHash.properties, withoutHash.properties);
+        EXPECT_EQ(withHash.point_geom.toWkt(), withoutHash.point_geom.toWkt());
+    }
+
 }
@@ -3,9 +3,12 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include <chrono>
+#include <fstream>
+#include <iterator>
 #include <numeric>
 #include "gtest/gtest.h"
 #include "entry.h"
+#include "exifreader.h"
 #include "test.h"
 #include "testarea.h"
 #include "logger.h"
@@ -259,4 +262,104 @@ namespace
         std::cout << "Has GPS: " << (!entry.point_geom.empty() ? "Yes" : "No") << std::endl;
         std::cout << "===========================\n" << std::endl;
     }
+
+    /**
+     * @brief The native JPEG reader extracts the same metadata as Exiv2.
+     */
+    TEST(exifOptimization, nativeReaderMatchesExiv2)
+    {
+        TestArea ta(TEST_NAME, true);
+
+        fs::path imagePath = ta.downloadTestAsset(
+            "https://github.com/DroneDB/test_data/raw/master/test-datasets/"
+            "drone_dataset_brighton_beach/DJI_0018.JPG",
+            "DJI_0018.JPG");
+
+        std::ifstream f(imagePath, std::ios::binary);
+        const std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+        JpegSegments segments;
+        ASSERT_TRUE(scanJpegSegments(data.data(), data.size(), segments));
+        ASSERT_NE(segments.exif, nullptr);
+
+        Exiv2::ExifData exifData;
+        EXPECT_TRUE(decodeExifIfds(segments.exif, segments.exifSize, exifData));
+
+        auto native = readJpegMetadata(data.data(), data.size());
+        ASSERT_NE(native, nullptr);
+
+        auto image = Exiv2::ImageFactory::open(imagePath.string());
+        image->readMetadata();
+        ExifParser exiv(image.get());
+
+        const auto nativeSize = native->extractImageSize();
+        const auto exivSize = exiv.extractImageSize();
+        EXPECT_EQ(nativeSize.width, exivSize.width);
+        EXPECT_EQ(nativeSize.height, exivSize.height);
+
+        EXPECT_EQ(native->extractMake(), exiv.extractMake());
+        EXPECT_EQ(native->extractModel(), exiv.extractModel());
+        EXPECT_EQ(native->extractCaptureTime(), exiv.extractCaptureTime());
+        EXPECT_EQ(native->extractImageOrientation(), exiv.extractImageOrientation());
+
+        GeoLocation nativeGeo, exivGeo;
+        ASSERT_TRUE(native->extractGeo(nativeGeo));
+        ASSERT_TRUE(exiv.extractGeo(exivGeo));
+        EXPECT_DOUBLE_EQ(nativeGeo.latitude, exivGeo.latitude);
+        EXPECT_DOUBLE_EQ(nativeGeo.longitude, exivGeo.longitude);
+        EXPECT_DOUBLE_EQ(nativeGeo.altitude, exivGeo.altitude);
+
+        CameraOrientation nativeOri, exivOri;
+        EXPECT_EQ(native->extractCameraOrientation(nativeOri), exiv.extractCameraOrientation(exivOri));
+        EXPECT_DOUBLE_EQ(nativeOri.pitch, exivOri.pitch);
+        EXPECT_DOUBLE_EQ(nativeOri.yaw, exivOri.yaw);
+        EXPECT_DOUBLE_EQ(nativeOri.roll, exivOri.roll);
+
+        Focal nativeFocal, exivFocal;
+        EXPECT_EQ(native->computeFocal(nativeFocal), exiv.computeFocal(exivFocal));
+        EXPECT_DOUBLE_EQ(nativeFocal.length, exivFocal.length);
+        EXPECT_DOUBLE_EQ(nativeFocal.length35, exivFocal.length35);
+
+        for (const auto &key : {"Xmp.drone-dji.RelativeAltitude", "Xmp.drone-dji.GimbalYawDegree", "Xmp.tiff.Make"})
+        {
+            auto n = native->findXmpKey(key);
+            auto e = exiv.findXmpKey(key);
+            ASSERT_EQ(n != native->xmpEnd(), e != exiv.xmpEnd()) << key;
+            if (n != native->xmpEnd())
+                EXPECT_EQ(n->toString(), e->toString()) << key;
+        }
+
+        // Truncated before the frame header: left to Exiv2
+        EXPECT_EQ(readJpegMetadata(data.data(), 64), nullptr);
+    }
+
+    TEST(exifOptimization, simpleXmpDecoding)
+    {
+        const std::string simple = R"(<x:xmpmeta xmlns:x="adobe:ns:meta/">
+<rdf:RDF xmlns:rdf="http://www.w3.org/1999/02/22-rdf-syntax-ns#">
+ <rdf:Description rdf:about="" xmlns:tiff="http://ns.adobe.com/tiff/1.0/"
+   xmlns:ddbtest="http://dronedb.app/test/1.0/" tiff:Make="A &amp; B" ddbtest:Altitude="+12.5">
+  <ddbtest:Name>first&#x20;second</ddbtest:Name>
+ </rdf:Description>
+</rdf:RDF>
+</x:xmpmeta>)";
+
+        Exiv2::XmpData xmpData;
+        ASSERT_TRUE(decodeSimpleXmp(simple.c_str(), simple.size(), xmpData));
+        EXPECT_EQ(xmpData.count(), 3);
+        EXPECT_EQ(xmpData["Xmp.tiff.Make"].toString(), "A & B");
+        EXPECT_EQ(xmpData["Xmp.ddbtest.Altitude"].toString(), "+12.5");
+        EXPECT_EQ(xmpData["Xmp.ddbtest.Name"].toString(), "first second");
+
+        // Arrays need the XMP toolkit
+        const std::string array = R"(<rdf:RDF xmlns:rdf="http://www.w3.org/1999/02/22-rdf-syntax-ns#">
+ <rdf:Description rdf:about="" xmlns:dc="http://purl.org/dc/elements/1.1/">
+  <dc:subject><rdf:Bag><rdf:li>a</rdf:li></rdf:Bag></dc:subject>
+ </rdf:Description>
+</rdf:RDF>)";
+
+        Exiv2::XmpData arrayData;
+        EXPECT_FALSE(decodeSimpleXmp(array.c_str(), array.size(), arrayData));
+        EXPECT_TRUE(arrayData.empty());
+    }
 }
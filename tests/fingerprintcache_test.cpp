@@ -0,0 +1,146 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "dbops.h"
+#include "fingerprintcache.h"
+#include "test.h"
+#include "testarea.h"
+
+#include <chrono>
+#include <fstream>
+
+namespace
+{
+
+    using namespace ddb;
+
+    // Creates a file whose mtime is old enough to be outside the racy window
+    fs::path createOldFile(const fs::path &p, const std::string &content)
+    {
+        std::ofstream(p.string(), std::ios::binary) << content;
+        fs::last_write_time(p, fs::last_write_time(p) - std::chrono::hours(1));
+        return p;
+    }
+
+    std::string getHash(Database *db, const std::string &path)
+    {
+        auto q = db->query("SELECT hash FROM entries WHERE path = ?");
+        q->bind(1, path);
+        return q->fetch() ? q->getText(0) : "";
+    }
+
+    TEST(fingerprintCache, addPopulatesCache)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto root = ta.getFolder("ds");
+        const auto file = createOldFile(root / "a.txt", "hello");
+
+        initIndex(root.string());
+        auto db = ddb::open(root.string(), true);
+        addToIndex(db.get(), {file.string()});
+
+        FileIdentity id;
+        ASSERT_TRUE(getFileIdentity(file, id));
+
+        FingerprintCache cache(db.get());
+        CachedFingerprint cached;
+        ASSERT_TRUE(cache.lookup(id, cached));
+        EXPECT_EQ(cached.hash, getHash(db.get(), "a.txt"));
+        EXPECT_TRUE(cached.hasEntry);
+        EXPECT_EQ(cached.type, EntryType::Generic);
+    }
+
+    TEST(fingerprintCache, recentFilesAreNotCached)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto root = ta.getFolder("ds");
+        const auto file = root / "fresh.txt";
+        std::ofstream(file.string()) << "fresh";
+
+        initIndex(root.string());
+        auto db = ddb::open(root.string(), true);
+        addToIndex(db.get(), {file.string()});
+
+        auto q = db->query("SELECT COUNT(*) FROM fingerprint_cache");
+        q->fetch();
+        EXPECT_EQ(q->getInt(0), 0);
+    }
+
+    // A renamed file keeps its inode: re-adding it under the new name must reuse the cached
+    // fingerprint instead of hashing. The cached hash is replaced with a sentinel to prove it.
+    TEST(fingerprintCache, renameReusesCachedFingerprint)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto root = ta.getFolder("ds");
+        const auto file = createOldFile(root / "a.txt", "hello");
+
+        initIndex(root.string());
+        auto db = ddb::open(root.string(), true);
+        addToIndex(db.get(), {file.string()});
+
+        db->exec("UPDATE fingerprint_cache SET hash = 'sentinel'");
+
+        const auto renamed = root / "b.txt";
+        fs::rename(file, renamed);
+        addToIndex(db.get(), {renamed.string()});
+
+        EXPECT_EQ(getHash(db.get(), "b.txt"), "sentinel");
+    }
+
+    TEST(fingerprintCache, rescanSkipsUnchangedFiles)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto root = ta.getFolder("ds");
+        const auto file = createOldFile(root / "a.txt", "hello");
+
+        initIndex(root.string());
+        auto db = ddb::open(root.string(), true);
+        addToIndex(db.get(), {file.string()});
+
+        db->exec("UPDATE fingerprint_cache SET hash = 'sentinel'");
+        rescanIndex(db.get());
+        EXPECT_EQ(getHash(db.get(), "a.txt"), "sentinel");
+
+        // A content change alters (size, mtime) and invalidates the cache
+        createOldFile(file, "hello world");
+        rescanIndex(db.get());
+        EXPECT_EQ(getHash(db.get(), "a.txt"), Hash::strSHA256("hello world"));
+    }
+
+    int countFingerprints(Database *db)
+    {
+        auto q = db->query("SELECT COUNT(*) FROM fingerprint_cache");
+        q->fetch();
+        return q->getInt(0);
+    }
+
+    // Fingerprints go away with the last entry having their hash
+    TEST(fingerprintCache, removePrunesFingerprints)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto root = ta.getFolder("ds");
+        const auto a = createOldFile(root / "a.txt", "hello");
+        const auto b = createOldFile(root / "b.txt", "hello");
+        const auto c = createOldFile(root / "c.txt", "other");
+
+        initIndex(root.string());
+        auto db = ddb::open(root.string(), true);
+        addToIndex(db.get(), {a.string(), b.string(), c.string()});
+        EXPECT_EQ(countFingerprints(db.get()), 3);
+
+        // b.txt has the same content, the fingerprints of that hash stay
+        removeFromIndex(db.get(), {a.string()});
+        EXPECT_EQ(countFingerprints(db.get()), 3);
+
+        removeFromIndex(db.get(), {c.string()});
+        EXPECT_EQ(countFingerprints(db.get()), 2);
+
+        // Deleted from disk and dropped by sync
+        fs::remove(b);
+        syncIndex(db.get());
+        EXPECT_EQ(countFingerprints(db.get()), 0);
+    }
+
+} // namespace
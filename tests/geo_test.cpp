@@ -2,8 +2,13 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+#include <cmath>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "geo.h"
+#include "coordstransformer.h"
+#include "exceptions.h"
 
 namespace
 {
@@ -27,4 +32,54 @@ namespace
         EXPECT_NEAR(coords.longitude, longitude, 1E-10);
     }
 
+    TEST(testUTM, InvalidCoordinates)
+    {
+        const UTMZone zone{true, 15};
+        EXPECT_THROW(toUTM(90.5, -91.0, zone), GDALException);
+        EXPECT_THROW(toUTM(std::nan(""), -91.0, zone), GDALException);
+        EXPECT_THROW(toUTM(46.0, HUGE_VAL, zone), GDALException);
+        EXPECT_THROW(fromUTM(std::nan(""), 5188207.22, zone), GDALException);
+        EXPECT_THROW(fromUTM(576764.77, -HUGE_VAL, zone), GDALException);
+
+        // A single bad point fails the batch
+        const double lats[2] = {46.0, -100.0}, lons[2] = {-91.0, -91.0};
+        double x[2], y[2];
+        EXPECT_THROW(toUTM(2, lats, lons, x, y, zone), GDALException);
+    }
+
+    TEST(testUTM, MatchesProj)
+    {
+        // Points across the UTM latitude range, up to beyond the zone edges
+        for (const UTMZone zone : {UTMZone{true, 15}, UTMZone{false, 33}, UTMZone{true, 60}, UTMZone{false, 1}})
+        {
+            const double lon0 = centralMeridian(zone);
+            std::vector<double> lats, lons;
+            for (double lat = zone.north ? 0.0 : -80.0; lat <= (zone.north ? 84.0 : 0.0); lat += 4.0)
+                for (double dlon = -3.5; dlon <= 3.5; dlon += 0.5)
+                {
+                    lats.push_back(lat);
+                    lons.push_back(angNormalize(lon0 + dlon));
+                }
+
+            const size_t count = lats.size();
+            std::vector<double> x(count), y(count);
+            toUTM(count, lats.data(), lons.data(), x.data(), y.data(), zone);
+
+            std::vector<double> px(lons), py(lats);
+            CoordsTransformer ct("EPSG:4326", getProjForUTM(zone));
+            ct.transform(count, px.data(), py.data());
+
+            std::vector<double> rlats(count), rlons(count);
+            fromUTM(count, x.data(), y.data(), rlats.data(), rlons.data(), zone);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                EXPECT_NEAR(x[i], px[i], 1E-4) << zone << " " << lats[i] << "," << lons[i];
+                EXPECT_NEAR(y[i], py[i], 1E-4) << zone << " " << lats[i] << "," << lons[i];
+                EXPECT_NEAR(rlats[i], lats[i], 1E-10);
+                EXPECT_NEAR(angNormalize(rlons[i] - lons[i]), 0.0, 1E-10);
+            }
+        }
+    }
+
 }
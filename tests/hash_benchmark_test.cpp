@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
@@ -12,6 +13,7 @@
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "exceptions.h"
 #include "hash.h"
 #include "mio.h"
 #include "test.h"
@@ -50,6 +52,73 @@ std::string opensslSHA256(const char* data, size_t size) {
     return oss.str();
 }
 
+// Files above the pipelining threshold are read on a background thread; the digest must
+// match a one-shot hash of the same bytes, including block-aligned sizes.
+TEST(hash, pipelinedFileMatchesOpenSSL) {
+    TestArea ta(TEST_NAME, true);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    for (size_t size : {size_t(0), size_t(1234), size_t(8 * 1024 * 1024), size_t(13 * 1024 * 1024 + 17)}) {
+        std::vector<char> data(size);
+        for (auto& byte : data) byte = static_cast<char>(dist(rng));
+
+        const auto file = ta.getPath("data_" + std::to_string(size) + ".bin");
+        std::ofstream out(file.string(), std::ios::binary);
+        out.write(data.data(), data.size());
+        out.close();
+
+        EXPECT_EQ(Hash::fileSHA256(file.string()), opensslSHA256(data.data(), data.size()))
+            << "size " << size;
+    }
+}
+
+// The head captured for metadata probing must not change the digest
+TEST(hash, fileSHA256CapturesHead) {
+    TestArea ta(TEST_NAME, true);
+
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    const size_t size = 9 * 1024 * 1024 + 5;
+    std::vector<char> data(size);
+    for (auto& byte : data) byte = static_cast<char>(dist(rng));
+
+    const auto file = ta.getPath("data.bin");
+    std::ofstream out(file.string(), std::ios::binary);
+    out.write(data.data(), data.size());
+    out.close();
+
+    const auto expected = opensslSHA256(data.data(), data.size());
+    for (size_t headSize : {size_t(0), size_t(1024 * 1024), size, size + 1}) {
+        std::vector<uint8_t> head;
+        EXPECT_EQ(Hash::fileSHA256(file.string(), head, headSize), expected) << "head " << headSize;
+        ASSERT_EQ(head.size(), std::min(size, headSize));
+        EXPECT_TRUE(std::equal(head.begin(), head.end(), reinterpret_cast<const uint8_t*>(data.data())));
+    }
+}
+
+TEST(hash, filesSHA256PreservesOrder) {
+    TestArea ta(TEST_NAME, true);
+
+    std::vector<std::string> paths;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 12; i++) {
+        const std::string content = "file content " + std::to_string(i);
+        const auto file = ta.getPath("f" + std::to_string(i) + ".txt");
+        std::ofstream(file.string(), std::ios::binary) << content;
+        paths.push_back(file.string());
+        expected.push_back(Hash::strSHA256(content));
+    }
+
+    EXPECT_EQ(Hash::filesSHA256(paths, 4), expected);
+    EXPECT_TRUE(Hash::filesSHA256({}).empty());
+
+    paths.push_back(ta.getPath("missing.txt").string());
+    EXPECT_THROW(Hash::filesSHA256(paths, 4), FSException);
+}
+
 /**
  * @brief Benchmark for hashing a single large file (~54 MB orthophoto)
  *
@@ -0,0 +1,259 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <random>
+
+#include "dbops.h"
+#include "ddb.h"
+#include "delta.h"
+#include "entry_types.h"
+#include "exceptions.h"
+#include "gtest/gtest.h"
+#include "hash.h"
+#include "merkle.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    void putFile(Database *db, const std::string &path, const std::string &content)
+    {
+        auto q = db->query("INSERT OR REPLACE INTO entries (path, hash, type, mtime, size, depth) VALUES (?, ?, ?, 0, ?, ?)");
+        q->bind(1, path);
+        q->bind(2, Hash::strSHA256(content));
+        q->bind(3, static_cast<int>(EntryType::Generic));
+        q->bind(4, static_cast<int>(content.size()));
+        q->bind(5, static_cast<int>(std::count(path.begin(), path.end(), '/')));
+        q->execute();
+    }
+
+    void putDirectory(Database *db, const std::string &path)
+    {
+        auto q = db->query("INSERT OR REPLACE INTO entries (path, hash, type, mtime, size, depth) VALUES (?, NULL, ?, 0, 0, ?)");
+        q->bind(1, path);
+        q->bind(2, static_cast<int>(EntryType::Directory));
+        q->bind(3, static_cast<int>(std::count(path.begin(), path.end(), '/')));
+        q->execute();
+    }
+
+    void remove(Database *db, const std::string &path)
+    {
+        auto q = db->query("DELETE FROM entries WHERE path = ?");
+        q->bind(1, path);
+        q->execute();
+    }
+
+    void putMeta(Database *db, const std::string &id)
+    {
+        auto q = db->query("INSERT OR REPLACE INTO entries_meta (id, path, key, data, mtime) VALUES (?, '', 'tags', '\"x\"', 0)");
+        q->bind(1, id);
+        q->execute();
+    }
+
+    std::string randomPath(std::mt19937 &gen, bool file)
+    {
+        static const char *dirs[] = {"a", "b", "c"};
+        static const char *files[] = {"a.jpg", "b.tif", "c.laz"};
+
+        std::string path;
+        for (int depth = gen() % 3; depth > 0; depth--)
+            path += std::string(dirs[gen() % 3]) + "/";
+        return path + (file ? files[gen() % 3] : dirs[gen() % 3]);
+    }
+
+    // Random mix of files, directories, directories implied by their contents and meta
+    void mutate(Database *db, std::mt19937 &gen, int steps)
+    {
+        for (int i = 0; i < steps; i++)
+        {
+            switch (gen() % 5)
+            {
+            case 0:
+            case 1:
+                putFile(db, randomPath(gen, true), std::to_string(gen() % 4));
+                break;
+            case 2:
+                putDirectory(db, randomPath(gen, false));
+                break;
+            case 3:
+                remove(db, randomPath(gen, gen() % 2));
+                break;
+            default:
+            {
+                const std::string hex = "0123456789abcdef";
+                std::string id;
+                for (int j = 0; j < 4; j++)
+                    id += hex[gen() % 16];
+                if (gen() % 2)
+                    putMeta(db, id);
+                else
+                    db->query("DELETE FROM entries_meta WHERE id = '" + id + "'")->execute();
+            }
+            }
+        }
+    }
+
+    void expectSameDelta(const Delta &expected, const Delta &actual)
+    {
+        ASSERT_EQ(expected.adds.size(), actual.adds.size());
+        for (size_t i = 0; i < expected.adds.size(); i++)
+        {
+            EXPECT_EQ(expected.adds[i].path, actual.adds[i].path);
+            EXPECT_EQ(expected.adds[i].hash, actual.adds[i].hash);
+        }
+
+        ASSERT_EQ(expected.removes.size(), actual.removes.size());
+        for (size_t i = 0; i < expected.removes.size(); i++)
+        {
+            EXPECT_EQ(expected.removes[i].path, actual.removes[i].path);
+            EXPECT_EQ(expected.removes[i].hash, actual.removes[i].hash);
+        }
+
+        EXPECT_EQ(expected.metaAdds, actual.metaAdds);
+        EXPECT_EQ(expected.metaRemoves, actual.metaRemoves);
+    }
+
+    TEST(merkle, deltaMatchesFlatStampDelta)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder("source").string());
+        initIndex(ta.getFolder("destination").string());
+        auto source = open(ta.getFolder("source").string(), false);
+        auto destination = open(ta.getFolder("destination").string(), false);
+
+        std::mt19937 gen(7);
+        mutate(source.get(), gen, 60);
+        mutate(destination.get(), gen, 60);
+
+        for (int round = 0; round < 10; round++)
+        {
+            mutate(source.get(), gen, 8);
+            mutate(destination.get(), gen, 4);
+
+            const auto expected = getDelta(source->getStamp(), destination->getStamp());
+            const auto actual = getDelta(source.get(), destination.get());
+            expectSameDelta(expected, actual);
+
+            const auto reverse = getDelta(destination.get(), source.get());
+            expectSameDelta(getDelta(destination->getStamp(), source->getStamp()), reverse);
+        }
+    }
+
+    TEST(merkle, rootFollowsContent)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder("a").string());
+        initIndex(ta.getFolder("b").string());
+        auto a = open(ta.getFolder("a").string(), false);
+        auto b = open(ta.getFolder("b").string(), false);
+
+        MerkleIndex ma(a.get());
+        MerkleIndex mb(b.get());
+        EXPECT_EQ(ma.rootHash(), mb.rootHash());
+
+        putDirectory(a.get(), "dir");
+        putFile(a.get(), "dir/1.jpg", "1");
+        putFile(a.get(), "dir/sub/2.jpg", "2");
+        putMeta(a.get(), "abcd");
+
+        // Same content inserted in a different order
+        putMeta(b.get(), "abcd");
+        putFile(b.get(), "dir/sub/2.jpg", "2");
+        putFile(b.get(), "dir/1.jpg", "1");
+        putDirectory(b.get(), "dir");
+
+        const auto root = ma.rootHash();
+        EXPECT_EQ(root, mb.rootHash());
+        EXPECT_TRUE(getDelta(a.get(), b.get()).empty());
+
+        // Only the changed branch is rehashed
+        putFile(b.get(), "dir/sub/2.jpg", "3");
+        EXPECT_NE(root, mb.rootHash());
+        EXPECT_EQ(ma.nodeHash(MerkleTree::Entries, "dir/sub").size(), 64u);
+        EXPECT_NE(ma.nodeHash(MerkleTree::Entries, "dir/sub"), mb.nodeHash(MerkleTree::Entries, "dir/sub"));
+        EXPECT_EQ(ma.nodeHash(MerkleTree::Meta, ""), mb.nodeHash(MerkleTree::Meta, ""));
+
+        // Reverting restores the root
+        putFile(b.get(), "dir/sub/2.jpg", "2");
+        EXPECT_EQ(root, mb.rootHash());
+
+        auto q = b->query("SELECT COUNT(*) FROM merkle_dirty");
+        ASSERT_TRUE(q->fetch());
+        EXPECT_EQ(q->getInt(0), 0);
+
+        // Empty subtrees are dropped
+        remove(b.get(), "dir/sub/2.jpg");
+        mb.refresh();
+        EXPECT_EQ(mb.nodeHash(MerkleTree::Entries, "dir/sub"), "");
+    }
+
+    TEST(merkle, readsWhileLocked)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder("a").string());
+        initIndex(ta.getFolder("b").string());
+        auto a = open(ta.getFolder("a").string(), false);
+        auto b = open(ta.getFolder("b").string(), false);
+
+        std::mt19937 genA(3), genB(3);
+        mutate(a.get(), genA, 80);
+        mutate(b.get(), genB, 80);
+
+        MerkleIndex mb(b.get());
+        const auto root = mb.rootHash();
+
+        // Another connection holds the write lock: hashes are computed in memory
+        auto writer = open(ta.getFolder("a").string(), false);
+        writer->exec("BEGIN IMMEDIATE");
+
+        MerkleIndex ma(a.get());
+        EXPECT_EQ(ma.rootHash(), root);
+        EXPECT_TRUE(getDelta(a.get(), b.get()).empty());
+
+        putFile(b.get(), "a/new.jpg", "new");
+        expectSameDelta(getDelta(a->getStamp(), b->getStamp()), getDelta(a.get(), b.get()));
+        expectSameDelta(getDelta(b->getStamp(), a->getStamp()), getDelta(b.get(), a.get()));
+
+        writer->exec("ROLLBACK");
+
+        // Stored by the next refresh that can write
+        EXPECT_EQ(ma.rootHash(), root);
+        auto q = a->query("SELECT COUNT(*) FROM merkle_dirty");
+        ASSERT_TRUE(q->fetch());
+        EXPECT_EQ(q->getInt(0), 0);
+    }
+
+    TEST(merkle, binaryStampRoundTrip)
+    {
+        TestArea ta(TEST_NAME, true);
+        initIndex(ta.getFolder().string());
+        auto db = open(ta.getFolder().string(), false);
+
+        std::mt19937 gen(11);
+        mutate(db.get(), gen, 200);
+
+        const auto stamp = db->getStamp();
+        const auto binary = encodeStamp(stamp);
+        EXPECT_EQ(decodeStamp(binary), stamp);
+        EXPECT_LT(binary.size(), stamp.dump().size() * 2 / 3);
+
+        json odd = {{"entries", json::array({json::object({{"x", "not-a-digest"}}), json::object({{"x/y", ""}})})},
+                    {"meta", json::array()},
+                    {"checksum", "ABC"}};
+        EXPECT_EQ(decodeStamp(encodeStamp(odd)), odd);
+
+        EXPECT_THROW(decodeStamp("DDBX"), InvalidArgsException);
+        EXPECT_THROW(decodeStamp(binary.substr(0, binary.size() - 1)), InvalidArgsException);
+
+        uint8_t *buffer = nullptr;
+        int bufferSize = 0;
+        ASSERT_EQ(DDBGetBinaryStamp(ta.getFolder().string().c_str(), &buffer, &bufferSize), DDBERR_NONE);
+        EXPECT_EQ(std::string(reinterpret_cast<char *>(buffer), bufferSize), binary);
+        DDBVSIFree(buffer);
+    }
+
+} // namespace
@@ -9,6 +9,7 @@
 #include "ddb.h"
 #include "sensorprofile.h"
 #include "vegetation.h"
+#include "bandmath.h"
 #include "merge_multispectral.h"
 #include "cog.h"
 #include "thumbs.h"
@@ -215,7 +216,7 @@ TEST(multispectral, applyFormulaVARI) {
 
     std::vector<float> result(4);
     float nodata = -9999.0f;
-    const auto* formulaPtr = ve.getFormula("VARI");
+    const auto formulaPtr = ve.getFormula("VARI");
     ASSERT_NE(formulaPtr, nullptr);
     ve.applyFormula(*formulaPtr, bf, bandData, result.data(), 4, nodata);
 
@@ -227,6 +228,170 @@ TEST(multispectral, applyFormulaVARI) {
     EXPECT_FLOAT_EQ(result[3], nodata);
 }
 
+TEST(multispectral, applyFormulaNDVIAcrossBlocks) {
+    auto& ve = VegetationEngine::instance();
+
+    // More pixels than a kernel block, with nodata and zero denominators scattered around
+    const size_t count = 2500;
+    const float nodata = -9999.0f;
+    std::vector<float> r(count), g(count), b(count), n(count);
+    for (size_t i = 0; i < count; i++) {
+        r[i] = static_cast<float>(i % 97);
+        g[i] = static_cast<float>(i % 13);
+        b[i] = static_cast<float>(i % 7);
+        n[i] = static_cast<float>(i % 89);
+        if (i % 101 == 0) n[i] = nodata;
+        if (i % 211 == 0) g[i] = nodata; // Not used by NDVI, but present in the filter
+    }
+    std::vector<float*> bandData = {r.data(), g.data(), b.data(), n.data()};
+
+    BandFilter bf = VegetationEngine::parseFilter("RGBN", 4);
+    const auto formulaPtr = ve.getFormula("NDVI");
+    ASSERT_NE(formulaPtr, nullptr);
+
+    std::vector<float> result(count);
+    ve.applyFormula(*formulaPtr, bf, bandData, result.data(), count, nodata);
+
+    for (size_t i = 0; i < count; i++) {
+        const float denom = n[i] + r[i];
+        const bool isNodata = n[i] == nodata || g[i] == nodata || std::abs(denom) < 1e-10f;
+        const float expected = isNodata ? nodata : (n[i] - r[i]) / denom;
+        ASSERT_FLOAT_EQ(result[i], expected) << "pixel " << i;
+    }
+}
+
+TEST(multispectral, bandMathMatchesBuiltinFormulas) {
+    auto& ve = VegetationEngine::instance();
+
+    const size_t count = 600;
+    const float nodata = -9999.0f;
+    std::vector<float> r(count), g(count), b(count), n(count), re(count);
+    for (size_t i = 0; i < count; i++) {
+        r[i] = static_cast<float>(i % 31);
+        g[i] = static_cast<float>(i % 17);
+        b[i] = static_cast<float>(i % 11);
+        n[i] = static_cast<float>(i % 43);
+        re[i] = static_cast<float>(i % 23);
+
+        // Pre-masked like premaskNodata does: all bands are nodata
+        if (i % 50 == 0) r[i] = g[i] = b[i] = n[i] = re[i] = nodata;
+    }
+    std::vector<float*> bandData = {r.data(), g.data(), b.data(), n.data(), re.data()};
+    BandFilter bf = VegetationEngine::parseFilter("RGBNRe", 5);
+
+    // The documented expression of each built-in ratio index compiles to the same result
+    for (const std::string id : {"NDVI", "VARI", "EXG", "GLI", "NDWI", "GNDVI", "SAVI", "EVI",
+                                 "NDRE", "NDYI", "MPRI", "OSAVI", "GRVI", "ENDVI", "ARVI"}) {
+        const auto formula = ve.getFormula(id);
+        ASSERT_NE(formula, nullptr);
+
+        const auto program = BandMathProgram::compile(formula->expr);
+        std::vector<float> expected(count), actual(count);
+        ve.applyFormula(*formula, bf, bandData, expected.data(), count, nodata);
+        program.evaluate(bf, bandData, actual.data(), count, nodata);
+
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_NEAR(actual[i], expected[i], 1e-5f) << id << " pixel " << i;
+        }
+    }
+}
+
+TEST(multispectral, bandMathRejectsDeepNesting) {
+    // Throws instead of overflowing the stack
+    const int depth = 100000;
+    EXPECT_THROW(BandMathProgram::compile(std::string(depth, '(') + "N" + std::string(depth, ')')), InvalidArgsException);
+    EXPECT_THROW(BandMathProgram::compile(std::string(depth, '-') + "N"), InvalidArgsException);
+    EXPECT_THROW(BandMathProgram::compile(std::string(depth, '(') + "1" + std::string(depth, ')')), InvalidArgsException);
+
+    std::string chain = "N";
+    for (int i = 0; i < depth; i++) chain += "+N";
+    EXPECT_THROW(BandMathProgram::compile(chain), InvalidArgsException);
+
+    // Reasonable nesting is fine
+    EXPECT_NO_THROW(BandMathProgram::compile(std::string(20, '(') + "N - R" + std::string(20, ')')));
+    EXPECT_NO_THROW(BandMathProgram::compile("--N + abs(min(N, (R + (G * (B - 1)))))"));
+}
+
+TEST(multispectral, registerCustomFormula) {
+    auto& ve = VegetationEngine::instance();
+
+    ve.loadFormulas(R"({"formulas": [{"id": "TEST_NIRRATIO", "name": "NIR Ratio",
+                                      "expr": "max(N / (R + G), 0) ^ 0.5", "min": 0, "max": 2}]})");
+
+    const auto formula = ve.getFormula("TEST_NIRRATIO");
+    ASSERT_NE(formula, nullptr);
+    EXPECT_EQ(formula->requiredBands, "RGN");
+    EXPECT_TRUE(formula->hasRange);
+
+    // Not available without a NIR band
+    bool found = false;
+    for (const auto& f : ve.getFormulasForFilter(VegetationEngine::parseFilter("RGB", 3)))
+        if (f.id == "TEST_NIRRATIO") found = true;
+    EXPECT_FALSE(found);
+
+    std::vector<float> red = {1, 2, 0, -9999};
+    std::vector<float> green = {1, 2, 0, 1};
+    std::vector<float> nir = {8, 16, 0, 1};
+    std::vector<float*> bandData = {red.data(), green.data(), nir.data()};
+    BandFilter bf = VegetationEngine::parseFilter("RGN", 3);
+
+    std::vector<float> result(4);
+    const float nodata = -9999.0f;
+    ve.applyFormula(*formula, bf, bandData, result.data(), 4, nodata);
+
+    EXPECT_FLOAT_EQ(result[0], 2.0f);
+    EXPECT_FLOAT_EQ(result[1], 2.0f);
+    EXPECT_FLOAT_EQ(result[2], nodata); // Zero denominator
+    EXPECT_FLOAT_EQ(result[3], nodata); // Nodata input
+
+    EXPECT_TRUE(ve.unregisterFormula("TEST_NIRRATIO"));
+    EXPECT_EQ(ve.getFormula("TEST_NIRRATIO"), nullptr);
+    EXPECT_FALSE(ve.unregisterFormula("TEST_NIRRATIO"));
+    EXPECT_THROW(ve.unregisterFormula("NDVI"), InvalidArgsException);
+
+    // Still usable after being unregistered
+    EXPECT_EQ(formula->id, "TEST_NIRRATIO");
+}
+
+TEST(multispectral, registerInvalidFormula) {
+    auto& ve = VegetationEngine::instance();
+
+    EXPECT_THROW(ve.registerFormula({"TEST_BAD", "Bad", "(N - R", "", 0, 0, false, ""}), InvalidArgsException);
+    EXPECT_THROW(ve.registerFormula({"TEST_BAD", "Bad", "N / 0", "", 0, 0, false, ""}), InvalidArgsException);
+    EXPECT_THROW(ve.registerFormula({"TEST_BAD", "Bad", "NIR - R", "", 0, 0, false, ""}), InvalidArgsException);
+    EXPECT_THROW(ve.registerFormula({"NDVI", "NDVI", "N - R", "", 0, 0, false, ""}), InvalidArgsException);
+    EXPECT_EQ(ve.getFormula("TEST_BAD"), nullptr);
+
+    // A file with an invalid formula registers none of them
+    EXPECT_THROW(ve.loadFormulas(R"({"formulas": [{"id": "TEST_GOOD", "expr": "N - R"},
+                                                  {"id": "TEST_BAD", "expr": "N - "}]})"), InvalidArgsException);
+    EXPECT_EQ(ve.getFormula("TEST_GOOD"), nullptr);
+    EXPECT_EQ(ve.getFormula("TEST_BAD"), nullptr);
+}
+
+TEST(multispectral, replaceCustomFormula) {
+    auto& ve = VegetationEngine::instance();
+
+    std::vector<float> red = {1, 2};
+    std::vector<float> nir = {8, 16};
+    std::vector<float*> bandData = {red.data(), nir.data()};
+    BandFilter bf = VegetationEngine::parseFilter("RN", 2);
+    std::vector<float> result(2);
+
+    ve.registerFormula({"TEST_REPLACED", "Replaced", "N - R", "", 0, 0, false, ""});
+    const auto first = ve.getFormula("TEST_REPLACED");
+    ve.registerFormula({"TEST_REPLACED", "Replaced", "N + R", "", 0, 0, false, ""});
+
+    ve.applyFormula(*ve.getFormula("TEST_REPLACED"), bf, bandData, result.data(), 2, -9999.0f);
+    EXPECT_FLOAT_EQ(result[0], 9.0f);
+
+    // A formula held from before the replacement keeps its expression
+    ve.applyFormula(*first, bf, bandData, result.data(), 2, -9999.0f);
+    EXPECT_FLOAT_EQ(result[0], 7.0f);
+
+    EXPECT_TRUE(ve.unregisterFormula("TEST_REPLACED"));
+}
+
 TEST(multispectral, colormapsList) {
     auto& ve = VegetationEngine::instance();
     json colormapsJson = ve.getColormapsJson();
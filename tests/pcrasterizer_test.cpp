@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "exceptions.h"
+#include "gtest/gtest.h"
+#include "pcrasterizer.h"
+#include "pctiler.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    RasterPoints randomPoints(size_t count, int paddedTileSize)
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> coord(-5, paddedTileSize + 5);
+        std::uniform_int_distribution<int> color(0, 255);
+        std::uniform_real_distribution<double> elevation(0, 10);
+
+        RasterPoints points;
+        points.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            points.px[i] = coord(gen);
+            points.py[i] = coord(gen);
+
+            // Coarse elevations, so that many points tie
+            points.z[i] = std::round(elevation(gen));
+            points.r[i] = static_cast<uint8_t>(color(gen));
+            points.g[i] = static_cast<uint8_t>(color(gen));
+            points.b[i] = static_cast<uint8_t>(color(gen));
+        }
+        return points;
+    }
+
+    TEST(pcRasterizer, bandsMatchSerialSplat)
+    {
+        const int tileSize = 256;
+        const int radius = 2;
+        const int paddedTileSize = tileSize + radius * 2;
+        const int wSize = tileSize * tileSize;
+        const RasterPoints points = randomPoints(200000, paddedTileSize);
+
+        // Point at a time, with a single z-buffer
+        std::vector<uint8_t> expected(wSize * 3, 0), expectedAlpha(wSize, 0);
+        std::vector<float> zBuffer(paddedTileSize * paddedTileSize, -99999.0f);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            const int px = points.px[i];
+            const int py = points.py[i];
+            if (px >= 0 && px < paddedTileSize && py >= 0 && py < paddedTileSize &&
+                zBuffer[py * paddedTileSize + px] < points.z[i])
+            {
+                zBuffer[py * paddedTileSize + px] = static_cast<float>(points.z[i]);
+                drawCircle(expected.data(), expectedAlpha.data(), px - radius, py - radius, radius,
+                           points.r[i], points.g[i], points.b[i], tileSize, wSize);
+            }
+        }
+
+        for (int threads : {1, 3, 8})
+        {
+            std::vector<uint8_t> buffer(wSize * 3, 0), alpha(wSize, 0);
+            rasterizePoints(points, radius, tileSize, buffer.data(), alpha.data(), threads);
+
+            EXPECT_EQ(buffer, expected) << threads << " threads";
+            EXPECT_EQ(alpha, expectedAlpha) << threads << " threads";
+        }
+    }
+
+    TEST(pcRasterizer, parseRenderMode)
+    {
+        EXPECT_EQ(parsePointCloudRenderMode("auto"), PointCloudRenderMode::Auto);
+        EXPECT_EQ(parsePointCloudRenderMode("classification"), PointCloudRenderMode::Classification);
+        EXPECT_THROW(parsePointCloudRenderMode("hillshade"), InvalidArgsException);
+    }
+
+} // namespace
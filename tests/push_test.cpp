@@ -0,0 +1,269 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "exceptions.h"
+#include "gtest/gtest.h"
+#include "hash.h"
+#include "pushpipeline.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    // Stands in for the registry push endpoints. Every failEvery-th request
+    // fails: half of them before the chunk is stored, the other half after
+    // (the acknowledgement is lost on the way back).
+    class FakeRegistry : public PushTransport
+    {
+        std::mutex mutex;
+        std::map<std::string, std::string> files;
+        size_t chunkSize;
+        int failEvery;
+        int requests = 0;
+
+        bool shouldFail()
+        {
+            return failEvery > 0 && ++requests % failEvery == 0;
+        }
+
+    public:
+        std::atomic<int> active{0};
+        std::atomic<int> maxActive{0};
+        std::atomic<uint64_t> bytesSent{0};
+        std::atomic<int> wholeFiles{0};
+
+        FakeRegistry(size_t chunkSize, int failEvery = 0) : chunkSize(chunkSize), failEvery(failEvery) {}
+
+        size_t maxChunkSize() override { return chunkSize; }
+
+        uint64_t received(const std::string &path) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return files[path].size();
+        }
+
+        uint64_t sendChunk(const std::string &path, uint64_t offset, uint64_t fileSize,
+                           const std::string &checksum, const char *data, size_t size) override
+        {
+            const int a = ++active;
+            int m = maxActive;
+            while (a > m && !maxActive.compare_exchange_weak(m, a))
+                ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            bytesSent += size;
+            --active;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            EXPECT_LE(size, chunkSize);
+            if (Hash::strSHA256(data, size) != checksum)
+                throw NetException("Checksum mismatch");
+
+            const bool fail = shouldFail();
+            if (fail && requests % 2 == 0)
+                throw NetException("Connection reset");
+
+            auto &f = files[path];
+            if (offset != f.size())
+                throw NetException("Unexpected offset");
+            f.append(data, size);
+            EXPECT_LE(f.size(), fileSize);
+
+            if (fail)
+                throw NetException("Connection reset");
+            return f.size();
+        }
+
+        void sendFile(const std::string &path, const fs::path &fullPath,
+                      const std::function<void(uint64_t bytes)> &onSent) override
+        {
+            std::ifstream in(fullPath, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+            // Streamed in pieces, like the HTTP transport
+            for (size_t sent = 0; sent < content.size(); sent += 1000)
+                onSent(std::min<size_t>(1000, content.size() - sent));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shouldFail())
+                throw NetException("Connection reset");
+            files[path] = content;
+            wholeFiles++;
+        }
+
+        std::string content(const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return files[path];
+        }
+    };
+
+    std::vector<std::string> createFiles(const fs::path &dir, std::map<std::string, std::string> &contents)
+    {
+        std::mt19937 gen(42);
+        std::vector<std::string> paths;
+
+        // Empty, smaller than a chunk, exact multiple of a chunk, many chunks
+        for (size_t size : {0, 100, 1000, 4000, 9999, 25000, 1, 3001})
+        {
+            const std::string path = "dir/file" + std::to_string(paths.size()) + ".bin";
+            std::string data(size, '\0');
+            for (auto &c : data)
+                c = static_cast<char>(gen() & 0xff);
+
+            fs::create_directories(dir / "dir");
+            std::ofstream out(dir / path, std::ios::binary);
+            out.write(data.data(), data.size());
+
+            paths.push_back(path);
+            contents[path] = data;
+        }
+        return paths;
+    }
+
+    TEST(pushFiles, chunkedConcurrentUploads)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        FakeRegistry registry(4096);
+        PushOptions options;
+        options.jobs = 4;
+        options.chunkSize = 1000;
+
+        std::atomic<int> started(0);
+        pushFiles(registry, ta.getFolder(), paths, options, [&](const std::string &) { started++; });
+
+        EXPECT_EQ(started, static_cast<int>(paths.size()));
+        EXPECT_GT(registry.maxActive, 1);
+        EXPECT_LE(registry.maxActive, 4);
+        for (const auto &p : paths)
+            EXPECT_EQ(registry.content(p), contents[p]) << p;
+    }
+
+    TEST(pushFiles, resumesFromAcknowledgedChunk)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        uint64_t total = 0;
+        for (const auto &c : contents)
+            total += c.second.size();
+
+        FakeRegistry registry(1000, 3);
+        PushOptions options;
+        options.jobs = 3;
+        options.retryDelayMs = 1;
+
+        pushFiles(registry, ta.getFolder(), paths, options);
+
+        for (const auto &p : paths)
+            EXPECT_EQ(registry.content(p), contents[p]) << p;
+
+        // Each failure costs at most the chunk in flight, never the whole file
+        EXPECT_LT(registry.bytesSent, total + total / 2);
+    }
+
+    TEST(pushFiles, wholeFileFallback)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        FakeRegistry registry(0, 4);
+        PushOptions options;
+        options.retryDelayMs = 1;
+
+        pushFiles(registry, ta.getFolder(), paths, options);
+
+        EXPECT_EQ(registry.wholeFiles, static_cast<int>(paths.size()));
+        for (const auto &p : paths)
+            EXPECT_EQ(registry.content(p), contents[p]) << p;
+    }
+
+    TEST(pushFiles, wholeFileThrottled)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        FakeRegistry registry(0);
+        PushOptions options;
+        options.maxBytesPerSecond = 20000;
+
+        // A single file is throttled as it is sent, not only between files
+        const auto start = std::chrono::steady_clock::now();
+        pushFiles(registry, ta.getFolder(), {"dir/file5.bin"}, options);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // 25000 bytes at 20000 bytes/s; the first piece does not wait
+        EXPECT_GE(elapsed, 1.1);
+        EXPECT_EQ(registry.content("dir/file5.bin"), contents["dir/file5.bin"]);
+    }
+
+    TEST(pushFiles, givesUpAfterRetries)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        FakeRegistry registry(1000, 1);
+        PushOptions options;
+        options.retries = 2;
+        options.retryDelayMs = 1;
+
+        EXPECT_THROW(pushFiles(registry, ta.getFolder(), paths, options), NetException);
+    }
+
+    TEST(pushFiles, callbackExceptionIsRethrown)
+    {
+        TestArea ta(TEST_NAME, true);
+        std::map<std::string, std::string> contents;
+        const auto paths = createFiles(ta.getFolder(), contents);
+
+        FakeRegistry registry(1000);
+        PushOptions options;
+        options.jobs = 4;
+
+        // Thrown on a worker thread, surfaces on the caller
+        EXPECT_THROW(pushFiles(registry, ta.getFolder(), paths, options,
+                               [](const std::string &) { throw AppException("Cancelled"); }),
+                     AppException);
+    }
+
+    TEST(pushFiles, bandwidthLimit)
+    {
+        BandwidthLimiter limiter(100000);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; i++)
+            threads.emplace_back([&limiter]()
+                                 {
+                for (int j = 0; j < 3; j++)
+                    limiter.acquire(10000); });
+        for (auto &t : threads)
+            t.join();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // 120 KB at 100 KB/s; the first acquisition does not wait
+        EXPECT_GE(elapsed, 1.05);
+
+        BandwidthLimiter unlimited(0);
+        unlimited.acquire(1ULL << 40);
+    }
+
+} // namespace
@@ -58,6 +58,10 @@ namespace
 
         // Verify the old redundant index is NOT present
         EXPECT_FALSE(indexExists(db.get(), "ix_entries_meta_path")) << "ix_entries_meta_path should NOT exist (redundant)";
+
+        // Verify geometry spatial indexes
+        EXPECT_TRUE(db->tableExists("idx_entries_point_geom")) << "idx_entries_point_geom should exist";
+        EXPECT_TRUE(db->tableExists("idx_entries_polygon_geom")) << "idx_entries_polygon_geom should exist";
     }
 
     TEST(schemaMigration, existingDatabaseGetsNewIndexes)
@@ -84,6 +88,31 @@ namespace
         EXPECT_TRUE(db->tableExists("entries_meta")) << "entries_meta table should exist";
         EXPECT_TRUE(indexExists(db.get(), "ix_entries_meta_path_key")) << "ix_entries_meta_path_key should exist after migration";
         EXPECT_TRUE(indexExists(db.get(), "ix_entries_meta_key")) << "ix_entries_meta_key should exist after migration";
+
+        // Spatial indexes are created and filled with the existing geometries
+        EXPECT_TRUE(db->tableExists("idx_entries_point_geom")) << "idx_entries_point_geom should exist after migration";
+        EXPECT_TRUE(db->tableExists("idx_entries_polygon_geom")) << "idx_entries_polygon_geom should exist after migration";
+
+        auto q = db->query("SELECT (SELECT COUNT(*) FROM entries WHERE point_geom IS NOT NULL), "
+                           "(SELECT COUNT(*) FROM idx_entries_point_geom)");
+        ASSERT_TRUE(q->fetch());
+        EXPECT_EQ(q->getInt(0), q->getInt(1));
+
+        // capture_time is backfilled for existing entries
+        auto ct = db->query("SELECT COUNT(*) FROM entries WHERE capture_time IS NULL AND mtime IS NOT NULL");
+        ASSERT_TRUE(ct->fetch());
+        EXPECT_EQ(ct->getInt(0), 0);
+        EXPECT_TRUE(indexExists(db.get(), "ix_entries_capture_time"));
+
+        // capture_time is a virtual generated column, no triggers maintain it
+        auto gen = db->query("SELECT hidden FROM pragma_table_xinfo('entries') WHERE name = 'capture_time'");
+        ASSERT_TRUE(gen->fetch());
+        EXPECT_EQ(gen->getInt(0), 2);
+        auto tg = db->query("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'tg_entries_capture_time%'");
+        ASSERT_TRUE(tg->fetch());
+        EXPECT_EQ(tg->getInt(0), 0);
+
+        EXPECT_EQ(db->getUserVersion(), DDB_SCHEMA_VERSION);
     }
 
     TEST(schemaMigration, hashIndexIsUsedForQueries)
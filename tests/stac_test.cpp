@@ -8,6 +8,7 @@
 #include "ddb.h"
 #include "test.h"
 #include "testarea.h"
+#include <cpr/cpr.h>
 
 namespace
 {
@@ -176,6 +177,50 @@ namespace
         EXPECT_GE(page["numberMatched"].get<long long>(), 1);
     }
 
+    // Keyset paging via the token of the "next" link
+    TEST_F(StacTest, itemCollectionTokenPaging)
+    {
+        ddb::initIndex(ta->getFolder().string());
+        auto db = ddb::open(ta->getFolder().string(), true);
+        ddb::addToIndex(db.get(), {orthoPath.string(), imagePath.string()});
+
+        const auto nextToken = [](const json &fc)
+        {
+            for (const auto &l : fc["links"])
+            {
+                if (l["rel"] == "next")
+                {
+                    const std::string href = l["href"];
+                    const auto start = href.find("token=") + 6;
+                    const auto end = href.find('&', start);
+                    return std::string(cpr::util::urlDecode(href.substr(start, end - start)));
+                }
+            }
+            return std::string();
+        };
+
+        auto first = generateStacItemCollection(ta->getFolder().string(), ".", "", "", {}, "", "", 1);
+        ASSERT_EQ(first["numberReturned"], 1);
+        const auto token = nextToken(first);
+        ASSERT_FALSE(token.empty());
+
+        auto second = generateStacItemCollection(ta->getFolder().string(), ".", "", "", {}, "", "", 1, 0, token);
+        ASSERT_EQ(second["numberReturned"], 1);
+        EXPECT_NE(first["features"][0]["id"], second["features"][0]["id"]);
+        EXPECT_TRUE(nextToken(second).empty()) << "Last page should not have a next link";
+
+        // Same as offset paging
+        auto byOffset = generateStacItemCollection(ta->getFolder().string(), ".", "", "", {}, "", "", 1, 1);
+        EXPECT_EQ(second["features"][0]["id"], byOffset["features"][0]["id"]);
+
+        EXPECT_THROW(generateStacItemCollection(ta->getFolder().string(), ".", "", "", {}, "", "", 1, 1, token),
+                     InvalidArgsException);
+
+        // Small results are counted exactly even when approximate
+        auto approx = generateStacItemCollection(ta->getFolder().string(), ".", "", "", {}, "", "", 10, 0, "", true);
+        EXPECT_EQ(approx["numberMatched"].get<long long>(), 2);
+    }
+
     // Test STAC Item generation for a GeoImage with captureTime
     TEST_F(StacTest, itemWithCaptureTime)
     {
@@ -530,6 +575,34 @@ namespace
         EXPECT_EQ(fcWorld["numberReturned"], fcWorld["numberMatched"]);
     }
 
+    // Bbox search through the spatial index
+    TEST_F(StacTest, searchIndexBboxFilter)
+    {
+        ddb::initIndex(ta->getFolder().string());
+        auto db = ddb::open(ta->getFolder().string(), true);
+        ddb::addToIndex(db.get(), {orthoPath.string(), imagePath.string()});
+
+        EXPECT_TRUE(getMatchingEntries(db.get(), "%", 0, false, {-179.0, -89.0, -178.0, -88.0}).empty());
+
+        const auto all = getMatchingEntries(db.get(), "%", 0, false, {-180.0, -90.0, 180.0, 90.0});
+        EXPECT_EQ(all.size(), 2);
+
+        // Corners in any order
+        EXPECT_EQ(getMatchingEntries(db.get(), "%", 0, false, {180.0, 90.0, -180.0, -90.0}).size(), 2);
+
+        // Text filter still applies
+        EXPECT_EQ(getMatchingEntries(db.get(), "ortho.tif", 0, false, {-180.0, -90.0, 180.0, 90.0}).size(), 1);
+
+        // Same result as the STAC item search
+        auto fc = generateStacItemCollection(ta->getFolder().string(), ".", "", "",
+                                             {-180.0, -90.0, 180.0, 90.0});
+        EXPECT_EQ(fc["numberMatched"].get<long long>(), static_cast<long long>(all.size()));
+
+        std::ostringstream out;
+        searchIndex(db.get(), "%", out, "text", {-179.0, -89.0, -178.0, -88.0});
+        EXPECT_TRUE(out.str().empty());
+    }
+
     // ItemCollection datetime filtering (including open-ended intervals)
     TEST_F(StacTest, itemCollectionDatetimeFilter)
     {
@@ -341,4 +341,42 @@ TEST(stockpile, detectAllCApiSmoke) {
     EXPECT_NE(DDBDetectAllStockpiles("does_not_exist.tif", 0.5f, 0.0, 10, &output), DDBERR_NONE);
 }
 
+// ---- Test 10: Tiled scan gives the same result for any tiling --------------
+
+TEST(stockpile, detectAllTilingInvariant) {
+    TestArea ta(TEST_NAME);
+    const int w = 150, h = 130;
+    const double originLon = 10.0;
+    const double originLat = 45.0;
+    const double pix = 0.0001;
+
+    fs::path dem = createSyntheticMoundDem(ta.getPath("dem_tiling.tif"),
+                                            w, h, originLon, originLat, pix);
+
+    StockpileScanOptions single;
+    single.tileSize = 4096;
+    single.threads = 1;
+    auto expected = json::parse(detectAllStockpilesJson(dem.string(), 0.5f, 0.0, 10, single));
+    ASSERT_GE(expected["stockpiles"].size(), 1u);
+
+    // The mound spans several seams of the smaller tilings
+    for (int tileSize : {32, 45}) {
+        StockpileScanOptions tiled;
+        tiled.tileSize = tileSize;
+        tiled.threads = 3;
+        auto j = json::parse(detectAllStockpilesJson(dem.string(), 0.5f, 0.0, 10, tiled));
+
+        ASSERT_EQ(j["stockpiles"].size(), expected["stockpiles"].size()) << tileSize;
+        for (size_t i = 0; i < j["stockpiles"].size(); i++) {
+            const auto &a = expected["stockpiles"][i];
+            const auto &b = j["stockpiles"][i];
+            EXPECT_EQ(a["pixelCount"], b["pixelCount"]) << tileSize;
+            EXPECT_EQ(a["polygon"], b["polygon"]) << tileSize;
+            EXPECT_NEAR(a["estimatedVolume"].get<double>(), b["estimatedVolume"].get<double>(),
+                        1e-6 * a["estimatedVolume"].get<double>()) << tileSize;
+            EXPECT_NEAR(a["baseElevation"].get<double>(), b["baseElevation"].get<double>(), 1e-6) << tileSize;
+        }
+    }
+}
+
 } // namespace
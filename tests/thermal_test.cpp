@@ -12,6 +12,7 @@
 #include "sensorprofile.h"
 #include "gdal_inc.h"
 
+#include <chrono>
 #include <cmath>
 
 namespace {
@@ -71,6 +72,112 @@ TEST(thermal, planckFormula) {
     EXPECT_LT(tempLow, temp);
 }
 
+TEST(thermal, temperatureLutMatchesPlanck) {
+    ThermalCalibration cal;
+    cal.valid = true;
+
+    auto lut = temperatureLut(cal);
+    ASSERT_EQ(lut->size(), 65536u);
+    for (uint32_t raw = 0; raw < 65536; raw += 7) {
+        EXPECT_EQ((*lut)[raw], static_cast<float>(rawToTemperature(static_cast<uint16_t>(raw), cal)));
+    }
+
+    // Shared by calibrations with the same Planck constants
+    ThermalCalibration sameConstants = cal;
+    sameConstants.emissivity = 0.5;
+    EXPECT_EQ(temperatureLut(sameConstants), lut);
+
+    ThermalCalibration other = cal;
+    other.planckB = 1400.0;
+    EXPECT_NE(temperatureLut(other), lut);
+}
+
+// ============================================================
+// Area Statistics
+// ============================================================
+
+TEST(thermal, areaStatsSelection) {
+    std::vector<float> values = {5.0f, 1.0f, 4.0f, 2.0f, 3.0f, 6.0f};
+    auto stats = computeAreaStats(values);
+    EXPECT_EQ(stats.pixelCount, 6);
+    EXPECT_FLOAT_EQ(stats.min, 1.0f);
+    EXPECT_FLOAT_EQ(stats.max, 6.0f);
+    EXPECT_DOUBLE_EQ(stats.mean, 3.5);
+    EXPECT_FLOAT_EQ(stats.median, 3.5f);
+    EXPECT_NEAR(stats.stddev, std::sqrt(17.5 / 6.0), 1e-9);
+
+    std::vector<float> odd = {9.0f, -1.0f, 3.0f};
+    EXPECT_FLOAT_EQ(computeAreaStats(odd).median, 3.0f);
+
+    std::vector<float> empty;
+    EXPECT_EQ(computeAreaStats(empty).pixelCount, 0);
+}
+
+TEST(thermal, areaStatsHistogramMatchesValues) {
+    ThermalCalibration cal;
+    auto lut = temperatureLut(cal);
+
+    std::vector<uint64_t> histogram(65536, 0);
+    std::vector<float> values;
+    uint32_t seed = 1;
+    for (int i = 0; i < 10001; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const uint16_t raw = static_cast<uint16_t>(18000 + (seed >> 16) % 4000);
+        histogram[raw]++;
+        values.push_back((*lut)[raw]);
+    }
+
+    auto expected = computeAreaStats(values);
+    auto stats = computeAreaStats(histogram, *lut);
+    EXPECT_EQ(stats.pixelCount, expected.pixelCount);
+    EXPECT_EQ(stats.min, expected.min);
+    EXPECT_EQ(stats.max, expected.max);
+    EXPECT_EQ(stats.median, expected.median);
+    EXPECT_NEAR(stats.mean, expected.mean, 1e-6);
+    EXPECT_NEAR(stats.stddev, expected.stddev, 1e-6);
+}
+
+// ============================================================
+// Decoded Frame Cache
+// ============================================================
+
+TEST(thermal, temperatureDataCache) {
+    TestArea ta(TEST_NAME);
+    GDALDriverH tifDrv = GDALGetDriverByName("GTiff");
+    ASSERT_NE(tifDrv, nullptr);
+
+    const fs::path rasterPath = ta.getPath("temperatures.tif");
+    auto writeRaster = [&](float value) {
+        GDALDatasetH hDs = GDALCreate(tifDrv, rasterPath.string().c_str(), 16, 8, 1, GDT_Float32, nullptr);
+        ASSERT_NE(hDs, nullptr);
+        std::vector<float> data(16 * 8, value);
+        ASSERT_EQ(GDALRasterIO(GDALGetRasterBand(hDs, 1), GF_Write, 0, 0, 16, 8,
+                               data.data(), 16, 8, GDT_Float32, 0, 0), CE_None);
+        GDALClose(hDs);
+    };
+
+    clearTemperatureDataCache();
+    writeRaster(21.5f);
+
+    auto first = readTemperatureDataCached(rasterPath.string());
+    ASSERT_EQ(first->temperatures.size(), 128u);
+    EXPECT_FLOAT_EQ(first->temperatures[0], 21.5f);
+    EXPECT_EQ(readTemperatureDataCached(rasterPath.string()), first);
+
+    // A rewritten file is decoded again. Its inode can be reused and the
+    // size is the same, so move the mtime forward past the timestamp granularity
+    const auto firstMtime = fs::last_write_time(rasterPath);
+    fs::remove(rasterPath);
+    writeRaster(30.0f);
+    fs::last_write_time(rasterPath, firstMtime + std::chrono::seconds(10));
+    auto second = readTemperatureDataCached(rasterPath.string());
+    EXPECT_NE(second, first);
+    EXPECT_FLOAT_EQ(second->temperatures[0], 30.0f);
+
+    clearTemperatureDataCache();
+    EXPECT_NE(readTemperatureDataCached(rasterPath.string()), second);
+}
+
 // ============================================================
 // R-JPEG Detection & Parsing (requires test data download)
 // ============================================================
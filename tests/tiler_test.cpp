@@ -94,6 +94,57 @@ TEST(testTiler, image) {
     */
 }
 
+TEST(testTiler, pointCloudColor) {
+    TestArea ta(TEST_NAME);
+    fs::path pc = ta.downloadTestAsset(
+        "https://github.com/DroneDB/test_data/raw/master/brighton/point_cloud.laz",
+        "point_cloud.laz");
+
+    ddb::buildCopc({pc.string()}, ta.getFolder("copc").string());
+    const std::string copcPath = ta.getPath(fs::path("copc") / "cloud.copc.laz").string();
+
+    // Each coloring is rendered by its own tiler
+    std::vector<uint8_t> tiles[2];
+    const char *colors[2] = {"auto", "elevation"};
+    for (int i = 0; i < 2; i++) {
+        uint8_t *buffer = nullptr;
+        int bufSize = 0;
+        ASSERT_EQ(DDBMemoryPointCloudTile(copcPath.c_str(), 20, 256337, 369481, &buffer, &bufSize,
+                                          256, true, false, "", colors[i]), DDBERR_NONE) << DDBGetLastError();
+        ASSERT_GT(bufSize, 0);
+        tiles[i].assign(buffer, buffer + bufSize);
+        DDBVSIFree(buffer);
+    }
+    EXPECT_NE(tiles[0], tiles[1]);
+
+    // And cached separately
+    char *tilePath = nullptr;
+    ASSERT_EQ(DDBPointCloudTile(copcPath.c_str(), 20, 256337, 369481, &tilePath, 256, true, false, "auto"), DDBERR_NONE)
+        << DDBGetLastError();
+    const std::string autoPath = tilePath;
+    DDBFree(tilePath);
+    ASSERT_EQ(DDBPointCloudTile(copcPath.c_str(), 20, 256337, 369481, &tilePath, 256, true, false, "elevation"), DDBERR_NONE)
+        << DDBGetLastError();
+    EXPECT_NE(autoPath, std::string(tilePath));
+    DDBFree(tilePath);
+
+    // The user cache serves the same tile in memory, without a spool file
+    for (int i = 0; i < 2; i++) {
+        uint8_t *cached = nullptr;
+        int cachedSize = 0;
+        ASSERT_EQ(DDBMemoryCachedTile(copcPath.c_str(), 20, 256337, 369481, &cached, &cachedSize,
+                                      256, true, false, "", colors[i]), DDBERR_NONE) << DDBGetLastError();
+        ASSERT_GT(cachedSize, 0);
+        EXPECT_EQ(tiles[i], std::vector<uint8_t>(cached, cached + cachedSize));
+        DDBVSIFree(cached);
+    }
+
+    uint8_t *buffer = nullptr;
+    int bufSize = 0;
+    EXPECT_EQ(DDBMemoryPointCloudTile(copcPath.c_str(), 20, 256337, 369481, &buffer, &bufSize,
+                                      256, true, false, "", "hillshade"), DDBERR_EXCEPTION);
+}
+
 TEST(testTiler, toledoPointCloud) {
     TestArea ta(TEST_NAME);
     fs::path pc = ta.downloadTestAsset(
@@ -191,6 +242,88 @@ TEST(testTiler, userCache) {
     EXPECT_TRUE(io::Path(tile).getSize() > 0);
 }
 
+TEST(testTiler, userCacheStore) {
+    TestArea ta(TEST_NAME, true);
+    fs::path ortho = ta.downloadTestAsset(
+        "https://github.com/DroneDB/test_data/raw/master/brighton/odm_orthophoto.tif",
+        "ortho.tif");
+    fs::path storeDir = ta.getFolder("stores");
+
+    TilerHelper::setUserCacheStoreFactory([&](const std::string& name) {
+        return std::make_shared<MBTilesStore>(storeDir / (name + ".mbtiles"), 1024 * 1024);
+    });
+
+    std::vector<std::vector<uint8_t>> tiles;
+    for (int i = 0; i < 2; i++) {
+        uint8_t* outBuffer = nullptr;
+        int outBufferSize = 0;
+        TilerHelper::getFromUserCache(ortho, 19, 128168, 339545, 256, false, false, &outBuffer,
+                                      &outBufferSize);
+        ASSERT_NE(outBuffer, nullptr);
+        tiles.emplace_back(outBuffer, outBuffer + outBufferSize);
+        VSIFree(outBuffer);
+    }
+
+    // Rendered once, then served from the store
+    auto stats = TilerHelper::getUserCacheStats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.open, 1u);
+    EXPECT_DOUBLE_EQ(stats.hitRatio(), 0.5);
+    EXPECT_EQ(tiles[0], tiles[1]);
+
+    // TMS addressing of the same tile hits the same entry
+    uint8_t* outBuffer = nullptr;
+    int outBufferSize = 0;
+    TilerHelper::getFromUserCache(ortho, 19, 128168, (1 << 19) - 1 - 339545, 256, true, false,
+                                  &outBuffer, &outBufferSize);
+    EXPECT_EQ(std::vector<uint8_t>(outBuffer, outBuffer + outBufferSize), tiles[0]);
+    VSIFree(outBuffer);
+    EXPECT_EQ(TilerHelper::getUserCacheStats().hits, 2u);
+
+    TilerHelper::setUserCacheStoreFactory(nullptr);
+    EXPECT_EQ(TilerHelper::getUserCacheStats().open, 0u);
+}
+
+TEST(testTiler, tilerPoolReuse) {
+    TestArea ta(TEST_NAME);
+    fs::path ortho = ta.downloadTestAsset(
+        "https://github.com/DroneDB/test_data/raw/master/brighton/odm_orthophoto.tif",
+        "ortho.tif");
+
+    TilerHelper::clearTilerPool();
+
+    std::vector<std::vector<uint8_t>> tiles;
+    for (int i = 0; i < 3; i++) {
+        uint8_t* outBuffer = nullptr;
+        int outBufferSize = 0;
+        TilerHelper::getTile(ortho, 19, 128168, 339545, 256, false, false, "", &outBuffer,
+                             &outBufferSize);
+        ASSERT_NE(outBuffer, nullptr);
+        tiles.emplace_back(outBuffer, outBuffer + outBufferSize);
+        VSIFree(outBuffer);
+    }
+
+    // Opened once, then served from the pool
+    auto stats = TilerHelper::getTilerPoolStats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.idle, 1u);
+    EXPECT_EQ(tiles[0], tiles[1]);
+    EXPECT_EQ(tiles[0], tiles[2]);
+
+    // A different tile size needs its own tiler
+    uint8_t* outBuffer = nullptr;
+    int outBufferSize = 0;
+    TilerHelper::getTile(ortho, 19, 128168, 339545, 512, false, false, "", &outBuffer,
+                         &outBufferSize);
+    VSIFree(outBuffer);
+    EXPECT_EQ(TilerHelper::getTilerPoolStats().idle, 2u);
+
+    TilerHelper::clearTilerPool();
+    EXPECT_EQ(TilerHelper::getTilerPoolStats().idle, 0u);
+}
+
 TEST(testTiler, MultipleZoomLevels) {
     TestArea ta(TEST_NAME);
     fs::path ortho = ta.downloadTestAsset(
@@ -0,0 +1,77 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "test.h"
+#include "testarea.h"
+#include "tilestore.h"
+
+namespace
+{
+
+    using namespace ddb;
+
+    std::vector<uint8_t> makeTile(size_t size, uint8_t value)
+    {
+        return std::vector<uint8_t>(size, value);
+    }
+
+    TEST(tileStore, putGet)
+    {
+        TestArea ta(TEST_NAME, true);
+        MBTilesStore store(ta.getPath("tiles.mbtiles"), 1024 * 1024);
+
+        std::vector<uint8_t> data;
+        EXPECT_FALSE(store.get(19, 128168, 339545, data));
+
+        const auto tile = makeTile(100, 7);
+        store.put(19, 128168, 339545, tile.data(), tile.size());
+
+        EXPECT_TRUE(store.get(19, 128168, 339545, data));
+        EXPECT_EQ(data, tile);
+        EXPECT_FALSE(store.get(19, 128168, 339546, data));
+        EXPECT_EQ(store.getTotalBytes(), 100);
+
+        // Replacing a tile returns the new content
+        const auto newTile = makeTile(50, 9);
+        store.put(19, 128168, 339545, newTile.data(), newTile.size());
+        EXPECT_TRUE(store.get(19, 128168, 339545, data));
+        EXPECT_EQ(data, newTile);
+    }
+
+    TEST(tileStore, evictsOverBudget)
+    {
+        TestArea ta(TEST_NAME, true);
+        MBTilesStore store(ta.getPath("tiles.mbtiles"), 1000);
+
+        const auto tile = makeTile(100, 1);
+        for (int x = 0; x < 20; x++)
+            store.put(10, x, 0, tile.data(), tile.size());
+
+        EXPECT_LE(store.getTotalBytes(), 1000);
+
+        // Most recent tiles survive
+        std::vector<uint8_t> data;
+        EXPECT_TRUE(store.get(10, 19, 0, data));
+    }
+
+    TEST(tileStore, persistsAcrossReopen)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto file = ta.getPath("tiles.mbtiles");
+        const auto tile = makeTile(64, 3);
+
+        {
+            MBTilesStore store(file, 1024 * 1024);
+            store.put(5, 1, 2, tile.data(), tile.size());
+        }
+
+        MBTilesStore store(file, 1024 * 1024);
+        std::vector<uint8_t> data;
+        EXPECT_TRUE(store.get(5, 1, 2, data));
+        EXPECT_EQ(data, tile);
+        EXPECT_EQ(store.getTotalBytes(), 64);
+    }
+
+} // namespace
@@ -3,8 +3,11 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include <fstream>
+#include <random>
+#include <zlib.h>
 #include "mzip.h"
 #include "exceptions.h"
+#include "hash.h"
 #include "gtest/gtest.h"
 #include "test.h"
 #include "testarea.h"
@@ -52,4 +55,191 @@ namespace
         EXPECT_FALSE(fs::is_regular_file(outdir / "subdir" / "exclude.txt"));
     }
 
+    std::string readFile(const fs::path &p)
+    {
+        std::ifstream in(p, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    // Feeds data in pieces of random size, as a network transfer would
+    void feed(zip::ZipStreamExtractor &extractor, const std::string &data)
+    {
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<size_t> piece(1, 5000);
+        for (size_t i = 0; i < data.size();)
+        {
+            const size_t n = std::min(piece(gen), data.size() - i);
+            extractor.write(data.data() + i, n);
+            i += n;
+        }
+    }
+
+    void putLE(std::string &out, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            out.push_back(static_cast<char>((v >> (i * 8)) & 0xff));
+    }
+
+    // Writes entries the way streaming servers do: deflated, with sizes and
+    // CRC in a data descriptor after the data. No central directory entries
+    // are needed by the extractor, only the end record.
+    std::string streamingZip(const std::vector<std::pair<std::string, std::string>> &entries)
+    {
+        std::string out;
+        for (const auto &e : entries)
+        {
+            const bool isDir = e.first.back() == '/';
+            std::string compressed;
+            if (!isDir)
+            {
+                z_stream zs{};
+                deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+                compressed.resize(deflateBound(&zs, e.second.size()));
+                zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(e.second.data()));
+                zs.avail_in = static_cast<uInt>(e.second.size());
+                zs.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+                zs.avail_out = static_cast<uInt>(compressed.size());
+                deflate(&zs, Z_FINISH);
+                compressed.resize(zs.total_out);
+                deflateEnd(&zs);
+            }
+            const uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(e.second.data()),
+                                    static_cast<uInt>(e.second.size()));
+
+            putLE(out, 0x04034b50, 4);
+            putLE(out, 20, 2);
+            putLE(out, isDir ? 0 : 8, 2); // Flags: data descriptor
+            putLE(out, isDir ? 0 : Z_DEFLATED, 2);
+            putLE(out, 0, 4); // Time, date
+            putLE(out, 0, 4); // CRC
+            putLE(out, 0, 4); // Sizes
+            putLE(out, 0, 4);
+            putLE(out, e.first.size(), 2);
+            putLE(out, 0, 2);
+            out += e.first;
+
+            if (!isDir)
+            {
+                out += compressed;
+                putLE(out, 0x08074b50, 4);
+                putLE(out, crc, 4);
+                putLE(out, compressed.size(), 4);
+                putLE(out, e.second.size(), 4);
+            }
+        }
+
+        putLE(out, 0x06054b50, 4);
+        out.append(18, '\0');
+        return out;
+    }
+
+    std::vector<std::pair<std::string, std::string>> sampleEntries()
+    {
+        std::mt19937 gen(42);
+        std::string random(200000, '\0');
+        for (auto &c : random)
+            c = static_cast<char>(gen() & 0xff);
+
+        return {{"a.txt", "hello"},
+                {"empty.txt", ""},
+                {"sub/", ""},
+                {"sub/repeated.bin", std::string(300000, 'x')},
+                {"sub/random.bin", random}};
+    }
+
+    TEST(zip, streamExtractDataDescriptors)
+    {
+        TestArea ta(TEST_NAME, true);
+        const auto entries = sampleEntries();
+
+        std::unordered_map<std::string, std::string> hashes;
+        for (const auto &e : entries)
+            if (e.first.back() != '/')
+                hashes[e.first] = Hash::strSHA256(e.second);
+
+        fs::path outdir = ta.getFolder("out");
+        zip::ZipStreamExtractor extractor(outdir.string(), hashes);
+        feed(extractor, streamingZip(entries));
+        extractor.finish();
+
+        EXPECT_EQ(extractor.extracted(), entries.size());
+        EXPECT_TRUE(fs::is_directory(outdir / "sub"));
+        for (const auto &e : entries)
+        {
+            if (e.first.back() == '/')
+                continue;
+            EXPECT_EQ(readFile(outdir / e.first), e.second) << e.first;
+        }
+    }
+
+    TEST(zip, streamExtractMatchesExtractAll)
+    {
+        TestArea ta(TEST_NAME, true);
+
+        fs::path dir = ta.getFolder("in");
+        for (const auto &e : sampleEntries())
+        {
+            if (e.first.back() == '/')
+                continue;
+            fs::create_directories((dir / e.first).parent_path());
+            std::ofstream out(dir / e.first, std::ios::binary);
+            out << e.second;
+        }
+
+        const auto zipFile = ta.getPath("archive.zip");
+        fs::remove(zipFile);
+        zip::zipFolder(dir.string(), zipFile.string(), {});
+
+        fs::path outdir = ta.getFolder("out");
+        zip::ZipStreamExtractor extractor(outdir.string());
+        feed(extractor, readFile(zipFile));
+        extractor.finish();
+
+        for (const auto &e : sampleEntries())
+        {
+            if (e.first.back() == '/')
+                continue;
+            EXPECT_EQ(readFile(outdir / e.first), e.second) << e.first;
+        }
+    }
+
+    TEST(zip, streamExtractChecksumMismatch)
+    {
+        TestArea ta(TEST_NAME, true);
+
+        fs::path outdir = ta.getFolder("out");
+        zip::ZipStreamExtractor extractor(outdir.string(), {{"a.txt", Hash::strSHA256("other")}});
+        EXPECT_THROW(feed(extractor, streamingZip({{"a.txt", "hello"}})), ZipException);
+        EXPECT_FALSE(fs::exists(outdir / "a.txt"));
+    }
+
+    TEST(zip, streamExtractRejectsBadInput)
+    {
+        TestArea ta(TEST_NAME, true);
+        fs::path outdir = ta.getFolder("out");
+
+        // Truncated
+        {
+            const auto data = streamingZip({{"a.txt", std::string(10000, 'a')}});
+            zip::ZipStreamExtractor extractor(outdir.string());
+            extractor.write(data.data(), data.size() / 2);
+            EXPECT_THROW(extractor.finish(), ZipException);
+        }
+        EXPECT_FALSE(fs::exists(outdir / "a.txt"));
+
+        // Not a zip
+        {
+            zip::ZipStreamExtractor extractor(outdir.string());
+            const std::string data = "{\"error\": \"not found\"}";
+            EXPECT_THROW(extractor.write(data.data(), data.size()), ZipException);
+        }
+
+        // Zip-Slip
+        {
+            zip::ZipStreamExtractor extractor(outdir.string());
+            const auto data = streamingZip({{"../escape.txt", "x"}});
+            EXPECT_THROW(extractor.write(data.data(), data.size()), ZipException);
+        }
+    }
+
 } // namespace